@@ -129,6 +129,60 @@ print_connections(void)
 	close(fd);
 }
 
+static const char *cache_names[ISCSI_CACHE_COUNT] = {
+	"pdu", "imm", "dout", "task"
+};
+
+/* Hits and misses of each core's free lists since the last call. */
+static void
+print_caches(int delay)
+{
+	static struct spdk_iscsi_cache_stats	last[SPDK_TRACE_MAX_LCORE][ISCSI_CACHE_COUNT];
+	struct spdk_iscsi_lcore_cache_stats	*stats;
+	struct spdk_iscsi_cache_stats		*cur;
+	size_t			stats_size;
+	void			*stats_ptr;
+	uint64_t		hits, misses;
+	int			fd, i, type;
+	char			shm_name[64];
+
+	/* Older targets do not export their caches; only show what is there. */
+	sprintf(shm_name, SPDK_ISCSI_CACHE_SHM_NAME, g_instance_id);
+	fd = shm_open(shm_name, O_RDONLY, 0600);
+	if (fd < 0) {
+		return;
+	}
+
+	stats_size = sizeof(*stats) * SPDK_TRACE_MAX_LCORE;
+	stats_ptr = mmap(NULL, stats_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (stats_ptr == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+
+	stats = (struct spdk_iscsi_lcore_cache_stats *)stats_ptr;
+
+	printf("lcore  cache     hits/s   misses/s\n");
+	printf("==================================\n");
+	for (i = 0; i < SPDK_TRACE_MAX_LCORE; i++) {
+		for (type = 0; type < ISCSI_CACHE_COUNT; type++) {
+			cur = &stats[i].cache[type];
+			hits = cur->hits - last[i][type].hits;
+			misses = cur->misses - last[i][type].misses;
+			last[i][type] = *cur;
+			if (hits == 0 && misses == 0) {
+				continue;
+			}
+			printf("%5d  %-5s %10" PRIu64 " %10" PRIu64 "\n", i, cache_names[type],
+			       hits / delay, misses / delay);
+		}
+	}
+
+	printf("\n");
+	munmap(stats_ptr, stats_size);
+	close(fd);
+}
+
 int main(int argc, char **argv)
 {
 	void			*history_ptr;
@@ -229,6 +283,7 @@ int main(int argc, char **argv)
 
 		printf("\e[1;1H\e[2J");
 		print_connections();
+		print_caches(delay);
 		printf("lcore   tasks\n");
 		printf("=============\n");
 		total_tasks_done_per_sec = 0;
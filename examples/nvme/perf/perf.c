@@ -152,6 +152,10 @@ static uint32_t g_max_completions;
 
 static const char *g_core_mask;
 
+static bool g_use_emu = false;
+static bool g_batch_doorbell = false;
+static struct spdk_nvme_emu_ctrlr *g_emu_ctrlr;
+
 static int g_aio_optind; /* Index of first AIO filename in argv */
 
 static void
@@ -554,6 +558,9 @@ init_ns_worker_ctx(struct ns_worker_ctx *ns_ctx)
 			printf("ERROR: spdk_nvme_ctrlr_alloc_io_qpair failed\n");
 			return -1;
 		}
+		if (g_batch_doorbell) {
+			spdk_nvme_qpair_set_batch_doorbell(ns_ctx->u.nvme.qpair, true);
+		}
 	}
 
 	return 0;
@@ -645,6 +652,9 @@ static void usage(char *program_name)
 	printf("\t\t(default: 1)]\n");
 	printf("\t[-m max completions per poll]\n");
 	printf("\t\t(default: 0 - unlimited)\n");
+	printf("\t[-B batch submission queue doorbell writes]\n");
+	printf("\t[-E also attach a software-emulated NVMe controller]\n");
+	printf("\t\t(measures driver overhead without hardware; the emulation thread polls its own CPU)\n");
 }
 
 static void
@@ -802,11 +812,17 @@ parse_args(int argc, char **argv)
 	g_core_mask = NULL;
 	g_max_completions = 0;
 
-	while ((op = getopt(argc, argv, "c:lm:q:s:t:w:M:")) != -1) {
+	while ((op = getopt(argc, argv, "Bc:Elm:q:s:t:w:M:")) != -1) {
 		switch (op) {
+		case 'B':
+			g_batch_doorbell = true;
+			break;
 		case 'c':
 			g_core_mask = optarg;
 			break;
+		case 'E':
+			g_use_emu = true;
+			break;
 		case 'l':
 			g_latency_tracking_enable = true;
 			break;
@@ -967,6 +983,11 @@ unregister_workers(void)
 static bool
 probe_cb(void *cb_ctx, struct spdk_pci_device *dev, struct spdk_nvme_ctrlr_opts *opts)
 {
+	if (dev == NULL) {
+		printf("Attaching to emulated controller\n");
+		return true;
+	}
+
 	if (spdk_pci_device_has_non_uio_driver(dev)) {
 		fprintf(stderr, "non-uio kernel driver attached to NVMe\n");
 		fprintf(stderr, " controller at PCI address %04x:%02x:%02x.%02x\n",
@@ -991,11 +1012,15 @@ static void
 attach_cb(void *cb_ctx, struct spdk_pci_device *dev, struct spdk_nvme_ctrlr *ctrlr,
 	  const struct spdk_nvme_ctrlr_opts *opts)
 {
-	printf("Attached to %04x:%02x:%02x.%02x\n",
-	       spdk_pci_device_get_domain(dev),
-	       spdk_pci_device_get_bus(dev),
-	       spdk_pci_device_get_dev(dev),
-	       spdk_pci_device_get_func(dev));
+	if (dev == NULL) {
+		printf("Attached to emulated controller\n");
+	} else {
+		printf("Attached to %04x:%02x:%02x.%02x\n",
+		       spdk_pci_device_get_domain(dev),
+		       spdk_pci_device_get_bus(dev),
+		       spdk_pci_device_get_dev(dev),
+		       spdk_pci_device_get_func(dev));
+	}
 
 	register_ctrlr(ctrlr);
 }
@@ -1005,6 +1030,17 @@ register_controllers(void)
 {
 	printf("Initializing NVMe Controllers\n");
 
+	if (g_use_emu) {
+		struct spdk_nvme_emu_opts emu_opts;
+
+		spdk_nvme_emu_opts_set_defaults(&emu_opts);
+		g_emu_ctrlr = spdk_nvme_emu_ctrlr_create(&emu_opts);
+		if (g_emu_ctrlr == NULL) {
+			fprintf(stderr, "spdk_nvme_emu_ctrlr_create() failed\n");
+			return 1;
+		}
+	}
+
 	if (spdk_nvme_probe(NULL, probe_cb, attach_cb, NULL) != 0) {
 		fprintf(stderr, "spdk_nvme_probe() failed\n");
 		return 1;
@@ -1028,6 +1064,9 @@ unregister_controllers(void)
 		free(entry);
 		entry = next;
 	}
+
+	spdk_nvme_emu_ctrlr_destroy(g_emu_ctrlr);
+	g_emu_ctrlr = NULL;
 }
 
 static int
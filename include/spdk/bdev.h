@@ -55,6 +55,7 @@
 #define SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH	50
 
 struct spdk_bdev_io;
+struct spdk_bdev_channel;
 
 /**
  * \brief SPDK block device.
@@ -86,7 +87,7 @@ struct spdk_bdev {
 	 */
 	int need_aligned_buffer;
 
-	/** thin provisioning, not used at the moment */
+	/** Set if the blockdev supports unmap, e.g. because blocks are allocated on write */
 	int thin_provisioning;
 
 	/** function table for all LUN ops */
@@ -98,14 +99,11 @@ struct spdk_bdev {
 	/** generation value used by block device reset */
 	uint32_t gencnt;
 
-	/** Whether the poller is registered with the reactor */
-	bool is_running;
-
-	/** Which lcore the poller is running on */
-	uint32_t lcore;
-
-	/** Poller to submit IO and check completion */
-	struct spdk_poller *poller;
+	/**
+	 * Per-lcore I/O channels, indexed by lcore.  A channel is created the
+	 *  first time I/O is submitted to this bdev from a given lcore.
+	 */
+	struct spdk_bdev_channel **channels;
 
 	/** True if another blockdev or a LUN is using this device */
 	bool claimed;
@@ -121,6 +119,7 @@ enum spdk_bdev_io_type {
 	SPDK_BDEV_IO_TYPE_UNMAP,
 	SPDK_BDEV_IO_TYPE_FLUSH,
 	SPDK_BDEV_IO_TYPE_RESET,
+	SPDK_BDEV_IO_TYPE_ZCOPY,
 };
 
 /**
@@ -135,17 +134,73 @@ struct spdk_bdev_fn_table {
 	int (*destruct)(struct spdk_bdev *bdev);
 
 	/**
-	 * Poll the backend for I/O waiting to be completed.
+	 * Poll the backend for I/O waiting to be completed on the given channel.
+	 *  Called on the lcore that owns the channel.
 	 *
 	 * Optional; if the bdev does not have any periodic work to do, this pointer can be NULL.
 	 */
-	int (*check_io)(struct spdk_bdev *bdev);
+	int (*check_io)(struct spdk_bdev_channel *ch);
 
-	/** Process the IO. */
+	/**
+	 * Process the IO.  Called on the lcore that submitted the I/O, with
+	 *  bdev_io->ch set to that lcore's channel.
+	 */
 	void (*submit_request)(struct spdk_bdev_io *);
 
 	/** Check if the block device supports a specific I/O type. */
 	bool (*io_type_supported)(struct spdk_bdev *bdev, enum spdk_bdev_io_type);
+
+	/**
+	 * Set up backend resources (queues, contexts) for a new per-lcore channel
+	 *  and store them in ch->ctx.  Called on the lcore that will own the channel.
+	 *
+	 * Optional; if NULL, the channel has no backend-specific context.
+	 */
+	int (*create_channel)(struct spdk_bdev_channel *ch);
+
+	/**
+	 * Release the resources set up by create_channel.  Called on the lcore that
+	 *  owns the channel, after its poller has been stopped.
+	 *
+	 * Optional.
+	 */
+	void (*destroy_channel)(struct spdk_bdev_channel *ch);
+
+	/**
+	 * Check whether the backend still owns I/O on the given channel.  Teardown
+	 *  keeps calling check_io until this returns false before destroy_channel.
+	 *
+	 * Optional; if NULL, the channel is destroyed as soon as its poller has stopped.
+	 */
+	bool (*channel_busy)(struct spdk_bdev_channel *ch);
+};
+
+/**
+ * \brief Per-lcore I/O channel for a block device.
+ *
+ * I/O submitted to a bdev is handed to the backend on the submitting lcore
+ *  together with that lcore's channel, and is completed on the same lcore.
+ *  Backends keep per-lcore queues in the channel context so that no I/O
+ *  state is shared between lcores.
+ */
+struct spdk_bdev_channel {
+	/** The block device this channel belongs to. */
+	struct spdk_bdev	*bdev;
+
+	/** The lcore that owns this channel. */
+	uint32_t		lcore;
+
+	/** Poller calling check_io for this channel. */
+	struct spdk_poller	*poller;
+
+	/** Backend-specific context set up by create_channel. */
+	void			*ctx;
+
+	/**
+	 * Interval in microseconds between check_io calls, or 0 to call it on every
+	 *  reactor iteration.  create_channel may set this.
+	 */
+	uint64_t		poll_period_us;
 };
 
 /** Blockdev I/O completion status */
@@ -190,6 +245,9 @@ struct spdk_bdev_io {
 	/** The block device that this I/O belongs to. */
 	struct spdk_bdev *bdev;
 
+	/** The I/O channel this I/O was submitted on. */
+	struct spdk_bdev_channel *ch;
+
 	/** Enumerated value representing the I/O type. */
 	enum spdk_bdev_io_type type;
 
@@ -199,11 +257,17 @@ struct spdk_bdev_io {
 			/** The unaligned rbuf originally allocated. */
 			void *buf_unaligned;
 
-			/** For single buffer cases, pointer to the aligned data buffer.  */
-			void *buf;
+			/** For basic read case, use our own iovec element. */
+			struct iovec iov;
+
+			/** For SG buffer cases, array of iovecs to transfer. */
+			struct iovec *iovs;
+
+			/** For SG buffer cases, number of iovecs in iovec array. */
+			int iovcnt;
 
-			/** For single buffer cases, size of the data buffer. */
-			uint64_t nbytes;
+			/** For SG buffer cases, total size of data to be transferred. */
+			size_t len;
 
 			/** Starting offset (in bytes) of the blockdev for this I/O. */
 			uint64_t offset;
@@ -244,6 +308,31 @@ struct spdk_bdev_io {
 		struct {
 			enum spdk_bdev_reset_type type;
 		} reset;
+		struct {
+			/** For a single backend buffer, use our own iovec element. */
+			struct iovec iov;
+
+			/**
+			 * Backend-owned buffers covering the range, set by the backend when
+			 *  the start phase completes.  The caller fills them in place.
+			 */
+			struct iovec *iovs;
+
+			/** Number of iovecs in iovec array. */
+			int iovcnt;
+
+			/** Total size of data to be written. */
+			size_t len;
+
+			/** Starting offset (in bytes) of the blockdev for this I/O. */
+			uint64_t offset;
+
+			/** True during the start phase, false during the commit phase. */
+			bool start;
+
+			/** Commit phase only: false to release the buffers without writing them. */
+			bool commit;
+		} zcopy;
 	} u;
 
 	/** User function that will be called when this completes */
@@ -289,6 +378,10 @@ bool spdk_bdev_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type
 struct spdk_bdev_io *spdk_bdev_read(struct spdk_bdev *bdev,
 				    void *buf, uint64_t offset, uint64_t nbytes,
 				    spdk_bdev_io_completion_cb cb, void *cb_arg);
+struct spdk_bdev_io *spdk_bdev_readv(struct spdk_bdev *bdev,
+				     struct iovec *iov, int iovcnt,
+				     uint64_t offset, uint64_t nbytes,
+				     spdk_bdev_io_completion_cb cb, void *cb_arg);
 struct spdk_bdev_io *spdk_bdev_write(struct spdk_bdev *bdev,
 				     void *buf, uint64_t offset, uint64_t nbytes,
 				     spdk_bdev_io_completion_cb cb, void *cb_arg);
@@ -296,6 +389,37 @@ struct spdk_bdev_io *spdk_bdev_writev(struct spdk_bdev *bdev,
 				      struct iovec *iov, int iovcnt,
 				      uint64_t offset, uint64_t len,
 				      spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/**
+ * \brief Start a zero-copy write of nbytes at offset.
+ *
+ * Instead of taking the caller's data buffers, the backend provides its own buffers
+ *  for the range (for example, the final location of the data) in bdev_io->u.zcopy.iovs
+ *  when cb is called with a successful status.  The caller fills those buffers in place
+ *  and then finishes the write with spdk_bdev_zcopy_commit().  The bdev_io must not be
+ *  freed in between.
+ *
+ * Only available if spdk_bdev_io_type_supported() returns true for
+ *  SPDK_BDEV_IO_TYPE_ZCOPY; callers must otherwise fall back to spdk_bdev_writev().
+ */
+struct spdk_bdev_io *spdk_bdev_zcopy_start(struct spdk_bdev *bdev,
+		uint64_t offset, uint64_t nbytes,
+		spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/**
+ * \brief Finish a zero-copy write started with spdk_bdev_zcopy_start().
+ *
+ * If commit is true, the data placed in the backend buffers is written; otherwise the
+ *  buffers are released and the write is abandoned.  Backends whose buffers are the
+ *  media itself cannot undo data already placed there, so an abandoned write may be
+ *  partially visible, as with an interrupted regular write.
+ *
+ * cb is called once more when the commit completes, after which the bdev_io is freed
+ *  with spdk_bdev_free_io() as usual.  Must be called on the lcore that started it.
+ */
+int spdk_bdev_zcopy_commit(struct spdk_bdev_io *bdev_io, bool commit,
+			   spdk_bdev_io_completion_cb cb, void *cb_arg);
+
 struct spdk_bdev_io *spdk_bdev_unmap(struct spdk_bdev *bdev,
 				     struct spdk_scsi_unmap_bdesc *unmap_d,
 				     uint16_t bdesc_count,
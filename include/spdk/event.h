@@ -138,6 +138,16 @@ struct spdk_app_opts {
 	 * specified in microseconds.
 	 */
 	uint64_t		max_delay_us;
+
+	/* Pass events between reactors through a dedicated
+	 * single-producer/single-consumer ring for each
+	 * (source, destination) core pair instead of the
+	 * destination's shared multi-producer ring. Uses one
+	 * ring per core pair, each as large as the shared one
+	 * (512 KiB of hugepage memory), so memory grows with the
+	 * square of the core count.
+	 */
+	bool			spsc_event_rings;
 };
 
 /**
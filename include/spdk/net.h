@@ -83,4 +83,10 @@ int spdk_sock_set_sendbuf(int sock, int sz);
 bool spdk_sock_is_ipv6(int sock);
 bool spdk_sock_is_ipv4(int sock);
 
+/**
+ * NUMA node of the network device that holds the local address of sock, or
+ *  -1 if it has none or it cannot be found.
+ */
+int spdk_sock_get_numa_node(int sock);
+
 #endif /* SPDK_NET_FRAMEWORK_H */
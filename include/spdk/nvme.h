@@ -123,6 +123,9 @@ typedef void (*spdk_nvme_remove_cb)(void *cb_ctx, struct spdk_nvme_ctrlr *ctrlr)
  * If called more than once, only devices that are not already attached to the SPDK NVMe driver
  * will be reported.
  *
+ * Software-emulated controllers created with \ref spdk_nvme_emu_ctrlr_create are enumerated
+ * after the PCI devices; for those, pci_dev is NULL in both probe_cb and attach_cb.
+ *
  * To stop using the the controller and release its associated resources,
  * call \ref spdk_nvme_detach with the spdk_nvme_ctrlr instance returned by this function.
  */
@@ -142,6 +145,67 @@ int spdk_nvme_probe(void *cb_ctx,
  */
 int spdk_nvme_detach(struct spdk_nvme_ctrlr *ctrlr);
 
+/** \brief Opaque handle to a software-emulated NVMe controller. */
+struct spdk_nvme_emu_ctrlr;
+
+/**
+ * \brief Options for a software-emulated NVMe controller.
+ */
+struct spdk_nvme_emu_opts {
+	/**
+	 * Number of I/O queue pairs the emulated controller will grant.
+	 */
+	uint32_t num_io_queues;
+	/**
+	 * Maximum number of entries per queue (reported in CAP.MQES).
+	 */
+	uint32_t max_queue_entries;
+	/**
+	 * Size of the single emulated namespace, in blocks.
+	 */
+	uint64_t num_blocks;
+	/**
+	 * Block size of the emulated namespace, in bytes.  Must be a power of 2 >= 512.
+	 */
+	uint32_t block_size;
+	/**
+	 * If true, namespace contents are kept in memory and I/O data is copied.
+	 *  If false, reads and writes complete without touching the data buffers,
+	 *  which is what is wanted for measuring driver overhead.
+	 */
+	bool store_data;
+};
+
+/**
+ * \brief Fill in the default options for a software-emulated NVMe controller.
+ */
+void spdk_nvme_emu_opts_set_defaults(struct spdk_nvme_emu_opts *opts);
+
+/**
+ * \brief Create a memory-backed, software-emulated NVMe controller.
+ *
+ * The emulated controller implements the NVMe register file, admin queue and I/O
+ * submission/completion queues in host memory, and services them from a dedicated
+ * background thread.  It is reported by subsequent \ref spdk_nvme_probe calls
+ * with a NULL pci_dev and is then driven by the normal userspace NVMe driver, which
+ * makes it suitable for measuring driver overhead and for testing without hardware.
+ *
+ * Queue and data buffers are translated from physical addresses, so the driver
+ * memory must come from the DPDK memory segments (this is always the case for
+ * buffers allocated with rte_malloc()).
+ *
+ * \return emulated controller handle, or NULL on failure.
+ */
+struct spdk_nvme_emu_ctrlr *spdk_nvme_emu_ctrlr_create(const struct spdk_nvme_emu_opts *opts);
+
+/**
+ * \brief Stop and free a software-emulated NVMe controller.
+ *
+ * The controller must already have been detached with \ref spdk_nvme_detach (or
+ * never attached).
+ */
+void spdk_nvme_emu_ctrlr_destroy(struct spdk_nvme_emu_ctrlr *emu);
+
 /**
  * \brief Perform a full hardware reset of the NVMe controller.
  *
@@ -298,6 +362,35 @@ int spdk_nvme_ctrlr_cmd_io_raw(struct spdk_nvme_ctrlr *ctrlr,
 int32_t spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair,
 		uint32_t max_completions);
 
+/**
+ * \brief Enable or disable doorbell batching on an I/O queue pair.
+ *
+ * By default, the submission queue tail doorbell is written for every command submitted.
+ * With batching enabled, commands are only copied into the submission queue and the
+ * doorbell is written once for the whole batch: on \ref spdk_nvme_qpair_flush, at the start
+ * and end of \ref spdk_nvme_qpair_process_completions (which also covers commands submitted
+ * from completion callbacks), or when batching is disabled again.  The completion queue
+ * head doorbell is always written once per completion pass.
+ *
+ * Batching trades a little latency for fewer MMIO writes, so it is mostly useful when
+ * several commands are submitted back to back at high queue depth.
+ *
+ * \return 0 on success, or -EINVAL if qpair is the admin queue.
+ *
+ * The caller must ensure that each queue pair is only used from one thread at a time.
+ */
+int spdk_nvme_qpair_set_batch_doorbell(struct spdk_nvme_qpair *qpair, bool enable);
+
+/**
+ * \brief Write the submission queue doorbell for any commands staged on a queue pair
+ * with doorbell batching enabled.
+ *
+ * This is a no-op if no commands are pending.
+ *
+ * The caller must ensure that each queue pair is only used from one thread at a time.
+ */
+void spdk_nvme_qpair_flush(struct spdk_nvme_qpair *qpair);
+
 /**
  * \brief Send the given admin command to the NVMe controller.
  *
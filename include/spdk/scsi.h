@@ -123,6 +123,17 @@ struct spdk_scsi_task {
 
 	uint64_t offset;
 	struct iovec iov;
+
+	/**
+	 * Caller-provided scatter-gather list for read data.  If iovcnt is
+	 *  non-zero, reads are issued directly into these buffers and rbuf
+	 *  is not used.  The iSCSI target does not set them yet: its Data-In
+	 *  PDUs point into rbuf, so each read subtask still takes one
+	 *  contiguous buffer of up to SPDK_BDEV_LARGE_RBUF_MAX_SIZE bytes.
+	 */
+	struct iovec *iovs;
+	int iovcnt;
+
 	struct spdk_scsi_task *parent;
 
 	void (*free_fn)(struct spdk_scsi_task *);
@@ -238,6 +249,12 @@ int spdk_scsi_port_construct(struct spdk_scsi_port *port, uint64_t id,
 void spdk_scsi_task_construct(struct spdk_scsi_task *task, uint32_t *owner_task_ctr,
 			      struct spdk_scsi_task *parent);
 void spdk_put_task(struct spdk_scsi_task *task);
+/**
+ * Release the task's data buffer and its bdev I/O, if any, before the task
+ *  itself is put.  Used by transports to hand a read buffer back to the bdev
+ *  layer as soon as the data has been sent.
+ */
+void spdk_scsi_task_free_data(struct spdk_scsi_task *task);
 void spdk_scsi_task_alloc_data(struct spdk_scsi_task *task, uint32_t alloc_len,
 			       uint8_t **data);
 int spdk_scsi_task_build_sense_data(struct spdk_scsi_task *task, int sk, int asc,
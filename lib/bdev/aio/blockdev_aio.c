@@ -35,20 +35,44 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 
 #include "spdk/bdev.h"
 #include "spdk/conf.h"
+#include "spdk/event.h"
 #include "spdk/fd.h"
 #include "spdk/log.h"
 
 static int g_blockdev_count = 0;
+static bool g_aio_use_eventfd = false;
+static uint64_t g_aio_eventfd_poll_us = 100;
+
+/*
+ * Fallback for kernels without IO_CMD_FDSYNC support: a single worker thread
+ *  runs fdatasync() so the reactors never block on it.
+ */
+static struct {
+	pthread_mutex_t				lock;
+	pthread_cond_t				cond;
+	TAILQ_HEAD(, blockdev_aio_task)		queue;
+	pthread_t				thread;
+	bool					started;
+	bool					exit;
+} g_aio_fsync = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.queue = TAILQ_HEAD_INITIALIZER(g_aio_fsync.queue),
+};
 
 static int blockdev_aio_initialize(void);
+static void blockdev_aio_finish(void);
 static void aio_free_disk(struct file_disk *fdisk);
 
 static int
@@ -57,7 +81,8 @@ blockdev_aio_get_ctx_size(void)
 	return sizeof(struct blockdev_aio_task);
 }
 
-SPDK_BDEV_MODULE_REGISTER(blockdev_aio_initialize, NULL, NULL, blockdev_aio_get_ctx_size)
+SPDK_BDEV_MODULE_REGISTER(blockdev_aio_initialize, blockdev_aio_finish, NULL,
+			  blockdev_aio_get_ctx_size)
 
 static int
 blockdev_aio_open(struct file_disk *disk)
@@ -81,8 +106,6 @@ blockdev_aio_close(struct file_disk *disk)
 {
 	int rc;
 
-	io_destroy(disk->io_ctx);
-
 	if (disk->fd == -1) {
 		return 0;
 	}
@@ -98,28 +121,215 @@ blockdev_aio_close(struct file_disk *disk)
 	return 0;
 }
 
+static void
+blockdev_aio_fail_iocb(struct iocb *iocb)
+{
+	struct blockdev_aio_task *aio_task = iocb->data;
+
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(aio_task), SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void *
+blockdev_aio_fsync_worker(void *arg)
+{
+	struct blockdev_aio_task *aio_task;
+	struct file_disk *fdisk;
+
+	pthread_mutex_lock(&g_aio_fsync.lock);
+	while (!g_aio_fsync.exit) {
+		aio_task = TAILQ_FIRST(&g_aio_fsync.queue);
+		if (aio_task == NULL) {
+			pthread_cond_wait(&g_aio_fsync.cond, &g_aio_fsync.lock);
+			continue;
+		}
+		TAILQ_REMOVE(&g_aio_fsync.queue, aio_task, link);
+		pthread_mutex_unlock(&g_aio_fsync.lock);
+
+		fdisk = spdk_bdev_io_from_ctx(aio_task)->ctx;
+		aio_task->rc = fdatasync(fdisk->fd);
+
+		/* Hand the result back; the owning reactor completes it in check_io. */
+		pthread_mutex_lock(&g_aio_fsync.lock);
+		TAILQ_INSERT_TAIL(&aio_task->ch->offload_done, aio_task, link);
+	}
+	pthread_mutex_unlock(&g_aio_fsync.lock);
+
+	return NULL;
+}
+
+static int
+blockdev_aio_offload_flush(struct blockdev_aio_io_channel *aio_ch,
+			   struct blockdev_aio_task *aio_task)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&g_aio_fsync.lock);
+	if (!g_aio_fsync.started) {
+		rc = pthread_create(&g_aio_fsync.thread, NULL, blockdev_aio_fsync_worker, NULL);
+		if (rc != 0) {
+			pthread_mutex_unlock(&g_aio_fsync.lock);
+			SPDK_ERRLOG("unable to start aio fsync thread: %d\n", rc);
+			return -1;
+		}
+		g_aio_fsync.started = true;
+	}
+
+	aio_task->ch = aio_ch;
+	aio_ch->num_offloaded++;
+	TAILQ_INSERT_TAIL(&g_aio_fsync.queue, aio_task, link);
+	pthread_cond_signal(&g_aio_fsync.cond);
+	pthread_mutex_unlock(&g_aio_fsync.lock);
+
+	return 0;
+}
+
+static void
+blockdev_aio_reap_offloaded(struct blockdev_aio_io_channel *aio_ch)
+{
+	TAILQ_HEAD(, blockdev_aio_task) done = TAILQ_HEAD_INITIALIZER(done);
+	struct blockdev_aio_task *aio_task;
+
+	pthread_mutex_lock(&g_aio_fsync.lock);
+	TAILQ_SWAP(&done, &aio_ch->offload_done, blockdev_aio_task, link);
+	pthread_mutex_unlock(&g_aio_fsync.lock);
+
+	while ((aio_task = TAILQ_FIRST(&done)) != NULL) {
+		TAILQ_REMOVE(&done, aio_task, link);
+		aio_ch->num_offloaded--;
+		spdk_bdev_io_complete(spdk_bdev_io_from_ctx(aio_task),
+				      aio_task->rc == 0 ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+/*
+ * An iocb was rejected by io_submit().  Flushes rejected with EINVAL mean the
+ *  kernel has no aio fsync support; route them to the worker thread instead.
+ */
+static void
+blockdev_aio_submit_failed(struct blockdev_aio_io_channel *aio_ch, struct iocb *iocb, int rc)
+{
+	struct blockdev_aio_task *aio_task = iocb->data;
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(aio_task);
+	struct file_disk *fdisk = bdev_io->ctx;
+
+	if (iocb->aio_lio_opcode == IO_CMD_FDSYNC && rc == -EINVAL) {
+		if (!fdisk->fdsync_unsupported) {
+			SPDK_NOTICELOG("%s: no aio fsync support, using fsync thread\n", fdisk->disk.name);
+			fdisk->fdsync_unsupported = true;
+		}
+		if (blockdev_aio_offload_flush(aio_ch, aio_task) == 0) {
+			return;
+		}
+	} else {
+		SPDK_ERRLOG("%s: io_submit returned %d\n", __func__, rc);
+	}
+
+	blockdev_aio_fail_iocb(iocb);
+}
+
+/*
+ * Hand all pending iocbs to the kernel with as few io_submit() calls as possible.
+ *  iocbs the kernel cannot accept right now (EAGAIN) stay pending for the next pass.
+ */
+static void
+blockdev_aio_submit_pending(struct blockdev_aio_io_channel *aio_ch)
+{
+	long submitted = 0;
+	int rc;
+
+	while (submitted < aio_ch->num_pending) {
+		rc = io_submit(aio_ch->io_ctx, aio_ch->num_pending - submitted,
+			       &aio_ch->pending_iocbs[submitted]);
+		if (rc == -EAGAIN || rc == 0) {
+			break;
+		} else if (rc < 0) {
+			/* The first iocb in the batch was rejected; deal with it and retry the rest. */
+			blockdev_aio_submit_failed(aio_ch, aio_ch->pending_iocbs[submitted], rc);
+			submitted++;
+		} else {
+			aio_ch->num_inflight += rc;
+			submitted += rc;
+		}
+	}
+
+	if (submitted == 0) {
+		return;
+	}
+
+	aio_ch->num_pending -= submitted;
+	if (aio_ch->num_pending > 0) {
+		memmove(aio_ch->pending_iocbs, &aio_ch->pending_iocbs[submitted],
+			aio_ch->num_pending * sizeof(struct iocb *));
+	}
+}
+
+static void
+blockdev_aio_submit_event(spdk_event_t event)
+{
+	struct blockdev_aio_io_channel *aio_ch = spdk_event_get_arg1(event);
+
+	aio_ch->submit_scheduled = false;
+	blockdev_aio_submit_pending(aio_ch);
+}
+
+static int
+blockdev_aio_queue_iocb(struct blockdev_aio_io_channel *aio_ch, struct iocb *iocb)
+{
+	if (aio_ch->num_pending == aio_ch->queue_depth) {
+		blockdev_aio_submit_pending(aio_ch);
+		if (aio_ch->num_pending == aio_ch->queue_depth) {
+			SPDK_ERRLOG("%s: aio submission queue full\n", __func__);
+			return -1;
+		}
+	}
+
+	if (aio_ch->efd >= 0) {
+		io_set_eventfd(iocb, aio_ch->efd);
+	} else {
+		/* Don't let a stale IOCB_FLAG_RESFD from an earlier use of this task through. */
+		iocb->u.c.flags = 0;
+	}
+
+	aio_ch->pending_iocbs[aio_ch->num_pending++] = iocb;
+
+	/*
+	 * A timer-driven channel poller would hold new I/O back for up to a
+	 *  whole period.  Queue one local event instead: it runs after the
+	 *  rest of this reactor pass, so everything staged until then still
+	 *  goes out in a single io_submit().
+	 */
+	if (aio_ch->efd >= 0 && !aio_ch->submit_scheduled) {
+		aio_ch->submit_scheduled = true;
+		spdk_event_call(spdk_event_allocate(aio_ch->lcore, blockdev_aio_submit_event,
+						    aio_ch, NULL, NULL));
+	}
+
+	return 0;
+}
+
 static int64_t
-blockdev_aio_read(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
-		  void *buf, uint64_t nbytes, off_t offset)
+blockdev_aio_readv(struct file_disk *fdisk, struct spdk_bdev_channel *ch,
+		   struct blockdev_aio_task *aio_task,
+		   struct iovec *iov, int iovcnt, uint64_t nbytes, off_t offset)
 {
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
 	struct iocb *iocb = &aio_task->iocb;
 	int rc;
 
 	iocb->aio_fildes = fdisk->fd;
 	iocb->aio_reqprio = 0;
-	iocb->aio_lio_opcode = IO_CMD_PREAD;
-	iocb->u.c.buf = buf;
-	iocb->u.c.nbytes = nbytes;
-	iocb->u.c.offset = offset;
+	iocb->aio_lio_opcode = IO_CMD_PREADV;
+	iocb->u.v.vec = iov;
+	iocb->u.v.nr = iovcnt;
+	iocb->u.v.offset = offset;
 	iocb->data = aio_task;
 	aio_task->len = nbytes;
 
-	SPDK_TRACELOG(SPDK_TRACE_AIO, "read from %p of size %lu to off: %#lx\n",
-		      buf, nbytes, offset);
+	SPDK_TRACELOG(SPDK_TRACE_AIO, "read %d iovs size %lu to off: %#lx\n",
+		      iovcnt, nbytes, offset);
 
-	rc = io_submit(fdisk->io_ctx, 1, &iocb);
+	rc = blockdev_aio_queue_iocb(aio_ch, iocb);
 	if (rc < 0) {
-		SPDK_ERRLOG("%s: io_submit returned %d\n", __func__, rc);
 		return -1;
 	}
 
@@ -127,9 +337,11 @@ blockdev_aio_read(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
 }
 
 static int64_t
-blockdev_aio_writev(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
+blockdev_aio_writev(struct file_disk *fdisk, struct spdk_bdev_channel *ch,
+		    struct blockdev_aio_task *aio_task,
 		    struct iovec *iov, int iovcnt, size_t len, off_t offset)
 {
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
 	struct iocb *iocb = &aio_task->iocb;
 	int rc;
 
@@ -145,9 +357,8 @@ blockdev_aio_writev(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
 	SPDK_TRACELOG(SPDK_TRACE_AIO, "write %d iovs size %lu from off: %#lx\n",
 		      iovcnt, len, offset);
 
-	rc = io_submit(fdisk->io_ctx, 1, &iocb);
+	rc = blockdev_aio_queue_iocb(aio_ch, iocb);
 	if (rc < 0) {
-		SPDK_ERRLOG("%s: io_submit returned %d\n", __func__, rc);
 		return -1;
 	}
 
@@ -155,15 +366,25 @@ blockdev_aio_writev(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
 }
 
 static int64_t
-blockdev_aio_flush(struct file_disk *fdisk, struct blockdev_aio_task *aio_task,
-		   uint64_t offset, uint64_t nbytes)
+blockdev_aio_flush(struct file_disk *fdisk, struct spdk_bdev_channel *ch,
+		   struct blockdev_aio_task *aio_task, uint64_t offset, uint64_t nbytes)
 {
-	int rc = fsync(fdisk->fd);
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
+	struct iocb *iocb = &aio_task->iocb;
 
-	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(aio_task),
-			      rc == 0 ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED);
+	if (fdisk->fdsync_unsupported) {
+		/* Writes staged for the next batch must at least reach the kernel first. */
+		blockdev_aio_submit_pending(aio_ch);
+		return blockdev_aio_offload_flush(aio_ch, aio_task);
+	}
 
-	return rc;
+	io_prep_fdsync(iocb, fdisk->fd);
+	iocb->data = aio_task;
+	aio_task->len = 0;
+
+	SPDK_TRACELOG(SPDK_TRACE_AIO, "flush\n");
+
+	return blockdev_aio_queue_iocb(aio_ch, iocb);
 }
 
 static int
@@ -181,28 +402,65 @@ blockdev_aio_destruct(struct spdk_bdev *bdev)
 }
 
 static int
-blockdev_aio_check_io(struct spdk_bdev *bdev)
+blockdev_aio_check_io(struct spdk_bdev_channel *ch)
 {
 	int nr, i;
 	enum spdk_bdev_io_status status;
 	struct blockdev_aio_task *aio_task;
-	struct file_disk *fdisk = (struct file_disk *)bdev;
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
 	struct timespec timeout;
+	uint64_t efd_count;
+	long max_events;
+
+	if (aio_ch->num_pending > 0) {
+		blockdev_aio_submit_pending(aio_ch);
+	}
+
+	if (aio_ch->num_offloaded > 0) {
+		blockdev_aio_reap_offloaded(aio_ch);
+	}
+
+	/* Nothing in flight, so there is nothing to reap - skip the syscall. */
+	if (aio_ch->num_inflight == 0) {
+		return 0;
+	}
+
+	max_events = aio_ch->queue_depth;
+	if (aio_ch->efd >= 0) {
+		/*
+		 * The eventfd counts completed iocbs; only enter io_getevents once
+		 *  the kernel has signalled that some are ready.
+		 */
+		if (read(aio_ch->efd, &efd_count, sizeof(efd_count)) == sizeof(efd_count)) {
+			aio_ch->efd_ready += efd_count;
+		}
+		if (aio_ch->efd_ready == 0) {
+			return 0;
+		}
+		if (aio_ch->efd_ready < (uint64_t)max_events) {
+			max_events = aio_ch->efd_ready;
+		}
+	}
 
 	timeout.tv_sec = 0;
 	timeout.tv_nsec = 0;
 
-	nr = io_getevents(fdisk->io_ctx, 1, fdisk->queue_depth,
-			  fdisk->events, &timeout);
+	nr = io_getevents(aio_ch->io_ctx, 1, max_events,
+			  aio_ch->events, &timeout);
 
 	if (nr < 0) {
 		SPDK_ERRLOG("%s: io_getevents returned %d\n", __func__, nr);
 		return -1;
 	}
 
+	aio_ch->num_inflight -= nr;
+	if (aio_ch->efd >= 0) {
+		aio_ch->efd_ready -= nr;
+	}
+
 	for (i = 0; i < nr; i++) {
-		aio_task = fdisk->events[i].data;
-		if (fdisk->events[i].res != aio_task->len) {
+		aio_task = aio_ch->events[i].data;
+		if (aio_ch->events[i].res != aio_task->len) {
 			status = SPDK_BDEV_IO_STATUS_FAILED;
 		} else {
 			status = SPDK_BDEV_IO_STATUS_SUCCESS;
@@ -226,11 +484,13 @@ static void blockdev_aio_get_rbuf_cb(struct spdk_bdev_io *bdev_io)
 {
 	int ret = 0;
 
-	ret = blockdev_aio_read((struct file_disk *)bdev_io->ctx,
-				(struct blockdev_aio_task *)bdev_io->driver_ctx,
-				bdev_io->u.read.buf,
-				bdev_io->u.read.nbytes,
-				bdev_io->u.read.offset);
+	ret = blockdev_aio_readv((struct file_disk *)bdev_io->ctx,
+				 bdev_io->ch,
+				 (struct blockdev_aio_task *)bdev_io->driver_ctx,
+				 bdev_io->u.read.iovs,
+				 bdev_io->u.read.iovcnt,
+				 bdev_io->u.read.len,
+				 bdev_io->u.read.offset);
 
 	if (ret < 0) {
 		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
@@ -246,6 +506,7 @@ static int _blockdev_aio_submit_request(struct spdk_bdev_io *bdev_io)
 
 	case SPDK_BDEV_IO_TYPE_WRITE:
 		return blockdev_aio_writev((struct file_disk *)bdev_io->ctx,
+					   bdev_io->ch,
 					   (struct blockdev_aio_task *)bdev_io->driver_ctx,
 					   bdev_io->u.write.iovs,
 					   bdev_io->u.write.iovcnt,
@@ -253,6 +514,7 @@ static int _blockdev_aio_submit_request(struct spdk_bdev_io *bdev_io)
 					   bdev_io->u.write.offset);
 	case SPDK_BDEV_IO_TYPE_FLUSH:
 		return blockdev_aio_flush((struct file_disk *)bdev_io->ctx,
+					  bdev_io->ch,
 					  (struct blockdev_aio_task *)bdev_io->driver_ctx,
 					  bdev_io->u.flush.offset,
 					  bdev_io->u.flush.length);
@@ -288,19 +550,104 @@ blockdev_aio_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io
 	}
 }
 
+static int
+blockdev_aio_create_channel(struct spdk_bdev_channel *ch)
+{
+	struct file_disk *fdisk = (struct file_disk *)ch->bdev;
+	struct blockdev_aio_io_channel *aio_ch;
+
+	aio_ch = calloc(1, sizeof(*aio_ch));
+	if (aio_ch == NULL) {
+		SPDK_ERRLOG("unable to allocate aio channel\n");
+		return -1;
+	}
+
+	aio_ch->queue_depth = fdisk->queue_depth;
+	aio_ch->lcore = ch->lcore;
+	if (io_setup(aio_ch->queue_depth, &aio_ch->io_ctx) < 0) {
+		SPDK_ERRLOG("async I/O context setup failure\n");
+		free(aio_ch);
+		return -1;
+	}
+
+	aio_ch->events = calloc(sizeof(struct io_event), aio_ch->queue_depth);
+	aio_ch->pending_iocbs = calloc(sizeof(struct iocb *), aio_ch->queue_depth);
+	if (!aio_ch->events || !aio_ch->pending_iocbs) {
+		SPDK_ERRLOG("unable to allocate async events\n");
+		goto error;
+	}
+
+	TAILQ_INIT(&aio_ch->offload_done);
+
+	aio_ch->efd = -1;
+	if (fdisk->use_eventfd) {
+		aio_ch->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (aio_ch->efd < 0) {
+			SPDK_ERRLOG("unable to create eventfd: %d\n", errno);
+			goto error;
+		}
+		/*
+		 * Completions are counted by the eventfd, so the channel need not be
+		 *  polled for them on every reactor pass.  Submissions do not wait
+		 *  for the poller; see blockdev_aio_queue_iocb().
+		 */
+		ch->poll_period_us = g_aio_eventfd_poll_us;
+	}
+
+	ch->ctx = aio_ch;
+
+	return 0;
+
+error:
+	io_destroy(aio_ch->io_ctx);
+	free(aio_ch->pending_iocbs);
+	free(aio_ch->events);
+	free(aio_ch);
+	return -1;
+}
+
+/*
+ * iocbs still pending or in the kernel, flushes still with the fsync
+ *  worker and a queued submit event point back at this channel; it must
+ *  outlive all of them.
+ */
+static bool
+blockdev_aio_channel_busy(struct spdk_bdev_channel *ch)
+{
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
+
+	return aio_ch->num_pending > 0 || aio_ch->num_inflight > 0 || aio_ch->num_offloaded > 0 ||
+	       aio_ch->submit_scheduled;
+}
+
+static void
+blockdev_aio_destroy_channel(struct spdk_bdev_channel *ch)
+{
+	struct blockdev_aio_io_channel *aio_ch = ch->ctx;
+
+	io_destroy(aio_ch->io_ctx);
+	if (aio_ch->efd >= 0) {
+		close(aio_ch->efd);
+	}
+	free(aio_ch->pending_iocbs);
+	free(aio_ch->events);
+	free(aio_ch);
+}
+
 static const struct spdk_bdev_fn_table aio_fn_table = {
 	.destruct		= blockdev_aio_destruct,
 	.check_io		= blockdev_aio_check_io,
 	.submit_request		= blockdev_aio_submit_request,
 	.io_type_supported	= blockdev_aio_io_type_supported,
+	.create_channel		= blockdev_aio_create_channel,
+	.destroy_channel	= blockdev_aio_destroy_channel,
+	.channel_busy		= blockdev_aio_channel_busy,
 };
 
 static void aio_free_disk(struct file_disk *fdisk)
 {
 	if (fdisk == NULL)
 		return;
-	if (fdisk->events != NULL)
-		free(fdisk->events);
 	free(fdisk);
 }
 
@@ -323,6 +670,7 @@ create_aio_disk(char *fname)
 
 	fdisk->size = spdk_fd_get_size(fdisk->fd);
 	fdisk->queue_depth = 128; // TODO: where do we get the queue depth from.
+	fdisk->use_eventfd = g_aio_use_eventfd;
 
 	TAILQ_INIT(&fdisk->sync_completion_list);
 	snprintf(fdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "AIO%d",
@@ -336,16 +684,6 @@ create_aio_disk(char *fname)
 	fdisk->disk.ctxt = fdisk;
 
 	fdisk->disk.fn_table = &aio_fn_table;
-	if (io_setup(fdisk->queue_depth, &fdisk->io_ctx) < 0) {
-		SPDK_ERRLOG("async I/O context setup failure\n");
-		goto error_return;
-	}
-
-	fdisk->events = calloc(sizeof(struct io_event), fdisk->queue_depth);
-	if (!fdisk->events) {
-		SPDK_ERRLOG("unable to allocate async events\n");
-		goto error_return;
-	}
 
 	g_blockdev_count++;
 
@@ -358,6 +696,22 @@ error_return:
 	return NULL;
 }
 
+static void
+blockdev_aio_finish(void)
+{
+	pthread_mutex_lock(&g_aio_fsync.lock);
+	if (!g_aio_fsync.started) {
+		pthread_mutex_unlock(&g_aio_fsync.lock);
+		return;
+	}
+	g_aio_fsync.exit = true;
+	pthread_cond_signal(&g_aio_fsync.cond);
+	pthread_mutex_unlock(&g_aio_fsync.lock);
+
+	pthread_join(g_aio_fsync.thread, NULL);
+	g_aio_fsync.started = false;
+}
+
 static int blockdev_aio_initialize(void)
 {
 	struct file_disk *fdisk;
@@ -374,6 +728,17 @@ static int blockdev_aio_initialize(void)
 		skip_missing = true;
 	}
 
+	if (sp != NULL) {
+		val = spdk_conf_section_get_val(sp, "UseEventfd");
+		if (val != NULL && !strcmp(val, "Yes")) {
+			g_aio_use_eventfd = true;
+		}
+		val = spdk_conf_section_get_val(sp, "EventfdPollInterval");
+		if (val != NULL) {
+			g_aio_eventfd_poll_us = strtoull(val, NULL, 10);
+		}
+	}
+
 	if (sp != NULL) {
 		for (i = 0; ; i++) {
 			val = spdk_conf_section_get_nval(sp, "AIO", i);
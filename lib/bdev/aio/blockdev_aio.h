@@ -42,10 +42,16 @@
 
 #include "bdev_module.h"
 
+struct blockdev_aio_io_channel;
+
 struct blockdev_aio_task {
 	struct iocb			iocb;
 	uint64_t			len;
 	TAILQ_ENTRY(blockdev_aio_task)	link;
+
+	/* Used by flushes handed to the fsync worker thread. */
+	struct blockdev_aio_io_channel	*ch;
+	int				rc;
 };
 
 struct file_disk {
@@ -56,15 +62,53 @@ struct file_disk {
 	long			queue_depth;
 	uint64_t		size;
 
+	/** Signal completions through an eventfd instead of polling io_getevents. */
+	bool			use_eventfd;
+
+	/** The kernel rejected IO_CMD_FDSYNC iocbs, so flushes go to the fsync worker. */
+	bool			fdsync_unsupported;
+
 	/**
 	 * For storing I/O that were completed synchronously, and will be
 	 *   completed during next check_io call.
 	 */
 	TAILQ_HEAD(, blockdev_aio_task) sync_completion_list;
+};
 
-	/* for libaio */
-	io_context_t io_ctx;
-	struct io_event *events;
+/* Per-lcore libaio context, stored in spdk_bdev_channel::ctx */
+struct blockdev_aio_io_channel {
+	long			queue_depth;
+	io_context_t		io_ctx;
+	struct io_event		*events;
+
+	/**
+	 * iocbs prepared by submit_request but not yet passed to the kernel.
+	 *  They are handed to a single io_submit() call on the next check_io, or
+	 *  in eventfd mode from the submit event queued by the first of them.
+	 */
+	struct iocb		**pending_iocbs;
+	long			num_pending;
+
+	/** In eventfd mode, an event to submit pending_iocbs is queued on lcore. */
+	bool			submit_scheduled;
+	uint32_t		lcore;
+
+	/** Number of iocbs submitted to the kernel and not yet reaped. */
+	long			num_inflight;
+
+	/**
+	 * eventfd signalled by the kernel for each completed iocb, or -1 if
+	 *  the channel polls io_getevents directly.
+	 */
+	int			efd;
+	uint64_t		efd_ready;
+
+	/**
+	 * Flushes handed to the fsync worker thread.  The worker moves them to
+	 *  offload_done (under the worker lock) and check_io completes them.
+	 */
+	long			num_offloaded;
+	TAILQ_HEAD(, blockdev_aio_task) offload_done;
 };
 
 struct file_disk *create_aio_disk(char *fname);
@@ -115,7 +115,8 @@ spdk_bdev_io_set_rbuf(struct spdk_bdev_io *bdev_io, void *buf)
 	RTE_VERIFY(bdev_io->get_rbuf_cb != NULL);
 	RTE_VERIFY(buf != NULL);
 	bdev_io->u.read.buf_unaligned = buf;
-	bdev_io->u.read.buf = (void *)((unsigned long)((char *)buf + 512) & ~511UL);
+	bdev_io->u.read.iov.iov_base = (void *)((unsigned long)((char *)buf + 512) & ~511UL);
+	bdev_io->u.read.iov.iov_len = bdev_io->u.read.len;
 	bdev_io->u.read.put_rbuf = true;
 	bdev_io->get_rbuf_cb(bdev_io);
 }
@@ -128,7 +129,7 @@ spdk_bdev_io_put_rbuf(struct spdk_bdev_io *bdev_io)
 	need_rbuf_tailq_t *tailq;
 	uint64_t length;
 
-	length = bdev_io->u.read.nbytes;
+	length = bdev_io->u.read.len;
 	buf = bdev_io->u.read.buf_unaligned;
 
 	if (length <= SPDK_BDEV_SMALL_RBUF_MAX_SIZE) {
@@ -266,11 +267,6 @@ spdk_bdev_initialize(void)
 {
 	int i;
 
-	if (spdk_bdev_module_initialize()) {
-		SPDK_ERRLOG("bdev module initialize failed");
-		return -1;
-	}
-
 	spdk_bdev_g_io_pool = rte_mempool_create("blockdev_io",
 			      SPDK_BDEV_IO_POOL_SIZE,
 			      sizeof(struct spdk_bdev_io) +
@@ -289,7 +285,17 @@ spdk_bdev_initialize(void)
 		TAILQ_INIT(&g_need_rbuf_large[i]);
 	}
 
-	return spdk_initialize_rbuf_pool();
+	if (spdk_initialize_rbuf_pool()) {
+		return -1;
+	}
+
+	/* Virtual blockdevs may already read their metadata from the blockdevs under them. */
+	if (spdk_bdev_module_initialize()) {
+		SPDK_ERRLOG("bdev module initialize failed");
+		return -1;
+	}
+
+	return 0;
 }
 
 /*
@@ -361,7 +367,7 @@ spdk_bdev_put_io(struct spdk_bdev_io *bdev_io)
 static void
 _spdk_bdev_io_get_rbuf(struct spdk_bdev_io *bdev_io)
 {
-	uint64_t len = bdev_io->u.read.nbytes;
+	uint64_t len = bdev_io->u.read.len;
 	struct rte_mempool *pool;
 	need_rbuf_tailq_t *tailq;
 	int rc;
@@ -405,78 +411,168 @@ spdk_bdev_cleanup_pending_rbuf_io(struct spdk_bdev *bdev)
 }
 
 static void
-__submit_request(spdk_event_t event)
+spdk_bdev_channel_poll(void *arg)
 {
-	struct spdk_bdev *bdev = spdk_event_get_arg1(event);
-	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct spdk_bdev_channel *ch = arg;
 
-	bdev_io->cb_event = spdk_event_get_next(event);
+	ch->bdev->fn_table->check_io(ch);
+}
 
-	if (bdev_io->status == SPDK_BDEV_IO_STATUS_PENDING) {
-		if (bdev_io->type == SPDK_BDEV_IO_TYPE_RESET) {
-			spdk_bdev_cleanup_pending_rbuf_io(bdev);
-		}
-		bdev->fn_table->submit_request(bdev_io);
-	} else {
-		struct spdk_bdev_io *child_io, *tmp;
-
-		TAILQ_FOREACH_SAFE(child_io, &bdev_io->child_io, link, tmp) {
-			/*
-			 * Make sure no references to the parent I/O remain, since it is being
-			 * returned to the free pool.
-			 */
-			child_io->parent = NULL;
-			TAILQ_REMOVE(&bdev_io->child_io, child_io, link);
-
-			/*
-			 * Child I/O may have an rbuf that needs to be returned to a pool
-			 *  on a different core, so free it through the request submission
-			 *  process rather than calling put_io directly here.
-			 */
-			spdk_bdev_free_io(child_io);
+static struct spdk_bdev_channel *
+spdk_bdev_get_channel(struct spdk_bdev *bdev)
+{
+	struct spdk_bdev_channel *ch;
+	uint32_t lcore = rte_lcore_id();
+
+	if (lcore >= RTE_MAX_LCORE) {
+		SPDK_ERRLOG("I/O to %s submitted from a non-reactor thread\n", bdev->name);
+		return NULL;
+	}
+
+	ch = bdev->channels[lcore];
+	if (ch != NULL) {
+		return ch;
+	}
+
+	ch = calloc(1, sizeof(*ch));
+	if (ch == NULL) {
+		SPDK_ERRLOG("could not allocate I/O channel for %s\n", bdev->name);
+		return NULL;
+	}
+
+	ch->bdev = bdev;
+	ch->lcore = lcore;
+
+	if (bdev->fn_table->create_channel && bdev->fn_table->create_channel(ch) != 0) {
+		SPDK_ERRLOG("could not create I/O channel for %s on lcore %u\n", bdev->name, lcore);
+		free(ch);
+		return NULL;
+	}
+
+	if (bdev->fn_table->check_io) {
+		spdk_poller_register(&ch->poller, spdk_bdev_channel_poll, ch, lcore, NULL,
+				     ch->poll_period_us);
+	}
+
+	bdev->channels[lcore] = ch;
+
+	return ch;
+}
+
+static void
+_spdk_bdev_channel_free(spdk_event_t event)
+{
+	struct spdk_bdev_channel *ch = spdk_event_get_arg1(event);
+	struct spdk_event *next = spdk_event_get_next(event);
+	struct spdk_bdev *bdev = ch->bdev;
+
+	if (bdev->fn_table->channel_busy && bdev->fn_table->channel_busy(ch)) {
+		/*
+		 * The poller is gone, so drive the backend from here and look again
+		 *  on the next pass until its outstanding I/O has completed.
+		 */
+		if (bdev->fn_table->check_io) {
+			bdev->fn_table->check_io(ch);
 		}
+		spdk_event_call(spdk_event_allocate(ch->lcore, _spdk_bdev_channel_free, ch, NULL, next));
+		return;
+	}
 
-		spdk_bdev_put_io(bdev_io);
+	spdk_bdev_cleanup_pending_rbuf_io(bdev);
+
+	if (bdev->fn_table->destroy_channel) {
+		bdev->fn_table->destroy_channel(ch);
 	}
+
+	bdev->channels[ch->lcore] = NULL;
+	free(ch);
+
+	if (next) {
+		spdk_event_call(next);
+	}
+}
+
+static void
+_spdk_bdev_channel_destroy(spdk_event_t event)
+{
+	struct spdk_bdev_channel *ch = spdk_event_get_arg1(event);
+	struct spdk_event *complete;
+
+	complete = spdk_event_allocate(ch->lcore, _spdk_bdev_channel_free, ch, NULL,
+				       spdk_event_get_next(event));
+	spdk_poller_unregister(&ch->poller, complete);
+}
+
+static void
+spdk_bdev_io_release(struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev_io *child_io, *tmp;
+
+	TAILQ_FOREACH_SAFE(child_io, &bdev_io->child_io, link, tmp) {
+		/*
+		 * Make sure no references to the parent I/O remain, since it is being
+		 * returned to the free pool.
+		 */
+		child_io->parent = NULL;
+		TAILQ_REMOVE(&bdev_io->child_io, child_io, link);
+
+		/*
+		 * Child I/O may have an rbuf that needs to be returned to a pool
+		 *  on a different core, so free it through spdk_bdev_free_io()
+		 *  rather than calling put_io directly here.
+		 */
+		spdk_bdev_free_io(child_io);
+	}
+
+	spdk_bdev_put_io(bdev_io);
+}
+
+static void
+_spdk_bdev_io_release(spdk_event_t event)
+{
+	spdk_bdev_io_release(spdk_event_get_arg1(event));
 }
 
 void
 spdk_bdev_do_work(void *ctx)
 {
 	struct spdk_bdev *bdev = ctx;
+	struct spdk_bdev_channel *ch;
 
-	bdev->fn_table->check_io(bdev->ctxt);
+	if (rte_lcore_id() >= RTE_MAX_LCORE || bdev->fn_table->check_io == NULL) {
+		return;
+	}
+
+	ch = bdev->channels[rte_lcore_id()];
+	if (ch != NULL) {
+		bdev->fn_table->check_io(ch);
+	}
 }
 
 int
 spdk_bdev_io_submit(struct spdk_bdev_io *bdev_io)
 {
 	struct spdk_bdev *bdev = bdev_io->bdev;
-	struct spdk_event *event, *cb_event = NULL;
-	uint32_t lcore = bdev->lcore;
-
-	/* start the poller when first IO comes */
-	if (!bdev->is_running) {
-		bdev->is_running = true;
-		if (lcore == 0) {
-			lcore = rte_lcore_id();
-		}
-		bdev->lcore = lcore;
-		if (bdev->fn_table->check_io) {
-			spdk_poller_register(&bdev->poller, spdk_bdev_do_work, bdev, lcore, NULL, 0);
-		}
-	}
 
-	if (bdev_io->status == SPDK_BDEV_IO_STATUS_PENDING) {
-		cb_event = spdk_event_allocate(rte_lcore_id(), bdev_io->cb,
-					       bdev_io->caller_ctx, bdev_io, NULL);
-		RTE_VERIFY(cb_event != NULL);
+	bdev_io->ch = spdk_bdev_get_channel(bdev);
+	if (bdev_io->ch == NULL) {
+		return -1;
 	}
 
-	event = spdk_event_allocate(lcore, __submit_request, bdev, bdev_io, cb_event);
+	/*
+	 * The I/O is submitted on the calling lcore, so the completion is also
+	 *  delivered there.  Queueing it as a local event rather than calling
+	 *  the callback directly keeps completions that the backend reports from
+	 *  within submit_request from re-entering the caller.
+	 */
+	bdev_io->cb_event = spdk_event_allocate(bdev_io->ch->lcore, bdev_io->cb,
+						bdev_io->caller_ctx, bdev_io, NULL);
+	RTE_VERIFY(bdev_io->cb_event != NULL);
 
-	RTE_VERIFY(event != NULL);
-	spdk_event_call(event);
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_RESET) {
+		spdk_bdev_cleanup_pending_rbuf_io(bdev);
+	}
+	bdev->fn_table->submit_request(bdev_io);
 
 	return 0;
 }
@@ -519,6 +615,17 @@ spdk_bdev_get_child_io(struct spdk_bdev_io *parent,
 	memcpy(&child->u, &parent->u, sizeof(child->u));
 	if (child->type == SPDK_BDEV_IO_TYPE_READ) {
 		child->u.read.put_rbuf = false;
+		if (parent->u.read.iovs == &parent->u.read.iov) {
+			child->u.read.iovs = &child->u.read.iov;
+		}
+	} else if (child->type == SPDK_BDEV_IO_TYPE_WRITE) {
+		if (parent->u.write.iovs == &parent->u.write.iov) {
+			child->u.write.iovs = &child->u.write.iov;
+		}
+	} else if (child->type == SPDK_BDEV_IO_TYPE_ZCOPY) {
+		if (parent->u.zcopy.iovs == &parent->u.zcopy.iov) {
+			child->u.zcopy.iovs = &child->u.zcopy.iov;
+		}
 	}
 	child->get_rbuf_cb = NULL;
 	child->parent = parent;
@@ -528,6 +635,152 @@ spdk_bdev_get_child_io(struct spdk_bdev_io *parent,
 	return child;
 }
 
+/*
+ * Point a read or write child at len bytes of its parent's buffer starting at
+ *  offset.  A range inside one parent iovec uses the child's own iovec element;
+ *  anything else is carved out of slices, which is sized on first use for
+ *  max_children children and reused for the rest of the parent's children.
+ */
+int
+spdk_bdev_io_slice_parent_iovs(struct spdk_bdev_io *child, struct spdk_bdev_iov_slices *slices,
+			       uint64_t offset, uint64_t len, int max_children)
+{
+	struct spdk_bdev_io *parent = child->parent;
+	struct iovec *parent_iovs, *own_iov, *slice, **iovs;
+	int parent_iovcnt, i, *iovcnt;
+	uint64_t chunk, start;
+
+	if (child->type == SPDK_BDEV_IO_TYPE_READ) {
+		parent_iovs = parent->u.read.iovs;
+		parent_iovcnt = parent->u.read.iovcnt;
+		own_iov = &child->u.read.iov;
+		iovs = &child->u.read.iovs;
+		iovcnt = &child->u.read.iovcnt;
+		child->u.read.len = len;
+	} else if (child->type == SPDK_BDEV_IO_TYPE_WRITE) {
+		parent_iovs = parent->u.write.iovs;
+		parent_iovcnt = parent->u.write.iovcnt;
+		own_iov = &child->u.write.iov;
+		iovs = &child->u.write.iovs;
+		iovcnt = &child->u.write.iovcnt;
+		child->u.write.len = len;
+	} else {
+		return -1;
+	}
+
+	/* Children are usually set up in buffer order, so resume where the last one ended. */
+	if (offset >= slices->idx_offset) {
+		i = slices->idx;
+		start = slices->idx_offset;
+	} else {
+		i = 0;
+		start = 0;
+	}
+	for (; i < parent_iovcnt && offset - start >= parent_iovs[i].iov_len; i++) {
+		start += parent_iovs[i].iov_len;
+	}
+	if (i == parent_iovcnt) {
+		return -1;
+	}
+	slices->idx = i;
+	slices->idx_offset = start;
+	offset -= start;
+
+	if (parent_iovs[i].iov_len - offset >= len) {
+		own_iov->iov_base = (char *)parent_iovs[i].iov_base + offset;
+		own_iov->iov_len = len;
+		*iovs = own_iov;
+		*iovcnt = 1;
+		return 0;
+	}
+
+	if (slices->iovs == NULL) {
+		/* Each child adds at most one split parent iovec to the total. */
+		slices->max = parent_iovcnt + max_children;
+		slices->iovs = calloc(slices->max, sizeof(struct iovec));
+		if (slices->iovs == NULL) {
+			return -1;
+		}
+	}
+
+	*iovs = &slices->iovs[slices->count];
+	*iovcnt = 0;
+	for (; len > 0; i++) {
+		if (i == parent_iovcnt || slices->count == slices->max) {
+			return -1;
+		}
+		chunk = parent_iovs[i].iov_len - offset;
+		if (chunk > len) {
+			chunk = len;
+		}
+		slice = &slices->iovs[slices->count++];
+		slice->iov_base = (char *)parent_iovs[i].iov_base + offset;
+		slice->iov_len = chunk;
+		(*iovcnt)++;
+		len -= chunk;
+		offset = 0;
+	}
+
+	return 0;
+}
+
+void
+spdk_bdev_iov_slices_free(struct spdk_bdev_iov_slices *slices)
+{
+	free(slices->iovs);
+	memset(slices, 0, sizeof(*slices));
+}
+
+void
+spdk_bdev_copy_from_iovs(void *buf, struct iovec *iovs, int iovcnt, uint64_t offset, uint64_t len)
+{
+	uint64_t chunk;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iovs[i].iov_len) {
+			offset -= iovs[i].iov_len;
+			continue;
+		}
+		chunk = iovs[i].iov_len - offset;
+		if (chunk > len) {
+			chunk = len;
+		}
+		memcpy(buf, (char *)iovs[i].iov_base + offset, chunk);
+		buf = (char *)buf + chunk;
+		len -= chunk;
+		offset = 0;
+	}
+}
+
+/* Copy buf to the iovecs, or zero them if buf is NULL. */
+void
+spdk_bdev_copy_to_iovs(struct iovec *iovs, int iovcnt, uint64_t offset, const void *buf,
+		       uint64_t len)
+{
+	uint64_t chunk;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iovs[i].iov_len) {
+			offset -= iovs[i].iov_len;
+			continue;
+		}
+		chunk = iovs[i].iov_len - offset;
+		if (chunk > len) {
+			chunk = len;
+		}
+		if (buf != NULL) {
+			memcpy((char *)iovs[i].iov_base + offset, buf, chunk);
+			buf = (const char *)buf + chunk;
+		} else {
+			memset((char *)iovs[i].iov_base + offset, 0, chunk);
+		}
+		len -= chunk;
+		offset = 0;
+	}
+}
+
 bool
 spdk_bdev_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
 {
@@ -565,8 +818,58 @@ spdk_bdev_read(struct spdk_bdev *bdev,
 	}
 
 	bdev_io->type = SPDK_BDEV_IO_TYPE_READ;
-	bdev_io->u.read.buf = buf;
-	bdev_io->u.read.nbytes = nbytes;
+	bdev_io->u.read.iov.iov_base = buf;
+	bdev_io->u.read.iov.iov_len = nbytes;
+	bdev_io->u.read.iovs = &bdev_io->u.read.iov;
+	bdev_io->u.read.iovcnt = 1;
+	bdev_io->u.read.len = nbytes;
+	bdev_io->u.read.offset = offset;
+	spdk_bdev_io_init(bdev_io, bdev, cb_arg, cb);
+
+	rc = spdk_bdev_io_submit(bdev_io);
+	if (rc < 0) {
+		spdk_bdev_put_io(bdev_io);
+		return NULL;
+	}
+
+	return bdev_io;
+}
+
+struct spdk_bdev_io *
+spdk_bdev_readv(struct spdk_bdev *bdev,
+		struct iovec *iov, int iovcnt,
+		uint64_t offset, uint64_t nbytes,
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct spdk_bdev_io *bdev_io;
+	int rc;
+
+	/* Return failure if nbytes is not a multiple of bdev->blocklen */
+	if (nbytes % bdev->blocklen) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes is less than offset; indicates there
+	 * has been an overflow and hence the offset has been wrapped around */
+	if ((offset + nbytes) < offset) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes exceeds the size of the blockdev */
+	if ((offset + nbytes) > (bdev->blockcnt * bdev->blocklen)) {
+		return NULL;
+	}
+
+	bdev_io = spdk_bdev_get_io();
+	if (!bdev_io) {
+		SPDK_ERRLOG("spdk_bdev_io memory allocation failed duing readv\n");
+		return NULL;
+	}
+
+	bdev_io->type = SPDK_BDEV_IO_TYPE_READ;
+	bdev_io->u.read.iovs = iov;
+	bdev_io->u.read.iovcnt = iovcnt;
+	bdev_io->u.read.len = nbytes;
 	bdev_io->u.read.offset = offset;
 	spdk_bdev_io_init(bdev_io, bdev, cb_arg, cb);
 
@@ -674,6 +977,76 @@ spdk_bdev_writev(struct spdk_bdev *bdev,
 	return bdev_io;
 }
 
+struct spdk_bdev_io *
+spdk_bdev_zcopy_start(struct spdk_bdev *bdev,
+		      uint64_t offset, uint64_t nbytes,
+		      spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct spdk_bdev_io *bdev_io;
+	int rc;
+
+	/* Return failure if nbytes is not a multiple of bdev->blocklen */
+	if (nbytes % bdev->blocklen) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes is less than offset; indicates there
+	 * has been an overflow and hence the offset has been wrapped around */
+	if ((offset + nbytes) < offset) {
+		return NULL;
+	}
+
+	/* Return failure if offset + nbytes exceeds the size of the blockdev */
+	if ((offset + nbytes) > (bdev->blockcnt * bdev->blocklen)) {
+		return NULL;
+	}
+
+	if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_ZCOPY)) {
+		return NULL;
+	}
+
+	bdev_io = spdk_bdev_get_io();
+	if (!bdev_io) {
+		SPDK_ERRLOG("bdev_io memory allocation failed duing zcopy start\n");
+		return NULL;
+	}
+
+	bdev_io->type = SPDK_BDEV_IO_TYPE_ZCOPY;
+	bdev_io->u.zcopy.iovs = &bdev_io->u.zcopy.iov;
+	bdev_io->u.zcopy.iovcnt = 0;
+	bdev_io->u.zcopy.len = nbytes;
+	bdev_io->u.zcopy.offset = offset;
+	bdev_io->u.zcopy.start = true;
+	spdk_bdev_io_init(bdev_io, bdev, cb_arg, cb);
+
+	rc = spdk_bdev_io_submit(bdev_io);
+	if (rc < 0) {
+		spdk_bdev_put_io(bdev_io);
+		return NULL;
+	}
+
+	return bdev_io;
+}
+
+int
+spdk_bdev_zcopy_commit(struct spdk_bdev_io *bdev_io, bool commit,
+		       spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	if (bdev_io->type != SPDK_BDEV_IO_TYPE_ZCOPY || !bdev_io->u.zcopy.start ||
+	    bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		SPDK_ERRLOG("bdev_io is not a started zcopy write\n");
+		return -1;
+	}
+
+	bdev_io->u.zcopy.start = false;
+	bdev_io->u.zcopy.commit = commit;
+	bdev_io->caller_ctx = cb_arg;
+	bdev_io->cb = cb;
+	bdev_io->status = SPDK_BDEV_IO_STATUS_PENDING;
+
+	return spdk_bdev_io_submit(bdev_io);
+}
+
 struct spdk_bdev_io *
 spdk_bdev_unmap(struct spdk_bdev *bdev,
 		struct spdk_scsi_unmap_bdesc *unmap_d,
@@ -760,8 +1133,6 @@ spdk_bdev_reset(struct spdk_bdev *bdev, enum spdk_bdev_reset_type reset_type,
 int
 spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
 {
-	int rc;
-
 	if (!bdev_io) {
 		SPDK_ERRLOG("bdev_io is NULL\n");
 		return -1;
@@ -772,13 +1143,18 @@ spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
 		return -1;
 	}
 
-	rc = spdk_bdev_io_submit(bdev_io);
-	if (rc < 0) {
-		spdk_bdev_put_io(bdev_io);
-		SPDK_ERRLOG("free_request failure\n");
+	/*
+	 * The rbuf, if any, must go back to the lcore the I/O was submitted on,
+	 *  since requests waiting for an rbuf are queued per lcore.
+	 */
+	if (bdev_io->ch == NULL || bdev_io->ch->lcore == rte_lcore_id()) {
+		spdk_bdev_io_release(bdev_io);
+	} else {
+		spdk_event_call(spdk_event_allocate(bdev_io->ch->lcore, _spdk_bdev_io_release,
+						    bdev_io, NULL, NULL));
 	}
 
-	return rc;
+	return 0;
 }
 
 void
@@ -816,31 +1192,66 @@ spdk_bdev_register(struct spdk_bdev *bdev)
 {
 	/* initialize the reset generation value to zero */
 	bdev->gencnt = 0;
-	bdev->is_running = false;
-	bdev->poller = NULL;
+
+	bdev->channels = calloc(RTE_MAX_LCORE, sizeof(*bdev->channels));
+	if (bdev->channels == NULL) {
+		SPDK_ERRLOG("Unable to allocate I/O channel table\n");
+		rte_panic("no memory\n");
+	}
 
 	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "Inserting bdev %s into list\n", bdev->name);
 	TAILQ_INSERT_TAIL(&spdk_bdev_list, bdev, link);
 }
 
-void
-spdk_bdev_unregister(struct spdk_bdev *bdev)
+static void
+spdk_bdev_destruct(struct spdk_bdev *bdev)
 {
-	int			rc;
+	int rc;
 
-	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "Removing bdev %s from list\n", bdev->name);
-	TAILQ_REMOVE(&spdk_bdev_list, bdev, link);
+	free(bdev->channels);
+	bdev->channels = NULL;
 
 	rc = bdev->fn_table->destruct(bdev->ctxt);
 	if (rc < 0) {
 		SPDK_ERRLOG("destruct failed\n");
 	}
+}
 
-	if (bdev->is_running) {
-		if (bdev->poller) {
-			spdk_poller_unregister(&bdev->poller, NULL);
+static void
+_spdk_bdev_destruct(spdk_event_t event)
+{
+	spdk_bdev_destruct(spdk_event_get_arg1(event));
+}
+
+void
+spdk_bdev_unregister(struct spdk_bdev *bdev)
+{
+	struct spdk_event *event = NULL;
+	int i;
+
+	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "Removing bdev %s from list\n", bdev->name);
+	TAILQ_REMOVE(&spdk_bdev_list, bdev, link);
+
+	/*
+	 * Each channel must be torn down on the lcore that owns it.  Chain the
+	 *  teardown through every such lcore and destruct the bdev at the end,
+	 *  once no channel can reference it anymore.
+	 */
+	for (i = 0; i < RTE_MAX_LCORE; i++) {
+		if (bdev->channels[i] == NULL) {
+			continue;
+		}
+
+		if (event == NULL) {
+			event = spdk_event_allocate(rte_lcore_id(), _spdk_bdev_destruct, bdev, NULL, NULL);
 		}
-		bdev->is_running = false;
+		event = spdk_event_allocate(i, _spdk_bdev_channel_destroy, bdev->channels[i], NULL, event);
+	}
+
+	if (event == NULL) {
+		spdk_bdev_destruct(bdev);
+	} else {
+		spdk_event_call(event);
 	}
 }
 
@@ -849,7 +1260,10 @@ spdk_bdev_io_get_rbuf(struct spdk_bdev_io *bdev_io, spdk_bdev_io_get_rbuf_cb cb)
 {
 	RTE_VERIFY(cb != NULL);
 
-	if (bdev_io->u.read.buf == NULL) {
+	if (bdev_io->u.read.iovs[0].iov_base == NULL) {
+		/* An rbuf can only stand in for a single caller-less buffer. */
+		RTE_VERIFY(bdev_io->u.read.iovcnt == 1);
+		RTE_VERIFY(bdev_io->u.read.iovs == &bdev_io->u.read.iov);
 		bdev_io->get_rbuf_cb = cb;
 		_spdk_bdev_io_get_rbuf(bdev_io);
 	} else {
@@ -0,0 +1,198 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Block-granular metadata writes for virtual blockdevs that keep metadata
+ *  on their base blockdev.  The owner changes its in-memory copy of a block
+ *  under its own lock and then commits the block; the write goes out from
+ *  a private buffer so that later changes cannot tear it.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_malloc.h>
+
+#include "spdk/bdev.h"
+#include "spdk/log.h"
+
+#include "bdev_module.h"
+
+static void spdk_bdev_md_write(struct spdk_bdev_md_update *update);
+
+static void
+spdk_bdev_md_write_complete(struct spdk_bdev_md_update *update, bool success)
+{
+	struct spdk_bdev_md_writer *writer = update->writer;
+	struct spdk_bdev_md_waiters done;
+	struct spdk_bdev_md_waiter *waiter;
+	bool again;
+
+	TAILQ_INIT(&done);
+
+	pthread_mutex_lock(writer->lock);
+	TAILQ_SWAP(&done, &update->writing, spdk_bdev_md_waiter, link);
+	again = !TAILQ_EMPTY(&update->next);
+	if (again) {
+		TAILQ_SWAP(&update->writing, &update->next, spdk_bdev_md_waiter, link);
+		memcpy(update->buf, update->src, writer->base->blocklen);
+	} else {
+		TAILQ_REMOVE(&writer->updates, update, link);
+		TAILQ_INSERT_HEAD(&writer->free_updates, update, link);
+	}
+	pthread_mutex_unlock(writer->lock);
+
+	if (again) {
+		spdk_bdev_md_write(update);
+	}
+
+	while ((waiter = TAILQ_FIRST(&done)) != NULL) {
+		TAILQ_REMOVE(&done, waiter, link);
+		waiter->cb(waiter, success);
+	}
+}
+
+static void
+spdk_bdev_md_write_done(spdk_event_t event)
+{
+	struct spdk_bdev_md_update *update = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: metadata write to block %" PRIu64 " failed\n", update->writer->name,
+			    update->block);
+	}
+
+	spdk_bdev_md_write_complete(update, success);
+}
+
+static void
+spdk_bdev_md_write(struct spdk_bdev_md_update *update)
+{
+	struct spdk_bdev *base = update->writer->base;
+
+	if (spdk_bdev_write(base, update->buf, update->block * base->blocklen,
+			    base->blocklen, spdk_bdev_md_write_done, update) == NULL) {
+		spdk_bdev_md_write_complete(update, false);
+	}
+}
+
+void
+spdk_bdev_md_writer_init(struct spdk_bdev_md_writer *writer, struct spdk_bdev *base,
+			 pthread_mutex_t *lock, const char *name)
+{
+	writer->base = base;
+	writer->lock = lock;
+	writer->name = name;
+	TAILQ_INIT(&writer->updates);
+	TAILQ_INIT(&writer->free_updates);
+}
+
+/* Release the write buffers.  No write may be in flight any more. */
+void
+spdk_bdev_md_writer_fini(struct spdk_bdev_md_writer *writer)
+{
+	struct spdk_bdev_md_update *update;
+
+	while ((update = TAILQ_FIRST(&writer->updates)) != NULL) {
+		TAILQ_REMOVE(&writer->updates, update, link);
+		TAILQ_INSERT_TAIL(&writer->free_updates, update, link);
+	}
+	while ((update = TAILQ_FIRST(&writer->free_updates)) != NULL) {
+		TAILQ_REMOVE(&writer->free_updates, update, link);
+		rte_free(update->buf);
+		free(update);
+	}
+}
+
+/*
+ * Write the metadata block whose in-memory copy is src, already changed by
+ *  the caller, and call waiter->cb once a write that includes the change
+ *  has completed.  Called without the writer's lock.
+ */
+void
+spdk_bdev_md_commit(struct spdk_bdev_md_writer *writer, uint64_t block, void *src,
+		    struct spdk_bdev_md_waiter *waiter)
+{
+	struct spdk_bdev_md_update *update;
+	uint32_t blocklen = writer->base->blocklen;
+
+	pthread_mutex_lock(writer->lock);
+
+	TAILQ_FOREACH(update, &writer->updates, link) {
+		if (update->block == block) {
+			/* The write in flight may predate the change. */
+			TAILQ_INSERT_TAIL(&update->next, waiter, link);
+			pthread_mutex_unlock(writer->lock);
+			return;
+		}
+	}
+
+	update = TAILQ_FIRST(&writer->free_updates);
+	if (update != NULL) {
+		TAILQ_REMOVE(&writer->free_updates, update, link);
+	} else {
+		update = calloc(1, sizeof(*update));
+		if (update != NULL) {
+			update->buf = rte_malloc(NULL, blocklen, blocklen);
+			if (update->buf == NULL) {
+				free(update);
+				update = NULL;
+			}
+		}
+		if (update == NULL) {
+			pthread_mutex_unlock(writer->lock);
+			SPDK_ERRLOG("%s: could not allocate metadata update\n", writer->name);
+			waiter->cb(waiter, false);
+			return;
+		}
+	}
+
+	update->writer = writer;
+	update->block = block;
+	update->src = src;
+	TAILQ_INIT(&update->writing);
+	TAILQ_INIT(&update->next);
+	TAILQ_INSERT_TAIL(&update->writing, waiter, link);
+	memcpy(update->buf, src, blocklen);
+	TAILQ_INSERT_TAIL(&writer->updates, update, link);
+
+	pthread_mutex_unlock(writer->lock);
+
+	spdk_bdev_md_write(update);
+}
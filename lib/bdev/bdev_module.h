@@ -40,6 +40,7 @@
 #define SPDK_BDEV_MODULE_H_
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stddef.h>  /* for offsetof */
 #include <sys/uio.h> /* for struct iovec */
@@ -82,6 +83,21 @@ The backend initialization routine also need to create "disks". A virtual
 representation of each LUN must be constructed. Mainly a struct spdk_bdev
 must be passed to the bdev database via spdk_bdev_register().
 
+I/O is handed to the backend on the lcore that submitted it, together with
+that lcore's struct spdk_bdev_channel.  Backends that need per-lcore queues
+(e.g. one NVMe queue pair per lcore) should implement create_channel and
+destroy_channel; the context they set up is available as bdev_io->ch->ctx in
+submit_request and as ch->ctx in check_io.  Backends whose I/O can still be
+outstanding when the bdev is unregistered should implement channel_busy, so
+that the channel is drained before destroy_channel is called.
+
+Backends that can expose buffers for writes to be filled in place report
+SPDK_BDEV_IO_TYPE_ZCOPY as supported.  A ZCOPY bdev_io is submitted twice:
+first with u.zcopy.start set, when the backend fills in u.zcopy.iovs/iovcnt
+with its own buffers for the range and completes it, and then with start
+cleared, when the backend writes the data (or drops it if u.zcopy.commit is
+false), releases the buffers and completes it again.
+
 */
 
 /** Block device module */
@@ -130,6 +146,79 @@ struct spdk_bdev_io *spdk_bdev_get_child_io(struct spdk_bdev_io *parent,
 		void *cb_arg);
 void spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io,
 			   enum spdk_bdev_io_status status);
+
+/**
+ * Pieces of a parent's iovecs handed to child I/Os whose range spans more than
+ *  one parent iovec.  Start zeroed in the parent's driver_ctx and release with
+ *  spdk_bdev_iov_slices_free() once every child has completed.
+ */
+struct spdk_bdev_iov_slices {
+	struct iovec	*iovs;
+	int		count;
+	int		max;
+
+	/** Parent iovec the previous slice ended in, and its byte offset in the parent */
+	int		idx;
+	uint64_t	idx_offset;
+};
+
+int spdk_bdev_io_slice_parent_iovs(struct spdk_bdev_io *child,
+				   struct spdk_bdev_iov_slices *slices,
+				   uint64_t offset, uint64_t len, int max_children);
+void spdk_bdev_iov_slices_free(struct spdk_bdev_iov_slices *slices);
+
+void spdk_bdev_copy_from_iovs(void *buf, struct iovec *iovs, int iovcnt, uint64_t offset,
+			      uint64_t len);
+void spdk_bdev_copy_to_iovs(struct iovec *iovs, int iovcnt, uint64_t offset, const void *buf,
+			    uint64_t len);
+
+/*
+ * A wait for one metadata block to reach the base blockdev.  Embedded in the
+ *  operation that changed the block; cb may run on any lcore.
+ */
+struct spdk_bdev_md_waiter {
+	void					(*cb)(struct spdk_bdev_md_waiter *waiter, bool success);
+	TAILQ_ENTRY(spdk_bdev_md_waiter)	link;
+};
+
+TAILQ_HEAD(spdk_bdev_md_waiters, spdk_bdev_md_waiter);
+
+/*
+ * Write of one metadata block.  Writes of the same block are never in flight
+ *  together, since the base may complete them in any order: changes made
+ *  meanwhile wait on next and go out in one more write when this one ends.
+ */
+struct spdk_bdev_md_update {
+	struct spdk_bdev_md_writer		*writer;
+	uint64_t				block;
+
+	/** In-memory copy of the block, and the snapshot of it being written */
+	void					*src;
+	void					*buf;
+
+	struct spdk_bdev_md_waiters		writing;
+	struct spdk_bdev_md_waiters		next;
+
+	TAILQ_ENTRY(spdk_bdev_md_update)	link;
+};
+
+/* Metadata blocks of one virtual blockdev, written to its base a block at a time. */
+struct spdk_bdev_md_writer {
+	struct spdk_bdev			*base;
+
+	/** The owner's lock, under which the in-memory blocks are changed */
+	pthread_mutex_t				*lock;
+	const char				*name;
+
+	TAILQ_HEAD(, spdk_bdev_md_update)	updates;
+	TAILQ_HEAD(, spdk_bdev_md_update)	free_updates;
+};
+
+void spdk_bdev_md_writer_init(struct spdk_bdev_md_writer *writer, struct spdk_bdev *base,
+			      pthread_mutex_t *lock, const char *name);
+void spdk_bdev_md_writer_fini(struct spdk_bdev_md_writer *writer);
+void spdk_bdev_md_commit(struct spdk_bdev_md_writer *writer, uint64_t block, void *src,
+			 struct spdk_bdev_md_waiter *waiter);
 void spdk_bdev_module_list_add(struct spdk_bdev_module_if *bdev_module);
 void spdk_vbdev_module_list_add(struct spdk_bdev_module_if *vbdev_module);
 
@@ -0,0 +1,1522 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Compressing virtual blockdev.  The disk is divided into fixed-size chunks,
+ *  each compressed on its own by a codec and stored in as few units of its
+ *  base blockdev as it needs.  A map from chunks to units is kept in memory
+ *  and on the base, and a bit array tracks which units are in use.  Writes
+ *  never overwrite a chunk in place: the new data goes to free units, and
+ *  the old ones are released once the map points to the new ones.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mempool.h>
+
+#include "blockdev_compress.h"
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/endian.h"
+#include "spdk/event.h"
+#include "spdk/log.h"
+#include "spdk/scsi_spec.h"
+
+/* Alignment of the scratch buffers, enough for any base blockdev */
+#define COMP_BUF_ALIGN		4096
+
+static TAILQ_HEAD(, comp_disk) g_comp_disks = TAILQ_HEAD_INITIALIZER(g_comp_disks);
+static TAILQ_HEAD(, comp_codec) g_comp_codecs = TAILQ_HEAD_INITIALIZER(g_comp_codecs);
+
+/* Mempools cannot be freed, so a pool stays for later disks of the same chunk size. */
+static TAILQ_HEAD(, comp_scratch_pool) g_scratch_pools = TAILQ_HEAD_INITIALIZER(g_scratch_pools);
+
+static int blockdev_compress_initialize(void);
+static void blockdev_compress_finish(void);
+static void blockdev_compress_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_compress_get_ctx_size(void)
+{
+	return sizeof(struct comp_task);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_compress_initialize, blockdev_compress_finish,
+			   blockdev_compress_get_spdk_running_config, blockdev_compress_get_ctx_size)
+
+static void comp_task_issue(struct comp_task *task);
+static void comp_op_run(struct comp_op *op);
+
+void
+spdk_comp_codec_register(struct comp_codec *codec)
+{
+	TAILQ_INSERT_TAIL(&g_comp_codecs, codec, link);
+}
+
+struct comp_codec *
+spdk_comp_codec_get_by_name(const char *name)
+{
+	struct comp_codec *codec;
+
+	TAILQ_FOREACH(codec, &g_comp_codecs, link) {
+		if (strcmp(codec->name, name) == 0) {
+			return codec;
+		}
+	}
+
+	return NULL;
+}
+
+static inline struct comp_entry *
+comp_entry(struct comp_disk *cdisk, uint64_t chunk)
+{
+	return (struct comp_entry *)((char *)cdisk->map + chunk * cdisk->entry_size);
+}
+
+/* Bytes of an entry that are stored; the rest of units[] is never used. */
+static inline size_t
+comp_entry_len(struct comp_disk *cdisk)
+{
+	return offsetof(struct comp_entry, units) + cdisk->units_per_chunk * sizeof(uint32_t);
+}
+
+static inline uint32_t
+comp_entries_per_block(struct comp_disk *cdisk)
+{
+	return cdisk->blocklen / cdisk->entry_size;
+}
+
+/* Map block holding the entry of a chunk, and its in-memory copy. */
+static uint64_t
+comp_entry_block(struct comp_disk *cdisk, uint64_t chunk, void **src)
+{
+	uint64_t index = chunk / comp_entries_per_block(cdisk);
+
+	*src = (char *)cdisk->map + index * cdisk->blocklen;
+	return 1 + index;
+}
+
+static uint32_t
+comp_md_units(struct comp_disk *cdisk, uint64_t num_chunks)
+{
+	uint64_t map_blocks = (num_chunks + comp_entries_per_block(cdisk) - 1) /
+			      comp_entries_per_block(cdisk);
+
+	return ((1 + map_blocks) * cdisk->blocklen + cdisk->unit_size - 1) / cdisk->unit_size;
+}
+
+/*
+ * Compute the geometry of a disk with the given chunk size on its base.
+ *  A size of 0 makes the disk as large as the base holds uncompressed;
+ *  a larger size counts on the data to compress.  Returns -1 if the chunk
+ *  size is not supported or leaves no room for data.
+ */
+static int
+comp_disk_geometry(struct comp_disk *cdisk, uint32_t chunk_size, uint64_t size)
+{
+	uint64_t total_units, num_chunks, md_units, excess;
+	uint32_t units_per_chunk;
+
+	if (chunk_size < cdisk->unit_size || chunk_size > COMP_MAX_CHUNK_SIZE ||
+	    (chunk_size & (chunk_size - 1)) != 0) {
+		return -1;
+	}
+
+	total_units = cdisk->base->blockcnt * cdisk->blocklen / cdisk->unit_size;
+	if (total_units >= UINT32_MAX) {
+		return -1;
+	}
+
+	units_per_chunk = chunk_size / cdisk->unit_size;
+	cdisk->units_per_chunk = units_per_chunk;
+	cdisk->entry_size = 1;
+	while (cdisk->entry_size < comp_entry_len(cdisk)) {
+		cdisk->entry_size <<= 1;
+	}
+
+	if (size != 0) {
+		num_chunks = size / chunk_size;
+	} else {
+		num_chunks = total_units / units_per_chunk;
+		while (num_chunks > 0) {
+			md_units = comp_md_units(cdisk, num_chunks);
+			if (md_units + num_chunks * units_per_chunk <= total_units) {
+				break;
+			}
+			excess = md_units + num_chunks * units_per_chunk - total_units;
+			excess = (excess + units_per_chunk - 1) / units_per_chunk;
+			num_chunks = excess < num_chunks ? num_chunks - excess : 0;
+		}
+	}
+
+	if (num_chunks == 0) {
+		return -1;
+	}
+
+	md_units = comp_md_units(cdisk, num_chunks);
+	if (md_units + units_per_chunk > total_units) {
+		return -1;
+	}
+
+	cdisk->chunk_size = chunk_size;
+	cdisk->num_chunks = num_chunks;
+	cdisk->map_blocks = (num_chunks + comp_entries_per_block(cdisk) - 1) /
+			    comp_entries_per_block(cdisk);
+	cdisk->md_units = md_units;
+	cdisk->total_units = total_units;
+
+	return 0;
+}
+
+/*
+ * Scratch pools.
+ */
+
+static void
+comp_scratch_init(struct rte_mempool *mp, void *arg, void *obj, unsigned idx)
+{
+	struct comp_scratch_pool *pool = arg;
+	struct comp_op *op = obj;
+	uintptr_t buf = (uintptr_t)(op + 1);
+
+	buf = (buf + COMP_BUF_ALIGN - 1) & ~((uintptr_t)COMP_BUF_ALIGN - 1);
+	op->bufs.chunk = (void *)buf;
+	op->bufs.comp = (char *)op->bufs.chunk + pool->chunk_size;
+	op->bufs.work = (char *)op->bufs.comp + pool->chunk_size;
+}
+
+static struct comp_scratch_pool *
+comp_scratch_pool_get(uint32_t chunk_size)
+{
+	struct comp_scratch_pool *pool;
+	struct comp_codec *codec;
+	char name[32];
+	uint32_t work_size = 0;
+	int cache_size;
+
+	TAILQ_FOREACH(pool, &g_scratch_pools, link) {
+		if (pool->chunk_size == chunk_size) {
+			return pool;
+		}
+	}
+
+	TAILQ_FOREACH(codec, &g_comp_codecs, link) {
+		if (codec->work_size > work_size) {
+			work_size = codec->work_size;
+		}
+	}
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		SPDK_ERRLOG("could not allocate scratch pool\n");
+		return NULL;
+	}
+
+	pool->chunk_size = chunk_size;
+	pthread_mutex_init(&pool->lock, NULL);
+	TAILQ_INIT(&pool->waiting);
+
+	/* As for the rbuf pools, keep no more than half of the buffers in lcore caches. */
+	cache_size = COMP_SCRATCH_COUNT / (2 * spdk_app_get_core_count());
+	if (cache_size > RTE_MEMPOOL_CACHE_MAX_SIZE) {
+		cache_size = RTE_MEMPOOL_CACHE_MAX_SIZE;
+	}
+
+	snprintf(name, sizeof(name), "comp_scratch_%u", chunk_size / 1024);
+	pool->mp = rte_mempool_create(name, COMP_SCRATCH_COUNT,
+				      sizeof(struct comp_op) + COMP_BUF_ALIGN + 2 * chunk_size + work_size,
+				      cache_size, 0, NULL, NULL, comp_scratch_init, pool,
+				      SOCKET_ID_ANY, 0);
+	if (pool->mp == NULL) {
+		SPDK_ERRLOG("could not create scratch pool for %u KiB chunks\n", chunk_size / 1024);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+
+	TAILQ_INSERT_TAIL(&g_scratch_pools, pool, link);
+
+	return pool;
+}
+
+/*
+ * Take an operation for the task, or queue the task on the pool if it is
+ *  empty.  Gets only take the lock when the pool looks empty; the waiter is
+ *  queued before the pool is tried again, and comp_op_put() checks for
+ *  waiters after its put, so one of the two always sees the other.
+ */
+static struct comp_op *
+comp_op_get(struct comp_disk *cdisk, struct comp_task *task)
+{
+	struct comp_scratch_pool *pool = cdisk->scratch;
+	struct comp_bufs bufs;
+	struct comp_op *op;
+	void *obj;
+
+	if (rte_mempool_get(pool->mp, &obj) != 0) {
+		pthread_mutex_lock(&pool->lock);
+		TAILQ_INSERT_TAIL(&pool->waiting, task, link);
+		__sync_synchronize();
+		if (rte_mempool_get(pool->mp, &obj) != 0) {
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		TAILQ_REMOVE(&pool->waiting, task, link);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	op = obj;
+	bufs = op->bufs;
+	memset(op, 0, sizeof(*op));
+	op->bufs = bufs;
+	op->cdisk = cdisk;
+	op->task = task;
+	TAILQ_INIT(&op->waiters);
+
+	return op;
+}
+
+static void
+comp_op_put(struct comp_op *op)
+{
+	struct comp_scratch_pool *pool = op->cdisk->scratch;
+	struct comp_task *task;
+
+	rte_mempool_put(pool->mp, op);
+	__sync_synchronize();
+
+	if (TAILQ_EMPTY(&pool->waiting)) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	task = TAILQ_FIRST(&pool->waiting);
+	if (task != NULL) {
+		TAILQ_REMOVE(&pool->waiting, task, link);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (task != NULL) {
+		comp_task_issue(task);
+	}
+}
+
+/*
+ * Units.  Called with the lock held.
+ */
+
+static int
+comp_alloc_units(struct comp_disk *cdisk, struct comp_entry *entry, uint32_t num_units)
+{
+	uint32_t i, unit;
+
+	if (cdisk->free_units < num_units) {
+		return -1;
+	}
+
+	for (i = 0; i < num_units; i++) {
+		unit = spdk_bit_array_find_first_clear(cdisk->used, cdisk->alloc_hint);
+		if (unit >= cdisk->total_units) {
+			unit = spdk_bit_array_find_first_clear(cdisk->used, cdisk->md_units);
+		}
+		assert(unit < cdisk->total_units);
+		spdk_bit_array_set(cdisk->used, unit);
+		cdisk->alloc_hint = unit + 1;
+		entry->units[i] = unit;
+	}
+
+	entry->num_units = num_units;
+	cdisk->free_units -= num_units;
+
+	return 0;
+}
+
+static void
+comp_free_units(struct comp_disk *cdisk, struct comp_entry *entry)
+{
+	uint32_t i;
+
+	for (i = 0; i < entry->num_units; i++) {
+		spdk_bit_array_clear(cdisk->used, entry->units[i]);
+	}
+
+	cdisk->free_units += entry->num_units;
+}
+
+/*
+ * I/O path.
+ */
+
+static void
+comp_task_put(struct comp_task *task, bool failed)
+{
+	if (failed) {
+		task->failed = true;
+	}
+
+	/* Operations of one I/O may complete on different lcores. */
+	if (__sync_sub_and_fetch(&task->outstanding, 1) > 0) {
+		return;
+	}
+
+	spdk_bdev_io_complete(task->bdev_io, task->failed ? SPDK_BDEV_IO_STATUS_FAILED :
+			      SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+static bool
+comp_is_zero(const void *buf, uint32_t len)
+{
+	const uint64_t *p = buf;
+	uint32_t i;
+
+	for (i = 0; i < len / sizeof(uint64_t); i++) {
+		if (p[i] != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Take the op's chunk, or queue the op on the operation that holds it.
+ *  Called with the lock held.
+ */
+static bool
+comp_op_lock(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct comp_op *holder;
+
+	TAILQ_FOREACH(holder, &cdisk->ops, link) {
+		if (holder->chunk == op->chunk) {
+			TAILQ_INSERT_TAIL(&holder->waiters, op, link);
+			return false;
+		}
+	}
+
+	TAILQ_INSERT_TAIL(&cdisk->ops, op, link);
+	return true;
+}
+
+/* Release the op's chunk; returns the waiting operation it passed to. Called with the lock held. */
+static struct comp_op *
+comp_op_unlock(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct comp_op *next;
+
+	TAILQ_REMOVE(&cdisk->ops, op, link);
+
+	next = TAILQ_FIRST(&op->waiters);
+	if (next != NULL) {
+		TAILQ_REMOVE(&op->waiters, next, link);
+		TAILQ_CONCAT(&next->waiters, &op->waiters, link);
+		TAILQ_INSERT_TAIL(&cdisk->ops, next, link);
+	}
+
+	return next;
+}
+
+static void
+comp_op_finish(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct comp_task *task = op->task;
+	bool failed = op->failed;
+	struct comp_op *next;
+
+	pthread_mutex_lock(&cdisk->lock);
+	next = comp_op_unlock(op);
+	pthread_mutex_unlock(&cdisk->lock);
+
+	comp_op_put(op);
+
+	if (next != NULL) {
+		comp_op_run(next);
+	}
+
+	comp_task_put(task, failed);
+}
+
+static void
+comp_op_io_put(struct comp_op *op, bool failed)
+{
+	if (failed) {
+		op->failed = true;
+	}
+
+	if (__sync_sub_and_fetch(&op->outstanding, 1) == 0) {
+		op->io_done(op);
+	}
+}
+
+static void
+comp_op_child_done(spdk_event_t event)
+{
+	struct comp_op *op = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	/* Children are released together with the parent in spdk_bdev_free_io(). */
+	comp_op_io_put(op, child->status != SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+/*
+ * Read or write the units of entry from or to buf, one child I/O per run of
+ *  consecutive units, and call io_done once they all complete.
+ */
+static void
+comp_op_io(struct comp_op *op, enum spdk_bdev_io_type type, struct comp_entry *entry, void *buf,
+	   void (*io_done)(struct comp_op *op))
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct spdk_bdev_io *child;
+	uint32_t i, n;
+	uint64_t offset, len;
+
+	op->io_done = io_done;
+	op->outstanding = 1;
+
+	for (i = 0; i < entry->num_units; i += n) {
+		for (n = 1; i + n < entry->num_units; n++) {
+			if (entry->units[i + n] != entry->units[i] + n) {
+				break;
+			}
+		}
+
+		__sync_add_and_fetch(&op->outstanding, 1);
+
+		child = spdk_bdev_get_child_io(op->task->bdev_io, cdisk->base, comp_op_child_done, op);
+		if (child == NULL) {
+			comp_op_io_put(op, true);
+			continue;
+		}
+
+		offset = (uint64_t)entry->units[i] * cdisk->unit_size;
+		len = (uint64_t)n * cdisk->unit_size;
+
+		child->type = type;
+		if (type == SPDK_BDEV_IO_TYPE_READ) {
+			child->u.read.buf_unaligned = NULL;
+			child->u.read.iov.iov_base = (char *)buf + (uint64_t)i * cdisk->unit_size;
+			child->u.read.iov.iov_len = len;
+			child->u.read.iovs = &child->u.read.iov;
+			child->u.read.iovcnt = 1;
+			child->u.read.len = len;
+			child->u.read.offset = offset;
+			child->u.read.put_rbuf = false;
+		} else {
+			child->u.write.iov.iov_base = (char *)buf + (uint64_t)i * cdisk->unit_size;
+			child->u.write.iov.iov_len = len;
+			child->u.write.iovs = &child->u.write.iov;
+			child->u.write.iovcnt = 1;
+			child->u.write.len = len;
+			child->u.write.offset = offset;
+		}
+
+		if (spdk_bdev_io_submit(child) != 0) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			comp_op_io_put(op, true);
+		}
+	}
+
+	comp_op_io_put(op, false);
+}
+
+static void
+comp_op_md_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct comp_op *op = (struct comp_op *)((char *)waiter - offsetof(struct comp_op, md));
+	struct comp_disk *cdisk = op->cdisk;
+
+	pthread_mutex_lock(&cdisk->lock);
+	if (success) {
+		comp_free_units(cdisk, &op->old);
+	} else {
+		/* The entry on disk may still point to the old units, so they stay in use. */
+		op->failed = true;
+	}
+	pthread_mutex_unlock(&cdisk->lock);
+
+	comp_op_finish(op);
+}
+
+/* Point the chunk's entry to the new units, and write it out. */
+static void
+comp_op_update(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	uint64_t block;
+	void *src;
+
+	if (op->old.num_units == 0 && op->new.num_units == 0) {
+		pthread_mutex_lock(&cdisk->lock);
+		cdisk->stats.chunks_zero++;
+		pthread_mutex_unlock(&cdisk->lock);
+		comp_op_finish(op);
+		return;
+	}
+
+	block = comp_entry_block(cdisk, op->chunk, &src);
+
+	pthread_mutex_lock(&cdisk->lock);
+	memcpy(comp_entry(cdisk, op->chunk), &op->new, comp_entry_len(cdisk));
+	if (op->old.num_units == 0) {
+		cdisk->allocated_chunks++;
+	} else if (op->new.num_units == 0) {
+		cdisk->allocated_chunks--;
+	}
+	if (op->new.num_units == 0) {
+		cdisk->stats.chunks_zero++;
+	} else {
+		cdisk->stats.chunks_written++;
+		cdisk->stats.bytes_in += cdisk->chunk_size;
+		cdisk->stats.bytes_out += (uint64_t)op->new.num_units * cdisk->unit_size;
+		if (op->new.flags & COMP_ENTRY_RAW) {
+			cdisk->stats.chunks_raw++;
+		}
+	}
+	pthread_mutex_unlock(&cdisk->lock);
+
+	op->md.cb = comp_op_md_done;
+	spdk_bdev_md_commit(&cdisk->md_writer, block, src, &op->md);
+}
+
+static void
+comp_op_written(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+
+	if (op->failed) {
+		pthread_mutex_lock(&cdisk->lock);
+		comp_free_units(cdisk, &op->new);
+		pthread_mutex_unlock(&cdisk->lock);
+		comp_op_finish(op);
+		return;
+	}
+
+	comp_op_update(op);
+}
+
+/* Compress the whole chunk, now in bufs.chunk, and write it to new units. */
+static void
+comp_op_store(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	uint32_t comp_len, num_units;
+	void *buf;
+	int rc;
+
+	if (comp_is_zero(op->bufs.chunk, cdisk->chunk_size)) {
+		comp_op_update(op);
+		return;
+	}
+
+	/* Compressing is only worth it if it saves a unit. */
+	comp_len = cdisk->codec->compress(op->bufs.work, op->bufs.chunk, cdisk->chunk_size,
+					  op->bufs.comp, cdisk->chunk_size - cdisk->unit_size);
+	if (comp_len == 0) {
+		op->new.flags = COMP_ENTRY_RAW;
+		op->new.comp_len = cdisk->chunk_size;
+		buf = op->bufs.chunk;
+	} else {
+		op->new.comp_len = comp_len;
+		buf = op->bufs.comp;
+	}
+
+	num_units = (op->new.comp_len + cdisk->unit_size - 1) / cdisk->unit_size;
+	memset((char *)buf + op->new.comp_len, 0,
+	       (uint64_t)num_units * cdisk->unit_size - op->new.comp_len);
+
+	pthread_mutex_lock(&cdisk->lock);
+	rc = comp_alloc_units(cdisk, &op->new, num_units);
+	pthread_mutex_unlock(&cdisk->lock);
+
+	if (rc != 0) {
+		SPDK_ERRLOG("%s: no free units left for chunk %" PRIu64 "\n", cdisk->disk.name,
+			    op->chunk);
+		op->failed = true;
+		comp_op_finish(op);
+		return;
+	}
+
+	comp_op_io(op, SPDK_BDEV_IO_TYPE_WRITE, &op->new, buf, comp_op_written);
+}
+
+/* Lay the op's data, or zeroes, over the chunk. */
+static void
+comp_op_fill(struct comp_op *op)
+{
+	struct spdk_bdev_io *bdev_io = op->task->bdev_io;
+	char *dst = (char *)op->bufs.chunk + op->in;
+
+	if (op->zero) {
+		memset(dst, 0, op->len);
+	} else {
+		spdk_bdev_copy_from_iovs(dst, bdev_io->u.write.iovs, bdev_io->u.write.iovcnt,
+				    op->io_offset, op->len);
+	}
+}
+
+static void
+comp_op_read_done(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct spdk_bdev_io *bdev_io = op->task->bdev_io;
+	int len;
+
+	if (op->failed) {
+		comp_op_finish(op);
+		return;
+	}
+
+	if (!(op->old.flags & COMP_ENTRY_RAW)) {
+		len = cdisk->codec->decompress(op->bufs.comp, op->old.comp_len, op->bufs.chunk,
+					       cdisk->chunk_size);
+		if (len != (int)cdisk->chunk_size) {
+			SPDK_ERRLOG("%s: chunk %" PRIu64 " does not decompress\n", cdisk->disk.name,
+				    op->chunk);
+			op->failed = true;
+			comp_op_finish(op);
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&cdisk->lock);
+	cdisk->stats.chunks_read++;
+	if (bdev_io->type != SPDK_BDEV_IO_TYPE_READ) {
+		cdisk->stats.partial_writes++;
+	}
+	pthread_mutex_unlock(&cdisk->lock);
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+		spdk_bdev_copy_to_iovs(bdev_io->u.read.iovs, bdev_io->u.read.iovcnt, op->io_offset,
+				  (char *)op->bufs.chunk + op->in, op->len);
+		comp_op_finish(op);
+		return;
+	}
+
+	comp_op_fill(op);
+	comp_op_store(op);
+}
+
+/* Run an operation that holds its chunk. */
+static void
+comp_op_run(struct comp_op *op)
+{
+	struct comp_disk *cdisk = op->cdisk;
+	struct spdk_bdev_io *bdev_io = op->task->bdev_io;
+	void *buf;
+
+	pthread_mutex_lock(&cdisk->lock);
+	memcpy(&op->old, comp_entry(cdisk, op->chunk), comp_entry_len(cdisk));
+	pthread_mutex_unlock(&cdisk->lock);
+
+	if (op->old.num_units == 0) {
+		if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+			spdk_bdev_copy_to_iovs(bdev_io->u.read.iovs, bdev_io->u.read.iovcnt,
+					  op->io_offset, NULL, op->len);
+			comp_op_finish(op);
+			return;
+		}
+		memset(op->bufs.chunk, 0, cdisk->chunk_size);
+		comp_op_fill(op);
+		comp_op_store(op);
+		return;
+	}
+
+	if (bdev_io->type != SPDK_BDEV_IO_TYPE_READ && op->len == cdisk->chunk_size) {
+		comp_op_fill(op);
+		comp_op_store(op);
+		return;
+	}
+
+	/* A chunk stored as it is can be read straight into place. */
+	buf = (op->old.flags & COMP_ENTRY_RAW) ? op->bufs.chunk : op->bufs.comp;
+	comp_op_io(op, SPDK_BDEV_IO_TYPE_READ, &op->old, buf, comp_op_read_done);
+}
+
+/* Find the next range of the task to start an operation for; false once there is none. */
+static bool
+comp_task_next_range(struct comp_task *task)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct spdk_scsi_unmap_bdesc *desc;
+
+	while (task->offset == task->end) {
+		if (bdev_io->type != SPDK_BDEV_IO_TYPE_UNMAP ||
+		    task->bdesc == bdev_io->u.unmap.bdesc_count) {
+			return false;
+		}
+		desc = &bdev_io->u.unmap.unmap_bdesc[task->bdesc++];
+		task->offset = from_be64(&desc->lba) * bdev_io->bdev->blocklen;
+		task->end = task->offset + (uint64_t)from_be32(&desc->block_count) *
+			    bdev_io->bdev->blocklen;
+	}
+
+	return true;
+}
+
+/*
+ * Start an operation for each chunk the task touches.  If the scratch pool
+ *  runs dry, the task waits and continues from where it stopped.
+ */
+static void
+comp_task_issue(struct comp_task *task)
+{
+	struct comp_disk *cdisk = task->bdev_io->ctx;
+	struct comp_op *op;
+	uint64_t len;
+	bool locked;
+
+	while (comp_task_next_range(task)) {
+		op = comp_op_get(cdisk, task);
+		if (op == NULL) {
+			return;
+		}
+
+		op->chunk = task->offset / cdisk->chunk_size;
+		op->in = task->offset % cdisk->chunk_size;
+		len = cdisk->chunk_size - op->in;
+		if (len > task->end - task->offset) {
+			len = task->end - task->offset;
+		}
+		op->len = len;
+		op->io_offset = task->io_offset;
+		op->zero = task->bdev_io->type == SPDK_BDEV_IO_TYPE_UNMAP;
+
+		task->offset += len;
+		task->io_offset += len;
+		__sync_add_and_fetch(&task->outstanding, 1);
+
+		pthread_mutex_lock(&cdisk->lock);
+		locked = comp_op_lock(op);
+		pthread_mutex_unlock(&cdisk->lock);
+
+		if (locked) {
+			comp_op_run(op);
+		}
+	}
+
+	/* Drop the reference held while starting operations. */
+	comp_task_put(task, false);
+}
+
+static void
+comp_passthru_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+comp_submit_passthru(struct spdk_bdev_io *bdev_io)
+{
+	struct comp_disk *cdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, cdisk->base, comp_passthru_done, bdev_io);
+	if (child == NULL) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (child->type == SPDK_BDEV_IO_TYPE_FLUSH) {
+		child->u.flush.offset = 0;
+		child->u.flush.length = cdisk->base->blockcnt * cdisk->base->blocklen;
+	}
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+/* Queue I/O while the disk loads, fail it if the disk is unusable, or start it. */
+static void
+comp_submit(struct comp_task *task)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct comp_disk *cdisk = bdev_io->ctx;
+	enum comp_disk_state state;
+
+	pthread_mutex_lock(&cdisk->lock);
+	state = cdisk->state;
+	if (state == COMP_LOADING) {
+		TAILQ_INSERT_TAIL(&cdisk->waiting, task, link);
+	}
+	pthread_mutex_unlock(&cdisk->lock);
+
+	if (state == COMP_LOADING) {
+		return;
+	}
+
+	if (state != COMP_ONLINE) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		comp_submit_passthru(bdev_io);
+		break;
+	default:
+		comp_task_issue(task);
+		break;
+	}
+}
+
+static void
+comp_submit_rw(struct spdk_bdev_io *bdev_io)
+{
+	struct comp_task *task = (struct comp_task *)bdev_io->driver_ctx;
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+		task->offset = bdev_io->u.read.offset;
+		task->end = task->offset + bdev_io->u.read.len;
+	} else {
+		task->offset = bdev_io->u.write.offset;
+		task->end = task->offset + bdev_io->u.write.len;
+	}
+
+	comp_submit(task);
+}
+
+static void
+blockdev_compress_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct comp_disk *cdisk = bdev_io->ctx;
+	struct comp_task *task = (struct comp_task *)bdev_io->driver_ctx;
+	struct spdk_scsi_unmap_bdesc *desc;
+	uint16_t i;
+
+	memset(task, 0, sizeof(*task));
+	task->bdev_io = bdev_io;
+	task->outstanding = 1;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		spdk_bdev_io_get_rbuf(bdev_io, comp_submit_rw);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		comp_submit_rw(bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		if (bdev_io->u.unmap.bdesc_count > COMP_MAX_UNMAP_BDESC) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+			desc = &bdev_io->u.unmap.unmap_bdesc[i];
+			if (from_be64(&desc->lba) + from_be32(&desc->block_count) > cdisk->disk.blockcnt) {
+				break;
+			}
+		}
+		if (i < bdev_io->u.unmap.bdesc_count) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		comp_submit(task);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		comp_submit(task);
+		break;
+	default:
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+blockdev_compress_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	struct comp_disk *cdisk = (struct comp_disk *)bdev;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		return true;
+
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return spdk_bdev_io_type_supported(cdisk->base, io_type);
+
+	default:
+		return false;
+	}
+}
+
+static void
+comp_free_disk(struct comp_disk *cdisk)
+{
+	spdk_bdev_md_writer_fini(&cdisk->md_writer);
+
+	cdisk->base->claimed = false;
+
+	pthread_mutex_destroy(&cdisk->lock);
+	spdk_bit_array_free(&cdisk->used);
+	rte_free(cdisk->super_buf);
+	rte_free(cdisk->map);
+	free(cdisk);
+}
+
+static int
+blockdev_compress_destruct(struct spdk_bdev *bdev)
+{
+	struct comp_disk *cdisk = (struct comp_disk *)bdev;
+
+	TAILQ_REMOVE(&g_comp_disks, cdisk, link);
+	comp_free_disk(cdisk);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table comp_fn_table = {
+	.destruct		= blockdev_compress_destruct,
+	.submit_request		= blockdev_compress_submit_request,
+	.io_type_supported	= blockdev_compress_io_type_supported,
+};
+
+/*
+ * Loading a disk.  The superblock is read (a missing one formats the disk),
+ *  then the map, from which the units in use are found.
+ */
+
+static void
+comp_load_done(struct comp_disk *cdisk, bool success)
+{
+	TAILQ_HEAD(, comp_task) resume;
+	struct comp_task *task;
+
+	TAILQ_INIT(&resume);
+
+	pthread_mutex_lock(&cdisk->lock);
+	cdisk->state = success ? COMP_ONLINE : COMP_FAILED;
+	TAILQ_SWAP(&resume, &cdisk->waiting, comp_task, link);
+	pthread_mutex_unlock(&cdisk->lock);
+
+	if (success) {
+		SPDK_NOTICELOG("%s: %" PRIu64 " of %" PRIu64 " chunks of %u KiB in use, "
+			       "%u of %u units free on %s\n", cdisk->disk.name,
+			       cdisk->allocated_chunks, cdisk->num_chunks, cdisk->chunk_size / 1024,
+			       cdisk->free_units, cdisk->total_units - cdisk->md_units,
+			       cdisk->base->name);
+	}
+
+	while ((task = TAILQ_FIRST(&resume)) != NULL) {
+		TAILQ_REMOVE(&resume, task, link);
+		comp_submit(task);
+	}
+}
+
+static bool
+comp_entry_valid(struct comp_disk *cdisk, struct comp_entry *entry)
+{
+	uint32_t i;
+
+	if (entry->num_units > cdisk->units_per_chunk ||
+	    entry->comp_len > (uint64_t)entry->num_units * cdisk->unit_size ||
+	    entry->comp_len <= (uint64_t)(entry->num_units - 1) * cdisk->unit_size) {
+		return false;
+	}
+
+	if ((entry->flags & COMP_ENTRY_RAW) && entry->comp_len != cdisk->chunk_size) {
+		return false;
+	}
+
+	for (i = 0; i < entry->num_units; i++) {
+		if (entry->units[i] < cdisk->md_units || entry->units[i] >= cdisk->total_units ||
+		    spdk_bit_array_get(cdisk->used, entry->units[i])) {
+			return false;
+		}
+		spdk_bit_array_set(cdisk->used, entry->units[i]);
+	}
+
+	return true;
+}
+
+static void
+comp_load_finish(struct comp_disk *cdisk)
+{
+	struct comp_entry *entry;
+	uint64_t chunk;
+	uint32_t i, used;
+
+	for (i = 0; i < cdisk->md_units; i++) {
+		spdk_bit_array_set(cdisk->used, i);
+	}
+	used = cdisk->md_units;
+
+	for (chunk = 0; chunk < cdisk->num_chunks; chunk++) {
+		entry = comp_entry(cdisk, chunk);
+		if (entry->num_units == 0 && entry->comp_len == 0) {
+			continue;
+		}
+		if (!comp_entry_valid(cdisk, entry)) {
+			SPDK_ERRLOG("%s: map entry of chunk %" PRIu64 " is corrupt\n", cdisk->disk.name,
+				    chunk);
+			comp_load_done(cdisk, false);
+			return;
+		}
+		used += entry->num_units;
+		cdisk->allocated_chunks++;
+	}
+
+	cdisk->free_units = cdisk->total_units - used;
+	cdisk->alloc_hint = cdisk->md_units;
+	comp_load_done(cdisk, true);
+}
+
+static void
+comp_load_map_done(spdk_event_t event)
+{
+	struct comp_disk *cdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read the map from %s\n", cdisk->disk.name,
+			    cdisk->base->name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	comp_load_finish(cdisk);
+}
+
+/* Allocate the in-memory metadata once the geometry is known. */
+static int
+comp_alloc_md(struct comp_disk *cdisk)
+{
+	cdisk->used = spdk_bit_array_create(cdisk->total_units);
+	cdisk->map = rte_zmalloc(NULL, (uint64_t)cdisk->map_blocks * cdisk->blocklen,
+				 cdisk->blocklen);
+
+	if (cdisk->used == NULL || cdisk->map == NULL) {
+		SPDK_ERRLOG("%s: could not allocate the map\n", cdisk->disk.name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+comp_format_super_done(spdk_event_t event)
+{
+	struct comp_disk *cdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not write the superblock\n", cdisk->disk.name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	comp_load_finish(cdisk);
+}
+
+static void
+comp_format_map_done(spdk_event_t event)
+{
+	struct comp_disk *cdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct comp_super *super = cdisk->super_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not clear the map\n", cdisk->disk.name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	/* The superblock goes last, so that an interrupted format is simply redone. */
+	memset(super, 0, cdisk->blocklen);
+	super->magic = COMP_SUPER_MAGIC;
+	super->version = COMP_VERSION;
+	super->blocklen = cdisk->blocklen;
+	super->base_blockcnt = cdisk->base->blockcnt;
+	snprintf(super->codec, sizeof(super->codec), "%s", cdisk->codec->name);
+	super->chunk_size = cdisk->chunk_size;
+	super->unit_size = cdisk->unit_size;
+	super->num_chunks = cdisk->num_chunks;
+	super->entry_size = cdisk->entry_size;
+	super->map_blocks = cdisk->map_blocks;
+	super->md_units = cdisk->md_units;
+	super->total_units = cdisk->total_units;
+
+	if (spdk_bdev_write(cdisk->base, super, 0, cdisk->blocklen, comp_format_super_done,
+			    cdisk) == NULL) {
+		comp_load_done(cdisk, false);
+	}
+}
+
+static void
+comp_format(struct comp_disk *cdisk)
+{
+	SPDK_NOTICELOG("%s: formatting %s\n", cdisk->disk.name, cdisk->base->name);
+
+	if (comp_alloc_md(cdisk) != 0) {
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	if (spdk_bdev_write(cdisk->base, cdisk->map, cdisk->blocklen,
+			    (uint64_t)cdisk->map_blocks * cdisk->blocklen, comp_format_map_done,
+			    cdisk) == NULL) {
+		comp_load_done(cdisk, false);
+	}
+}
+
+static void
+comp_load_super_done(spdk_event_t event)
+{
+	struct comp_disk *cdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct comp_super *super = cdisk->super_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+	char codec_name[COMP_CODEC_NAME_LEN + 1];
+	struct comp_codec *codec;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read the superblock from %s\n", cdisk->disk.name,
+			    cdisk->base->name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	if (super->magic != COMP_SUPER_MAGIC) {
+		comp_format(cdisk);
+		return;
+	}
+
+	/* The size of the blockdev is already known, so the geometry cannot change. */
+	if (super->version != COMP_VERSION || super->blocklen != cdisk->blocklen ||
+	    super->base_blockcnt != cdisk->base->blockcnt ||
+	    super->chunk_size != cdisk->chunk_size ||
+	    super->unit_size != cdisk->unit_size ||
+	    super->num_chunks != cdisk->num_chunks ||
+	    super->entry_size != cdisk->entry_size ||
+	    super->map_blocks != cdisk->map_blocks ||
+	    super->md_units != cdisk->md_units ||
+	    super->total_units != cdisk->total_units) {
+		SPDK_ERRLOG("%s: %s holds a compressed disk of a different geometry or version\n",
+			    cdisk->disk.name, cdisk->base->name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	snprintf(codec_name, sizeof(codec_name), "%.*s", COMP_CODEC_NAME_LEN, super->codec);
+	codec = spdk_comp_codec_get_by_name(codec_name);
+	if (codec == NULL) {
+		SPDK_ERRLOG("%s: %s was written with codec %s, which is not available\n",
+			    cdisk->disk.name, cdisk->base->name, codec_name);
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	if (codec != cdisk->codec) {
+		SPDK_NOTICELOG("%s: using codec %s from %s\n", cdisk->disk.name, codec->name,
+			       cdisk->base->name);
+		cdisk->codec = codec;
+	}
+
+	if (comp_alloc_md(cdisk) != 0) {
+		comp_load_done(cdisk, false);
+		return;
+	}
+
+	if (spdk_bdev_read(cdisk->base, cdisk->map, cdisk->blocklen,
+			   (uint64_t)cdisk->map_blocks * cdisk->blocklen, comp_load_map_done,
+			   cdisk) == NULL) {
+		comp_load_done(cdisk, false);
+	}
+}
+
+static struct comp_disk *
+comp_disk_create(const char *name, struct spdk_bdev *base, const char *codec_name,
+		 uint32_t chunk_size, uint64_t size)
+{
+	struct comp_disk *cdisk;
+	struct comp_codec *codec;
+
+	if (strlen(name) >= SPDK_BDEV_MAX_NAME_LENGTH) {
+		SPDK_ERRLOG("%s: name is too long\n", name);
+		return NULL;
+	}
+
+	if (spdk_bdev_get_by_name(name) != NULL) {
+		SPDK_ERRLOG("%s: blockdev already exists\n", name);
+		return NULL;
+	}
+
+	if (base->claimed) {
+		SPDK_ERRLOG("%s: base blockdev %s is already in use\n", name, base->name);
+		return NULL;
+	}
+
+	if (base->blocklen < sizeof(struct comp_super) || (base->blocklen & (base->blocklen - 1)) != 0) {
+		SPDK_ERRLOG("%s: block size %u of %s is not supported\n", name, base->blocklen,
+			    base->name);
+		return NULL;
+	}
+
+	codec = spdk_comp_codec_get_by_name(codec_name);
+	if (codec == NULL) {
+		SPDK_ERRLOG("%s: codec %s not found\n", name, codec_name);
+		return NULL;
+	}
+
+	cdisk = calloc(1, sizeof(*cdisk));
+	if (cdisk == NULL) {
+		SPDK_ERRLOG("could not allocate compressed disk\n");
+		return NULL;
+	}
+
+	cdisk->base = base;
+	cdisk->codec = codec;
+	cdisk->size = size;
+	cdisk->blocklen = base->blocklen;
+	cdisk->unit_size = base->blocklen > COMP_UNIT_SIZE ? base->blocklen : COMP_UNIT_SIZE;
+	if (comp_disk_geometry(cdisk, chunk_size, size) != 0) {
+		SPDK_ERRLOG("%s: chunk size %u and size %" PRIu64 " do not suit %s\n", name,
+			    chunk_size, size, base->name);
+		free(cdisk);
+		return NULL;
+	}
+
+	cdisk->scratch = comp_scratch_pool_get(chunk_size);
+	if (cdisk->scratch == NULL) {
+		free(cdisk);
+		return NULL;
+	}
+
+	cdisk->super_buf = rte_zmalloc(NULL, cdisk->blocklen, cdisk->blocklen);
+	if (cdisk->super_buf == NULL) {
+		SPDK_ERRLOG("%s: could not allocate superblock\n", name);
+		free(cdisk);
+		return NULL;
+	}
+
+	pthread_mutex_init(&cdisk->lock, NULL);
+	cdisk->state = COMP_LOADING;
+	spdk_bdev_md_writer_init(&cdisk->md_writer, base, &cdisk->lock, cdisk->disk.name);
+	TAILQ_INIT(&cdisk->ops);
+	TAILQ_INIT(&cdisk->waiting);
+
+	snprintf(cdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(cdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Compressed disk");
+
+	cdisk->disk.write_cache = base->write_cache;
+	cdisk->disk.need_aligned_buffer = base->need_aligned_buffer;
+	cdisk->disk.blocklen = cdisk->blocklen;
+	cdisk->disk.blockcnt = cdisk->num_chunks * cdisk->chunk_size / cdisk->blocklen;
+	cdisk->disk.thin_provisioning = 1;
+	cdisk->disk.max_unmap_bdesc_count = COMP_MAX_UNMAP_BDESC;
+	cdisk->disk.ctxt = cdisk;
+	cdisk->disk.fn_table = &comp_fn_table;
+
+	base->claimed = true;
+	TAILQ_INSERT_TAIL(&g_comp_disks, cdisk, link);
+
+	SPDK_TRACELOG(SPDK_TRACE_COMPRESS, "%s: %" PRIu64 " chunks of %u KiB on %u units of %s\n",
+		      name, cdisk->num_chunks, cdisk->chunk_size / 1024,
+		      cdisk->total_units - cdisk->md_units, base->name);
+
+	spdk_bdev_register(&cdisk->disk);
+
+	/* I/O submitted meanwhile is queued until the map is loaded. */
+	if (spdk_bdev_read(base, cdisk->super_buf, 0, cdisk->blocklen, comp_load_super_done,
+			   cdisk) == NULL) {
+		cdisk->state = COMP_FAILED;
+	}
+
+	return cdisk;
+}
+
+struct comp_disk *
+spdk_comp_first(void)
+{
+	return TAILQ_FIRST(&g_comp_disks);
+}
+
+struct comp_disk *
+spdk_comp_next(struct comp_disk *prev)
+{
+	return TAILQ_NEXT(prev, link);
+}
+
+void
+spdk_comp_get_stats(struct comp_disk *cdisk, struct comp_stats *stats, struct comp_usage *usage)
+{
+	uint32_t data_units = cdisk->total_units - cdisk->md_units;
+
+	pthread_mutex_lock(&cdisk->lock);
+	*stats = cdisk->stats;
+	usage->allocated_chunks = cdisk->allocated_chunks;
+	if (cdisk->state == COMP_ONLINE) {
+		usage->used_bytes = (uint64_t)(data_units - cdisk->free_units) * cdisk->unit_size;
+		usage->free_bytes = (uint64_t)cdisk->free_units * cdisk->unit_size;
+	} else {
+		usage->used_bytes = 0;
+		usage->free_bytes = 0;
+	}
+	pthread_mutex_unlock(&cdisk->lock);
+}
+
+static int
+blockdev_compress_initialize(void)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "Compress");
+	struct spdk_bdev *base;
+	const char *name, *base_name, *codec_name, *val;
+	uint32_t chunk_size;
+	uint64_t size_mb;
+	int i;
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "Compress", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "Compress", i, 0);
+		base_name = spdk_conf_section_get_nmval(sp, "Compress", i, 1);
+		if (name == NULL || base_name == NULL) {
+			SPDK_ERRLOG("Compress line %d: format error\n", i);
+			return -1;
+		}
+
+		codec_name = spdk_conf_section_get_nmval(sp, "Compress", i, 2);
+		if (codec_name == NULL) {
+			codec_name = COMP_DEFAULT_CODEC;
+		}
+
+		chunk_size = COMP_DEFAULT_CHUNK_SIZE;
+		val = spdk_conf_section_get_nmval(sp, "Compress", i, 3);
+		if (val != NULL) {
+			chunk_size = strtoul(val, NULL, 10) * 1024;
+		}
+
+		size_mb = 0;
+		val = spdk_conf_section_get_nmval(sp, "Compress", i, 4);
+		if (val != NULL) {
+			size_mb = strtoull(val, NULL, 10);
+		}
+
+		base = spdk_bdev_get_by_name(base_name);
+		if (base == NULL) {
+			SPDK_ERRLOG("%s: blockdev %s not found\n", name, base_name);
+			return -1;
+		}
+
+		if (comp_disk_create(name, base, codec_name, chunk_size,
+				     size_mb * 1024 * 1024) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_compress_finish(void)
+{
+	struct comp_disk *cdisk;
+	struct comp_stats *stats;
+
+	while ((cdisk = TAILQ_FIRST(&g_comp_disks)) != NULL) {
+		stats = &cdisk->stats;
+		if (stats->chunks_written != 0) {
+			SPDK_NOTICELOG("%s: %" PRIu64 " chunks compressed from %" PRIu64 " to %" PRIu64
+				       " KiB (%.2f:1), %" PRIu64 " stored uncompressed, %" PRIu64
+				       " zero\n", cdisk->disk.name, stats->chunks_written,
+				       stats->bytes_in / 1024, stats->bytes_out / 1024,
+				       (double)stats->bytes_in / stats->bytes_out, stats->chunks_raw,
+				       stats->chunks_zero);
+		}
+		TAILQ_REMOVE(&g_comp_disks, cdisk, link);
+		comp_free_disk(cdisk);
+	}
+}
+
+static void
+blockdev_compress_get_spdk_running_config(FILE *fp)
+{
+	struct comp_disk *cdisk;
+
+	if (TAILQ_EMPTY(&g_comp_disks)) {
+		return;
+	}
+
+	fprintf(fp,
+		"\n"
+		"# Compress <name> <base blockdev> [<codec> [<chunk size in KiB> [<size in MB>]]]\n"
+		"[Compress]\n");
+	TAILQ_FOREACH(cdisk, &g_comp_disks, link) {
+		fprintf(fp, "  Compress %s %s %s %u", cdisk->disk.name, cdisk->base->name,
+			cdisk->codec->name, cdisk->chunk_size / 1024);
+		if (cdisk->size != 0) {
+			fprintf(fp, " %" PRIu64, cdisk->size / (1024 * 1024));
+		}
+		fprintf(fp, "\n");
+	}
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("compress", SPDK_TRACE_COMPRESS)
@@ -0,0 +1,320 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SPDK_BLOCKDEV_COMPRESS_H
+#define SPDK_BLOCKDEV_COMPRESS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "spdk/queue.h"
+#include "spdk/bdev.h"
+#include "spdk/bit_array.h"
+
+#include "bdev_module.h"
+
+/*
+ * On-disk layout of a compressed blockdev on its base blockdev, which is
+ *  carved into units of max(COMP_UNIT_SIZE, block size) bytes:
+ *
+ *  block 0				struct comp_super
+ *  blocks 1 .. map_blocks		one struct comp_entry per chunk
+ *  then from unit md_units		compressed chunk data
+ *
+ * The disk is divided into chunks of chunk_size bytes.  Each one is
+ *  compressed on its own and stored in as few units as it fits in; a chunk
+ *  that does not compress to less than its size is stored as it is.  The
+ *  units of a chunk need not be contiguous.  An entry with no units is a
+ *  chunk that was never written, or holds only zeroes.
+ */
+#define COMP_SUPER_MAGIC	0x31504D434B445053ULL	/* "SPDKCMP1" */
+#define COMP_VERSION		1
+
+#define COMP_UNIT_SIZE		4096
+
+#define COMP_DEFAULT_CHUNK_SIZE	(64 * 1024)
+#define COMP_MAX_CHUNK_SIZE	(128 * 1024)
+
+#define COMP_MAX_UNITS		(COMP_MAX_CHUNK_SIZE / COMP_UNIT_SIZE)
+
+#define COMP_CODEC_NAME_LEN	16
+#define COMP_DEFAULT_CODEC	"lz4"
+
+#define COMP_MAX_UNMAP_BDESC	16
+
+/* Operations in each scratch pool, each with the buffers for one chunk */
+#define COMP_SCRATCH_COUNT	128
+
+struct comp_super {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	blocklen;
+	uint64_t	base_blockcnt;
+	char		codec[COMP_CODEC_NAME_LEN];
+	uint32_t	chunk_size;
+	uint32_t	unit_size;
+	uint64_t	num_chunks;
+	uint32_t	entry_size;
+	uint32_t	map_blocks;
+	uint32_t	md_units;
+	uint32_t	total_units;
+};
+
+/*
+ * Map entry of one chunk.  On disk, entries are entry_size bytes apart and
+ *  only hold units[] up to the number of units in a chunk.
+ */
+struct comp_entry {
+	/** Length of the compressed data, or chunk_size if the chunk is stored as it is */
+	uint32_t	comp_len;
+	uint16_t	num_units;
+	uint16_t	flags;
+	uint32_t	units[COMP_MAX_UNITS];
+};
+
+/* Stored uncompressed */
+#define COMP_ENTRY_RAW		(1U << 0)
+
+/*
+ * A compression codec.  The module holds no codec state of its own: compress
+ *  gets work_size bytes of scratch memory of the calling lcore.
+ */
+struct comp_codec {
+	const char	*name;
+	uint32_t	work_size;
+
+	/**
+	 * Compress src_len bytes of src into dst.  Returns the compressed length,
+	 *  or 0 if it would be more than dst_len.
+	 */
+	uint32_t	(*compress)(void *work, const void *src, uint32_t src_len,
+				    void *dst, uint32_t dst_len);
+
+	/**
+	 * Decompress src_len bytes of src into dst.  Returns the decompressed
+	 *  length, or -1 if src is corrupt or expands to more than dst_len.
+	 */
+	int		(*decompress)(const void *src, uint32_t src_len, void *dst,
+				      uint32_t dst_len);
+
+	TAILQ_ENTRY(comp_codec)	link;
+};
+
+void spdk_comp_codec_register(struct comp_codec *codec);
+struct comp_codec *spdk_comp_codec_get_by_name(const char *name);
+
+#define SPDK_COMP_CODEC_REGISTER(codec)						\
+	__attribute__((constructor)) static void codec ## _register(void)	\
+	{									\
+		spdk_comp_codec_register(&codec);				\
+	}
+
+enum comp_disk_state {
+	/** Reading or formatting the metadata; I/O is queued */
+	COMP_LOADING,
+
+	COMP_ONLINE,
+
+	/** The metadata could not be read or is inconsistent; all I/O fails */
+	COMP_FAILED,
+};
+
+struct comp_task {
+	struct spdk_bdev_io	*bdev_io;
+
+	/** On comp_disk::waiting or comp_scratch_pool::waiting */
+	TAILQ_ENTRY(comp_task)	link;
+
+	/** Chunk operations outstanding, plus one while they are being started */
+	int			outstanding;
+	bool			failed;
+
+	/** Next byte of the disk to start an operation at, and its offset in the I/O's data */
+	uint64_t		offset;
+	uint64_t		end;
+	uint64_t		io_offset;
+
+	/** Next unmap descriptor */
+	uint16_t		bdesc;
+};
+
+struct comp_bufs {
+	void		*chunk;
+	void		*comp;
+	void		*work;
+};
+
+/*
+ * Operations of the disks with the same chunk size.  I/O that finds the
+ *  pool empty waits for an operation to be put back, and resumes on the
+ *  lcore that put it, where the freed buffers are cached.
+ */
+struct comp_scratch_pool {
+	uint32_t			chunk_size;
+	struct rte_mempool		*mp;
+
+	pthread_mutex_t			lock;
+	TAILQ_HEAD(, comp_task)		waiting;
+
+	TAILQ_ENTRY(comp_scratch_pool)	link;
+};
+
+/*
+ * The part of one I/O that falls in one chunk.  Operations come from a
+ *  mempool shared by the disks with the same chunk size, with a cache on
+ *  each lcore, and carry the lcore's scratch buffers: the whole chunk, its
+ *  compressed form and the codec's work memory.
+ *
+ * Only one operation works on a chunk at a time; the others wait on the
+ *  one that holds it.  A write or an unmap of part of a chunk reads and
+ *  expands the rest of it first.  The chunk is then compressed into newly
+ *  allocated units, and its old units are freed once the map entry that
+ *  points to the new ones is written.
+ */
+struct comp_op {
+	struct comp_bufs	bufs;
+
+	struct comp_disk	*cdisk;
+	struct comp_task	*task;
+	uint64_t		chunk;
+
+	/** Byte range of the chunk, and where it starts in the I/O's data */
+	uint32_t		in;
+	uint32_t		len;
+	uint64_t		io_offset;
+
+	/** Part of an unmap: the range reads as zeroes afterwards */
+	bool			zero;
+
+	/** Child I/Os outstanding, and what to do once they complete */
+	int			outstanding;
+	bool			failed;
+	void			(*io_done)(struct comp_op *op);
+
+	struct comp_entry	old;
+	struct comp_entry	new;
+
+	struct spdk_bdev_md_waiter	md;
+	TAILQ_HEAD(, comp_op)	waiters;
+
+	/** On comp_disk::ops while it holds the chunk, else on the holder's waiters */
+	TAILQ_ENTRY(comp_op)	link;
+};
+
+struct comp_stats {
+	/** Chunks read and expanded */
+	uint64_t	chunks_read;
+
+	/** Chunks compressed and written, and their size before and after */
+	uint64_t	chunks_written;
+	uint64_t	bytes_in;
+	uint64_t	bytes_out;
+
+	/** Chunks written that did not compress and were stored as they are */
+	uint64_t	chunks_raw;
+
+	/** Chunks written or unmapped that hold only zeroes, and take no units */
+	uint64_t	chunks_zero;
+
+	/** Writes and unmaps of part of a chunk that first read its other data */
+	uint64_t	partial_writes;
+};
+
+struct comp_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+	struct comp_codec	*codec;
+
+	/** Geometry; checked against the superblock when loaded */
+	uint32_t		blocklen;
+	uint32_t		chunk_size;
+	uint32_t		unit_size;
+	uint32_t		units_per_chunk;
+	uint64_t		num_chunks;
+	uint32_t		entry_size;
+	uint32_t		map_blocks;
+	uint32_t		md_units;
+	uint32_t		total_units;
+
+	struct comp_scratch_pool	*scratch;
+
+	/** Size requested in the configuration; 0 if the disk takes all of its base */
+	uint64_t		size;
+
+	/*
+	 * Protects everything below, and changes to the map.  I/O is submitted
+	 *  and completed on any lcore; loading runs on the master lcore.
+	 */
+	pthread_mutex_t		lock;
+	enum comp_disk_state	state;
+
+	/** One bit per unit, set while the metadata or a chunk uses it */
+	struct spdk_bit_array	*used;
+	uint32_t		free_units;
+	uint32_t		alloc_hint;
+
+	/** Chunks that take units */
+	uint64_t		allocated_chunks;
+
+	struct comp_super	*super_buf;
+
+	/** The map, as on disk */
+	void			*map;
+
+	struct spdk_bdev_md_writer	md_writer;
+	TAILQ_HEAD(, comp_op)		ops;
+
+	/** I/O waiting for the disk to load */
+	TAILQ_HEAD(, comp_task)	waiting;
+
+	struct comp_stats	stats;
+
+	TAILQ_ENTRY(comp_disk)	link;
+};
+
+struct comp_disk *spdk_comp_first(void);
+struct comp_disk *spdk_comp_next(struct comp_disk *prev);
+
+struct comp_usage {
+	uint64_t	allocated_chunks;
+
+	/** Bytes of units taken by chunk data */
+	uint64_t	used_bytes;
+	uint64_t	free_bytes;
+};
+
+void spdk_comp_get_stats(struct comp_disk *cdisk, struct comp_stats *stats,
+			 struct comp_usage *usage);
+
+#endif // SPDK_BLOCKDEV_COMPRESS_H
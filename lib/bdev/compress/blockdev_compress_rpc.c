@@ -0,0 +1,103 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "blockdev_compress.h"
+#include "spdk/log.h"
+#include "spdk/rpc.h"
+
+static void
+spdk_rpc_get_compress_stats(struct spdk_jsonrpc_server_conn *conn,
+			    const struct spdk_json_val *params,
+			    const struct spdk_json_val *id)
+{
+	struct spdk_json_write_ctx *w;
+	struct comp_disk *cdisk;
+	struct comp_stats stats;
+	struct comp_usage usage;
+
+	if (params != NULL) {
+		spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+						 "get_compress_stats requires no parameters");
+		return;
+	}
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_array_begin(w);
+
+	for (cdisk = spdk_comp_first(); cdisk != NULL; cdisk = spdk_comp_next(cdisk)) {
+		spdk_comp_get_stats(cdisk, &stats, &usage);
+
+		spdk_json_write_object_begin(w);
+		spdk_json_write_name(w, "name");
+		spdk_json_write_string(w, cdisk->disk.name);
+		spdk_json_write_name(w, "base");
+		spdk_json_write_string(w, cdisk->base->name);
+		spdk_json_write_name(w, "codec");
+		spdk_json_write_string(w, cdisk->codec->name);
+		spdk_json_write_name(w, "chunk_size");
+		spdk_json_write_uint32(w, cdisk->chunk_size);
+		spdk_json_write_name(w, "num_chunks");
+		spdk_json_write_uint64(w, cdisk->num_chunks);
+		spdk_json_write_name(w, "allocated_chunks");
+		spdk_json_write_uint64(w, usage.allocated_chunks);
+		spdk_json_write_name(w, "used_bytes");
+		spdk_json_write_uint64(w, usage.used_bytes);
+		spdk_json_write_name(w, "free_bytes");
+		spdk_json_write_uint64(w, usage.free_bytes);
+		spdk_json_write_name(w, "chunks_read");
+		spdk_json_write_uint64(w, stats.chunks_read);
+		spdk_json_write_name(w, "chunks_written");
+		spdk_json_write_uint64(w, stats.chunks_written);
+		spdk_json_write_name(w, "bytes_in");
+		spdk_json_write_uint64(w, stats.bytes_in);
+		spdk_json_write_name(w, "bytes_out");
+		spdk_json_write_uint64(w, stats.bytes_out);
+		spdk_json_write_name(w, "chunks_raw");
+		spdk_json_write_uint64(w, stats.chunks_raw);
+		spdk_json_write_name(w, "chunks_zero");
+		spdk_json_write_uint64(w, stats.chunks_zero);
+		spdk_json_write_name(w, "partial_writes");
+		spdk_json_write_uint64(w, stats.partial_writes);
+		spdk_json_write_object_end(w);
+	}
+
+	spdk_json_write_array_end(w);
+
+	spdk_jsonrpc_end_result(conn, w);
+}
+SPDK_RPC_REGISTER("get_compress_stats", spdk_rpc_get_compress_stats)
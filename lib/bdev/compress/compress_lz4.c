@@ -0,0 +1,271 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Built-in codec producing the LZ4 block format, so that chunks can be
+ *  inspected or recovered with the standard lz4 tools.  The compressor is
+ *  the greedy single-pass one of the reference implementation: a hash table
+ *  of the last position of each 4-byte sequence, no chaining.
+ *
+ * A block is a series of sequences, each a token byte, the literal length
+ *  beyond 15, the literals, a 2-byte little-endian match offset and the match
+ *  length beyond 19.  The last sequence has literals only; the last 5 bytes
+ *  of a block are always literals, and the last match starts at least 12
+ *  bytes before the end.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blockdev_compress.h"
+
+#define LZ4_MIN_MATCH		4
+#define LZ4_LAST_LITERALS	5
+#define LZ4_MF_LIMIT		12
+#define LZ4_MAX_OFFSET		65535
+
+#define LZ4_HASH_LOG		12
+#define LZ4_HASH_SIZE		(1 << LZ4_HASH_LOG)
+
+/* Literals scanned without a match before the step between probes grows */
+#define LZ4_SKIP_TRIGGER	6
+
+static inline uint32_t
+lz4_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t
+lz4_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Append a length beyond what fits in the token: 255 per byte, then the rest. */
+static inline uint8_t *
+lz4_put_length(uint8_t *op, uint32_t len)
+{
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+
+	return op;
+}
+
+/* Room a sequence with lit_len literals and a match of match_len bytes takes. */
+static inline uint32_t
+lz4_sequence_size(uint32_t lit_len, uint32_t match_len)
+{
+	return 1 + lit_len + lit_len / 255 + 1 + 2 + match_len / 255 + 1;
+}
+
+static uint8_t *
+lz4_put_sequence(uint8_t *op, const uint8_t *lit, uint32_t lit_len, uint32_t offset,
+		 uint32_t match_len)
+{
+	uint8_t *token = op++;
+
+	*token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+	if (lit_len >= 15) {
+		op = lz4_put_length(op, lit_len - 15);
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if (match_len == 0) {
+		return op;
+	}
+
+	*op++ = (uint8_t)offset;
+	*op++ = (uint8_t)(offset >> 8);
+
+	match_len -= LZ4_MIN_MATCH;
+	*token |= match_len >= 15 ? 15 : match_len;
+	if (match_len >= 15) {
+		op = lz4_put_length(op, match_len - 15);
+	}
+
+	return op;
+}
+
+static uint32_t
+lz4_compress(void *work, const void *src, uint32_t src_len, void *dst, uint32_t dst_len)
+{
+	const uint8_t *in = src;
+	uint8_t *op = dst, *oend = op + dst_len;
+	uint32_t *table = work;
+	uint32_t ip, anchor = 0, ref, h, len, step;
+	uint32_t match_limit = src_len - LZ4_LAST_LITERALS;
+	uint32_t mf_limit = src_len - LZ4_MF_LIMIT;
+
+	/* Positions are stored plus one, so that 0 is an empty slot. */
+	memset(table, 0, LZ4_HASH_SIZE * sizeof(uint32_t));
+
+	if (src_len > LZ4_MF_LIMIT) {
+		ip = 0;
+		step = 1 << LZ4_SKIP_TRIGGER;
+		while (ip < mf_limit) {
+			h = lz4_hash(lz4_read32(in + ip));
+			ref = table[h];
+			table[h] = ip + 1;
+
+			if (ref == 0 || ip - (ref - 1) > LZ4_MAX_OFFSET ||
+			    lz4_read32(in + ref - 1) != lz4_read32(in + ip)) {
+				ip += step++ >> LZ4_SKIP_TRIGGER;
+				continue;
+			}
+			ref--;
+
+			len = LZ4_MIN_MATCH;
+			while (ip + len < match_limit && in[ref + len] == in[ip + len]) {
+				len++;
+			}
+			while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+				ip--;
+				ref--;
+				len++;
+			}
+
+			if (lz4_sequence_size(ip - anchor, len) > (uint32_t)(oend - op)) {
+				return 0;
+			}
+			op = lz4_put_sequence(op, in + anchor, ip - anchor, ip - ref, len);
+
+			ip += len;
+			anchor = ip;
+			step = 1 << LZ4_SKIP_TRIGGER;
+
+			/* Index the end of the match as well; runs tend to repeat. */
+			if (ip - 2 < mf_limit) {
+				table[lz4_hash(lz4_read32(in + ip - 2))] = ip - 2 + 1;
+			}
+		}
+	}
+
+	len = src_len - anchor;
+	if (1 + len + len / 255 + 1 > (uint32_t)(oend - op)) {
+		return 0;
+	}
+	op = lz4_put_sequence(op, in + anchor, len, 0, 0);
+
+	return op - (uint8_t *)dst;
+}
+
+static int
+lz4_decompress(const void *src, uint32_t src_len, void *dst, uint32_t dst_len)
+{
+	const uint8_t *ip = src, *iend = ip + src_len;
+	uint8_t *op = dst, *oend = op + dst_len;
+	const uint8_t *match;
+	uint32_t token, len, offset;
+	uint8_t b;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15) {
+			do {
+				if (ip == iend) {
+					return -1;
+				}
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		if (len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op)) {
+			return -1;
+		}
+		memcpy(op, ip, len);
+		ip += len;
+		op += len;
+
+		if (ip == iend) {
+			/* The last sequence has no match. */
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		offset = ip[0] | ((uint32_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (uint32_t)(op - (uint8_t *)dst)) {
+			return -1;
+		}
+
+		len = token & 15;
+		if (len == 15) {
+			do {
+				if (ip == iend) {
+					return -1;
+				}
+				b = *ip++;
+				len += b;
+			} while (b == 255);
+		}
+		len += LZ4_MIN_MATCH;
+		if (len > (uint32_t)(oend - op)) {
+			return -1;
+		}
+
+		/* The match may overlap the bytes it produces. */
+		match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			while (len-- > 0) {
+				*op++ = *match++;
+			}
+		}
+	}
+
+	return op - (uint8_t *)dst;
+}
+
+static struct comp_codec lz4_codec = {
+	.name		= "lz4",
+	.work_size	= LZ4_HASH_SIZE * sizeof(uint32_t),
+	.compress	= lz4_compress,
+	.decompress	= lz4_decompress,
+};
+
+SPDK_COMP_CODEC_REGISTER(lz4_codec)
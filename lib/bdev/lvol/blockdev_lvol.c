@@ -0,0 +1,3128 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Logical volume virtual blockdev.  A volume store carves a base blockdev
+ *  into fixed-size clusters and hands them out to thin-provisioned volumes
+ *  on first write; unmapping a whole cluster returns it to the store.  Each
+ *  volume has a map from its logical clusters to the store's physical ones,
+ *  kept in memory and on the base, and a bit array tracks which physical
+ *  clusters are in use.
+ *
+ * Snapshots are copy-on-write: taking one only hands the volume's map to
+ *  the snapshot and gives the volume an empty one, and a write to a cluster
+ *  the volume still shares goes to a newly allocated cluster.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "blockdev_lvol.h"
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/endian.h"
+#include "spdk/log.h"
+#include "spdk/scsi_spec.h"
+
+static TAILQ_HEAD(, lvol_store) g_lvol_stores = TAILQ_HEAD_INITIALIZER(g_lvol_stores);
+
+static int blockdev_lvol_initialize(void);
+static void blockdev_lvol_finish(void);
+static void blockdev_lvol_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_lvol_get_ctx_size(void)
+{
+	return sizeof(struct lvol_task);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_lvol_initialize, blockdev_lvol_finish,
+			   blockdev_lvol_get_spdk_running_config, blockdev_lvol_get_ctx_size)
+
+static void lvol_submit_read(struct spdk_bdev_io *bdev_io);
+static void lvol_submit_write(struct spdk_bdev_io *bdev_io);
+static void lvol_submit_unmap(struct spdk_bdev_io *bdev_io);
+static void lvol_submit_passthru(struct spdk_bdev_io *bdev_io);
+
+static inline struct lvol_entry *
+lvol_entry(struct lvol_store *store, uint32_t slot)
+{
+	return (struct lvol_entry *)((char *)store->entries + (uint64_t)slot * store->blocklen);
+}
+
+static inline uint64_t
+lvol_entry_block(uint32_t slot)
+{
+	return 1 + slot;
+}
+
+static inline uint64_t
+lvol_map_block(struct lvol_store *store, uint32_t slot)
+{
+	return 1 + store->max_lvols + (uint64_t)slot * store->map_blocks;
+}
+
+static inline uint32_t
+lvol_map_entries_per_block(struct lvol_store *store)
+{
+	return store->blocklen / sizeof(uint32_t);
+}
+
+/*
+ * Compute the geometry of a store with the given cluster size on its base.
+ *  Returns -1 if the base is too small or too large for it.
+ */
+static int
+lvol_store_geometry(struct lvol_store *store, uint32_t cluster_size)
+{
+	uint64_t total_clusters, map_blocks, md_blocks, md_clusters;
+
+	if (cluster_size < LVOL_MIN_CLUSTER_SIZE || cluster_size > LVOL_MAX_CLUSTER_SIZE ||
+	    (cluster_size & (cluster_size - 1)) != 0 || cluster_size % store->blocklen != 0) {
+		return -1;
+	}
+
+	total_clusters = store->base->blockcnt * store->blocklen / cluster_size;
+	if (total_clusters >= UINT32_MAX) {
+		return -1;
+	}
+
+	map_blocks = (total_clusters * sizeof(uint32_t) + store->blocklen - 1) / store->blocklen;
+	md_blocks = 1 + LVOL_MAX_LVOLS + LVOL_MAX_LVOLS * map_blocks;
+	md_clusters = (md_blocks * store->blocklen + cluster_size - 1) / cluster_size;
+	if (md_clusters >= total_clusters) {
+		return -1;
+	}
+
+	store->cluster_size = cluster_size;
+	store->total_clusters = total_clusters;
+	store->md_clusters = md_clusters;
+	store->max_lvols = LVOL_MAX_LVOLS;
+	store->map_blocks = map_blocks;
+
+	return 0;
+}
+
+/* Metadata block holding the map entry of logical cluster lcluster, and its in-memory copy. */
+static uint64_t
+lvol_map_entry_block(struct lvol_disk *lvol, uint32_t lcluster, void **src)
+{
+	struct lvol_store *store = lvol->store;
+	uint32_t index = lcluster / lvol_map_entries_per_block(store);
+
+	*src = (char *)lvol->map + (uint64_t)index * store->blocklen;
+	return lvol_map_block(store, lvol->slot) + index;
+}
+
+/* True if a map entry is a physical cluster of the volume's own. */
+static inline bool
+lvol_owns(uint32_t pcluster)
+{
+	return pcluster != LVOL_UNALLOCATED && pcluster != LVOL_ZERO_CLUSTER;
+}
+
+/*
+ * Physical cluster holding logical cluster lcluster of the volume in slot,
+ *  looking through the snapshots it was created from; LVOL_UNALLOCATED if
+ *  it reads as zeroes.  Called with the lock held if the volume has a parent.
+ */
+static uint32_t
+lvol_resolve(struct lvol_store *store, uint32_t slot, uint32_t lcluster)
+{
+	uint32_t pcluster, parent;
+
+	for (;;) {
+		pcluster = store->maps[slot][lcluster];
+		if (pcluster == LVOL_ZERO_CLUSTER) {
+			return LVOL_UNALLOCATED;
+		}
+		parent = lvol_entry(store, slot)->parent;
+		if (pcluster != LVOL_UNALLOCATED || parent == 0) {
+			return pcluster;
+		}
+		slot = parent - 1;
+	}
+}
+
+/*
+ * Volume table lookups.  Called with the lock held.
+ */
+
+/* Slot of the volume or snapshot of that name; snapshots being deleted are gone already. */
+static uint32_t
+lvol_find_entry(struct lvol_store *store, const char *name)
+{
+	struct lvol_entry *entry;
+	uint32_t slot;
+
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		entry = lvol_entry(store, slot);
+		if (entry->magic == LVOL_ENTRY_MAGIC && !(entry->flags & LVOL_ENTRY_DELETING) &&
+		    strncmp(entry->name, name, sizeof(entry->name)) == 0) {
+			return slot;
+		}
+	}
+
+	return LVOL_NO_SLOT;
+}
+
+static uint32_t
+lvol_find_free_slot(struct lvol_store *store)
+{
+	uint32_t slot;
+
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		if (lvol_entry(store, slot)->magic != LVOL_ENTRY_MAGIC && store->maps[slot] == NULL) {
+			return slot;
+		}
+	}
+
+	return LVOL_NO_SLOT;
+}
+
+/* Number of volumes and snapshots created from the snapshot in slot, and the slot of one. */
+static uint32_t
+lvol_children(struct lvol_store *store, uint32_t slot, uint32_t *child)
+{
+	struct lvol_entry *entry;
+	uint32_t i, count = 0;
+
+	*child = LVOL_NO_SLOT;
+	for (i = 0; i < store->max_lvols; i++) {
+		entry = lvol_entry(store, i);
+		if (entry->magic == LVOL_ENTRY_MAGIC && entry->parent == slot + 1) {
+			*child = i;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* True if the parent of the volume in slot is being deleted. */
+static bool
+lvol_parent_deleting(struct lvol_store *store, uint32_t slot)
+{
+	uint32_t parent = lvol_entry(store, slot)->parent;
+
+	return parent != 0 && (lvol_entry(store, parent - 1)->flags & LVOL_ENTRY_DELETING);
+}
+
+/*
+ * Cluster reuse.  Called with the lock held.
+ */
+
+static void
+lvol_task_count(struct lvol_store *store, struct lvol_task *task)
+{
+	task->gen = store->io_gen & 1;
+	store->ios[task->gen]++;
+	((struct lvol_disk *)task->bdev_io->ctx)->inflight++;
+	task->counted = true;
+}
+
+static void
+lvol_release_clusters(struct lvol_store *store)
+{
+	uint32_t *tmp, tmp_max, i;
+
+	for (;;) {
+		if (store->num_pending_free > 0) {
+			if (store->ios[store->pending_gen] != 0) {
+				return;
+			}
+			for (i = 0; i < store->num_pending_free; i++) {
+				spdk_bit_array_clear(store->used, store->pending_free[i]);
+			}
+			store->free_clusters += store->num_pending_free;
+			store->num_pending_free = 0;
+		}
+
+		if (store->num_next_free == 0) {
+			return;
+		}
+
+		/* Start a new batch; I/O from now on is counted in the other generation. */
+		tmp = store->pending_free;
+		tmp_max = store->max_pending_free;
+		store->pending_free = store->next_free;
+		store->max_pending_free = store->max_next_free;
+		store->num_pending_free = store->num_next_free;
+		store->next_free = tmp;
+		store->max_next_free = tmp_max;
+		store->num_next_free = 0;
+		store->pending_gen = store->io_gen & 1;
+		store->io_gen++;
+	}
+}
+
+static void
+lvol_defer_free(struct lvol_store *store, uint32_t cluster)
+{
+	uint32_t *clusters, max;
+
+	if (store->num_next_free == store->max_next_free) {
+		max = store->max_next_free ? 2 * store->max_next_free : 64;
+		clusters = realloc(store->next_free, max * sizeof(*clusters));
+		if (clusters == NULL) {
+			/* Leaked until the store is loaded again. */
+			SPDK_ERRLOG("%s: could not free cluster %u\n", store->name, cluster);
+			return;
+		}
+		store->next_free = clusters;
+		store->max_next_free = max;
+	}
+
+	store->next_free[store->num_next_free++] = cluster;
+}
+
+/*
+ * Freezing.  A snapshot is taken, or merged into its child, with the
+ *  volume's map unchanging: new I/O waits on lvol_disk::waiting until
+ *  the volume is thawed.
+ */
+
+/* Callback of a frozen volume whose I/O has drained, so that it runs once.  Lock held. */
+static lvol_frozen_fn
+lvol_take_frozen_fn(struct lvol_disk *lvol, void **arg)
+{
+	lvol_frozen_fn fn = lvol->frozen_fn;
+
+	if (lvol->state != LVOL_FROZEN || lvol->inflight != 0 || fn == NULL) {
+		return NULL;
+	}
+
+	*arg = lvol->frozen_arg;
+	lvol->frozen_fn = NULL;
+	lvol->frozen_arg = NULL;
+	return fn;
+}
+
+static void lvol_resume_waiting(struct lvol_disk *lvol);
+
+/*
+ * Freeze the volume and call fn, possibly at once, when its counted I/O has
+ *  completed; fn must thaw it.  A volume being created is frozen once it is
+ *  attached, and fn also runs if that fails, with the volume not frozen.
+ *  Returns -EBUSY if the volume is frozen already or unusable.
+ */
+static int
+lvol_freeze(struct lvol_disk *lvol, lvol_frozen_fn fn, void *arg)
+{
+	struct lvol_store *store = lvol->store;
+	void *fn_arg = NULL;
+
+	pthread_mutex_lock(&store->lock);
+	if (lvol->frozen_fn != NULL ||
+	    (lvol->state != LVOL_CREATING && lvol->state != LVOL_ONLINE)) {
+		pthread_mutex_unlock(&store->lock);
+		return -EBUSY;
+	}
+	lvol->frozen_fn = fn;
+	lvol->frozen_arg = arg;
+	if (lvol->state == LVOL_ONLINE) {
+		lvol->state = LVOL_FROZEN;
+	}
+	fn = lvol_take_frozen_fn(lvol, &fn_arg);
+	pthread_mutex_unlock(&store->lock);
+
+	if (fn != NULL) {
+		fn(lvol, fn_arg);
+	}
+
+	return 0;
+}
+
+/* Let the volume's I/O go on, or fail it if state is LVOL_FAILED. */
+static void
+lvol_thaw(struct lvol_disk *lvol, enum lvol_state state)
+{
+	struct lvol_store *store = lvol->store;
+
+	pthread_mutex_lock(&store->lock);
+	lvol->state = state;
+	pthread_mutex_unlock(&store->lock);
+
+	lvol_resume_waiting(lvol);
+}
+
+/*
+ * I/O path.
+ */
+
+static void
+lvol_task_put(struct lvol_task *task, bool failed)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_store *store = lvol->store;
+	lvol_frozen_fn frozen_fn = NULL;
+	void *frozen_arg = NULL;
+
+	if (failed) {
+		task->failed = true;
+	}
+
+	/* Map updates of one I/O may complete on different lcores. */
+	if (__sync_sub_and_fetch(&task->outstanding, 1) > 0) {
+		return;
+	}
+
+	if (task->counted) {
+		pthread_mutex_lock(&store->lock);
+		store->ios[task->gen]--;
+		lvol_release_clusters(store);
+		lvol->inflight--;
+		frozen_fn = lvol_take_frozen_fn(lvol, &frozen_arg);
+		pthread_mutex_unlock(&store->lock);
+		task->counted = false;
+	}
+
+	spdk_bdev_iov_slices_free(&task->iov_slices);
+
+	spdk_bdev_io_complete(bdev_io, task->failed ? SPDK_BDEV_IO_STATUS_FAILED :
+			      SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	if (frozen_fn != NULL) {
+		frozen_fn(lvol, frozen_arg);
+	}
+}
+
+static void
+lvol_child_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	/* Children are released together with the parent in spdk_bdev_free_io(). */
+	lvol_task_put((struct lvol_task *)parent->driver_ctx,
+		      child->status != SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+/* Submit again I/O that waited for its volume or for a cluster allocation. */
+static void
+lvol_resubmit(struct lvol_task *task)
+{
+	switch (task->bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		lvol_submit_read(task->bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		lvol_submit_write(task->bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		lvol_submit_unmap(task->bdev_io);
+		break;
+	default:
+		lvol_submit_passthru(task->bdev_io);
+		break;
+	}
+}
+
+/*
+ * Queue I/O to a volume that is still being created or is frozen, or fail
+ *  it if the volume is unusable.  Returns true if the I/O was taken care of.
+ *  Called with the lock held.
+ */
+static bool
+lvol_queue_or_fail(struct lvol_disk *lvol, struct lvol_task *task)
+{
+	if (lvol->state == LVOL_CREATING || lvol->state == LVOL_FROZEN) {
+		TAILQ_INSERT_TAIL(&lvol->waiting, task, link);
+		return true;
+	}
+
+	if (lvol->state != LVOL_ONLINE) {
+		spdk_bdev_io_complete(task->bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return true;
+	}
+
+	return false;
+}
+
+static void
+lvol_resume_waiting(struct lvol_disk *lvol)
+{
+	struct lvol_store *store = lvol->store;
+	TAILQ_HEAD(, lvol_task) resume;
+	struct lvol_task *task;
+
+	TAILQ_INIT(&resume);
+	pthread_mutex_lock(&store->lock);
+	TAILQ_SWAP(&resume, &lvol->waiting, lvol_task, link);
+	pthread_mutex_unlock(&store->lock);
+
+	while ((task = TAILQ_FIRST(&resume)) != NULL) {
+		TAILQ_REMOVE(&resume, task, link);
+		lvol_resubmit(task);
+	}
+}
+
+/*
+ * Child I/O to the base for len bytes of the parent's buffer at io_offset.
+ *  Returns NULL if it could not be set up; such a child, if allocated at all,
+ *  is marked failed so that it is released with the parent.
+ */
+static struct spdk_bdev_io *
+lvol_data_child(struct lvol_task *task, spdk_bdev_io_completion_cb cb, void *cb_arg,
+		uint64_t base_offset, uint64_t io_offset, uint64_t len, int max_children)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, lvol->store->base, cb, cb_arg);
+	if (child == NULL) {
+		return NULL;
+	}
+
+	if (spdk_bdev_io_slice_parent_iovs(child, &task->iov_slices, io_offset, len,
+					   max_children) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		return NULL;
+	}
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+		child->u.read.offset = base_offset;
+	} else {
+		child->u.write.offset = base_offset;
+	}
+
+	return child;
+}
+
+/* Child write of len bytes of zeroes to the base. */
+static struct spdk_bdev_io *
+lvol_zero_child(struct lvol_task *task, spdk_bdev_io_completion_cb cb, void *cb_arg,
+		uint64_t base_offset, uint64_t len)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, lvol->store->base, cb, cb_arg);
+	if (child == NULL) {
+		return NULL;
+	}
+
+	child->type = SPDK_BDEV_IO_TYPE_WRITE;
+	child->u.write.iov.iov_base = lvol->store->zero_buf;
+	child->u.write.iov.iov_len = len;
+	child->u.write.iovs = &child->u.write.iov;
+	child->u.write.iovcnt = 1;
+	child->u.write.len = len;
+	child->u.write.offset = base_offset;
+
+	return child;
+}
+
+/* Submit the children set up under the lock. */
+static void
+lvol_submit_children(struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev_io *child, *tmp;
+
+	TAILQ_FOREACH_SAFE(child, &bdev_io->child_io, link, tmp) {
+		if (child->status != SPDK_BDEV_IO_STATUS_PENDING) {
+			continue;
+		}
+		if (spdk_bdev_io_submit(child) != 0) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			spdk_event_call(spdk_event_allocate(rte_lcore_id(), child->cb,
+							    child->caller_ctx, child, NULL));
+		}
+	}
+}
+
+static void
+lvol_submit_read(struct spdk_bdev_io *bdev_io)
+{
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_store *store = lvol->store;
+	struct lvol_task *task = (struct lvol_task *)bdev_io->driver_ctx;
+	uint64_t cluster_size = store->cluster_size;
+	uint64_t offset = bdev_io->u.read.offset, len = bdev_io->u.read.len;
+	uint64_t done, in, seg, more;
+	uint32_t lcluster, pcluster, next;
+	bool locked;
+	int max_children;
+
+	pthread_mutex_lock(&store->lock);
+	if (lvol_queue_or_fail(lvol, task)) {
+		pthread_mutex_unlock(&store->lock);
+		return;
+	}
+	lvol_task_count(store, task);
+
+	/*
+	 * The map of a volume without a parent is read without the lock.  An
+	 *  entry only becomes nonzero once the cluster holds the data, and a
+	 *  cluster cleared from the map is not reused before this read, counted
+	 *  above, completes.  A volume only gets a parent while frozen.  The maps
+	 *  of its snapshots may be merged and released meanwhile, though, so a
+	 *  volume with a parent keeps the lock until its children are set up.
+	 */
+	locked = lvol_entry(store, lvol->slot)->parent != 0;
+	if (!locked) {
+		pthread_mutex_unlock(&store->lock);
+	}
+
+	max_children = (offset % cluster_size + len + cluster_size - 1) / cluster_size;
+	task->outstanding = 1;
+	for (done = 0; done < len; done += seg) {
+		lcluster = (offset + done) / cluster_size;
+		in = (offset + done) % cluster_size;
+		seg = cluster_size - in;
+		if (seg > len - done) {
+			seg = len - done;
+		}
+		pcluster = lvol_resolve(store, lvol->slot, lcluster);
+
+		/* Read runs of clusters that are also adjacent on the base in one go. */
+		while (done + seg < len) {
+			next = lvol_resolve(store, lvol->slot, lcluster + 1);
+			if (pcluster == LVOL_UNALLOCATED ? next != LVOL_UNALLOCATED :
+			    next != pcluster + (in + seg) / cluster_size) {
+				break;
+			}
+			more = len - done - seg;
+			seg += more < cluster_size ? more : cluster_size;
+			lcluster++;
+		}
+
+		if (pcluster == LVOL_UNALLOCATED) {
+			spdk_bdev_copy_to_iovs(bdev_io->u.read.iovs, bdev_io->u.read.iovcnt, done, NULL, seg);
+			continue;
+		}
+
+		if (lvol_data_child(task, lvol_child_done, bdev_io,
+				    (uint64_t)pcluster * cluster_size + in, done, seg,
+				    max_children) == NULL) {
+			task->failed = true;
+			break;
+		}
+		task->outstanding++;
+	}
+
+	if (locked) {
+		pthread_mutex_unlock(&store->lock);
+	}
+
+	lvol_submit_children(bdev_io);
+	lvol_task_put(task, false);
+}
+
+/*
+ * Write path.  Clusters are allocated on the first write to them; writes
+ *  and unmaps overlapping a cluster being allocated wait for it to finish.
+ */
+
+/* First allocation in progress for a logical cluster of the volume in [first, last]. */
+static struct lvol_alloc *
+lvol_find_alloc(struct lvol_store *store, struct lvol_disk *lvol, uint32_t first, uint32_t last)
+{
+	struct lvol_alloc *alloc;
+
+	TAILQ_FOREACH(alloc, &store->allocs, link) {
+		if (alloc->lvol == lvol && alloc->lcluster >= first && alloc->lcluster <= last) {
+			return alloc;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+lvol_alloc_finish(struct lvol_alloc *alloc, bool success)
+{
+	struct lvol_store *store = alloc->lvol->store;
+	TAILQ_HEAD(, lvol_task) waiters;
+	struct lvol_task *task;
+
+	TAILQ_INIT(&waiters);
+	pthread_mutex_lock(&store->lock);
+	TAILQ_REMOVE(&store->allocs, alloc, link);
+	TAILQ_SWAP(&waiters, &alloc->waiters, lvol_task, link);
+	pthread_mutex_unlock(&store->lock);
+
+	lvol_task_put(alloc->task, !success);
+
+	while ((task = TAILQ_FIRST(&waiters)) != NULL) {
+		TAILQ_REMOVE(&waiters, task, link);
+		lvol_resubmit(task);
+	}
+
+	rte_free(alloc->buf);
+	free(alloc);
+}
+
+static void
+lvol_alloc_md_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_alloc *alloc;
+
+	alloc = (struct lvol_alloc *)((char *)waiter - offsetof(struct lvol_alloc, md));
+
+	/* The data is in place and mapped in memory, but may be lost on restart. */
+	lvol_alloc_finish(alloc, success);
+}
+
+static void
+lvol_alloc_put(struct lvol_alloc *alloc, bool failed)
+{
+	struct lvol_disk *lvol = alloc->lvol;
+	struct lvol_store *store = lvol->store;
+	uint64_t block;
+	void *src;
+
+	if (failed) {
+		alloc->failed = true;
+	}
+
+	if (--alloc->outstanding > 0) {
+		return;
+	}
+
+	if (alloc->failed) {
+		/* Never mapped, so nothing else can be using the cluster. */
+		pthread_mutex_lock(&store->lock);
+		spdk_bit_array_clear(store->used, alloc->pcluster);
+		store->free_clusters++;
+		pthread_mutex_unlock(&store->lock);
+		lvol_alloc_finish(alloc, false);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	lvol->map[alloc->lcluster] = alloc->pcluster;
+	lvol->allocated++;
+	pthread_mutex_unlock(&store->lock);
+
+	alloc->md.cb = lvol_alloc_md_done;
+	block = lvol_map_entry_block(lvol, alloc->lcluster, &src);
+	spdk_bdev_md_commit(&store->md_writer, block, src, &alloc->md);
+}
+
+static void
+lvol_alloc_child_done(spdk_event_t event)
+{
+	struct lvol_alloc *alloc = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	lvol_alloc_put(alloc, child->status != SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+/* Take a free physical cluster for lcluster.  Called with the lock held. */
+static struct lvol_alloc *
+lvol_alloc_start(struct lvol_disk *lvol, struct lvol_task *task, uint32_t lcluster)
+{
+	struct lvol_store *store = lvol->store;
+	struct lvol_alloc *alloc;
+	uint32_t pcluster;
+
+	alloc = calloc(1, sizeof(*alloc));
+	if (alloc == NULL) {
+		return NULL;
+	}
+
+	pcluster = spdk_bit_array_find_first_clear(store->used, store->alloc_hint);
+	if (pcluster >= store->total_clusters) {
+		pcluster = spdk_bit_array_find_first_clear(store->used, store->md_clusters);
+	}
+	assert(pcluster < store->total_clusters);
+	spdk_bit_array_set(store->used, pcluster);
+	store->free_clusters--;
+	store->alloc_hint = pcluster + 1;
+
+	alloc->lvol = lvol;
+	alloc->lcluster = lcluster;
+	alloc->pcluster = pcluster;
+	alloc->task = task;
+
+	/* Held until all of its children are submitted. */
+	alloc->outstanding = 1;
+	TAILQ_INIT(&alloc->waiters);
+	TAILQ_INSERT_TAIL(&store->allocs, alloc, link);
+	task->outstanding++;
+
+	return alloc;
+}
+
+static void
+lvol_alloc_copy_done(spdk_event_t event)
+{
+	struct lvol_alloc *alloc = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct spdk_bdev_io *bdev_io = alloc->task->bdev_io;
+	struct lvol_store *store = alloc->lvol->store;
+	uint32_t i;
+
+	if (child->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		lvol_alloc_put(alloc, true);
+		return;
+	}
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_WRITE) {
+		spdk_bdev_copy_from_iovs((char *)alloc->buf + alloc->in, bdev_io->u.write.iovs,
+				    bdev_io->u.write.iovcnt, alloc->io_offset, alloc->len);
+	}
+	for (i = 0; i < alloc->num_zero; i++) {
+		memset((char *)alloc->buf + alloc->zero[i].in, 0, alloc->zero[i].len);
+	}
+
+	/* The read's hold on the allocation passes to the write of the whole cluster. */
+	child = spdk_bdev_get_child_io(bdev_io, store->base, lvol_alloc_child_done, alloc);
+	if (child == NULL) {
+		lvol_alloc_put(alloc, true);
+		return;
+	}
+
+	child->type = SPDK_BDEV_IO_TYPE_WRITE;
+	child->u.write.iov.iov_base = alloc->buf;
+	child->u.write.iov.iov_len = store->cluster_size;
+	child->u.write.iovs = &child->u.write.iov;
+	child->u.write.iovcnt = 1;
+	child->u.write.len = store->cluster_size;
+	child->u.write.offset = (uint64_t)alloc->pcluster * store->cluster_size;
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		lvol_alloc_put(alloc, true);
+	}
+}
+
+/*
+ * Set up the read of the snapshot's cluster src for a partial first write
+ *  of len bytes at in within the cluster, from io_offset in the I/O's
+ *  buffer.  Called with the lock held.
+ */
+static int
+lvol_alloc_copy(struct lvol_alloc *alloc, uint32_t src, uint32_t in, uint64_t io_offset,
+		uint32_t len)
+{
+	struct lvol_store *store = alloc->lvol->store;
+	struct spdk_bdev_io *child;
+
+	alloc->buf = rte_malloc(NULL, store->cluster_size, store->blocklen);
+	if (alloc->buf == NULL) {
+		return -1;
+	}
+	alloc->src = src;
+	alloc->in = in;
+	alloc->io_offset = io_offset;
+	alloc->len = len;
+
+	child = spdk_bdev_get_child_io(alloc->task->bdev_io, store->base, lvol_alloc_copy_done,
+				       alloc);
+	if (child == NULL) {
+		return -1;
+	}
+
+	child->type = SPDK_BDEV_IO_TYPE_READ;
+	child->u.read.buf_unaligned = NULL;
+	child->u.read.put_rbuf = false;
+	child->u.read.iov.iov_base = alloc->buf;
+	child->u.read.iov.iov_len = store->cluster_size;
+	child->u.read.iovs = &child->u.read.iov;
+	child->u.read.iovcnt = 1;
+	child->u.read.len = store->cluster_size;
+	child->u.read.offset = (uint64_t)src * store->cluster_size;
+	alloc->outstanding++;
+
+	return 0;
+}
+
+static void
+lvol_submit_write(struct spdk_bdev_io *bdev_io)
+{
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_store *store = lvol->store;
+	struct lvol_task *task = (struct lvol_task *)bdev_io->driver_ctx;
+	struct lvol_alloc *alloc, *tmp;
+	TAILQ_HEAD(, lvol_alloc) allocs;
+	uint64_t cluster_size = store->cluster_size;
+	uint64_t offset = bdev_io->u.write.offset, len = bdev_io->u.write.len;
+	uint64_t done, in, seg, base_offset;
+	uint32_t first, last, lcluster, pcluster, src, parent, needed = 0;
+	int max_children;
+
+	first = offset / cluster_size;
+	last = (offset + len - 1) / cluster_size;
+	max_children = 3 * (last - first + 1);
+	TAILQ_INIT(&allocs);
+
+	pthread_mutex_lock(&store->lock);
+
+	if (lvol_queue_or_fail(lvol, task)) {
+		pthread_mutex_unlock(&store->lock);
+		return;
+	}
+
+	alloc = lvol_find_alloc(store, lvol, first, last);
+	if (alloc != NULL) {
+		TAILQ_INSERT_TAIL(&alloc->waiters, task, link);
+		pthread_mutex_unlock(&store->lock);
+		return;
+	}
+
+	for (lcluster = first; lcluster <= last; lcluster++) {
+		if (!lvol_owns(lvol->map[lcluster])) {
+			needed++;
+		}
+	}
+	if (needed > store->free_clusters) {
+		pthread_mutex_unlock(&store->lock);
+		SPDK_ERRLOG("%s: out of space in %s\n", lvol->disk.name, store->name);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	lvol_task_count(store, task);
+	task->outstanding = 1;
+	parent = lvol_entry(store, lvol->slot)->parent;
+
+	for (done = 0; done < len; done += seg) {
+		lcluster = (offset + done) / cluster_size;
+		in = (offset + done) % cluster_size;
+		seg = cluster_size - in;
+		if (seg > len - done) {
+			seg = len - done;
+		}
+
+		pcluster = lvol->map[lcluster];
+		if (lvol_owns(pcluster)) {
+			if (lvol_data_child(task, lvol_child_done, bdev_io,
+					    (uint64_t)pcluster * cluster_size + in, done, seg,
+					    max_children) == NULL) {
+				task->failed = true;
+				break;
+			}
+			task->outstanding++;
+			continue;
+		}
+
+		alloc = lvol_alloc_start(lvol, task, lcluster);
+		if (alloc == NULL) {
+			task->failed = true;
+			break;
+		}
+		TAILQ_INSERT_TAIL(&allocs, alloc, task_link);
+
+		src = LVOL_UNALLOCATED;
+		if (pcluster == LVOL_UNALLOCATED && parent != 0) {
+			src = lvol_resolve(store, parent - 1, lcluster);
+		}
+		if (src != LVOL_UNALLOCATED && seg < cluster_size) {
+			if (lvol_alloc_copy(alloc, src, in, done, seg) != 0) {
+				alloc->failed = true;
+				break;
+			}
+			continue;
+		}
+
+		/* Fill the rest of the new cluster with zeroes. */
+		base_offset = (uint64_t)alloc->pcluster * cluster_size;
+		if (in > 0) {
+			if (lvol_zero_child(task, lvol_alloc_child_done, alloc, base_offset,
+					    in) == NULL) {
+				alloc->failed = true;
+				break;
+			}
+			alloc->outstanding++;
+		}
+		if (lvol_data_child(task, lvol_alloc_child_done, alloc, base_offset + in, done, seg,
+				    max_children) == NULL) {
+			alloc->failed = true;
+			break;
+		}
+		alloc->outstanding++;
+		if (in + seg < cluster_size) {
+			if (lvol_zero_child(task, lvol_alloc_child_done, alloc,
+					    base_offset + in + seg,
+					    cluster_size - in - seg) == NULL) {
+				alloc->failed = true;
+				break;
+			}
+			alloc->outstanding++;
+		}
+	}
+
+	pthread_mutex_unlock(&store->lock);
+
+	lvol_submit_children(bdev_io);
+
+	TAILQ_FOREACH_SAFE(alloc, &allocs, task_link, tmp) {
+		TAILQ_REMOVE(&allocs, alloc, task_link);
+		lvol_alloc_put(alloc, false);
+	}
+	lvol_task_put(task, false);
+}
+
+/*
+ * Unmap.  Whole clusters are taken out of the map and returned to the store
+ *  once the map blocks are written; the rest of the range is zeroed, so that
+ *  it reads back as zeroes like the unallocated clusters.  In a volume with
+ *  a parent, unmapped clusters are marked so as not to read the parent's
+ *  data, and a cluster shared with it is copied with the range zeroed.
+ */
+
+static void
+lvol_unmap_md_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_unmap *unmap;
+	struct lvol_task *task;
+	struct lvol_store *store;
+	uint32_t i;
+
+	unmap = (struct lvol_unmap *)((char *)waiter - offsetof(struct lvol_unmap, md));
+	task = unmap->task;
+	store = ((struct lvol_disk *)task->bdev_io->ctx)->store;
+
+	if (success) {
+		pthread_mutex_lock(&store->lock);
+		for (i = 0; i < unmap->num_clusters; i++) {
+			lvol_defer_free(store, unmap->clusters[i]);
+		}
+		lvol_release_clusters(store);
+		pthread_mutex_unlock(&store->lock);
+	} else {
+		/* The map on disk may still refer to them; keep them until the next load. */
+		SPDK_ERRLOG("%s: %u unmapped clusters not released\n", store->name,
+			    unmap->num_clusters);
+	}
+
+	lvol_task_put(task, !success);
+	free(unmap);
+}
+
+/* Group of the clusters unmapped from one map block.  Called with the lock held. */
+static struct lvol_unmap *
+lvol_unmap_group(struct lvol_task *task, struct lvol_unmap **groups, uint64_t block)
+{
+	struct lvol_store *store = ((struct lvol_disk *)task->bdev_io->ctx)->store;
+	struct lvol_unmap *unmap;
+
+	for (unmap = *groups; unmap != NULL; unmap = unmap->next) {
+		if (unmap->block == block) {
+			return unmap;
+		}
+	}
+
+	unmap = calloc(1, sizeof(*unmap) + lvol_map_entries_per_block(store) * sizeof(uint32_t));
+	if (unmap == NULL) {
+		return NULL;
+	}
+
+	unmap->md.cb = lvol_unmap_md_done;
+	unmap->task = task;
+	unmap->block = block;
+	unmap->next = *groups;
+	*groups = unmap;
+	task->outstanding++;
+
+	return unmap;
+}
+
+static void
+lvol_submit_unmap(struct spdk_bdev_io *bdev_io)
+{
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_store *store = lvol->store;
+	struct lvol_task *task = (struct lvol_task *)bdev_io->driver_ctx;
+	struct spdk_scsi_unmap_bdesc *bdesc = bdev_io->u.unmap.unmap_bdesc;
+	struct lvol_unmap *groups = NULL, *unmap;
+	struct lvol_alloc *alloc, *tmp;
+	TAILQ_HEAD(, lvol_alloc) allocs;
+	uint64_t cluster_size = store->cluster_size;
+	uint64_t disk_size = lvol->disk.blockcnt * lvol->disk.blocklen;
+	uint64_t offset, len, end, cstart, cend, zstart, zend, block;
+	uint32_t lcluster, pcluster, src_cluster, parent;
+	uint16_t i;
+	void *src;
+
+	TAILQ_INIT(&allocs);
+
+	if (bdev_io->u.unmap.bdesc_count > LVOL_MAX_UNMAP_BDESC) {
+		SPDK_ERRLOG("%s: too many unmap descriptors (%u)\n", lvol->disk.name,
+			    bdev_io->u.unmap.bdesc_count);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+		offset = from_be64(&bdesc[i].lba) * lvol->disk.blocklen;
+		len = (uint64_t)from_be32(&bdesc[i].block_count) * lvol->disk.blocklen;
+		if (offset > disk_size || len > disk_size - offset) {
+			SPDK_ERRLOG("%s: unmap beyond the end of the volume\n", lvol->disk.name);
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			return;
+		}
+	}
+
+	pthread_mutex_lock(&store->lock);
+
+	if (lvol_queue_or_fail(lvol, task)) {
+		pthread_mutex_unlock(&store->lock);
+		return;
+	}
+
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+		offset = from_be64(&bdesc[i].lba) * lvol->disk.blocklen;
+		len = (uint64_t)from_be32(&bdesc[i].block_count) * lvol->disk.blocklen;
+		if (len == 0) {
+			continue;
+		}
+		alloc = lvol_find_alloc(store, lvol, offset / cluster_size,
+					(offset + len - 1) / cluster_size);
+		if (alloc != NULL) {
+			TAILQ_INSERT_TAIL(&alloc->waiters, task, link);
+			pthread_mutex_unlock(&store->lock);
+			return;
+		}
+	}
+
+	lvol_task_count(store, task);
+	task->outstanding = 1;
+	parent = lvol_entry(store, lvol->slot)->parent;
+
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count && !task->failed; i++) {
+		offset = from_be64(&bdesc[i].lba) * lvol->disk.blocklen;
+		end = offset + (uint64_t)from_be32(&bdesc[i].block_count) * lvol->disk.blocklen;
+
+		for (; offset < end; offset = cend) {
+			lcluster = offset / cluster_size;
+			cstart = (uint64_t)lcluster * cluster_size;
+			cend = cstart + cluster_size;
+			zstart = offset;
+			zend = end < cend ? end : cend;
+
+			/* Descriptors may overlap; a cluster copied for an earlier one is zeroed too. */
+			TAILQ_FOREACH(alloc, &allocs, task_link) {
+				if (alloc->lcluster == lcluster) {
+					break;
+				}
+			}
+			if (alloc != NULL) {
+				assert(alloc->num_zero < LVOL_MAX_UNMAP_BDESC);
+				alloc->zero[alloc->num_zero].in = zstart - cstart;
+				alloc->zero[alloc->num_zero].len = zend - zstart;
+				alloc->num_zero++;
+				continue;
+			}
+
+			pcluster = lvol->map[lcluster];
+			src_cluster = LVOL_UNALLOCATED;
+			if (pcluster == LVOL_UNALLOCATED && parent != 0) {
+				src_cluster = lvol_resolve(store, parent - 1, lcluster);
+			}
+			if (!lvol_owns(pcluster) && src_cluster == LVOL_UNALLOCATED) {
+				continue;
+			}
+
+			if (offset == cstart && end >= cend) {
+				block = lvol_map_entry_block(lvol, lcluster, &src);
+				unmap = lvol_unmap_group(task, &groups, block);
+				if (unmap == NULL) {
+					task->failed = true;
+					break;
+				}
+				lvol->map[lcluster] = parent != 0 ? LVOL_ZERO_CLUSTER : LVOL_UNALLOCATED;
+				if (lvol_owns(pcluster)) {
+					lvol->allocated--;
+					unmap->clusters[unmap->num_clusters++] = pcluster;
+				}
+				continue;
+			}
+
+			if (lvol_owns(pcluster)) {
+				if (lvol_zero_child(task, lvol_child_done, bdev_io,
+						    (uint64_t)pcluster * cluster_size + zstart - cstart,
+						    zend - zstart) == NULL) {
+					task->failed = true;
+					break;
+				}
+				task->outstanding++;
+				continue;
+			}
+
+			if (store->free_clusters == 0) {
+				SPDK_ERRLOG("%s: out of space in %s\n", lvol->disk.name, store->name);
+				task->failed = true;
+				break;
+			}
+			alloc = lvol_alloc_start(lvol, task, lcluster);
+			if (alloc == NULL) {
+				task->failed = true;
+				break;
+			}
+			TAILQ_INSERT_TAIL(&allocs, alloc, task_link);
+			alloc->zero[0].in = zstart - cstart;
+			alloc->zero[0].len = zend - zstart;
+			alloc->num_zero = 1;
+			if (lvol_alloc_copy(alloc, src_cluster, 0, 0, 0) != 0) {
+				alloc->failed = true;
+				task->failed = true;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&store->lock);
+
+	lvol_submit_children(bdev_io);
+
+	while ((unmap = groups) != NULL) {
+		groups = unmap->next;
+		src = (char *)lvol->map +
+		      (unmap->block - lvol_map_block(store, lvol->slot)) * store->blocklen;
+		spdk_bdev_md_commit(&store->md_writer, unmap->block, src, &unmap->md);
+	}
+
+	TAILQ_FOREACH_SAFE(alloc, &allocs, task_link, tmp) {
+		TAILQ_REMOVE(&allocs, alloc, task_link);
+		lvol_alloc_put(alloc, false);
+	}
+	lvol_task_put(task, false);
+}
+
+/* Flush and reset apply to the base as a whole. */
+
+static void
+lvol_passthru_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+lvol_submit_passthru(struct spdk_bdev_io *bdev_io)
+{
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_store *store = lvol->store;
+	struct lvol_task *task = (struct lvol_task *)bdev_io->driver_ctx;
+	struct spdk_bdev_io *child;
+
+	pthread_mutex_lock(&store->lock);
+	if (lvol_queue_or_fail(lvol, task)) {
+		pthread_mutex_unlock(&store->lock);
+		return;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	child = spdk_bdev_get_child_io(bdev_io, store->base, lvol_passthru_done, bdev_io);
+	if (child == NULL) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (child->type == SPDK_BDEV_IO_TYPE_FLUSH) {
+		child->u.flush.offset = 0;
+		child->u.flush.length = store->base->blockcnt * store->base->blocklen;
+	}
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_lvol_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct lvol_disk *lvol = bdev_io->ctx;
+	struct lvol_task *task = (struct lvol_task *)bdev_io->driver_ctx;
+
+	memset(task, 0, sizeof(*task));
+	task->bdev_io = bdev_io;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		spdk_bdev_io_get_rbuf(bdev_io, lvol_submit_read);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		if (lvol->snapshot) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		lvol_submit_write(bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		if (lvol->snapshot) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		lvol_submit_unmap(bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		lvol_submit_passthru(bdev_io);
+		break;
+	default:
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+blockdev_lvol_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	struct lvol_disk *lvol = (struct lvol_disk *)bdev;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		return true;
+
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		return !lvol->snapshot;
+
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return spdk_bdev_io_type_supported(lvol->store->base, io_type);
+
+	default:
+		return false;
+	}
+}
+
+/* Volume whose own metadata write waiter is this one. */
+static inline struct lvol_disk *
+lvol_from_md(struct spdk_bdev_md_waiter *waiter)
+{
+	return (struct lvol_disk *)((char *)waiter - offsetof(struct lvol_disk, md));
+}
+
+static void
+lvol_delete_md_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_disk *lvol = lvol_from_md(waiter);
+	struct lvol_store *store = lvol->store;
+	uint32_t i;
+
+	if (!success) {
+		/* The entry may still be on disk, so the slot and its clusters stay reserved. */
+		SPDK_ERRLOG("%s: could not release volume %s\n", store->name, lvol->disk.name);
+		free(lvol);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	for (i = 0; i < lvol->num_clusters; i++) {
+		if (lvol_owns(lvol->map[i])) {
+			lvol_defer_free(store, lvol->map[i]);
+		}
+	}
+	lvol_release_clusters(store);
+	store->maps[lvol->slot] = NULL;
+	pthread_mutex_unlock(&store->lock);
+
+	SPDK_TRACELOG(SPDK_TRACE_LVOL, "%s: released slot %u of %s\n", lvol->disk.name, lvol->slot,
+		      store->name);
+
+	rte_free(lvol->map);
+	free(lvol);
+}
+
+static int
+blockdev_lvol_destruct(struct spdk_bdev *bdev)
+{
+	struct lvol_disk *lvol = (struct lvol_disk *)bdev;
+	struct lvol_store *store = lvol->store;
+	bool release;
+
+	pthread_mutex_lock(&store->lock);
+	TAILQ_REMOVE(&store->lvols, lvol, link);
+	release = lvol->deleting && lvol->state == LVOL_ONLINE && store->state == LVOL_STORE_ONLINE;
+	if (release) {
+		memset(lvol_entry(store, lvol->slot), 0, store->blocklen);
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (!release) {
+		/* The volume stays in the store and is attached again by name. */
+		free(lvol);
+		return 0;
+	}
+
+	lvol->md.cb = lvol_delete_md_done;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(lvol->slot), lvol_entry(store, lvol->slot),
+		       &lvol->md);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table lvol_fn_table = {
+	.destruct		= blockdev_lvol_destruct,
+	.submit_request		= blockdev_lvol_submit_request,
+	.io_type_supported	= blockdev_lvol_io_type_supported,
+};
+
+/* In-memory size of the map of a volume, in whole blocks. */
+static uint64_t
+lvol_map_size(struct lvol_store *store, uint32_t num_clusters)
+{
+	uint32_t per_block = lvol_map_entries_per_block(store);
+
+	return (uint64_t)((num_clusters + per_block - 1) / per_block) * store->blocklen;
+}
+
+/*
+ * Attaching a volume to its slot.
+ */
+
+static void
+lvol_attach_done(struct lvol_disk *lvol, bool success)
+{
+	struct lvol_store *store = lvol->store;
+	lvol_frozen_fn frozen_fn;
+	void *frozen_arg;
+	bool frozen;
+
+	pthread_mutex_lock(&store->lock);
+	lvol->state = success ? LVOL_ONLINE : LVOL_FAILED;
+
+	/* A freeze requested meanwhile takes effect now, with nothing in flight yet. */
+	frozen_fn = lvol->frozen_fn;
+	frozen_arg = lvol->frozen_arg;
+	lvol->frozen_fn = NULL;
+	lvol->frozen_arg = NULL;
+	frozen = success && frozen_fn != NULL;
+	if (frozen) {
+		lvol->state = LVOL_FROZEN;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (success) {
+		SPDK_TRACELOG(SPDK_TRACE_LVOL, "%s: slot %u of %s, %u of %u clusters allocated\n",
+			      lvol->disk.name, lvol->slot, store->name, lvol->allocated,
+			      lvol->num_clusters);
+	}
+
+	if (!frozen) {
+		lvol_resume_waiting(lvol);
+	}
+
+	if (frozen_fn != NULL) {
+		frozen_fn(lvol, frozen_arg);
+	}
+}
+
+/* Give back a slot whose entry was never written. */
+static void
+lvol_attach_release(struct lvol_disk *lvol)
+{
+	struct lvol_store *store = lvol->store;
+
+	pthread_mutex_lock(&store->lock);
+	memset(lvol_entry(store, lvol->slot), 0, store->blocklen);
+	store->maps[lvol->slot] = NULL;
+	pthread_mutex_unlock(&store->lock);
+
+	rte_free(lvol->map);
+	lvol->map = NULL;
+	lvol->slot = LVOL_NO_SLOT;
+}
+
+static void
+lvol_attach_md_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_disk *lvol = lvol_from_md(waiter);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not write volume entry\n", lvol->disk.name);
+		lvol_attach_release(lvol);
+	}
+
+	lvol_attach_done(lvol, success);
+}
+
+static void
+lvol_attach_map_done(spdk_event_t event)
+{
+	struct lvol_disk *lvol = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct lvol_store *store = lvol->store;
+	struct lvol_entry *entry;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not write volume map\n", lvol->disk.name);
+		lvol_attach_release(lvol);
+		lvol_attach_done(lvol, false);
+		return;
+	}
+
+	/* The map is on disk and empty; the entry makes the volume part of the store. */
+	pthread_mutex_lock(&store->lock);
+	entry = lvol_entry(store, lvol->slot);
+	memset(entry, 0, store->blocklen);
+	entry->magic = LVOL_ENTRY_MAGIC;
+	snprintf(entry->name, sizeof(entry->name), "%s", lvol->disk.name);
+	entry->num_clusters = lvol->num_clusters;
+	if (lvol->clone_parent != LVOL_NO_SLOT) {
+		entry->parent = lvol->clone_parent + 1;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	lvol->md.cb = lvol_attach_md_done;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(lvol->slot), entry, &lvol->md);
+}
+
+/*
+ * Taking a snapshot.  With the volume frozen, an empty map is written for
+ *  it in a new slot, then the new slot's entry with the old slot as parent,
+ *  and last the old slot's entry is renamed to the snapshot.  A restart
+ *  before the rename finds the new slot's parent under the volume's own
+ *  name and drops the new slot.  The snapshot's blockdev holds the new slot
+ *  meanwhile; the two swap slots once it is taken.
+ */
+
+/* End the snapshot; the volume is thawed into state. */
+static void
+lvol_snapshot_done(struct lvol_disk *snap, bool taken, enum lvol_state state)
+{
+	struct lvol_disk *lvol = snap->origin;
+	struct lvol_store *store = lvol->store;
+	uint32_t slot, *map;
+
+	if (taken) {
+		pthread_mutex_lock(&store->lock);
+		slot = lvol->slot;
+		map = lvol->map;
+		lvol->slot = snap->slot;
+		lvol->map = snap->map;
+		snap->slot = slot;
+		snap->map = map;
+		snap->allocated = lvol->allocated;
+		lvol->allocated = 0;
+		pthread_mutex_unlock(&store->lock);
+
+		SPDK_NOTICELOG("%s: took snapshot %s, %u clusters\n", lvol->disk.name,
+			       snap->disk.name, snap->allocated);
+	}
+
+	snap->origin = NULL;
+	lvol_thaw(lvol, state);
+	lvol_attach_done(snap, taken);
+}
+
+/*
+ * The metadata on disk may or may not include the last change.  The volume
+ *  stays offline so that it changes no further; the new slot stays reserved.
+ */
+static void
+lvol_snapshot_abandon(struct lvol_disk *snap)
+{
+	struct lvol_store *store = snap->store;
+
+	SPDK_ERRLOG("%s: could not take snapshot %s; the volume is offline until %s is loaded again\n",
+		    snap->origin->disk.name, snap->disk.name, store->name);
+
+	pthread_mutex_lock(&store->lock);
+	memset(lvol_entry(store, snap->slot), 0, store->blocklen);
+	pthread_mutex_unlock(&store->lock);
+
+	snap->slot = LVOL_NO_SLOT;
+	snap->map = NULL;
+	lvol_snapshot_done(snap, false, LVOL_FAILED);
+}
+
+static void
+lvol_snapshot_renamed(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_disk *snap = lvol_from_md(waiter);
+	struct lvol_disk *lvol = snap->origin;
+	struct lvol_store *store = snap->store;
+	struct lvol_entry *entry;
+
+	if (!success) {
+		pthread_mutex_lock(&store->lock);
+		entry = lvol_entry(store, lvol->slot);
+		memset(entry->name, 0, sizeof(entry->name));
+		snprintf(entry->name, sizeof(entry->name), "%s", lvol->disk.name);
+		entry->flags &= ~LVOL_ENTRY_SNAPSHOT;
+		pthread_mutex_unlock(&store->lock);
+		lvol_snapshot_abandon(snap);
+		return;
+	}
+
+	lvol_snapshot_done(snap, true, LVOL_ONLINE);
+}
+
+static void
+lvol_snapshot_entry_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_disk *snap = lvol_from_md(waiter);
+	struct lvol_disk *lvol = snap->origin;
+	struct lvol_store *store = snap->store;
+	struct lvol_entry *entry;
+
+	if (!success) {
+		lvol_snapshot_abandon(snap);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	entry = lvol_entry(store, lvol->slot);
+	memset(entry->name, 0, sizeof(entry->name));
+	snprintf(entry->name, sizeof(entry->name), "%s", snap->disk.name);
+	entry->flags |= LVOL_ENTRY_SNAPSHOT;
+	pthread_mutex_unlock(&store->lock);
+
+	snap->md.cb = lvol_snapshot_renamed;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(lvol->slot), entry, &snap->md);
+}
+
+static void
+lvol_snapshot_map_done(spdk_event_t event)
+{
+	struct lvol_disk *snap = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct lvol_disk *lvol = snap->origin;
+	struct lvol_store *store = snap->store;
+	struct lvol_entry *entry;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not write volume map\n", snap->disk.name);
+		lvol_attach_release(snap);
+		lvol_snapshot_done(snap, false, LVOL_ONLINE);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	entry = lvol_entry(store, snap->slot);
+	memset(entry, 0, store->blocklen);
+	entry->magic = LVOL_ENTRY_MAGIC;
+	snprintf(entry->name, sizeof(entry->name), "%s", lvol->disk.name);
+	entry->num_clusters = lvol->num_clusters;
+	entry->parent = lvol->slot + 1;
+	pthread_mutex_unlock(&store->lock);
+
+	snap->md.cb = lvol_snapshot_entry_done;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(snap->slot), entry, &snap->md);
+}
+
+/* The volume is frozen, or failed to attach; arg is the snapshot. */
+static void
+lvol_snapshot_frozen(struct lvol_disk *lvol, void *arg)
+{
+	struct lvol_disk *snap = arg;
+	struct lvol_store *store = lvol->store;
+	uint64_t size = lvol_map_size(store, lvol->num_clusters);
+	uint32_t slot;
+
+	if (lvol->state != LVOL_FROZEN) {
+		SPDK_ERRLOG("%s: volume %s is offline\n", snap->disk.name, lvol->disk.name);
+		snap->origin = NULL;
+		lvol_attach_done(snap, false);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	if (lvol_parent_deleting(store, lvol->slot)) {
+		pthread_mutex_unlock(&store->lock);
+		SPDK_ERRLOG("%s: the parent of %s is being deleted\n", snap->disk.name,
+			    lvol->disk.name);
+		lvol_snapshot_done(snap, false, LVOL_ONLINE);
+		return;
+	}
+	slot = lvol_find_free_slot(store);
+	if (slot != LVOL_NO_SLOT) {
+		snap->map = rte_zmalloc(NULL, size, store->blocklen);
+		if (snap->map != NULL) {
+			snap->slot = slot;
+			store->maps[slot] = snap->map;
+		}
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (snap->map == NULL) {
+		SPDK_ERRLOG("%s: no free volume slot in %s\n", snap->disk.name, store->name);
+		lvol_snapshot_done(snap, false, LVOL_ONLINE);
+		return;
+	}
+
+	if (spdk_bdev_write(store->base, snap->map, lvol_map_block(store, slot) * store->blocklen,
+			    size, lvol_snapshot_map_done, snap) == NULL) {
+		lvol_attach_release(snap);
+		lvol_snapshot_done(snap, false, LVOL_ONLINE);
+	}
+}
+
+/*
+ * Find the volume's slot by name, or set up a new one.  The store must be
+ *  online.  The volume leaves LVOL_CREATING, possibly later.
+ */
+static void
+lvol_attach(struct lvol_disk *lvol)
+{
+	struct lvol_store *store = lvol->store;
+	struct lvol_disk *other;
+	struct lvol_entry *entry;
+	uint64_t size = lvol->disk.blockcnt * lvol->disk.blocklen;
+	const char *err = NULL;
+	uint32_t slot, i;
+
+	if ((size + store->cluster_size - 1) / store->cluster_size >
+	    store->total_clusters - store->md_clusters) {
+		SPDK_ERRLOG("%s: larger than the store %s\n", lvol->disk.name, store->name);
+		lvol_attach_done(lvol, false);
+		return;
+	}
+	lvol->num_clusters = (size + store->cluster_size - 1) / store->cluster_size;
+
+	pthread_mutex_lock(&store->lock);
+
+	slot = lvol_find_entry(store, lvol->disk.name);
+	if (slot != LVOL_NO_SLOT) {
+		entry = lvol_entry(store, slot);
+		TAILQ_FOREACH(other, &store->lvols, link) {
+			if (other != lvol && other->slot == slot) {
+				break;
+			}
+		}
+		if (other != NULL) {
+			err = "already attached in";
+		} else if (entry->num_clusters != lvol->num_clusters) {
+			err = "size differs in";
+		} else if (!(entry->flags & LVOL_ENTRY_SNAPSHOT) != !lvol->snapshot) {
+			err = lvol->snapshot ? "is not a snapshot in" : "is a snapshot in";
+		}
+		if (err != NULL) {
+			pthread_mutex_unlock(&store->lock);
+			SPDK_ERRLOG("%s: %s %s\n", lvol->disk.name, err, store->name);
+			lvol_attach_done(lvol, false);
+			return;
+		}
+
+		lvol->slot = slot;
+		lvol->map = store->maps[slot];
+		lvol->origin = NULL;
+		for (i = 0; i < lvol->num_clusters; i++) {
+			if (lvol_owns(lvol->map[i])) {
+				lvol->allocated++;
+			}
+		}
+		pthread_mutex_unlock(&store->lock);
+
+		lvol_attach_done(lvol, true);
+		return;
+	}
+
+	if (lvol->snapshot) {
+		pthread_mutex_unlock(&store->lock);
+		if (lvol->origin == NULL || lvol_freeze(lvol->origin, lvol_snapshot_frozen, lvol) != 0) {
+			SPDK_ERRLOG("%s: could not take snapshot of %s\n", lvol->disk.name,
+				    lvol->origin_name);
+			lvol->origin = NULL;
+			lvol_attach_done(lvol, false);
+		}
+		return;
+	}
+
+	slot = lvol_find_free_slot(store);
+	if (slot == LVOL_NO_SLOT) {
+		pthread_mutex_unlock(&store->lock);
+		SPDK_ERRLOG("%s: no free volume slot in %s\n", lvol->disk.name, store->name);
+		lvol_attach_done(lvol, false);
+		return;
+	}
+
+	lvol->map = rte_zmalloc(NULL, lvol_map_size(store, lvol->num_clusters), store->blocklen);
+	if (lvol->map == NULL) {
+		pthread_mutex_unlock(&store->lock);
+		SPDK_ERRLOG("%s: could not allocate volume map\n", lvol->disk.name);
+		lvol_attach_done(lvol, false);
+		return;
+	}
+	lvol->slot = slot;
+	store->maps[slot] = lvol->map;
+
+	pthread_mutex_unlock(&store->lock);
+
+	/* Clear whatever an earlier volume in the slot left in its map. */
+	if (spdk_bdev_write(store->base, lvol->map, lvol_map_block(store, slot) * store->blocklen,
+			    lvol_map_size(store, lvol->num_clusters), lvol_attach_map_done,
+			    lvol) == NULL) {
+		lvol_attach_release(lvol);
+		lvol_attach_done(lvol, false);
+	}
+}
+
+/*
+ * Deleting a snapshot.  The entry is flagged, the child is frozen while the
+ *  clusters move into its map, the changed map blocks are written, then the
+ *  child's entry takes over the snapshot's parent and the snapshot's entry
+ *  is cleared.  The clusters left over are only freed after that.
+ */
+
+static void
+lvol_merge_free(struct lvol_merge *merge)
+{
+	struct lvol_store *store = merge->store;
+
+	pthread_mutex_lock(&store->lock);
+	TAILQ_REMOVE(&store->merges, merge, link);
+	pthread_mutex_unlock(&store->lock);
+
+	free(merge->blocks);
+	free(merge->freed);
+	free(merge);
+}
+
+static void
+lvol_merge_fail(struct lvol_merge *merge)
+{
+	/* The slot and the clusters stay reserved; the flagged entry is found again on load. */
+	SPDK_ERRLOG("%s: could not delete snapshot %s; it is deleted when the store is loaded again\n",
+		    merge->store->name, merge->name);
+	lvol_merge_free(merge);
+}
+
+static inline struct lvol_merge *
+lvol_merge_from_md(struct spdk_bdev_md_waiter *waiter)
+{
+	return (struct lvol_merge *)((char *)waiter - offsetof(struct lvol_merge, md));
+}
+
+static void
+lvol_merge_dropped(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_merge *merge = lvol_merge_from_md(waiter);
+	struct lvol_store *store = merge->store;
+	uint32_t *map;
+	uint32_t i;
+
+	if (!success) {
+		lvol_merge_fail(merge);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	for (i = 0; i < merge->num_freed; i++) {
+		lvol_defer_free(store, merge->freed[i]);
+	}
+	lvol_release_clusters(store);
+	map = store->maps[merge->slot];
+	store->maps[merge->slot] = NULL;
+	pthread_mutex_unlock(&store->lock);
+
+	SPDK_NOTICELOG("%s: deleted snapshot %s, %u clusters freed\n", store->name, merge->name,
+		       merge->num_freed);
+
+	rte_free(map);
+	lvol_merge_free(merge);
+}
+
+static void
+lvol_merge_drop(struct lvol_merge *merge)
+{
+	struct lvol_store *store = merge->store;
+
+	pthread_mutex_lock(&store->lock);
+	memset(lvol_entry(store, merge->slot), 0, store->blocklen);
+	pthread_mutex_unlock(&store->lock);
+
+	merge->md.cb = lvol_merge_dropped;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(merge->slot), lvol_entry(store, merge->slot),
+		       &merge->md);
+}
+
+static void
+lvol_merge_relinked(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_merge *merge = lvol_merge_from_md(waiter);
+
+	if (!success) {
+		lvol_merge_fail(merge);
+		return;
+	}
+
+	lvol_merge_drop(merge);
+}
+
+static void
+lvol_merge_block_put(struct lvol_merge *merge, bool failed)
+{
+	struct lvol_store *store = merge->store;
+
+	if (failed) {
+		merge->failed = true;
+	}
+
+	if (__sync_sub_and_fetch(&merge->pending, 1) > 0) {
+		return;
+	}
+
+	if (merge->failed) {
+		lvol_merge_fail(merge);
+		return;
+	}
+
+	if (merge->child == LVOL_NO_SLOT) {
+		lvol_merge_drop(merge);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	lvol_entry(store, merge->child)->parent = lvol_entry(store, merge->slot)->parent;
+	pthread_mutex_unlock(&store->lock);
+
+	merge->md.cb = lvol_merge_relinked;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(merge->child), lvol_entry(store, merge->child),
+		       &merge->md);
+}
+
+static void
+lvol_merge_block_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_merge_block *block;
+
+	block = (struct lvol_merge_block *)((char *)waiter - offsetof(struct lvol_merge_block, md));
+	lvol_merge_block_put(block->merge, !success);
+}
+
+/* Write the blocks of the child's map that clusters were moved into. */
+static void
+lvol_merge_write_maps(struct lvol_merge *merge)
+{
+	struct lvol_store *store = merge->store;
+	uint32_t i;
+
+	merge->pending = 1;
+	for (i = 0; i < merge->num_blocks; i++) {
+		if (merge->blocks[i].dirty) {
+			merge->pending++;
+		}
+	}
+
+	for (i = 0; i < merge->num_blocks; i++) {
+		if (merge->blocks[i].dirty) {
+			spdk_bdev_md_commit(&store->md_writer, lvol_map_block(store, merge->child) + i,
+				       (char *)store->maps[merge->child] + (uint64_t)i * store->blocklen,
+				       &merge->blocks[i].md);
+		}
+	}
+
+	lvol_merge_block_put(merge, false);
+}
+
+/*
+ * Move the snapshot's clusters into its child where the child has nothing
+ *  of its own, and note the others to be freed.  When loading, a cluster in
+ *  use already, as it was moved before a restart, is left alone, and moved
+ *  ones are marked used.  Returns the number of clusters moved, or -1 if
+ *  the map is corrupt.  Called with the lock held.
+ */
+static int
+lvol_merge_move(struct lvol_merge *merge, struct lvol_disk *child_lvol, bool loading)
+{
+	struct lvol_store *store = merge->store;
+	uint32_t *map = store->maps[merge->slot];
+	uint32_t *child_map = NULL;
+	uint32_t num_clusters = lvol_entry(store, merge->slot)->num_clusters;
+	uint32_t per_block = lvol_map_entries_per_block(store);
+	uint32_t i, pcluster;
+	int moved = 0;
+
+	if (merge->child != LVOL_NO_SLOT) {
+		child_map = store->maps[merge->child];
+	}
+
+	for (i = 0; i < num_clusters; i++) {
+		pcluster = map[i];
+		if (pcluster == LVOL_UNALLOCATED) {
+			continue;
+		}
+
+		if (loading && lvol_owns(pcluster)) {
+			if (pcluster < store->md_clusters || pcluster >= store->total_clusters) {
+				return -1;
+			}
+			if (spdk_bit_array_get(store->used, pcluster)) {
+				continue;
+			}
+		}
+
+		if (child_map != NULL && child_map[i] == LVOL_UNALLOCATED) {
+			child_map[i] = pcluster;
+			merge->blocks[i / per_block].dirty = true;
+			if (lvol_owns(pcluster)) {
+				moved++;
+				if (loading) {
+					spdk_bit_array_set(store->used, pcluster);
+				}
+				if (child_lvol != NULL) {
+					child_lvol->allocated++;
+				}
+			}
+			continue;
+		}
+
+		if (!loading && lvol_owns(pcluster)) {
+			merge->freed[merge->num_freed++] = pcluster;
+		}
+	}
+
+	return moved;
+}
+
+/* The child is frozen, or has no blockdev; arg is the merge. */
+static void
+lvol_merge_frozen(struct lvol_disk *child_lvol, void *arg)
+{
+	struct lvol_merge *merge = arg;
+	struct lvol_store *store = merge->store;
+	bool frozen = false;
+
+	pthread_mutex_lock(&store->lock);
+	lvol_merge_move(merge, child_lvol, false);
+	if (child_lvol != NULL) {
+		frozen = child_lvol->state == LVOL_FROZEN;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (frozen) {
+		lvol_thaw(child_lvol, LVOL_ONLINE);
+	}
+
+	lvol_merge_write_maps(merge);
+}
+
+static void
+lvol_merge_flagged(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	struct lvol_merge *merge = lvol_merge_from_md(waiter);
+	struct lvol_store *store = merge->store;
+	struct lvol_disk *child_lvol;
+
+	if (!success) {
+		lvol_merge_fail(merge);
+		return;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	TAILQ_FOREACH(child_lvol, &store->lvols, link) {
+		if (merge->child != LVOL_NO_SLOT && child_lvol->slot == merge->child &&
+		    child_lvol->state != LVOL_FAILED) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (child_lvol == NULL) {
+		lvol_merge_frozen(NULL, merge);
+	} else if (lvol_freeze(child_lvol, lvol_merge_frozen, merge) != 0) {
+		lvol_merge_fail(merge);
+	}
+}
+
+/* Called with the lock held. */
+static struct lvol_merge *
+lvol_merge_create(struct lvol_store *store, uint32_t slot, uint32_t child)
+{
+	struct lvol_merge *merge;
+	uint32_t num_clusters = lvol_entry(store, slot)->num_clusters;
+	uint32_t i;
+
+	merge = calloc(1, sizeof(*merge));
+	if (merge == NULL) {
+		return NULL;
+	}
+
+	merge->store = store;
+	merge->slot = slot;
+	merge->child = child;
+	snprintf(merge->name, sizeof(merge->name), "%s", lvol_entry(store, slot)->name);
+	merge->num_blocks = lvol_map_size(store, num_clusters) / store->blocklen;
+	merge->blocks = calloc(merge->num_blocks, sizeof(*merge->blocks));
+	merge->freed = calloc(num_clusters, sizeof(*merge->freed));
+	if (merge->blocks == NULL || merge->freed == NULL) {
+		free(merge->blocks);
+		free(merge->freed);
+		free(merge);
+		return NULL;
+	}
+
+	for (i = 0; i < merge->num_blocks; i++) {
+		merge->blocks[i].md.cb = lvol_merge_block_done;
+		merge->blocks[i].merge = merge;
+	}
+
+	TAILQ_INSERT_TAIL(&store->merges, merge, link);
+
+	return merge;
+}
+
+/*
+ * Loading a store.  The superblock is read (a missing one formats the
+ *  store), then the volume table and the map of each volume in it.
+ */
+
+static void
+lvol_load_done(struct lvol_store *store, bool success)
+{
+	struct lvol_disk *lvol, *tmp;
+
+	pthread_mutex_lock(&store->lock);
+	store->state = success ? LVOL_STORE_ONLINE : LVOL_STORE_FAILED;
+	pthread_mutex_unlock(&store->lock);
+
+	if (success) {
+		SPDK_NOTICELOG("%s: %u of %u clusters of %u KiB free on %s\n", store->name,
+			       store->free_clusters, store->total_clusters,
+			       store->cluster_size / 1024, store->base->name);
+	}
+
+	TAILQ_FOREACH_SAFE(lvol, &store->lvols, link, tmp) {
+		if (success) {
+			lvol_attach(lvol);
+		} else {
+			lvol_attach_done(lvol, false);
+		}
+	}
+}
+
+static void
+lvol_load_finish(struct lvol_store *store)
+{
+	struct lvol_merge *merge, *tmp;
+	struct lvol_entry *entry;
+	uint32_t slot, i, pcluster, used, child;
+	int moved;
+
+	for (i = 0; i < store->md_clusters; i++) {
+		spdk_bit_array_set(store->used, i);
+	}
+	used = store->md_clusters;
+
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		entry = lvol_entry(store, slot);
+		if (store->maps[slot] == NULL || (entry->flags & LVOL_ENTRY_DELETING)) {
+			continue;
+		}
+		for (i = 0; i < entry->num_clusters; i++) {
+			pcluster = store->maps[slot][i];
+			if (!lvol_owns(pcluster)) {
+				continue;
+			}
+			if (pcluster < store->md_clusters || pcluster >= store->total_clusters ||
+			    spdk_bit_array_get(store->used, pcluster)) {
+				SPDK_ERRLOG("%s: volume %s maps cluster %u twice or out of range\n",
+					    store->name, entry->name, pcluster);
+				lvol_load_done(store, false);
+				return;
+			}
+			spdk_bit_array_set(store->used, pcluster);
+			used++;
+		}
+	}
+
+	/* Finish deleting the snapshots whose deletion was interrupted. */
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		entry = lvol_entry(store, slot);
+		if (store->maps[slot] == NULL || !(entry->flags & LVOL_ENTRY_DELETING)) {
+			continue;
+		}
+		merge = NULL;
+		moved = -1;
+		if (lvol_children(store, slot, &child) <= 1) {
+			merge = lvol_merge_create(store, slot, child);
+		}
+		if (merge != NULL) {
+			moved = lvol_merge_move(merge, NULL, true);
+		}
+		if (moved < 0) {
+			SPDK_ERRLOG("%s: could not finish deleting snapshot %s\n", store->name,
+				    entry->name);
+			lvol_load_done(store, false);
+			return;
+		}
+		used += moved;
+	}
+
+	store->free_clusters = store->total_clusters - used;
+	store->alloc_hint = store->md_clusters;
+	lvol_load_done(store, true);
+
+	TAILQ_FOREACH_SAFE(merge, &store->merges, link, tmp) {
+		lvol_merge_write_maps(merge);
+	}
+}
+
+static void lvol_load_next_map(struct lvol_store *store);
+
+static void
+lvol_load_map_done(spdk_event_t event)
+{
+	struct lvol_store *store = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct lvol_entry *entry = lvol_entry(store, store->load_slot);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+	uint64_t size = lvol_map_size(store, entry->num_clusters);
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read the map of volume %s\n", store->name, entry->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	/* Entries past the end of the volume are never used; keep them zero on disk. */
+	memset(&store->maps[store->load_slot][entry->num_clusters], 0,
+	       size - entry->num_clusters * sizeof(uint32_t));
+
+	store->load_slot++;
+	lvol_load_next_map(store);
+}
+
+static void
+lvol_load_next_map(struct lvol_store *store)
+{
+	struct lvol_entry *entry;
+	uint32_t slot;
+	uint64_t size;
+
+	for (slot = store->load_slot; slot < store->max_lvols; slot++) {
+		if (lvol_entry(store, slot)->magic == LVOL_ENTRY_MAGIC) {
+			break;
+		}
+	}
+
+	if (slot == store->max_lvols) {
+		lvol_load_finish(store);
+		return;
+	}
+
+	entry = lvol_entry(store, slot);
+	if (entry->num_clusters == 0 ||
+	    entry->num_clusters > store->total_clusters - store->md_clusters ||
+	    strnlen(entry->name, sizeof(entry->name)) == sizeof(entry->name)) {
+		SPDK_ERRLOG("%s: volume entry %u is corrupt\n", store->name, slot);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	size = lvol_map_size(store, entry->num_clusters);
+	store->maps[slot] = rte_malloc(NULL, size, store->blocklen);
+	if (store->maps[slot] == NULL) {
+		SPDK_ERRLOG("%s: could not allocate the map of volume %s\n", store->name,
+			    entry->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	store->load_slot = slot;
+	if (spdk_bdev_read(store->base, store->maps[slot],
+			   lvol_map_block(store, slot) * store->blocklen, size, lvol_load_map_done,
+			   store) == NULL) {
+		lvol_load_done(store, false);
+	}
+}
+
+static void
+lvol_load_drop_done(struct spdk_bdev_md_waiter *waiter, bool success)
+{
+	/* If the write failed, the entry is dropped again on the next load. */
+	free(waiter);
+}
+
+/*
+ * Check the links from volumes to their parents, and drop the new slot of a
+ *  snapshot that was not finished: its parent still has the volume's name
+ *  and is no snapshot.  Returns -1 if the volume table is corrupt.
+ */
+static int
+lvol_load_check_entries(struct lvol_store *store)
+{
+	struct lvol_entry *entry, *parent;
+	struct spdk_bdev_md_waiter *waiter;
+	uint32_t slot, i, p;
+
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		entry = lvol_entry(store, slot);
+		if (entry->magic != LVOL_ENTRY_MAGIC || entry->parent == 0) {
+			continue;
+		}
+		if (entry->parent > store->max_lvols || entry->parent == slot + 1 ||
+		    lvol_entry(store, entry->parent - 1)->magic != LVOL_ENTRY_MAGIC) {
+			SPDK_ERRLOG("%s: volume entry %u has no parent\n", store->name, slot);
+			return -1;
+		}
+
+		parent = lvol_entry(store, entry->parent - 1);
+		if (!(parent->flags & LVOL_ENTRY_SNAPSHOT) &&
+		    strncmp(parent->name, entry->name, sizeof(entry->name)) == 0) {
+			SPDK_NOTICELOG("%s: dropping unfinished snapshot of %.*s\n", store->name,
+				       (int)sizeof(entry->name), entry->name);
+			memset(entry, 0, store->blocklen);
+			waiter = calloc(1, sizeof(*waiter));
+			if (waiter != NULL) {
+				waiter->cb = lvol_load_drop_done;
+				spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(slot), entry, waiter);
+			}
+			continue;
+		}
+
+		if (!(parent->flags & LVOL_ENTRY_SNAPSHOT) ||
+		    parent->num_clusters != entry->num_clusters) {
+			SPDK_ERRLOG("%s: the parent of volume entry %u is no snapshot of it\n",
+				    store->name, slot);
+			return -1;
+		}
+	}
+
+	/* A loop of parents would make reads spin. */
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		p = slot;
+		for (i = 0; lvol_entry(store, p)->magic == LVOL_ENTRY_MAGIC &&
+		     lvol_entry(store, p)->parent != 0; i++) {
+			if (i == store->max_lvols) {
+				SPDK_ERRLOG("%s: the parents of volume entry %u form a loop\n",
+					    store->name, slot);
+				return -1;
+			}
+			p = lvol_entry(store, p)->parent - 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+lvol_load_entries_done(spdk_event_t event)
+{
+	struct lvol_store *store = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read the volume table\n", store->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	if (lvol_load_check_entries(store) != 0) {
+		lvol_load_done(store, false);
+		return;
+	}
+
+	store->load_slot = 0;
+	lvol_load_next_map(store);
+}
+
+/* Allocate the in-memory metadata once the geometry is known. */
+static int
+lvol_store_alloc_md(struct lvol_store *store)
+{
+	store->used = spdk_bit_array_create(store->total_clusters);
+	store->entries = rte_zmalloc(NULL, (uint64_t)store->max_lvols * store->blocklen,
+				     store->blocklen);
+	store->maps = calloc(store->max_lvols, sizeof(*store->maps));
+	store->zero_buf = rte_zmalloc(NULL, store->cluster_size, store->blocklen);
+
+	if (store->used == NULL || store->entries == NULL || store->maps == NULL ||
+	    store->zero_buf == NULL) {
+		SPDK_ERRLOG("%s: could not allocate metadata\n", store->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+lvol_format_super_done(spdk_event_t event)
+{
+	struct lvol_store *store = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not write the superblock\n", store->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	lvol_load_finish(store);
+}
+
+static void
+lvol_format_entries_done(spdk_event_t event)
+{
+	struct lvol_store *store = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct lvol_super *super = store->super_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not clear the volume table\n", store->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	/* The superblock goes last, so that an interrupted format is simply redone. */
+	memset(super, 0, store->blocklen);
+	super->magic = LVOL_SUPER_MAGIC;
+	super->version = LVOL_VERSION;
+	super->blocklen = store->blocklen;
+	super->base_blockcnt = store->base->blockcnt;
+	super->cluster_size = store->cluster_size;
+	super->total_clusters = store->total_clusters;
+	super->md_clusters = store->md_clusters;
+	super->max_lvols = store->max_lvols;
+	super->map_blocks = store->map_blocks;
+
+	if (spdk_bdev_write(store->base, super, 0, store->blocklen, lvol_format_super_done,
+			    store) == NULL) {
+		lvol_load_done(store, false);
+	}
+}
+
+static void
+lvol_format(struct lvol_store *store)
+{
+	SPDK_NOTICELOG("%s: formatting %s\n", store->name, store->base->name);
+
+	if (lvol_store_alloc_md(store) != 0) {
+		lvol_load_done(store, false);
+		return;
+	}
+
+	if (spdk_bdev_write(store->base, store->entries, lvol_entry_block(0) * store->blocklen,
+			    (uint64_t)store->max_lvols * store->blocklen, lvol_format_entries_done,
+			    store) == NULL) {
+		lvol_load_done(store, false);
+	}
+}
+
+static void
+lvol_load_super_done(spdk_event_t event)
+{
+	struct lvol_store *store = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct lvol_super *super = store->super_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+	uint32_t cluster_size = store->cluster_size;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read the superblock from %s\n", store->name,
+			    store->base->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	if (super->magic != LVOL_SUPER_MAGIC) {
+		lvol_format(store);
+		return;
+	}
+
+	if (super->version != LVOL_VERSION || super->blocklen != store->blocklen ||
+	    super->base_blockcnt != store->base->blockcnt ||
+	    lvol_store_geometry(store, super->cluster_size) != 0 ||
+	    super->total_clusters != store->total_clusters ||
+	    super->md_clusters != store->md_clusters ||
+	    super->max_lvols != store->max_lvols ||
+	    super->map_blocks != store->map_blocks) {
+		SPDK_ERRLOG("%s: %s holds a store of a different geometry or version\n",
+			    store->name, store->base->name);
+		lvol_load_done(store, false);
+		return;
+	}
+
+	if (store->cluster_size != cluster_size) {
+		SPDK_NOTICELOG("%s: using the cluster size of %u KiB from %s\n", store->name,
+			       store->cluster_size / 1024, store->base->name);
+	}
+
+	if (lvol_store_alloc_md(store) != 0) {
+		lvol_load_done(store, false);
+		return;
+	}
+
+	if (spdk_bdev_read(store->base, store->entries, lvol_entry_block(0) * store->blocklen,
+			   (uint64_t)store->max_lvols * store->blocklen, lvol_load_entries_done,
+			   store) == NULL) {
+		lvol_load_done(store, false);
+	}
+}
+
+static void
+lvol_free_store(struct lvol_store *store)
+{
+	struct lvol_disk *lvol;
+	struct lvol_alloc *alloc;
+	struct lvol_merge *merge;
+	uint32_t slot;
+
+	while ((lvol = TAILQ_FIRST(&store->lvols)) != NULL) {
+		TAILQ_REMOVE(&store->lvols, lvol, link);
+		free(lvol);
+	}
+
+	spdk_bdev_md_writer_fini(&store->md_writer);
+
+	while ((alloc = TAILQ_FIRST(&store->allocs)) != NULL) {
+		TAILQ_REMOVE(&store->allocs, alloc, link);
+		rte_free(alloc->buf);
+		free(alloc);
+	}
+
+	while ((merge = TAILQ_FIRST(&store->merges)) != NULL) {
+		TAILQ_REMOVE(&store->merges, merge, link);
+		free(merge->blocks);
+		free(merge->freed);
+		free(merge);
+	}
+
+	if (store->maps != NULL) {
+		for (slot = 0; slot < store->max_lvols; slot++) {
+			rte_free(store->maps[slot]);
+		}
+	}
+
+	store->base->claimed = false;
+
+	pthread_mutex_destroy(&store->lock);
+	spdk_bit_array_free(&store->used);
+	rte_free(store->super_buf);
+	rte_free(store->entries);
+	rte_free(store->zero_buf);
+	free(store->maps);
+	free(store->pending_free);
+	free(store->next_free);
+	free(store);
+}
+
+static struct lvol_store *
+lvol_store_create(const char *name, struct spdk_bdev *base, uint32_t cluster_size)
+{
+	struct lvol_store *store;
+
+	if (spdk_lvol_store_get_by_name(name) != NULL) {
+		SPDK_ERRLOG("%s: volume store already exists\n", name);
+		return NULL;
+	}
+
+	if (base->claimed) {
+		SPDK_ERRLOG("%s: base blockdev %s is already in use\n", name, base->name);
+		return NULL;
+	}
+
+	if (base->blocklen < sizeof(struct lvol_entry) || base->blocklen % sizeof(uint32_t) != 0) {
+		SPDK_ERRLOG("%s: block size %u of %s is not supported\n", name, base->blocklen,
+			    base->name);
+		return NULL;
+	}
+
+	store = calloc(1, sizeof(*store));
+	if (store == NULL) {
+		SPDK_ERRLOG("could not allocate volume store\n");
+		return NULL;
+	}
+
+	snprintf(store->name, sizeof(store->name), "%s", name);
+	store->base = base;
+	store->blocklen = base->blocklen;
+	if (lvol_store_geometry(store, cluster_size) != 0) {
+		SPDK_ERRLOG("%s: cluster size %u does not suit %s\n", name, cluster_size,
+			    base->name);
+		free(store);
+		return NULL;
+	}
+
+	pthread_mutex_init(&store->lock, NULL);
+	store->state = LVOL_STORE_LOADING;
+	spdk_bdev_md_writer_init(&store->md_writer, base, &store->lock, store->name);
+	TAILQ_INIT(&store->allocs);
+	TAILQ_INIT(&store->merges);
+	TAILQ_INIT(&store->lvols);
+
+	store->super_buf = rte_zmalloc(NULL, store->blocklen, store->blocklen);
+	if (store->super_buf == NULL) {
+		SPDK_ERRLOG("%s: could not allocate superblock\n", name);
+		pthread_mutex_destroy(&store->lock);
+		free(store);
+		return NULL;
+	}
+
+	base->claimed = true;
+	TAILQ_INSERT_TAIL(&g_lvol_stores, store, link);
+
+	/* Volumes created meanwhile are attached once the metadata is loaded. */
+	if (spdk_bdev_read(base, store->super_buf, 0, store->blocklen, lvol_load_super_done,
+			   store) == NULL) {
+		store->state = LVOL_STORE_FAILED;
+	}
+
+	return store;
+}
+
+struct lvol_store *
+spdk_lvol_store_first(void)
+{
+	return TAILQ_FIRST(&g_lvol_stores);
+}
+
+struct lvol_store *
+spdk_lvol_store_next(struct lvol_store *prev)
+{
+	return TAILQ_NEXT(prev, link);
+}
+
+struct lvol_store *
+spdk_lvol_store_get_by_name(const char *name)
+{
+	struct lvol_store *store;
+
+	TAILQ_FOREACH(store, &g_lvol_stores, link) {
+		if (strcmp(store->name, name) == 0) {
+			return store;
+		}
+	}
+
+	return NULL;
+}
+
+struct lvol_disk *
+spdk_lvol_get_by_name(const char *name)
+{
+	struct spdk_bdev *bdev = spdk_bdev_get_by_name(name);
+
+	if (bdev == NULL || bdev->fn_table != &lvol_fn_table) {
+		return NULL;
+	}
+
+	return (struct lvol_disk *)bdev;
+}
+
+static struct lvol_disk *
+lvol_disk_alloc(struct lvol_store *store, const char *name, uint64_t size)
+{
+	struct lvol_disk *lvol;
+
+	if (strlen(name) >= SPDK_BDEV_MAX_NAME_LENGTH) {
+		SPDK_ERRLOG("%s: volume name is too long\n", name);
+		return NULL;
+	}
+
+	if (spdk_bdev_get_by_name(name) != NULL) {
+		SPDK_ERRLOG("%s: blockdev already exists\n", name);
+		return NULL;
+	}
+
+	if (size < store->blocklen) {
+		SPDK_ERRLOG("%s: volume is smaller than one block\n", name);
+		return NULL;
+	}
+
+	if (store->state == LVOL_STORE_FAILED) {
+		SPDK_ERRLOG("%s: volume store %s is offline\n", name, store->name);
+		return NULL;
+	}
+
+	lvol = calloc(1, sizeof(*lvol));
+	if (lvol == NULL) {
+		SPDK_ERRLOG("could not allocate volume\n");
+		return NULL;
+	}
+
+	lvol->store = store;
+	lvol->state = LVOL_CREATING;
+	lvol->slot = LVOL_NO_SLOT;
+	lvol->clone_parent = LVOL_NO_SLOT;
+	TAILQ_INIT(&lvol->waiting);
+
+	snprintf(lvol->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(lvol->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Logical volume");
+
+	lvol->disk.write_cache = store->base->write_cache;
+	lvol->disk.need_aligned_buffer = store->base->need_aligned_buffer;
+	lvol->disk.blocklen = store->blocklen;
+	lvol->disk.blockcnt = size / store->blocklen;
+	lvol->disk.thin_provisioning = 1;
+	lvol->disk.max_unmap_bdesc_count = LVOL_MAX_UNMAP_BDESC;
+	lvol->disk.ctxt = lvol;
+	lvol->disk.fn_table = &lvol_fn_table;
+
+	return lvol;
+}
+
+/* Register the volume, and attach it unless the store is still loading. */
+static struct lvol_disk *
+lvol_disk_add(struct lvol_disk *lvol)
+{
+	struct lvol_store *store = lvol->store;
+	enum lvol_store_state state;
+
+	pthread_mutex_lock(&store->lock);
+	TAILQ_INSERT_TAIL(&store->lvols, lvol, link);
+	state = store->state;
+	pthread_mutex_unlock(&store->lock);
+
+	spdk_bdev_register(&lvol->disk);
+
+	if (state == LVOL_STORE_ONLINE) {
+		lvol_attach(lvol);
+		if (lvol->state == LVOL_FAILED) {
+			spdk_bdev_unregister(&lvol->disk);
+			return NULL;
+		}
+	}
+
+	return lvol;
+}
+
+struct lvol_disk *
+spdk_lvol_create(struct lvol_store *store, const char *name, uint64_t size)
+{
+	struct lvol_disk *lvol;
+
+	lvol = lvol_disk_alloc(store, name, size);
+	if (lvol == NULL) {
+		return NULL;
+	}
+
+	return lvol_disk_add(lvol);
+}
+
+struct lvol_disk *
+spdk_lvol_snapshot(struct lvol_disk *lvol, const char *name)
+{
+	struct lvol_store *store = lvol->store;
+	struct lvol_disk *snap;
+	bool busy;
+
+	if (lvol->snapshot) {
+		SPDK_ERRLOG("%s: %s is a snapshot already\n", name, lvol->disk.name);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	busy = lvol->frozen_fn != NULL || lvol->state == LVOL_FROZEN ||
+	       (lvol->slot != LVOL_NO_SLOT && lvol_parent_deleting(store, lvol->slot));
+	pthread_mutex_unlock(&store->lock);
+
+	if (busy) {
+		SPDK_ERRLOG("%s: volume %s is busy\n", name, lvol->disk.name);
+		return NULL;
+	}
+
+	snap = lvol_disk_alloc(store, name, lvol->disk.blockcnt * lvol->disk.blocklen);
+	if (snap == NULL) {
+		return NULL;
+	}
+
+	snprintf(snap->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH,
+		 "Logical volume snapshot");
+	snap->disk.thin_provisioning = 0;
+	snap->snapshot = true;
+	snap->origin = lvol;
+	snprintf(snap->origin_name, sizeof(snap->origin_name), "%s", lvol->disk.name);
+
+	return lvol_disk_add(snap);
+}
+
+struct lvol_disk *
+spdk_lvol_clone(struct lvol_store *store, const char *snapshot, const char *name)
+{
+	struct lvol_disk *lvol;
+	uint32_t slot = LVOL_NO_SLOT;
+	uint64_t size = 0;
+
+	pthread_mutex_lock(&store->lock);
+	if (store->state == LVOL_STORE_ONLINE) {
+		slot = lvol_find_entry(store, snapshot);
+		if (slot != LVOL_NO_SLOT && !(lvol_entry(store, slot)->flags & LVOL_ENTRY_SNAPSHOT)) {
+			slot = LVOL_NO_SLOT;
+		}
+	}
+	if (slot != LVOL_NO_SLOT) {
+		size = (uint64_t)lvol_entry(store, slot)->num_clusters * store->cluster_size;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (slot == LVOL_NO_SLOT) {
+		SPDK_ERRLOG("%s: snapshot %s not found in %s\n", name, snapshot, store->name);
+		return NULL;
+	}
+
+	lvol = lvol_disk_alloc(store, name, size);
+	if (lvol == NULL) {
+		return NULL;
+	}
+
+	lvol->clone_parent = slot;
+
+	return lvol_disk_add(lvol);
+}
+
+int
+spdk_lvol_delete(struct lvol_disk *lvol)
+{
+	struct lvol_store *store = lvol->store;
+	bool busy;
+
+	if (lvol->snapshot && lvol->state == LVOL_ONLINE) {
+		return spdk_lvol_snapshot_delete(store, lvol->disk.name);
+	}
+
+	if (lvol->disk.claimed) {
+		return -EBUSY;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	busy = lvol->state == LVOL_CREATING || lvol->state == LVOL_FROZEN ||
+	       lvol->frozen_fn != NULL ||
+	       (lvol->slot != LVOL_NO_SLOT && lvol_parent_deleting(store, lvol->slot));
+	if (busy) {
+		pthread_mutex_unlock(&store->lock);
+		return -EBUSY;
+	}
+	lvol->deleting = true;
+	pthread_mutex_unlock(&store->lock);
+
+	spdk_bdev_unregister(&lvol->disk);
+
+	return 0;
+}
+
+int
+spdk_lvol_snapshot_delete(struct lvol_store *store, const char *name)
+{
+	struct lvol_disk *lvol, *snap = NULL;
+	struct lvol_merge *merge;
+	uint32_t slot, child;
+
+	pthread_mutex_lock(&store->lock);
+
+	slot = LVOL_NO_SLOT;
+	if (store->state == LVOL_STORE_ONLINE) {
+		slot = lvol_find_entry(store, name);
+	}
+	if (slot == LVOL_NO_SLOT || !(lvol_entry(store, slot)->flags & LVOL_ENTRY_SNAPSHOT)) {
+		pthread_mutex_unlock(&store->lock);
+		return -ENOENT;
+	}
+
+	if (lvol_children(store, slot, &child) > 1) {
+		pthread_mutex_unlock(&store->lock);
+		return -EBUSY;
+	}
+
+	TAILQ_FOREACH(lvol, &store->lvols, link) {
+		if (lvol->slot == slot) {
+			/* While a snapshot is taken, the volume still holds its slot. */
+			if (!lvol->snapshot || lvol->disk.claimed) {
+				pthread_mutex_unlock(&store->lock);
+				return -EBUSY;
+			}
+			snap = lvol;
+		}
+		if ((lvol->state == LVOL_CREATING && lvol->clone_parent == slot) ||
+		    (child != LVOL_NO_SLOT && lvol->slot == child &&
+		     (lvol->frozen_fn != NULL || lvol->state == LVOL_FROZEN))) {
+			pthread_mutex_unlock(&store->lock);
+			return -EBUSY;
+		}
+	}
+
+	merge = lvol_merge_create(store, slot, child);
+	if (merge == NULL) {
+		pthread_mutex_unlock(&store->lock);
+		return -ENOMEM;
+	}
+
+	lvol_entry(store, slot)->flags |= LVOL_ENTRY_DELETING;
+	if (snap != NULL) {
+		/* Fail new reads; its clusters are about to move to the child. */
+		snap->state = LVOL_FAILED;
+	}
+
+	pthread_mutex_unlock(&store->lock);
+
+	if (snap != NULL) {
+		spdk_bdev_unregister(&snap->disk);
+	}
+
+	merge->md.cb = lvol_merge_flagged;
+	spdk_bdev_md_commit(&store->md_writer, lvol_entry_block(slot), lvol_entry(store, slot), &merge->md);
+
+	return 0;
+}
+
+int
+spdk_lvol_store_get_snapshots(struct lvol_store *store, struct lvol_snapshot_info *info, int max)
+{
+	struct lvol_entry *entry;
+	struct lvol_disk *lvol;
+	uint32_t slot, i, child;
+	int count = 0;
+
+	pthread_mutex_lock(&store->lock);
+
+	for (slot = 0; slot < store->max_lvols; slot++) {
+		entry = lvol_entry(store, slot);
+		if (entry->magic != LVOL_ENTRY_MAGIC || !(entry->flags & LVOL_ENTRY_SNAPSHOT) ||
+		    (entry->flags & LVOL_ENTRY_DELETING)) {
+			continue;
+		}
+
+		if (count < max) {
+			memset(&info[count], 0, sizeof(info[count]));
+			snprintf(info[count].name, sizeof(info[count].name), "%.*s",
+				 (int)sizeof(entry->name), entry->name);
+			if (entry->parent != 0) {
+				snprintf(info[count].parent, sizeof(info[count].parent), "%.*s",
+					 (int)sizeof(entry->name), lvol_entry(store, entry->parent - 1)->name);
+			}
+			info[count].num_clusters = entry->num_clusters;
+			for (i = 0; i < entry->num_clusters; i++) {
+				if (lvol_owns(store->maps[slot][i])) {
+					info[count].allocated_clusters++;
+				}
+			}
+			info[count].children = lvol_children(store, slot, &child);
+			TAILQ_FOREACH(lvol, &store->lvols, link) {
+				if (lvol->slot == slot && lvol->snapshot) {
+					info[count].attached = true;
+				}
+			}
+		}
+		count++;
+	}
+
+	pthread_mutex_unlock(&store->lock);
+
+	return count;
+}
+
+bool
+spdk_lvol_get_parent(struct lvol_disk *lvol, char *name, size_t len)
+{
+	struct lvol_store *store = lvol->store;
+	uint32_t parent = 0;
+
+	pthread_mutex_lock(&store->lock);
+	if (lvol->slot != LVOL_NO_SLOT) {
+		parent = lvol_entry(store, lvol->slot)->parent;
+	}
+	if (parent != 0) {
+		snprintf(name, len, "%.*s", LVOL_NAME_LEN, lvol_entry(store, parent - 1)->name);
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	return parent != 0;
+}
+
+uint32_t
+spdk_lvol_store_free_clusters(struct lvol_store *store)
+{
+	return store->free_clusters;
+}
+
+uint32_t
+spdk_lvol_allocated_clusters(struct lvol_disk *lvol)
+{
+	return lvol->allocated;
+}
+
+static int
+blockdev_lvol_initialize(void)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "Lvol");
+	struct lvol_store *store;
+	struct lvol_disk *lvol;
+	struct spdk_bdev *base;
+	const char *name, *base_name, *store_name, *val;
+	uint32_t cluster_size;
+	uint64_t size_mb;
+	int i;
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "LvolStore", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "LvolStore", i, 0);
+		base_name = spdk_conf_section_get_nmval(sp, "LvolStore", i, 1);
+		if (name == NULL || base_name == NULL) {
+			SPDK_ERRLOG("LvolStore line %d: format error\n", i);
+			return -1;
+		}
+
+		cluster_size = LVOL_DEFAULT_CLUSTER_SIZE;
+		val = spdk_conf_section_get_nmval(sp, "LvolStore", i, 2);
+		if (val != NULL) {
+			cluster_size = strtoul(val, NULL, 10) * 1024;
+		}
+
+		base = spdk_bdev_get_by_name(base_name);
+		if (base == NULL) {
+			SPDK_ERRLOG("%s: blockdev %s not found\n", name, base_name);
+			return -1;
+		}
+
+		if (lvol_store_create(name, base, cluster_size) == NULL) {
+			return -1;
+		}
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "Lvol", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "Lvol", i, 0);
+		store_name = spdk_conf_section_get_nmval(sp, "Lvol", i, 1);
+		val = spdk_conf_section_get_nmval(sp, "Lvol", i, 2);
+		if (name == NULL || store_name == NULL || val == NULL) {
+			SPDK_ERRLOG("Lvol line %d: format error\n", i);
+			return -1;
+		}
+
+		store = spdk_lvol_store_get_by_name(store_name);
+		if (store == NULL) {
+			SPDK_ERRLOG("%s: volume store %s not found\n", name, store_name);
+			return -1;
+		}
+
+		size_mb = strtoull(val, NULL, 10);
+		if (spdk_lvol_create(store, name, size_mb * 1024 * 1024) == NULL) {
+			return -1;
+		}
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "Snapshot", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "Snapshot", i, 0);
+		val = spdk_conf_section_get_nmval(sp, "Snapshot", i, 1);
+		if (name == NULL || val == NULL) {
+			SPDK_ERRLOG("Snapshot line %d: format error\n", i);
+			return -1;
+		}
+
+		lvol = spdk_lvol_get_by_name(val);
+		if (lvol == NULL) {
+			SPDK_ERRLOG("%s: volume %s not found\n", name, val);
+			return -1;
+		}
+
+		if (spdk_lvol_snapshot(lvol, name) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_lvol_finish(void)
+{
+	struct lvol_store *store;
+
+	while ((store = TAILQ_FIRST(&g_lvol_stores)) != NULL) {
+		TAILQ_REMOVE(&g_lvol_stores, store, link);
+		lvol_free_store(store);
+	}
+}
+
+static void
+blockdev_lvol_get_spdk_running_config(FILE *fp)
+{
+	struct lvol_store *store;
+	struct lvol_disk *lvol;
+
+	if (TAILQ_EMPTY(&g_lvol_stores)) {
+		return;
+	}
+
+	fprintf(fp,
+		"\n"
+		"# LvolStore <name> <base blockdev> [<cluster size in KiB>]\n"
+		"# Lvol <name> <volume store> <size in MB>\n"
+		"# Snapshot <name> <volume>\n"
+		"[Lvol]\n");
+	TAILQ_FOREACH(store, &g_lvol_stores, link) {
+		fprintf(fp, "  LvolStore %s %s %u\n", store->name, store->base->name,
+			store->cluster_size / 1024);
+	}
+	TAILQ_FOREACH(store, &g_lvol_stores, link) {
+		TAILQ_FOREACH(lvol, &store->lvols, link) {
+			if (!lvol->snapshot) {
+				fprintf(fp, "  Lvol %s %s %" PRIu64 "\n", lvol->disk.name, store->name,
+					lvol->disk.blockcnt * lvol->disk.blocklen / (1024 * 1024));
+			}
+		}
+	}
+	TAILQ_FOREACH(store, &g_lvol_stores, link) {
+		TAILQ_FOREACH(lvol, &store->lvols, link) {
+			/* Once its volume is deleted, the snapshot only stays in the store for its clones. */
+			if (lvol->snapshot && spdk_lvol_get_by_name(lvol->origin_name) != NULL) {
+				fprintf(fp, "  Snapshot %s %s\n", lvol->disk.name, lvol->origin_name);
+			}
+		}
+	}
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("lvol", SPDK_TRACE_LVOL)
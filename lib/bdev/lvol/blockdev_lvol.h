@@ -0,0 +1,406 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SPDK_BLOCKDEV_LVOL_H
+#define SPDK_BLOCKDEV_LVOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "spdk/queue.h"
+#include "spdk/bdev.h"
+#include "spdk/bit_array.h"
+
+#include "bdev_module.h"
+
+/*
+ * On-disk layout of a logical volume store on its base blockdev:
+ *
+ *  block 0				struct lvol_super
+ *  blocks 1 .. max_lvols		one struct lvol_entry per volume slot
+ *  then max_lvols map slots		map_blocks blocks each
+ *
+ * A map slot holds one uint32_t per logical cluster of the volume: the
+ *  physical cluster backing it, or LVOL_UNALLOCATED.  The metadata is
+ *  rounded up to whole clusters, which are never allocated.
+ *
+ * A snapshot is a read-only volume that keeps the clusters its volume had
+ *  when it was taken; the volume continues in a new slot with an empty map
+ *  and the snapshot as its parent.  Reads of an unallocated cluster go on
+ *  to the parent, and the first write to it copies the parent's cluster.
+ *  A clone is a writable volume created with a snapshot as its parent.
+ */
+#define LVOL_SUPER_MAGIC	0x314C564C4B445053ULL	/* "SPDKLVL1" */
+#define LVOL_ENTRY_MAGIC	0x454C564C4B445053ULL	/* "SPDKLVLE" */
+#define LVOL_VERSION		1
+
+#define LVOL_MAX_LVOLS		64
+#define LVOL_NAME_LEN		64
+
+#define LVOL_DEFAULT_CLUSTER_SIZE	(1024 * 1024)
+#define LVOL_MIN_CLUSTER_SIZE		4096
+#define LVOL_MAX_CLUSTER_SIZE		(4 * 1024 * 1024)
+
+#define LVOL_MAX_UNMAP_BDESC	16
+
+/* Cluster 0 always holds the superblock, so it can mark unallocated clusters. */
+#define LVOL_UNALLOCATED	0
+
+/* Unmapped in a volume with a parent: reads zeroes instead of the parent's data. */
+#define LVOL_ZERO_CLUSTER	UINT32_MAX
+
+#define LVOL_NO_SLOT		UINT32_MAX
+
+struct lvol_super {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	blocklen;
+	uint64_t	base_blockcnt;
+	uint32_t	cluster_size;
+	uint32_t	total_clusters;
+	uint32_t	md_clusters;
+	uint32_t	max_lvols;
+	uint32_t	map_blocks;
+	uint32_t	reserved;
+};
+
+struct lvol_entry {
+	/** LVOL_ENTRY_MAGIC while the slot holds a volume */
+	uint64_t	magic;
+	char		name[LVOL_NAME_LEN];
+	uint32_t	num_clusters;
+
+	/** Slot of the snapshot the volume was created from, plus one; 0 if none */
+	uint32_t	parent;
+
+	uint32_t	flags;
+	uint32_t	reserved;
+};
+
+/* Read-only; the parent of the volume it was taken of */
+#define LVOL_ENTRY_SNAPSHOT	(1U << 0)
+
+/* Being deleted; its clusters are moved to its child, or freed */
+#define LVOL_ENTRY_DELETING	(1U << 1)
+
+enum lvol_store_state {
+	/** Reading or formatting the metadata; volume I/O is queued */
+	LVOL_STORE_LOADING,
+
+	LVOL_STORE_ONLINE,
+
+	/** The metadata could not be read or is inconsistent; all I/O fails */
+	LVOL_STORE_FAILED,
+};
+
+enum lvol_state {
+	/** Waiting for the store to load, or for the volume's slot to be written */
+	LVOL_CREATING,
+
+	LVOL_ONLINE,
+
+	/** Taking a snapshot or merging one; new I/O waits until the I/O in flight completes */
+	LVOL_FROZEN,
+
+	LVOL_FAILED,
+};
+
+struct lvol_store;
+struct lvol_disk;
+struct lvol_merge;
+
+typedef void (*lvol_frozen_fn)(struct lvol_disk *lvol, void *arg);
+
+struct lvol_task {
+	struct spdk_bdev_io	*bdev_io;
+
+	/** On lvol_disk::waiting or lvol_alloc::waiters */
+	TAILQ_ENTRY(lvol_task)	link;
+
+	/** Child I/Os, allocations and map updates outstanding */
+	int			outstanding;
+	bool			failed;
+
+	/** Counted in lvol_store::ios[gen] while it may touch allocated clusters */
+	bool			counted;
+	uint32_t		gen;
+
+	struct spdk_bdev_iov_slices	iov_slices;
+};
+
+/*
+ * First write to a logical cluster: the new physical cluster is filled with
+ *  the data and zeroes around it, and only then entered into the map, so a
+ *  volume never exposes what a previous owner left in the cluster.  Writes
+ *  and unmaps that overlap the cluster meanwhile wait here.
+ *
+ * If the cluster is shared with a snapshot and only part of it is written,
+ *  the snapshot's cluster is read into buf instead, the data or the zeroes
+ *  of an unmap are laid over it, and the whole of it is written.
+ */
+struct lvol_alloc {
+	struct lvol_disk		*lvol;
+	uint32_t			lcluster;
+	uint32_t			pcluster;
+
+	struct lvol_task		*task;
+	int				outstanding;
+	bool				failed;
+
+	uint32_t			src;
+	void				*buf;
+	uint64_t			io_offset;
+	uint32_t			in;
+	uint32_t			len;
+	uint32_t			num_zero;
+	struct {
+		uint32_t		in;
+		uint32_t		len;
+	} zero[LVOL_MAX_UNMAP_BDESC];
+
+	struct spdk_bdev_md_waiter		md;
+	TAILQ_HEAD(, lvol_task)		waiters;
+
+	/** On lvol_store::allocs, and on the submitting write's local list */
+	TAILQ_ENTRY(lvol_alloc)		link;
+	TAILQ_ENTRY(lvol_alloc)		task_link;
+};
+
+/* Clusters released by an unmap from one map block, freed once the block is written. */
+struct lvol_unmap {
+	struct spdk_bdev_md_waiter	md;
+	struct lvol_task	*task;
+	struct lvol_unmap	*next;
+	uint64_t		block;
+	uint32_t		num_clusters;
+	uint32_t		clusters[];
+};
+
+/*
+ * Deletion of a snapshot.  Its clusters move into the map of its only child,
+ *  where the child has none of its own, and the others are freed.  The entry
+ *  is flagged first, so that a deletion interrupted by a restart is finished
+ *  when the store is loaded again.
+ */
+struct lvol_merge_block {
+	struct spdk_bdev_md_waiter	md;
+	struct lvol_merge	*merge;
+	bool			dirty;
+};
+
+struct lvol_merge {
+	struct lvol_store		*store;
+	char				name[LVOL_NAME_LEN];
+	uint32_t			slot;
+
+	/** Slot of the child, or LVOL_NO_SLOT */
+	uint32_t			child;
+
+	struct spdk_bdev_md_waiter		md;
+
+	/** One per block of the child's map; dirty if clusters were moved into it */
+	struct lvol_merge_block		*blocks;
+	uint32_t			num_blocks;
+	uint32_t			pending;
+	bool				failed;
+
+	uint32_t			*freed;
+	uint32_t			num_freed;
+
+	TAILQ_ENTRY(lvol_merge)		link;
+};
+
+struct lvol_store {
+	char			name[SPDK_BDEV_MAX_NAME_LENGTH];
+	struct spdk_bdev	*base;
+
+	/** Geometry; from the superblock once loaded */
+	uint32_t		blocklen;
+	uint32_t		cluster_size;
+	uint32_t		total_clusters;
+	uint32_t		md_clusters;
+	uint32_t		max_lvols;
+	uint32_t		map_blocks;
+
+	/*
+	 * Protects everything below, and writes to the maps.  I/O is submitted
+	 *  and completed on any lcore; loading runs on the master lcore.
+	 */
+	pthread_mutex_t		lock;
+	enum lvol_store_state	state;
+
+	/** One bit per physical cluster, set while metadata or a volume uses it */
+	struct spdk_bit_array	*used;
+	uint32_t		free_clusters;
+	uint32_t		alloc_hint;
+
+	struct lvol_super	*super_buf;
+
+	/** Volume table, one struct lvol_entry per block as on disk */
+	void			*entries;
+
+	/** Map of each slot in use; volumes not named in the configuration keep theirs */
+	uint32_t		**maps;
+	uint32_t		load_slot;
+
+	/** Source of the zeroes written around the data of partial first writes */
+	void			*zero_buf;
+
+	struct spdk_bdev_md_writer	md_writer;
+	TAILQ_HEAD(, lvol_alloc)	allocs;
+	TAILQ_HEAD(, lvol_merge)	merges;
+
+	/*
+	 * Clusters freed by unmap or deletion are only reused once every I/O
+	 *  that might still access them has completed.  I/O is counted in one
+	 *  of two generations; a batch of freed clusters waits for the count
+	 *  of the generation current when it was freed to drop to zero, while
+	 *  new I/O is counted in the other one.
+	 */
+	uint64_t		io_gen;
+	uint64_t		ios[2];
+	uint32_t		pending_gen;
+	uint32_t		*pending_free;
+	uint32_t		num_pending_free;
+	uint32_t		max_pending_free;
+	uint32_t		*next_free;
+	uint32_t		num_next_free;
+	uint32_t		max_next_free;
+
+	TAILQ_HEAD(, lvol_disk)	lvols;
+	TAILQ_ENTRY(lvol_store)	link;
+};
+
+struct lvol_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct lvol_store	*store;
+	enum lvol_state		state;
+	uint32_t		slot;
+	uint32_t		num_clusters;
+	uint32_t		*map;
+
+	/** Logical clusters currently backed by a physical cluster of its own */
+	uint32_t		allocated;
+
+	/** Set by spdk_lvol_delete(); the slot is released when the blockdev is destructed */
+	bool			deleting;
+
+	/** Read-only; origin is the volume it is being taken of, until it is */
+	bool			snapshot;
+	struct lvol_disk	*origin;
+	char			origin_name[SPDK_BDEV_MAX_NAME_LENGTH];
+
+	/** Slot of the snapshot a new clone is created from, or LVOL_NO_SLOT */
+	uint32_t		clone_parent;
+
+	/** Counted I/O in flight, and what to run once it drains while frozen */
+	uint32_t		inflight;
+	lvol_frozen_fn		frozen_fn;
+	void			*frozen_arg;
+
+	TAILQ_HEAD(, lvol_task)	waiting;
+	struct spdk_bdev_md_waiter	md;
+	TAILQ_ENTRY(lvol_disk)	link;
+};
+
+struct lvol_store *spdk_lvol_store_first(void);
+struct lvol_store *spdk_lvol_store_next(struct lvol_store *prev);
+struct lvol_store *spdk_lvol_store_get_by_name(const char *name);
+struct lvol_disk *spdk_lvol_get_by_name(const char *name);
+
+/**
+ * Create a thin-provisioned volume of size bytes in the store, or attach to
+ *  the volume of that name already in the store's metadata.  The blockdev is
+ *  registered at once; its I/O waits until the volume's metadata is written.
+ */
+struct lvol_disk *spdk_lvol_create(struct lvol_store *store, const char *name, uint64_t size);
+
+/**
+ * Take a snapshot of the volume, or attach to the snapshot of that name
+ *  already in the store.  The volume's I/O pauses while the I/O in flight
+ *  completes and the metadata is written; the snapshot's I/O waits until
+ *  it is taken.
+ */
+struct lvol_disk *spdk_lvol_snapshot(struct lvol_disk *lvol, const char *name);
+
+/**
+ * Create a writable volume whose data is that of the snapshot, or attach to
+ *  the volume of that name already in the store.  The store must be online.
+ */
+struct lvol_disk *spdk_lvol_clone(struct lvol_store *store, const char *snapshot,
+				  const char *name);
+
+/**
+ * Unregister a volume and release its clusters.  Fails with -EBUSY if the
+ *  blockdev is claimed, the volume is still being created or a snapshot is
+ *  being taken of it.  Snapshots are deleted as by spdk_lvol_snapshot_delete().
+ */
+int spdk_lvol_delete(struct lvol_disk *lvol);
+
+/**
+ * Delete a snapshot, whether attached or not.  Its only child, if any, takes
+ *  over its clusters.  Fails with -EBUSY if it has more than one child or its
+ *  blockdev is claimed, and with -ENOENT if there is no such snapshot.
+ */
+int spdk_lvol_snapshot_delete(struct lvol_store *store, const char *name);
+
+struct lvol_snapshot_info {
+	char		name[LVOL_NAME_LEN];
+
+	/** The snapshot it was taken of, if it was taken of a clone */
+	char		parent[LVOL_NAME_LEN];
+
+	uint32_t	num_clusters;
+	uint32_t	allocated_clusters;
+
+	/** Volumes and snapshots created from it */
+	uint32_t	children;
+
+	/** Set if its blockdev is registered */
+	bool		attached;
+};
+
+/** Fill in up to max snapshots of the store; returns how many there are. */
+int spdk_lvol_store_get_snapshots(struct lvol_store *store, struct lvol_snapshot_info *info,
+				  int max);
+
+/** Copy the name of the snapshot the volume was created from; false if there is none. */
+bool spdk_lvol_get_parent(struct lvol_disk *lvol, char *name, size_t len);
+
+/** Free clusters in the store, and clusters allocated to the volume. */
+uint32_t spdk_lvol_store_free_clusters(struct lvol_store *store);
+uint32_t spdk_lvol_allocated_clusters(struct lvol_disk *lvol);
+
+#endif // SPDK_BLOCKDEV_LVOL_H
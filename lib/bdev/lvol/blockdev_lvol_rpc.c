@@ -0,0 +1,463 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "blockdev_lvol.h"
+#include "spdk/log.h"
+#include "spdk/rpc.h"
+
+struct rpc_construct_lvol {
+	char *lvol_store;
+	char *name;
+	uint32_t size_mb;
+};
+
+static void
+free_rpc_construct_lvol(struct rpc_construct_lvol *req)
+{
+	free(req->lvol_store);
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_construct_lvol_decoders[] = {
+	{"lvol_store", offsetof(struct rpc_construct_lvol, lvol_store), spdk_json_decode_string},
+	{"name", offsetof(struct rpc_construct_lvol, name), spdk_json_decode_string},
+	{"size_mb", offsetof(struct rpc_construct_lvol, size_mb), spdk_json_decode_uint32},
+};
+
+static void
+spdk_rpc_construct_lvol(struct spdk_jsonrpc_server_conn *conn,
+			const struct spdk_json_val *params,
+			const struct spdk_json_val *id)
+{
+	struct rpc_construct_lvol req = {};
+	struct spdk_json_write_ctx *w;
+	struct lvol_store *store;
+
+	if (spdk_json_decode_object(params, rpc_construct_lvol_decoders,
+				    sizeof(rpc_construct_lvol_decoders) / sizeof(*rpc_construct_lvol_decoders),
+				    &req)) {
+		SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_json_decode_object failed\n");
+		goto invalid;
+	}
+
+	store = spdk_lvol_store_get_by_name(req.lvol_store);
+	if (store == NULL) {
+		SPDK_ERRLOG("volume store %s not found\n", req.lvol_store);
+		goto invalid;
+	}
+
+	if (spdk_lvol_create(store, req.name, (uint64_t)req.size_mb * 1024 * 1024) == NULL) {
+		goto invalid;
+	}
+
+	free_rpc_construct_lvol(&req);
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_bool(w, true);
+	spdk_jsonrpc_end_result(conn, w);
+	return;
+
+invalid:
+	spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS, "Invalid parameters");
+	free_rpc_construct_lvol(&req);
+}
+SPDK_RPC_REGISTER("construct_lvol", spdk_rpc_construct_lvol)
+
+struct rpc_delete_lvol {
+	char *name;
+};
+
+static void
+free_rpc_delete_lvol(struct rpc_delete_lvol *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_delete_lvol_decoders[] = {
+	{"name", offsetof(struct rpc_delete_lvol, name), spdk_json_decode_string},
+};
+
+static void
+spdk_rpc_delete_lvol(struct spdk_jsonrpc_server_conn *conn,
+		     const struct spdk_json_val *params,
+		     const struct spdk_json_val *id)
+{
+	struct rpc_delete_lvol req = {};
+	struct spdk_json_write_ctx *w;
+	struct lvol_disk *lvol;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_delete_lvol_decoders,
+				    sizeof(rpc_delete_lvol_decoders) / sizeof(*rpc_delete_lvol_decoders),
+				    &req)) {
+		SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_json_decode_object failed\n");
+		goto invalid;
+	}
+
+	lvol = spdk_lvol_get_by_name(req.name);
+	if (lvol == NULL) {
+		SPDK_ERRLOG("volume %s not found\n", req.name);
+		goto invalid;
+	}
+
+	rc = spdk_lvol_delete(lvol);
+	if (rc != 0) {
+		SPDK_ERRLOG("%s: could not delete volume: %s\n", req.name, strerror(-rc));
+		goto invalid;
+	}
+
+	free_rpc_delete_lvol(&req);
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_bool(w, true);
+	spdk_jsonrpc_end_result(conn, w);
+	return;
+
+invalid:
+	spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS, "Invalid parameters");
+	free_rpc_delete_lvol(&req);
+}
+SPDK_RPC_REGISTER("delete_lvol", spdk_rpc_delete_lvol)
+
+static void
+spdk_rpc_get_lvol_stores(struct spdk_jsonrpc_server_conn *conn,
+			 const struct spdk_json_val *params,
+			 const struct spdk_json_val *id)
+{
+	struct spdk_json_write_ctx *w;
+	struct lvol_store *store;
+	struct lvol_disk *lvol;
+	char parent[LVOL_NAME_LEN];
+
+	if (params != NULL) {
+		spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+						 "get_lvol_stores requires no parameters");
+		return;
+	}
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_array_begin(w);
+
+	for (store = spdk_lvol_store_first(); store != NULL; store = spdk_lvol_store_next(store)) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_name(w, "name");
+		spdk_json_write_string(w, store->name);
+		spdk_json_write_name(w, "base");
+		spdk_json_write_string(w, store->base->name);
+		spdk_json_write_name(w, "cluster_size");
+		spdk_json_write_uint32(w, store->cluster_size);
+		spdk_json_write_name(w, "total_clusters");
+		spdk_json_write_uint32(w, store->total_clusters);
+		spdk_json_write_name(w, "free_clusters");
+		spdk_json_write_uint32(w, spdk_lvol_store_free_clusters(store));
+
+		spdk_json_write_name(w, "lvols");
+		spdk_json_write_array_begin(w);
+		TAILQ_FOREACH(lvol, &store->lvols, link) {
+			spdk_json_write_object_begin(w);
+			spdk_json_write_name(w, "name");
+			spdk_json_write_string(w, lvol->disk.name);
+			spdk_json_write_name(w, "num_clusters");
+			spdk_json_write_uint32(w, lvol->num_clusters);
+			spdk_json_write_name(w, "allocated_clusters");
+			spdk_json_write_uint32(w, spdk_lvol_allocated_clusters(lvol));
+			spdk_json_write_name(w, "snapshot");
+			spdk_json_write_bool(w, lvol->snapshot);
+			if (spdk_lvol_get_parent(lvol, parent, sizeof(parent))) {
+				spdk_json_write_name(w, "parent");
+				spdk_json_write_string(w, parent);
+			}
+			spdk_json_write_object_end(w);
+		}
+		spdk_json_write_array_end(w);
+
+		spdk_json_write_object_end(w);
+	}
+
+	spdk_json_write_array_end(w);
+
+	spdk_jsonrpc_end_result(conn, w);
+}
+SPDK_RPC_REGISTER("get_lvol_stores", spdk_rpc_get_lvol_stores)
+
+struct rpc_construct_lvol_snapshot {
+	char *lvol;
+	char *name;
+};
+
+static void
+free_rpc_construct_lvol_snapshot(struct rpc_construct_lvol_snapshot *req)
+{
+	free(req->lvol);
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_construct_lvol_snapshot_decoders[] = {
+	{"lvol", offsetof(struct rpc_construct_lvol_snapshot, lvol), spdk_json_decode_string},
+	{"name", offsetof(struct rpc_construct_lvol_snapshot, name), spdk_json_decode_string},
+};
+
+static void
+spdk_rpc_construct_lvol_snapshot(struct spdk_jsonrpc_server_conn *conn,
+				 const struct spdk_json_val *params,
+				 const struct spdk_json_val *id)
+{
+	struct rpc_construct_lvol_snapshot req = {};
+	struct spdk_json_write_ctx *w;
+	struct lvol_disk *lvol;
+
+	if (spdk_json_decode_object(params, rpc_construct_lvol_snapshot_decoders,
+				    sizeof(rpc_construct_lvol_snapshot_decoders) / sizeof(*rpc_construct_lvol_snapshot_decoders),
+				    &req)) {
+		SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_json_decode_object failed\n");
+		goto invalid;
+	}
+
+	lvol = spdk_lvol_get_by_name(req.lvol);
+	if (lvol == NULL) {
+		SPDK_ERRLOG("volume %s not found\n", req.lvol);
+		goto invalid;
+	}
+
+	if (spdk_lvol_snapshot(lvol, req.name) == NULL) {
+		goto invalid;
+	}
+
+	free_rpc_construct_lvol_snapshot(&req);
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_bool(w, true);
+	spdk_jsonrpc_end_result(conn, w);
+	return;
+
+invalid:
+	spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS, "Invalid parameters");
+	free_rpc_construct_lvol_snapshot(&req);
+}
+SPDK_RPC_REGISTER("construct_lvol_snapshot", spdk_rpc_construct_lvol_snapshot)
+
+struct rpc_construct_lvol_clone {
+	char *lvol_store;
+	char *snapshot;
+	char *name;
+};
+
+static void
+free_rpc_construct_lvol_clone(struct rpc_construct_lvol_clone *req)
+{
+	free(req->lvol_store);
+	free(req->snapshot);
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_construct_lvol_clone_decoders[] = {
+	{"lvol_store", offsetof(struct rpc_construct_lvol_clone, lvol_store), spdk_json_decode_string},
+	{"snapshot", offsetof(struct rpc_construct_lvol_clone, snapshot), spdk_json_decode_string},
+	{"name", offsetof(struct rpc_construct_lvol_clone, name), spdk_json_decode_string},
+};
+
+static void
+spdk_rpc_construct_lvol_clone(struct spdk_jsonrpc_server_conn *conn,
+			      const struct spdk_json_val *params,
+			      const struct spdk_json_val *id)
+{
+	struct rpc_construct_lvol_clone req = {};
+	struct spdk_json_write_ctx *w;
+	struct lvol_store *store;
+
+	if (spdk_json_decode_object(params, rpc_construct_lvol_clone_decoders,
+				    sizeof(rpc_construct_lvol_clone_decoders) / sizeof(*rpc_construct_lvol_clone_decoders),
+				    &req)) {
+		SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_json_decode_object failed\n");
+		goto invalid;
+	}
+
+	store = spdk_lvol_store_get_by_name(req.lvol_store);
+	if (store == NULL) {
+		SPDK_ERRLOG("volume store %s not found\n", req.lvol_store);
+		goto invalid;
+	}
+
+	if (spdk_lvol_clone(store, req.snapshot, req.name) == NULL) {
+		goto invalid;
+	}
+
+	free_rpc_construct_lvol_clone(&req);
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_bool(w, true);
+	spdk_jsonrpc_end_result(conn, w);
+	return;
+
+invalid:
+	spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS, "Invalid parameters");
+	free_rpc_construct_lvol_clone(&req);
+}
+SPDK_RPC_REGISTER("construct_lvol_clone", spdk_rpc_construct_lvol_clone)
+
+struct rpc_delete_lvol_snapshot {
+	char *lvol_store;
+	char *name;
+};
+
+static void
+free_rpc_delete_lvol_snapshot(struct rpc_delete_lvol_snapshot *req)
+{
+	free(req->lvol_store);
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_delete_lvol_snapshot_decoders[] = {
+	{"lvol_store", offsetof(struct rpc_delete_lvol_snapshot, lvol_store), spdk_json_decode_string},
+	{"name", offsetof(struct rpc_delete_lvol_snapshot, name), spdk_json_decode_string},
+};
+
+static void
+spdk_rpc_delete_lvol_snapshot(struct spdk_jsonrpc_server_conn *conn,
+			      const struct spdk_json_val *params,
+			      const struct spdk_json_val *id)
+{
+	struct rpc_delete_lvol_snapshot req = {};
+	struct spdk_json_write_ctx *w;
+	struct lvol_store *store;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_delete_lvol_snapshot_decoders,
+				    sizeof(rpc_delete_lvol_snapshot_decoders) / sizeof(*rpc_delete_lvol_snapshot_decoders),
+				    &req)) {
+		SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_json_decode_object failed\n");
+		goto invalid;
+	}
+
+	store = spdk_lvol_store_get_by_name(req.lvol_store);
+	if (store == NULL) {
+		SPDK_ERRLOG("volume store %s not found\n", req.lvol_store);
+		goto invalid;
+	}
+
+	rc = spdk_lvol_snapshot_delete(store, req.name);
+	if (rc != 0) {
+		SPDK_ERRLOG("%s: could not delete snapshot: %s\n", req.name, strerror(-rc));
+		goto invalid;
+	}
+
+	free_rpc_delete_lvol_snapshot(&req);
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_bool(w, true);
+	spdk_jsonrpc_end_result(conn, w);
+	return;
+
+invalid:
+	spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS, "Invalid parameters");
+	free_rpc_delete_lvol_snapshot(&req);
+}
+SPDK_RPC_REGISTER("delete_lvol_snapshot", spdk_rpc_delete_lvol_snapshot)
+
+static void
+spdk_rpc_get_lvol_snapshots(struct spdk_jsonrpc_server_conn *conn,
+			    const struct spdk_json_val *params,
+			    const struct spdk_json_val *id)
+{
+	struct spdk_json_write_ctx *w;
+	struct lvol_store *store;
+	struct lvol_snapshot_info info[LVOL_MAX_LVOLS];
+	int count, i;
+
+	if (params != NULL) {
+		spdk_jsonrpc_send_error_response(conn, id, SPDK_JSONRPC_ERROR_INVALID_PARAMS,
+						 "get_lvol_snapshots requires no parameters");
+		return;
+	}
+
+	if (id == NULL) {
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(conn, id);
+	spdk_json_write_array_begin(w);
+
+	for (store = spdk_lvol_store_first(); store != NULL; store = spdk_lvol_store_next(store)) {
+		count = spdk_lvol_store_get_snapshots(store, info, LVOL_MAX_LVOLS);
+		for (i = 0; i < count && i < LVOL_MAX_LVOLS; i++) {
+			spdk_json_write_object_begin(w);
+			spdk_json_write_name(w, "name");
+			spdk_json_write_string(w, info[i].name);
+			spdk_json_write_name(w, "lvol_store");
+			spdk_json_write_string(w, store->name);
+			if (info[i].parent[0] != '\0') {
+				spdk_json_write_name(w, "parent");
+				spdk_json_write_string(w, info[i].parent);
+			}
+			spdk_json_write_name(w, "num_clusters");
+			spdk_json_write_uint32(w, info[i].num_clusters);
+			spdk_json_write_name(w, "allocated_clusters");
+			spdk_json_write_uint32(w, info[i].allocated_clusters);
+			spdk_json_write_name(w, "children");
+			spdk_json_write_uint32(w, info[i].children);
+			spdk_json_write_name(w, "attached");
+			spdk_json_write_bool(w, info[i].attached);
+			spdk_json_write_object_end(w);
+		}
+	}
+
+	spdk_json_write_array_end(w);
+
+	spdk_jsonrpc_end_result(conn, w);
+}
+SPDK_RPC_REGISTER("get_lvol_snapshots", spdk_rpc_get_lvol_snapshots)
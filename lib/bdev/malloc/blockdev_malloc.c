@@ -55,18 +55,61 @@ struct malloc_disk {
 	struct malloc_disk	*next;
 };
 
+/*
+ * Per-I/O context.  The copy engine context immediately follows it in
+ *  bdev_io->driver_ctx.  The copy engine accepts only one outstanding
+ *  operation per copy_task, so vectored reads and writes copy one iovec
+ *  element at a time and resubmit from the completion callback.
+ */
+struct malloc_task {
+	/** Index of the next iovec element to copy */
+	int		iov_index;
+
+	/** Offset in bytes into malloc_buf for the next iovec element */
+	uint64_t	offset;
+};
+
+static struct malloc_task *
+__malloc_task_from_copy_task(struct copy_task *ct)
+{
+	return (struct malloc_task *)((uintptr_t)ct - sizeof(struct malloc_task));
+}
+
+static struct copy_task *
+__copy_task_from_malloc_task(struct malloc_task *mt)
+{
+	return (struct copy_task *)((uintptr_t)mt + sizeof(struct malloc_task));
+}
+
+static int64_t blockdev_malloc_copy_next(struct malloc_task *task);
+
 static void
 malloc_done(void *ref, int status)
 {
-	struct copy_task *cp_task = (struct copy_task *)ref;
+	struct malloc_task *task = __malloc_task_from_copy_task((struct copy_task *)ref);
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(task);
 	enum spdk_bdev_io_status bdev_status;
+	int iovcnt = 0;
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+		iovcnt = bdev_io->u.read.iovcnt;
+	} else if (bdev_io->type == SPDK_BDEV_IO_TYPE_WRITE) {
+		iovcnt = bdev_io->u.write.iovcnt;
+	}
+
+	if (status == 0 && task->iov_index < iovcnt) {
+		if (blockdev_malloc_copy_next(task) >= 0) {
+			return;
+		}
+		status = -1;
+	}
 
 	if (status != 0) {
 		bdev_status = SPDK_BDEV_IO_STATUS_FAILED;
 	} else {
 		bdev_status = SPDK_BDEV_IO_STATUS_SUCCESS;
 	}
-	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(cp_task), bdev_status);
+	spdk_bdev_io_complete(bdev_io, bdev_status);
 }
 
 static struct malloc_disk *g_malloc_disk_head = NULL;
@@ -80,7 +123,7 @@ static void blockdev_malloc_get_spdk_running_config(FILE *fp);
 static int
 blockdev_malloc_get_ctx_size(void)
 {
-	return spdk_copy_module_get_max_ctx_size();
+	return sizeof(struct malloc_task) + spdk_copy_module_get_max_ctx_size();
 }
 
 SPDK_BDEV_MODULE_REGISTER(blockdev_malloc_initialize, blockdev_malloc_finish,
@@ -120,33 +163,94 @@ blockdev_malloc_destruct(struct spdk_bdev *bdev)
 }
 
 static int64_t
-blockdev_malloc_read(struct malloc_disk *mdisk, struct copy_task *copy_req,
-		     void *buf, uint64_t nbytes, off_t offset)
+blockdev_malloc_copy_next(struct malloc_task *task)
+{
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(task);
+	struct malloc_disk *mdisk = bdev_io->ctx;
+	struct iovec *iov;
+	void *disk_buf;
+
+	disk_buf = (uint8_t *)mdisk->malloc_buf + task->offset;
+
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+		iov = &bdev_io->u.read.iovs[task->iov_index++];
+		task->offset += iov->iov_len;
+		return spdk_copy_submit(__copy_task_from_malloc_task(task), iov->iov_base,
+					disk_buf, iov->iov_len, malloc_done);
+	} else {
+		iov = &bdev_io->u.write.iovs[task->iov_index++];
+		task->offset += iov->iov_len;
+		return spdk_copy_submit(__copy_task_from_malloc_task(task), disk_buf,
+					iov->iov_base, iov->iov_len, malloc_done);
+	}
+}
+
+static int64_t
+blockdev_malloc_copy_iovs(struct malloc_task *task, struct iovec *iov, int iovcnt,
+			  size_t len, off_t offset)
 {
-	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "read %lu bytes from offset %#lx to %p\n",
-		      nbytes, offset, buf);
+	size_t total = 0;
+	int i;
 
-	return spdk_copy_submit(copy_req, buf, mdisk->malloc_buf + offset,
-				nbytes, malloc_done);
+	for (i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+
+	if (iovcnt < 1 || total != len) {
+		return -1;
+	}
+
+	task->iov_index = 0;
+	task->offset = offset;
+
+	return blockdev_malloc_copy_next(task);
+}
+
+static int64_t
+blockdev_malloc_readv(struct malloc_disk *mdisk, struct malloc_task *task,
+		      struct iovec *iov, int iovcnt, size_t len, off_t offset)
+{
+	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "read %lu bytes from offset %#lx into %d iovs\n",
+		      len, offset, iovcnt);
+
+	return blockdev_malloc_copy_iovs(task, iov, iovcnt, len, offset);
 }
 
 static int64_t
-blockdev_malloc_writev(struct malloc_disk *mdisk, struct copy_task *copy_req,
+blockdev_malloc_writev(struct malloc_disk *mdisk, struct malloc_task *task,
 		       struct iovec *iov, int iovcnt, size_t len, off_t offset)
 {
-	if ((iovcnt != 1) || (iov->iov_len != len))
-		return -1;
+	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "wrote %lu bytes to offset %#lx from %d iovs\n",
+		      len, offset, iovcnt);
 
-	SPDK_TRACELOG(SPDK_TRACE_MALLOC, "wrote %lu bytes to offset %#lx from %p\n",
-		      iov->iov_len, offset, iov->iov_base);
+	return blockdev_malloc_copy_iovs(task, iov, iovcnt, len, offset);
+}
 
-	return spdk_copy_submit(copy_req, mdisk->malloc_buf + offset,
-				iov->iov_base, len, malloc_done);
+static int
+blockdev_malloc_zcopy(struct malloc_disk *mdisk, struct malloc_task *task,
+		      struct spdk_bdev_io *bdev_io)
+{
+	/*
+	 * The disk contents are the final location of the data, so the start phase
+	 *  hands out the region itself and the commit phase has nothing to copy.
+	 */
+	if (bdev_io->u.zcopy.start) {
+		SPDK_TRACELOG(SPDK_TRACE_MALLOC, "zcopy write of %lu bytes at offset %#lx\n",
+			      bdev_io->u.zcopy.len, bdev_io->u.zcopy.offset);
+		bdev_io->u.zcopy.iov.iov_base = mdisk->malloc_buf + bdev_io->u.zcopy.offset;
+		bdev_io->u.zcopy.iov.iov_len = bdev_io->u.zcopy.len;
+		bdev_io->u.zcopy.iovs = &bdev_io->u.zcopy.iov;
+		bdev_io->u.zcopy.iovcnt = 1;
+	}
+
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(task), SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	return 0;
 }
 
 static int
 blockdev_malloc_unmap(struct malloc_disk *mdisk,
-		      struct copy_task *copy_req,
+		      struct malloc_task *task,
 		      struct spdk_scsi_unmap_bdesc *unmap_d,
 		      uint16_t bdesc_count)
 {
@@ -170,28 +274,29 @@ blockdev_malloc_unmap(struct malloc_disk *mdisk,
 		return -1;
 	}
 
-	return spdk_copy_submit_fill(copy_req, mdisk->malloc_buf + offset, 0, byte_count, malloc_done);
+	return spdk_copy_submit_fill(__copy_task_from_malloc_task(task), mdisk->malloc_buf + offset, 0,
+				     byte_count, malloc_done);
 }
 
 static int
-blockdev_malloc_check_io(struct spdk_bdev *bdev)
+blockdev_malloc_check_io(struct spdk_bdev_channel *ch)
 {
 	return spdk_copy_check_io();
 }
 
 static int64_t
-blockdev_malloc_flush(struct malloc_disk *mdisk, struct copy_task *copy_req,
+blockdev_malloc_flush(struct malloc_disk *mdisk, struct malloc_task *task,
 		      uint64_t offset, uint64_t nbytes)
 {
-	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(copy_req), SPDK_BDEV_IO_STATUS_SUCCESS);
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(task), SPDK_BDEV_IO_STATUS_SUCCESS);
 
 	return 0;
 }
 
 static int
-blockdev_malloc_reset(struct malloc_disk *mdisk, struct copy_task *copy_req)
+blockdev_malloc_reset(struct malloc_disk *mdisk, struct malloc_task *task)
 {
-	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(copy_req), SPDK_BDEV_IO_STATUS_SUCCESS);
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(task), SPDK_BDEV_IO_STATUS_SUCCESS);
 
 	return 0;
 }
@@ -200,23 +305,27 @@ static int _blockdev_malloc_submit_request(struct spdk_bdev_io *bdev_io)
 {
 	switch (bdev_io->type) {
 	case SPDK_BDEV_IO_TYPE_READ:
-		if (bdev_io->u.read.buf == NULL) {
-			bdev_io->u.read.buf = ((struct malloc_disk *)bdev_io->ctx)->malloc_buf +
-					      bdev_io->u.read.offset;
+		if (bdev_io->u.read.iovs[0].iov_base == NULL) {
+			assert(bdev_io->u.read.iovcnt == 1);
+			bdev_io->u.read.iovs[0].iov_base =
+				((struct malloc_disk *)bdev_io->ctx)->malloc_buf +
+				bdev_io->u.read.offset;
+			bdev_io->u.read.iovs[0].iov_len = bdev_io->u.read.len;
 			spdk_bdev_io_complete(spdk_bdev_io_from_ctx(bdev_io->driver_ctx),
 					      SPDK_BDEV_IO_STATUS_SUCCESS);
 			return 0;
 		}
 
-		return blockdev_malloc_read((struct malloc_disk *)bdev_io->ctx,
-					    (struct copy_task *)bdev_io->driver_ctx,
-					    bdev_io->u.read.buf,
-					    bdev_io->u.read.nbytes,
-					    bdev_io->u.read.offset);
+		return blockdev_malloc_readv((struct malloc_disk *)bdev_io->ctx,
+					     (struct malloc_task *)bdev_io->driver_ctx,
+					     bdev_io->u.read.iovs,
+					     bdev_io->u.read.iovcnt,
+					     bdev_io->u.read.len,
+					     bdev_io->u.read.offset);
 
 	case SPDK_BDEV_IO_TYPE_WRITE:
 		return blockdev_malloc_writev((struct malloc_disk *)bdev_io->ctx,
-					      (struct copy_task *)bdev_io->driver_ctx,
+					      (struct malloc_task *)bdev_io->driver_ctx,
 					      bdev_io->u.write.iovs,
 					      bdev_io->u.write.iovcnt,
 					      bdev_io->u.write.len,
@@ -224,19 +333,24 @@ static int _blockdev_malloc_submit_request(struct spdk_bdev_io *bdev_io)
 
 	case SPDK_BDEV_IO_TYPE_RESET:
 		return blockdev_malloc_reset((struct malloc_disk *)bdev_io->ctx,
-					     (struct copy_task *)bdev_io->driver_ctx);
+					     (struct malloc_task *)bdev_io->driver_ctx);
 
 	case SPDK_BDEV_IO_TYPE_FLUSH:
 		return blockdev_malloc_flush((struct malloc_disk *)bdev_io->ctx,
-					     (struct copy_task *)bdev_io->driver_ctx,
+					     (struct malloc_task *)bdev_io->driver_ctx,
 					     bdev_io->u.flush.offset,
 					     bdev_io->u.flush.length);
 
 	case SPDK_BDEV_IO_TYPE_UNMAP:
 		return blockdev_malloc_unmap((struct malloc_disk *)bdev_io->ctx,
-					     (struct copy_task *)bdev_io->driver_ctx,
+					     (struct malloc_task *)bdev_io->driver_ctx,
 					     bdev_io->u.unmap.unmap_bdesc,
 					     bdev_io->u.unmap.bdesc_count);
+
+	case SPDK_BDEV_IO_TYPE_ZCOPY:
+		return blockdev_malloc_zcopy((struct malloc_disk *)bdev_io->ctx,
+					     (struct malloc_task *)bdev_io->driver_ctx,
+					     bdev_io);
 	default:
 		return -1;
 	}
@@ -259,6 +373,7 @@ blockdev_malloc_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type
 	case SPDK_BDEV_IO_TYPE_FLUSH:
 	case SPDK_BDEV_IO_TYPE_RESET:
 	case SPDK_BDEV_IO_TYPE_UNMAP:
+	case SPDK_BDEV_IO_TYPE_ZCOPY:
 		return true;
 
 	default:
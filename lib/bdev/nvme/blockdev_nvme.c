@@ -32,6 +32,7 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -51,7 +52,9 @@
 #include "spdk/pci.h"
 #include "spdk/log.h"
 #include "spdk/bdev.h"
+#include "spdk/event.h"
 #include "spdk/nvme.h"
+#include "spdk/vtophys.h"
 
 #include "bdev_module.h"
 
@@ -60,6 +63,19 @@
 void init_request_mempool(void);
 static void blockdev_nvme_get_spdk_running_config(FILE *fp);
 
+/*
+ * Per-lcore I/O state of a controller.  Each reactor lcore owns one I/O
+ *  queue pair and is the only lcore that ever submits to or polls it, so
+ *  no locking is needed on the I/O path.  All blockdevs carved out of the
+ *  controller share the queue pair (and its poller) of the lcore they are
+ *  being accessed from.
+ */
+struct nvme_io_channel {
+	struct spdk_nvme_qpair		*qpair;
+	struct spdk_poller		*poller;
+	uint32_t			ref;
+};
+
 struct nvme_device {
 	/**
 	 * points to pinned, physically contiguous memory region;
@@ -68,6 +84,9 @@ struct nvme_device {
 	 */
 	struct spdk_nvme_ctrlr		*ctrlr;
 
+	/** I/O queue pairs, indexed by reactor lcore */
+	struct nvme_io_channel		ch[RTE_MAX_LCORE];
+
 	/** linked list pointer for device list */
 	TAILQ_ENTRY(nvme_device)	tailq;
 
@@ -76,9 +95,9 @@ struct nvme_device {
 
 struct nvme_blockdev {
 	struct spdk_bdev	disk;
+	struct nvme_device	*dev;
 	struct spdk_nvme_ctrlr	*ctrlr;
 	struct spdk_nvme_ns	*ns;
-	struct spdk_nvme_qpair	*qpair;
 	uint64_t		lba_start;
 	uint64_t		lba_end;
 	uint64_t		blocklen;
@@ -87,6 +106,18 @@ struct nvme_blockdev {
 #define NVME_DEFAULT_MAX_UNMAP_BDESC_COUNT	1
 struct nvme_blockio {
 	struct spdk_nvme_dsm_range dsm_range[NVME_DEFAULT_MAX_UNMAP_BDESC_COUNT];
+
+	/** array of iovecs to transfer. */
+	struct iovec *iovs;
+
+	/** Number of iovecs in iovs array. */
+	int iovcnt;
+
+	/** Current iovec position. */
+	int iovpos;
+
+	/** Offset in current iovec. */
+	uint32_t iov_offset;
 };
 
 enum data_direction {
@@ -115,12 +146,14 @@ static int unbindfromkernel = 0;
 
 static TAILQ_HEAD(, nvme_device)	g_nvme_devices = TAILQ_HEAD_INITIALIZER(g_nvme_devices);;
 
-static void nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr,
+static void nvme_ctrlr_initialize_blockdevs(struct nvme_device *dev,
 		int bdev_per_ns, int ctrlr_id);
 static int nvme_library_init(void);
 static void nvme_library_fini(void);
-int nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
-		   int direction, void *buf, uint64_t nbytes, uint64_t offset);
+int nvme_queue_cmd(struct nvme_blockdev *bdev, struct spdk_nvme_qpair *qpair,
+		   struct nvme_blockio *bio,
+		   int direction, struct iovec *iov, int iovcnt, uint64_t nbytes,
+		   uint64_t offset);
 
 static int
 nvme_get_ctx_size(void)
@@ -132,15 +165,16 @@ SPDK_BDEV_MODULE_REGISTER(nvme_library_init, NULL, blockdev_nvme_get_spdk_runnin
 			  nvme_get_ctx_size)
 
 static int64_t
-blockdev_nvme_read(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
-		   void *buf, uint64_t nbytes, off_t offset)
+blockdev_nvme_readv(struct nvme_blockdev *nbdev, struct spdk_bdev_channel *ch,
+		    struct nvme_blockio *bio,
+		    struct iovec *iov, int iovcnt, uint64_t nbytes, off_t offset)
 {
 	int64_t rc;
 
-	SPDK_TRACELOG(SPDK_TRACE_NVME, "read %lu bytes with offset %#lx to %p\n",
-		      nbytes, offset, buf);
+	SPDK_TRACELOG(SPDK_TRACE_NVME, "read %lu bytes with offset %#lx into %d iovs\n",
+		      nbytes, offset, iovcnt);
 
-	rc = nvme_queue_cmd(nbdev, bio, BDEV_DISK_READ, buf, nbytes, offset);
+	rc = nvme_queue_cmd(nbdev, ch->ctx, bio, BDEV_DISK_READ, iov, iovcnt, nbytes, offset);
 	if (rc < 0)
 		return -1;
 
@@ -148,33 +182,28 @@ blockdev_nvme_read(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
 }
 
 static int64_t
-blockdev_nvme_writev(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
+blockdev_nvme_writev(struct nvme_blockdev *nbdev, struct spdk_bdev_channel *ch,
+		     struct nvme_blockio *bio,
 		     struct iovec *iov, int iovcnt, size_t len, off_t offset)
 {
 	int64_t rc;
 
-	if ((iovcnt != 1) || (iov->iov_len != len))
-		return -1;
+	SPDK_TRACELOG(SPDK_TRACE_NVME, "write %lu bytes with offset %#lx from %d iovs\n",
+		      len, offset, iovcnt);
 
-	SPDK_TRACELOG(SPDK_TRACE_NVME, "write %lu bytes with offset %#lx from %p\n",
-		      iov->iov_len, offset, iov->iov_base);
-
-	rc = nvme_queue_cmd(nbdev, bio, BDEV_DISK_WRITE, (void *)iov->iov_base,
-			    iov->iov_len, offset);
+	rc = nvme_queue_cmd(nbdev, ch->ctx, bio, BDEV_DISK_WRITE, iov, iovcnt, len, offset);
 	if (rc < 0)
 		return -1;
 
-	return iov->iov_len;
+	return len;
 }
 
-static int
-blockdev_nvme_check_io(struct spdk_bdev *bdev)
+static void
+blockdev_nvme_poll(void *arg)
 {
-	struct nvme_blockdev *nbdev = (struct nvme_blockdev *)bdev;
+	struct spdk_nvme_qpair *qpair = arg;
 
-	spdk_nvme_qpair_process_completions(nbdev->qpair, 0);
-
-	return 0;
+	spdk_nvme_qpair_process_completions(qpair, 0);
 }
 
 static int
@@ -209,7 +238,8 @@ blockdev_nvme_reset(struct nvme_blockdev *nbdev, struct nvme_blockio *bio)
 }
 
 static int
-blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
+blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct spdk_bdev_channel *ch,
+		    struct nvme_blockio *bio,
 		    struct spdk_scsi_unmap_bdesc *umap_d,
 		    uint16_t bdesc_count);
 
@@ -217,11 +247,13 @@ static void blockdev_nvme_get_rbuf_cb(struct spdk_bdev_io *bdev_io)
 {
 	int ret;
 
-	ret = blockdev_nvme_read((struct nvme_blockdev *)bdev_io->ctx,
-				 (struct nvme_blockio *)bdev_io->driver_ctx,
-				 bdev_io->u.read.buf,
-				 bdev_io->u.read.nbytes,
-				 bdev_io->u.read.offset);
+	ret = blockdev_nvme_readv((struct nvme_blockdev *)bdev_io->ctx,
+				  bdev_io->ch,
+				  (struct nvme_blockio *)bdev_io->driver_ctx,
+				  bdev_io->u.read.iovs,
+				  bdev_io->u.read.iovcnt,
+				  bdev_io->u.read.len,
+				  bdev_io->u.read.offset);
 
 	if (ret < 0) {
 		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
@@ -237,6 +269,7 @@ static int _blockdev_nvme_submit_request(struct spdk_bdev_io *bdev_io)
 
 	case SPDK_BDEV_IO_TYPE_WRITE:
 		return blockdev_nvme_writev((struct nvme_blockdev *)bdev_io->ctx,
+					    bdev_io->ch,
 					    (struct nvme_blockio *)bdev_io->driver_ctx,
 					    bdev_io->u.write.iovs,
 					    bdev_io->u.write.iovcnt,
@@ -245,6 +278,7 @@ static int _blockdev_nvme_submit_request(struct spdk_bdev_io *bdev_io)
 
 	case SPDK_BDEV_IO_TYPE_UNMAP:
 		return blockdev_nvme_unmap((struct nvme_blockdev *)bdev_io->ctx,
+					   bdev_io->ch,
 					   (struct nvme_blockio *)bdev_io->driver_ctx,
 					   bdev_io->u.unmap.unmap_bdesc,
 					   bdev_io->u.unmap.bdesc_count);
@@ -294,11 +328,46 @@ blockdev_nvme_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type i
 	}
 }
 
+static int
+blockdev_nvme_create_channel(struct spdk_bdev_channel *ch)
+{
+	struct nvme_blockdev *nbdev = (struct nvme_blockdev *)ch->bdev;
+	struct nvme_io_channel *nvme_ch = &nbdev->dev->ch[ch->lcore];
+
+	if (nvme_ch->qpair == NULL) {
+		SPDK_ERRLOG("No I/O queue pair for %s on lcore %u\n",
+			    nbdev->disk.name, ch->lcore);
+		return -1;
+	}
+
+	if (nvme_ch->ref++ == 0) {
+		spdk_poller_register(&nvme_ch->poller, blockdev_nvme_poll, nvme_ch->qpair,
+				     ch->lcore, NULL, 0);
+	}
+
+	ch->ctx = nvme_ch->qpair;
+
+	return 0;
+}
+
+static void
+blockdev_nvme_destroy_channel(struct spdk_bdev_channel *ch)
+{
+	struct nvme_blockdev *nbdev = (struct nvme_blockdev *)ch->bdev;
+	struct nvme_io_channel *nvme_ch = &nbdev->dev->ch[ch->lcore];
+
+	assert(nvme_ch->ref > 0);
+	if (--nvme_ch->ref == 0) {
+		spdk_poller_unregister(&nvme_ch->poller, NULL);
+	}
+}
+
 static const struct spdk_bdev_fn_table nvmelib_fn_table = {
 	.destruct		= blockdev_nvme_destruct,
-	.check_io		= blockdev_nvme_check_io,
 	.submit_request		= blockdev_nvme_submit_request,
 	.io_type_supported	= blockdev_nvme_io_type_supported,
+	.create_channel		= blockdev_nvme_create_channel,
+	.destroy_channel	= blockdev_nvme_destroy_channel,
 };
 
 struct nvme_probe_ctx {
@@ -378,8 +447,10 @@ attach_cb(void *cb_ctx, struct spdk_pci_device *pci_dev, struct spdk_nvme_ctrlr
 {
 	struct nvme_probe_ctx *ctx = cb_ctx;
 	struct nvme_device *dev;
+	uint64_t core_mask;
+	uint32_t lcore;
 
-	dev = malloc(sizeof(struct nvme_device));
+	dev = calloc(1, sizeof(struct nvme_device));
 	if (dev == NULL) {
 		SPDK_ERRLOG("Failed to allocate device struct\n");
 		return;
@@ -388,7 +459,25 @@ attach_cb(void *cb_ctx, struct spdk_pci_device *pci_dev, struct spdk_nvme_ctrlr
 	dev->ctrlr = ctrlr;
 	dev->id = nvme_controller_index++;
 
-	nvme_ctrlr_initialize_blockdevs(dev->ctrlr, nvme_luns_per_ns, dev->id);
+	/*
+	 * Allocate one I/O queue pair for every reactor lcore up front.  If the
+	 *  controller runs out of queues, the remaining lcores simply cannot
+	 *  submit I/O to this controller.
+	 */
+	core_mask = spdk_app_get_core_mask();
+	for (lcore = 0; lcore < RTE_MAX_LCORE && lcore < 64; lcore++) {
+		if (!(core_mask & (1ULL << lcore))) {
+			continue;
+		}
+
+		dev->ch[lcore].qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, 0);
+		if (dev->ch[lcore].qpair == NULL) {
+			SPDK_ERRLOG("Could not allocate I/O queue pair for lcore %u on controller %d\n",
+				    lcore, dev->id);
+		}
+	}
+
+	nvme_ctrlr_initialize_blockdevs(dev, nvme_luns_per_ns, dev->id);
 	TAILQ_INSERT_TAIL(&g_nvme_devices, dev, tailq);
 
 	if (ctx->controllers_remaining > 0) {
@@ -498,18 +587,25 @@ __attribute__((destructor)) void
 nvme_library_fini(void)
 {
 	struct nvme_device *dev;
+	uint32_t lcore;
 
 	while (!TAILQ_EMPTY(&g_nvme_devices)) {
 		dev = TAILQ_FIRST(&g_nvme_devices);
 		TAILQ_REMOVE(&g_nvme_devices, dev, tailq);
+		for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+			if (dev->ch[lcore].qpair != NULL) {
+				spdk_nvme_ctrlr_free_io_qpair(dev->ch[lcore].qpair);
+			}
+		}
 		spdk_nvme_detach(dev->ctrlr);
 		free(dev);
 	}
 }
 
 void
-nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr, int bdev_per_ns, int ctrlr_id)
+nvme_ctrlr_initialize_blockdevs(struct nvme_device *dev, int bdev_per_ns, int ctrlr_id)
 {
+	struct spdk_nvme_ctrlr	*ctrlr = dev->ctrlr;
 	struct nvme_blockdev	*bdev;
 	struct spdk_nvme_ns	*ns;
 	const struct spdk_nvme_ctrlr_data *cdata;
@@ -544,6 +640,7 @@ nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr, int bdev_per_ns,
 				return;
 
 			bdev = &g_blockdev[blockdev_index_max];
+			bdev->dev = dev;
 			bdev->ctrlr = ctrlr;
 			bdev->ns = ns;
 			bdev->lba_start = lba_offset;
@@ -555,13 +652,6 @@ nvme_ctrlr_initialize_blockdevs(struct spdk_nvme_ctrlr *ctrlr, int bdev_per_ns,
 			snprintf(bdev->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH,
 				 "NVMe disk");
 
-			bdev->qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, 0);
-			if (!bdev->qpair) {
-				SPDK_ERRLOG("Could not allocate I/O queue pair for %s\n",
-					    bdev->disk.name);
-				continue;
-			}
-
 			if (cdata->oncs.dsm) {
 				/*
 				 * Enable the thin provisioning
@@ -600,9 +690,51 @@ queued_done(void *ref, const struct spdk_nvme_cpl *cpl)
 	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(bio), status);
 }
 
+static void
+queued_reset_sgl(void *ref, uint32_t sgl_offset)
+{
+	struct nvme_blockio *bio = ref;
+	struct iovec *iov;
+
+	bio->iov_offset = sgl_offset;
+	for (bio->iovpos = 0; bio->iovpos < bio->iovcnt; bio->iovpos++) {
+		iov = &bio->iovs[bio->iovpos];
+		if (bio->iov_offset < iov->iov_len)
+			break;
+
+		bio->iov_offset -= iov->iov_len;
+	}
+}
+
+static int
+queued_next_sge(void *ref, uint64_t *address, uint32_t *length)
+{
+	struct nvme_blockio *bio = ref;
+	struct iovec *iov;
+
+	assert(bio->iovpos < bio->iovcnt);
+
+	iov = &bio->iovs[bio->iovpos];
+	bio->iovpos++;
+
+	*address = spdk_vtophys(iov->iov_base);
+	*length = iov->iov_len;
+
+	if (bio->iov_offset) {
+		assert(bio->iov_offset <= iov->iov_len);
+		*address += bio->iov_offset;
+		*length -= bio->iov_offset;
+		bio->iov_offset = 0;
+	}
+
+	return 0;
+}
+
 int
-nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
-	       int direction, void *buf, uint64_t nbytes, uint64_t offset)
+nvme_queue_cmd(struct nvme_blockdev *bdev, struct spdk_nvme_qpair *qpair,
+	       struct nvme_blockio *bio,
+	       int direction, struct iovec *iov, int iovcnt, uint64_t nbytes,
+	       uint64_t offset)
 {
 	uint32_t ss = spdk_nvme_ns_get_sector_size(bdev->ns);
 	uint32_t lba_count;
@@ -618,12 +750,19 @@ nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
 
 	lba_count = nbytes / ss;
 
+	bio->iovs = iov;
+	bio->iovcnt = iovcnt;
+	bio->iovpos = 0;
+	bio->iov_offset = 0;
+
 	if (direction == BDEV_DISK_READ) {
-		rc = spdk_nvme_ns_cmd_read(bdev->ns, bdev->qpair, buf, next_lba,
-					   lba_count, queued_done, bio, 0);
+		rc = spdk_nvme_ns_cmd_readv(bdev->ns, qpair, next_lba,
+					    lba_count, queued_done, bio, 0,
+					    queued_reset_sgl, queued_next_sge);
 	} else {
-		rc = spdk_nvme_ns_cmd_write(bdev->ns, bdev->qpair, buf, next_lba,
-					    lba_count, queued_done, bio, 0);
+		rc = spdk_nvme_ns_cmd_writev(bdev->ns, qpair, next_lba,
+					     lba_count, queued_done, bio, 0,
+					     queued_reset_sgl, queued_next_sge);
 	}
 
 	if (rc != 0) {
@@ -633,7 +772,8 @@ nvme_queue_cmd(struct nvme_blockdev *bdev, struct nvme_blockio *bio,
 }
 
 static int
-blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
+blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct spdk_bdev_channel *ch,
+		    struct nvme_blockio *bio,
 		    struct spdk_scsi_unmap_bdesc *unmap_d,
 		    uint16_t bdesc_count)
 {
@@ -646,7 +786,7 @@ blockdev_nvme_unmap(struct nvme_blockdev *nbdev, struct nvme_blockio *bio,
 		unmap_d++;
 	}
 
-	rc = spdk_nvme_ns_cmd_deallocate(nbdev->ns, nbdev->qpair, bio->dsm_range, bdesc_count,
+	rc = spdk_nvme_ns_cmd_deallocate(nbdev->ns, ch->ctx, bio->dsm_range, bdesc_count,
 					 queued_done, bio);
 
 	if (rc != 0)
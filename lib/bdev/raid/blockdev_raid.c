@@ -0,0 +1,465 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (C) 2008-2012 Daisuke Aoyama <aoyama@peach.ne.jp>.
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * RAID-0 virtual blockdev.  Stripes the address space across N base blockdevs
+ *  in fixed-size strips; strip i lives on member (i % N) at member strip (i / N).
+ *  Each parent I/O is split at strip boundaries into child I/Os on the members
+ *  and is completed once all of its children have completed.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_lcore.h>
+
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/log.h"
+
+#include "bdev_module.h"
+
+#define RAID_MAX_MEMBERS	32
+
+struct raid_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	uint64_t		strip_size;	/* in bytes */
+	int			num_members;
+	struct spdk_bdev	*members[RAID_MAX_MEMBERS];
+	TAILQ_ENTRY(raid_disk)	link;
+};
+
+/* Per-I/O context for the parent I/O submitted to the RAID blockdev. */
+struct raid_task {
+	/** Child I/Os submitted and not yet completed */
+	int		outstanding;
+
+	/** Set once every child has been submitted */
+	bool		submitted;
+
+	/** Set if any child failed */
+	bool		failed;
+
+	struct spdk_bdev_iov_slices	iov_slices;
+};
+
+static TAILQ_HEAD(, raid_disk) g_raid_disks = TAILQ_HEAD_INITIALIZER(g_raid_disks);
+
+static int blockdev_raid_initialize(void);
+static void blockdev_raid_finish(void);
+static void blockdev_raid_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_raid_get_ctx_size(void)
+{
+	return sizeof(struct raid_task);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_raid_initialize, blockdev_raid_finish,
+			   blockdev_raid_get_spdk_running_config, blockdev_raid_get_ctx_size)
+
+static void
+raid_free_disk(struct raid_disk *rdisk)
+{
+	int i;
+
+	for (i = 0; i < rdisk->num_members; i++) {
+		rdisk->members[i]->claimed = false;
+	}
+	free(rdisk);
+}
+
+static int
+blockdev_raid_destruct(struct spdk_bdev *bdev)
+{
+	struct raid_disk *rdisk = (struct raid_disk *)bdev;
+
+	TAILQ_REMOVE(&g_raid_disks, rdisk, link);
+	raid_free_disk(rdisk);
+
+	return 0;
+}
+
+static void
+raid_task_try_complete(struct spdk_bdev_io *parent)
+{
+	struct raid_task *task = (struct raid_task *)parent->driver_ctx;
+
+	if (!task->submitted || task->outstanding > 0) {
+		return;
+	}
+
+	spdk_bdev_iov_slices_free(&task->iov_slices);
+
+	spdk_bdev_io_complete(parent, task->failed ? SPDK_BDEV_IO_STATUS_FAILED :
+			      SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+static void
+raid_child_complete(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct raid_task *task = (struct raid_task *)parent->driver_ctx;
+
+	/* Children are released together with the parent in spdk_bdev_free_io(). */
+	if (child->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		task->failed = true;
+	}
+
+	task->outstanding--;
+	raid_task_try_complete(parent);
+}
+
+static void
+raid_submit_child(struct spdk_bdev_io *parent, struct spdk_bdev_io *child)
+{
+	struct raid_task *task = (struct raid_task *)parent->driver_ctx;
+
+	task->outstanding++;
+	if (spdk_bdev_io_submit(child) != 0) {
+		/* Never submitted: marked failed so the parent's spdk_bdev_free_io() releases it. */
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		task->outstanding--;
+		task->failed = true;
+	}
+}
+
+static void
+raid_submit_rw(struct spdk_bdev_io *parent)
+{
+	struct raid_disk *rdisk = parent->ctx;
+	struct raid_task *task = (struct raid_task *)parent->driver_ctx;
+	struct spdk_bdev_io *child;
+	int max_children;
+	uint64_t offset, remaining, done = 0, strip, in_strip, seg;
+	bool is_read = parent->type == SPDK_BDEV_IO_TYPE_READ;
+
+	if (is_read) {
+		offset = parent->u.read.offset;
+		remaining = parent->u.read.len;
+	} else {
+		offset = parent->u.write.offset;
+		remaining = parent->u.write.len;
+	}
+
+	max_children = (offset % rdisk->strip_size + remaining + rdisk->strip_size - 1) /
+		       rdisk->strip_size;
+
+	while (remaining > 0) {
+		strip = offset / rdisk->strip_size;
+		in_strip = offset % rdisk->strip_size;
+		seg = rdisk->strip_size - in_strip;
+		if (seg > remaining) {
+			seg = remaining;
+		}
+
+		child = spdk_bdev_get_child_io(parent, rdisk->members[strip % rdisk->num_members],
+					       raid_child_complete, parent);
+		if (child == NULL) {
+			task->failed = true;
+			break;
+		}
+
+		if (spdk_bdev_io_slice_parent_iovs(child, &task->iov_slices, done, seg,
+						   max_children) != 0) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			task->failed = true;
+			break;
+		}
+		if (is_read) {
+			child->u.read.offset = (strip / rdisk->num_members) * rdisk->strip_size + in_strip;
+		} else {
+			child->u.write.offset = (strip / rdisk->num_members) * rdisk->strip_size + in_strip;
+		}
+
+		raid_submit_child(parent, child);
+
+		offset += seg;
+		done += seg;
+		remaining -= seg;
+	}
+
+	task->submitted = true;
+	raid_task_try_complete(parent);
+}
+
+/* Flush and reset apply to every member as a whole. */
+static void
+raid_submit_all_members(struct spdk_bdev_io *parent)
+{
+	struct raid_disk *rdisk = parent->ctx;
+	struct raid_task *task = (struct raid_task *)parent->driver_ctx;
+	struct spdk_bdev_io *child;
+	int i;
+
+	for (i = 0; i < rdisk->num_members; i++) {
+		child = spdk_bdev_get_child_io(parent, rdisk->members[i], raid_child_complete, parent);
+		if (child == NULL) {
+			task->failed = true;
+			break;
+		}
+
+		if (child->type == SPDK_BDEV_IO_TYPE_FLUSH) {
+			child->u.flush.offset = 0;
+			child->u.flush.length = rdisk->members[i]->blockcnt * rdisk->members[i]->blocklen;
+		}
+
+		raid_submit_child(parent, child);
+	}
+
+	task->submitted = true;
+	raid_task_try_complete(parent);
+}
+
+static void
+raid_get_rbuf_cb(struct spdk_bdev_io *bdev_io)
+{
+	raid_submit_rw(bdev_io);
+}
+
+static void
+blockdev_raid_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct raid_task *task = (struct raid_task *)bdev_io->driver_ctx;
+
+	memset(task, 0, sizeof(*task));
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		/* Children need real buffers to read into, so get an rbuf first if needed. */
+		spdk_bdev_io_get_rbuf(bdev_io, raid_get_rbuf_cb);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		raid_submit_rw(bdev_io);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		raid_submit_all_members(bdev_io);
+		break;
+	default:
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+blockdev_raid_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static const struct spdk_bdev_fn_table raid_fn_table = {
+	.destruct		= blockdev_raid_destruct,
+	.submit_request		= blockdev_raid_submit_request,
+	.io_type_supported	= blockdev_raid_io_type_supported,
+};
+
+static struct raid_disk *
+create_raid0_disk(const char *name, uint64_t strip_size, struct spdk_bdev **members,
+		  int num_members)
+{
+	struct raid_disk *rdisk;
+	uint64_t member_strips, min_blockcnt;
+	int i;
+
+	if (num_members < 2 || num_members > RAID_MAX_MEMBERS) {
+		SPDK_ERRLOG("%s: RAID0 needs 2 to %d members\n", name, RAID_MAX_MEMBERS);
+		return NULL;
+	}
+
+	min_blockcnt = members[0]->blockcnt;
+	for (i = 0; i < num_members; i++) {
+		if (members[i]->claimed) {
+			SPDK_ERRLOG("%s: member %s is already in use\n", name, members[i]->name);
+			return NULL;
+		}
+		if (members[i]->blocklen != members[0]->blocklen) {
+			SPDK_ERRLOG("%s: members must have the same block size\n", name);
+			return NULL;
+		}
+		if (members[i]->blockcnt < min_blockcnt) {
+			min_blockcnt = members[i]->blockcnt;
+		}
+	}
+
+	if (strip_size == 0 || strip_size % members[0]->blocklen != 0) {
+		SPDK_ERRLOG("%s: strip size must be a multiple of the block size %u\n",
+			    name, members[0]->blocklen);
+		return NULL;
+	}
+
+	member_strips = min_blockcnt * members[0]->blocklen / strip_size;
+	if (member_strips == 0) {
+		SPDK_ERRLOG("%s: members are smaller than one strip\n", name);
+		return NULL;
+	}
+
+	rdisk = calloc(1, sizeof(*rdisk));
+	if (rdisk == NULL) {
+		SPDK_ERRLOG("could not allocate raid disk\n");
+		return NULL;
+	}
+
+	rdisk->strip_size = strip_size;
+	rdisk->num_members = num_members;
+	for (i = 0; i < num_members; i++) {
+		rdisk->members[i] = members[i];
+		members[i]->claimed = true;
+		if (members[i]->need_aligned_buffer) {
+			rdisk->disk.need_aligned_buffer = 1;
+		}
+	}
+
+	snprintf(rdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(rdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "RAID0 disk");
+
+	rdisk->disk.write_cache = 1;
+	rdisk->disk.blocklen = members[0]->blocklen;
+	rdisk->disk.blockcnt = member_strips * (strip_size / rdisk->disk.blocklen) * num_members;
+	rdisk->disk.ctxt = rdisk;
+	rdisk->disk.fn_table = &raid_fn_table;
+
+	SPDK_TRACELOG(SPDK_TRACE_RAID, "%s: %d members, strip %" PRIu64 " bytes, %" PRIu64 " blocks\n",
+		      name, num_members, strip_size, rdisk->disk.blockcnt);
+
+	spdk_bdev_register(&rdisk->disk);
+	TAILQ_INSERT_TAIL(&g_raid_disks, rdisk, link);
+
+	return rdisk;
+}
+
+static int
+blockdev_raid_initialize(void)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "RAID0");
+	struct spdk_bdev *members[RAID_MAX_MEMBERS];
+	const char *name, *val, *member_name;
+	int i, j, num_members, strip_kb;
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "RAID0", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "RAID0", i, 0);
+		val = spdk_conf_section_get_nmval(sp, "RAID0", i, 1);
+		if (name == NULL || val == NULL) {
+			SPDK_ERRLOG("RAID0 line %d: format error\n", i);
+			return -1;
+		}
+
+		strip_kb = atoi(val);
+		if (strip_kb <= 0) {
+			SPDK_ERRLOG("%s: invalid strip size %s\n", name, val);
+			return -1;
+		}
+
+		num_members = 0;
+		for (j = 2; ; j++) {
+			member_name = spdk_conf_section_get_nmval(sp, "RAID0", i, j);
+			if (member_name == NULL) {
+				break;
+			}
+			if (num_members == RAID_MAX_MEMBERS) {
+				SPDK_ERRLOG("%s: too many members\n", name);
+				return -1;
+			}
+			members[num_members] = spdk_bdev_get_by_name(member_name);
+			if (members[num_members] == NULL) {
+				SPDK_ERRLOG("%s: member %s not found\n", name, member_name);
+				return -1;
+			}
+			num_members++;
+		}
+
+		if (create_raid0_disk(name, (uint64_t)strip_kb * 1024, members, num_members) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_raid_finish(void)
+{
+	struct raid_disk *rdisk;
+
+	while ((rdisk = TAILQ_FIRST(&g_raid_disks)) != NULL) {
+		TAILQ_REMOVE(&g_raid_disks, rdisk, link);
+		raid_free_disk(rdisk);
+	}
+}
+
+static void
+blockdev_raid_get_spdk_running_config(FILE *fp)
+{
+	struct raid_disk *rdisk;
+	int i;
+
+	if (TAILQ_EMPTY(&g_raid_disks)) {
+		return;
+	}
+
+	fprintf(fp,
+		"\n"
+		"# RAID0 <name> <strip size in KiB> <member blockdev> <member blockdev> ...\n"
+		"[RAID0]\n");
+	TAILQ_FOREACH(rdisk, &g_raid_disks, link) {
+		fprintf(fp, "  RAID0 %s %" PRIu64, rdisk->disk.name, rdisk->strip_size / 1024);
+		for (i = 0; i < rdisk->num_members; i++) {
+			fprintf(fp, " %s", rdisk->members[i]->name);
+		}
+		fprintf(fp, "\n");
+	}
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("raid", SPDK_TRACE_RAID)
@@ -0,0 +1,736 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Read cache virtual blockdev.  Keeps recently read lines of a base blockdev
+ *  in hugepage memory, partitioned per lcore, and serves aligned reads that
+ *  hit entirely in the cache without going to the base blockdev.  Writes go
+ *  straight through to the base and invalidate the lines they touch on all
+ *  lcores (see rcache_disk::epochs).
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "blockdev_rcache.h"
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/endian.h"
+#include "spdk/log.h"
+#include "spdk/scsi_spec.h"
+
+#define RCACHE_DEFAULT_LINE_SIZE	4096
+#define RCACHE_MIN_EPOCHS		1024
+
+struct rcache_task {
+	/** Sum of the epochs of the lines read on a miss, sampled at submission */
+	uint64_t	epoch_sum;
+};
+
+static TAILQ_HEAD(, rcache_disk) g_rcache_disks = TAILQ_HEAD_INITIALIZER(g_rcache_disks);
+
+static int blockdev_rcache_initialize(void);
+static void blockdev_rcache_finish(void);
+static void blockdev_rcache_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_rcache_get_ctx_size(void)
+{
+	return sizeof(struct rcache_task);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_rcache_initialize, blockdev_rcache_finish,
+			   blockdev_rcache_get_spdk_running_config, blockdev_rcache_get_ctx_size)
+
+static uint64_t
+rcache_roundup_pow2(uint64_t n)
+{
+	uint64_t v = 1;
+
+	while (v < n) {
+		v <<= 1;
+	}
+
+	return v;
+}
+
+static inline uint32_t
+rcache_epoch(struct rcache_disk *rdisk, uint64_t line)
+{
+	return *(volatile uint32_t *)&rdisk->epochs[line & rdisk->epoch_mask];
+}
+
+static uint64_t
+rcache_epoch_sum(struct rcache_disk *rdisk, uint64_t first, uint64_t count)
+{
+	uint64_t i, sum = 0;
+
+	for (i = 0; i < count; i++) {
+		sum += rcache_epoch(rdisk, first + i);
+	}
+
+	return sum;
+}
+
+static void
+rcache_invalidate_range(struct rcache_disk *rdisk, uint64_t offset, uint64_t len)
+{
+	uint64_t first, last, line;
+
+	if (len == 0) {
+		return;
+	}
+
+	first = offset / rdisk->line_size;
+	last = (offset + len - 1) / rdisk->line_size;
+	if (last - first >= rdisk->epoch_mask) {
+		first = 0;
+		last = rdisk->epoch_mask;
+	}
+
+	for (line = first; line <= last; line++) {
+		__sync_fetch_and_add(&rdisk->epochs[line & rdisk->epoch_mask], 1);
+	}
+}
+
+static void
+rcache_invalidate_unmap(struct rcache_disk *rdisk, struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_scsi_unmap_bdesc *bdesc = bdev_io->u.unmap.unmap_bdesc;
+	uint16_t i;
+
+	for (i = 0; i < bdev_io->u.unmap.bdesc_count; i++) {
+		rcache_invalidate_range(rdisk, from_be64(&bdesc[i].lba) * rdisk->disk.blocklen,
+					(uint64_t)from_be32(&bdesc[i].block_count) * rdisk->disk.blocklen);
+	}
+}
+
+/*
+ * Copy len bytes between buf and the iovec array, starting offset bytes into
+ *  the data described by the array.
+ */
+static void
+rcache_iov_copy(struct iovec *iovs, int iovcnt, uint64_t offset, void *buf, uint64_t len,
+		bool to_iovs)
+{
+	uint64_t chunk;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iovs[i].iov_len) {
+			offset -= iovs[i].iov_len;
+			continue;
+		}
+
+		chunk = iovs[i].iov_len - offset;
+		if (chunk > len) {
+			chunk = len;
+		}
+
+		if (to_iovs) {
+			memcpy((char *)iovs[i].iov_base + offset, buf, chunk);
+		} else {
+			memcpy(buf, (char *)iovs[i].iov_base + offset, chunk);
+		}
+
+		buf = (char *)buf + chunk;
+		len -= chunk;
+		offset = 0;
+	}
+}
+
+static void
+rcache_unhash(struct rcache_channel *rch, struct rcache_line *entry)
+{
+	struct rcache_line **prev = &rch->buckets[entry->line & rch->bucket_mask];
+
+	while (*prev != entry) {
+		prev = &(*prev)->hash_next;
+	}
+	*prev = entry->hash_next;
+}
+
+static void
+rcache_lru_remove(struct rcache_channel *rch, struct rcache_line *entry)
+{
+	if (entry->protected) {
+		TAILQ_REMOVE(&rch->protected, entry, lru);
+		rch->num_protected--;
+		entry->protected = false;
+	} else {
+		TAILQ_REMOVE(&rch->probation, entry, lru);
+	}
+}
+
+/* Find a valid cached copy of the line, dropping it if a write has invalidated it. */
+static struct rcache_line *
+rcache_lookup(struct rcache_disk *rdisk, struct rcache_channel *rch, uint64_t line)
+{
+	struct rcache_line *entry;
+
+	for (entry = rch->buckets[line & rch->bucket_mask]; entry != NULL; entry = entry->hash_next) {
+		if (entry->line != line) {
+			continue;
+		}
+
+		if (entry->epoch != rcache_epoch(rdisk, line)) {
+			rcache_unhash(rch, entry);
+			rcache_lru_remove(rch, entry);
+			TAILQ_INSERT_HEAD(&rch->free, entry, lru);
+			rch->stats.invalidated++;
+			return NULL;
+		}
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+static void
+rcache_touch(struct rcache_channel *rch, struct rcache_line *entry)
+{
+	struct rcache_line *demoted;
+
+	if (entry->protected) {
+		TAILQ_REMOVE(&rch->protected, entry, lru);
+		TAILQ_INSERT_HEAD(&rch->protected, entry, lru);
+		return;
+	}
+
+	TAILQ_REMOVE(&rch->probation, entry, lru);
+	TAILQ_INSERT_HEAD(&rch->protected, entry, lru);
+	entry->protected = true;
+	rch->num_protected++;
+
+	if (rch->num_protected > rch->max_protected) {
+		demoted = TAILQ_LAST(&rch->protected, rcache_lru);
+		TAILQ_REMOVE(&rch->protected, demoted, lru);
+		demoted->protected = false;
+		rch->num_protected--;
+		TAILQ_INSERT_HEAD(&rch->probation, demoted, lru);
+	}
+}
+
+static void
+rcache_insert(struct rcache_channel *rch, uint64_t line, uint32_t epoch,
+	      struct iovec *iovs, int iovcnt, uint64_t offset, uint32_t line_size)
+{
+	struct rcache_line *entry;
+
+	entry = TAILQ_FIRST(&rch->free);
+	if (entry != NULL) {
+		TAILQ_REMOVE(&rch->free, entry, lru);
+	} else {
+		entry = TAILQ_LAST(&rch->probation, rcache_lru);
+		if (entry == NULL) {
+			entry = TAILQ_LAST(&rch->protected, rcache_lru);
+		}
+		rcache_unhash(rch, entry);
+		rcache_lru_remove(rch, entry);
+		rch->stats.evicted++;
+	}
+
+	entry->line = line;
+	entry->epoch = epoch;
+	rcache_iov_copy(iovs, iovcnt, offset, entry->data, line_size, false);
+
+	entry->hash_next = rch->buckets[line & rch->bucket_mask];
+	rch->buckets[line & rch->bucket_mask] = entry;
+	TAILQ_INSERT_HEAD(&rch->probation, entry, lru);
+}
+
+static void
+rcache_fill(struct rcache_disk *rdisk, struct rcache_channel *rch, struct spdk_bdev_io *bdev_io)
+{
+	uint64_t first = bdev_io->u.read.offset / rdisk->line_size;
+	uint64_t count = bdev_io->u.read.len / rdisk->line_size;
+	struct rcache_line *entry;
+	uint64_t i;
+
+	for (i = 0; i < count; i++) {
+		entry = rcache_lookup(rdisk, rch, first + i);
+		if (entry != NULL) {
+			rcache_touch(rch, entry);
+			continue;
+		}
+		rcache_insert(rch, first + i, rcache_epoch(rdisk, first + i),
+			      bdev_io->u.read.iovs, bdev_io->u.read.iovcnt,
+			      i * rdisk->line_size, rdisk->line_size);
+	}
+}
+
+static void
+rcache_passthru_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	/* The child is released together with the parent in spdk_bdev_free_io(). */
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+rcache_read_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct rcache_disk *rdisk = parent->ctx;
+	struct rcache_task *task = (struct rcache_task *)parent->driver_ctx;
+
+	/*
+	 * Epochs only ever increase, so an unchanged sum means no write to these
+	 *  lines started or finished while the read was outstanding and the data
+	 *  read is safe to cache.
+	 */
+	if (child->status == SPDK_BDEV_IO_STATUS_SUCCESS &&
+	    rcache_epoch_sum(rdisk, parent->u.read.offset / rdisk->line_size,
+			     parent->u.read.len / rdisk->line_size) == task->epoch_sum) {
+		rcache_fill(rdisk, parent->ch->ctx, parent);
+	}
+
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+rcache_write_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct rcache_disk *rdisk = parent->ctx;
+
+	if (parent->type == SPDK_BDEV_IO_TYPE_UNMAP) {
+		rcache_invalidate_unmap(rdisk, parent);
+	} else {
+		rcache_invalidate_range(rdisk, parent->u.write.offset, parent->u.write.len);
+	}
+
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+rcache_submit_child(struct spdk_bdev_io *bdev_io, spdk_bdev_io_completion_cb cb)
+{
+	struct rcache_disk *rdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, rdisk->base, cb, bdev_io);
+	if (child == NULL) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		/* Fail the child as well so freeing the parent can release it. */
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+rcache_submit_read(struct spdk_bdev_io *bdev_io)
+{
+	struct rcache_disk *rdisk = bdev_io->ctx;
+	struct rcache_channel *rch = bdev_io->ch->ctx;
+	struct rcache_task *task = (struct rcache_task *)bdev_io->driver_ctx;
+	struct rcache_line *entry;
+	uint64_t first, count, i;
+
+	if (bdev_io->u.read.offset % rdisk->line_size != 0 ||
+	    bdev_io->u.read.len % rdisk->line_size != 0 ||
+	    bdev_io->u.read.len / rdisk->line_size > rdisk->lines_per_core) {
+		rch->stats.bypassed++;
+		rcache_submit_child(bdev_io, rcache_passthru_done);
+		return;
+	}
+
+	first = bdev_io->u.read.offset / rdisk->line_size;
+	count = bdev_io->u.read.len / rdisk->line_size;
+
+	for (i = 0; i < count; i++) {
+		if (rcache_lookup(rdisk, rch, first + i) == NULL) {
+			goto miss;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		/* A write on another lcore may have invalidated the line since the first pass. */
+		entry = rcache_lookup(rdisk, rch, first + i);
+		if (entry == NULL) {
+			goto miss;
+		}
+		rcache_iov_copy(bdev_io->u.read.iovs, bdev_io->u.read.iovcnt, i * rdisk->line_size,
+				entry->data, rdisk->line_size, true);
+		rcache_touch(rch, entry);
+	}
+
+	rch->stats.hits++;
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+	return;
+
+miss:
+	rch->stats.misses++;
+	task->epoch_sum = rcache_epoch_sum(rdisk, first, count);
+	rcache_submit_child(bdev_io, rcache_read_done);
+}
+
+static void
+blockdev_rcache_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct rcache_disk *rdisk = bdev_io->ctx;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		/* Hits are copied into the caller's buffer, so one is needed either way. */
+		spdk_bdev_io_get_rbuf(bdev_io, rcache_submit_read);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		rcache_invalidate_range(rdisk, bdev_io->u.write.offset, bdev_io->u.write.len);
+		rcache_submit_child(bdev_io, rcache_write_done);
+		break;
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+		rcache_invalidate_unmap(rdisk, bdev_io);
+		rcache_submit_child(bdev_io, rcache_write_done);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		rcache_submit_child(bdev_io, rcache_passthru_done);
+		break;
+	default:
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+blockdev_rcache_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	struct rcache_disk *rdisk = (struct rcache_disk *)bdev;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_UNMAP:
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return spdk_bdev_io_type_supported(rdisk->base, io_type);
+
+	default:
+		return false;
+	}
+}
+
+static void
+blockdev_rcache_destroy_channel(struct spdk_bdev_channel *ch)
+{
+	struct rcache_channel *rch = ch->ctx;
+
+	if (rch == NULL) {
+		return;
+	}
+
+	free(rch->buckets);
+	rte_free(rch->data);
+	free(rch->lines);
+	free(rch);
+	ch->ctx = NULL;
+}
+
+static int
+blockdev_rcache_create_channel(struct spdk_bdev_channel *ch)
+{
+	struct rcache_disk *rdisk = ch->bdev->ctxt;
+	struct rcache_channel *rch;
+	uint64_t num_buckets, i;
+
+	rch = calloc(1, sizeof(*rch));
+	if (rch == NULL) {
+		return -1;
+	}
+	ch->ctx = rch;
+
+	TAILQ_INIT(&rch->free);
+	TAILQ_INIT(&rch->probation);
+	TAILQ_INIT(&rch->protected);
+	rch->max_protected = rdisk->lines_per_core * 4 / 5;
+
+	num_buckets = rcache_roundup_pow2(rdisk->lines_per_core);
+	rch->bucket_mask = num_buckets - 1;
+	rch->buckets = calloc(num_buckets, sizeof(*rch->buckets));
+	rch->lines = calloc(rdisk->lines_per_core, sizeof(*rch->lines));
+
+	/* Keep the cached data on the socket of the lcore that copies it. */
+	rch->data = rte_malloc_socket(NULL, rdisk->lines_per_core * rdisk->line_size,
+				      rdisk->line_size, rte_socket_id());
+
+	if (rch->buckets == NULL || rch->lines == NULL || rch->data == NULL) {
+		SPDK_ERRLOG("%s: could not allocate %" PRIu64 " cache lines on lcore %u\n",
+			    rdisk->disk.name, rdisk->lines_per_core, ch->lcore);
+		blockdev_rcache_destroy_channel(ch);
+		return -1;
+	}
+
+	for (i = 0; i < rdisk->lines_per_core; i++) {
+		rch->lines[i].data = (char *)rch->data + i * rdisk->line_size;
+		TAILQ_INSERT_TAIL(&rch->free, &rch->lines[i], lru);
+	}
+
+	return 0;
+}
+
+static void
+rcache_free_disk(struct rcache_disk *rdisk)
+{
+	rdisk->base->claimed = false;
+	rte_free(rdisk->epochs);
+	free(rdisk);
+}
+
+static int
+blockdev_rcache_destruct(struct spdk_bdev *bdev)
+{
+	struct rcache_disk *rdisk = (struct rcache_disk *)bdev;
+
+	TAILQ_REMOVE(&g_rcache_disks, rdisk, link);
+	rcache_free_disk(rdisk);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table rcache_fn_table = {
+	.destruct		= blockdev_rcache_destruct,
+	.submit_request		= blockdev_rcache_submit_request,
+	.io_type_supported	= blockdev_rcache_io_type_supported,
+	.create_channel		= blockdev_rcache_create_channel,
+	.destroy_channel	= blockdev_rcache_destroy_channel,
+};
+
+static struct rcache_disk *
+create_rcache_disk(const char *name, struct spdk_bdev *base, uint64_t cache_size,
+		   uint32_t line_size)
+{
+	struct rcache_disk *rdisk;
+	uint64_t num_epochs;
+
+	if (base->claimed) {
+		SPDK_ERRLOG("%s: base blockdev %s is already in use\n", name, base->name);
+		return NULL;
+	}
+
+	if (line_size == 0 || line_size % base->blocklen != 0) {
+		SPDK_ERRLOG("%s: line size must be a multiple of the block size %u\n",
+			    name, base->blocklen);
+		return NULL;
+	}
+
+	if (cache_size < line_size) {
+		SPDK_ERRLOG("%s: cache is smaller than one line\n", name);
+		return NULL;
+	}
+
+	rdisk = calloc(1, sizeof(*rdisk));
+	if (rdisk == NULL) {
+		SPDK_ERRLOG("could not allocate read cache disk\n");
+		return NULL;
+	}
+
+	rdisk->base = base;
+	rdisk->line_size = line_size;
+	rdisk->lines_per_core = cache_size / line_size;
+
+	/* Enough slots that unrelated cached lines rarely share an epoch. */
+	num_epochs = rcache_roundup_pow2(rdisk->lines_per_core * 4);
+	if (num_epochs < RCACHE_MIN_EPOCHS) {
+		num_epochs = RCACHE_MIN_EPOCHS;
+	}
+	rdisk->epoch_mask = num_epochs - 1;
+	rdisk->epochs = rte_zmalloc(NULL, num_epochs * sizeof(*rdisk->epochs), 64);
+	if (rdisk->epochs == NULL) {
+		SPDK_ERRLOG("%s: could not allocate invalidation epochs\n", name);
+		free(rdisk);
+		return NULL;
+	}
+
+	snprintf(rdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(rdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Read cache disk");
+
+	rdisk->disk.write_cache = base->write_cache;
+	rdisk->disk.need_aligned_buffer = base->need_aligned_buffer;
+	rdisk->disk.thin_provisioning = base->thin_provisioning;
+	rdisk->disk.max_unmap_bdesc_count = base->max_unmap_bdesc_count;
+	rdisk->disk.blocklen = base->blocklen;
+	rdisk->disk.blockcnt = base->blockcnt;
+	rdisk->disk.ctxt = rdisk;
+	rdisk->disk.fn_table = &rcache_fn_table;
+
+	base->claimed = true;
+
+	SPDK_TRACELOG(SPDK_TRACE_RCACHE, "%s: caching %s, %" PRIu64 " lines of %u bytes per lcore\n",
+		      name, base->name, rdisk->lines_per_core, line_size);
+
+	spdk_bdev_register(&rdisk->disk);
+	TAILQ_INSERT_TAIL(&g_rcache_disks, rdisk, link);
+
+	return rdisk;
+}
+
+struct rcache_disk *
+spdk_rcache_first(void)
+{
+	return TAILQ_FIRST(&g_rcache_disks);
+}
+
+struct rcache_disk *
+spdk_rcache_next(struct rcache_disk *prev)
+{
+	return TAILQ_NEXT(prev, link);
+}
+
+void
+spdk_rcache_get_stats(struct rcache_disk *rdisk, struct rcache_stats *stats)
+{
+	struct rcache_channel *rch;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (rdisk->disk.channels == NULL) {
+		return;
+	}
+
+	/* Counters are only written by their own lcore; a slightly stale sum is fine. */
+	for (i = 0; i < RTE_MAX_LCORE; i++) {
+		if (rdisk->disk.channels[i] == NULL || rdisk->disk.channels[i]->ctx == NULL) {
+			continue;
+		}
+		rch = rdisk->disk.channels[i]->ctx;
+		stats->hits += rch->stats.hits;
+		stats->misses += rch->stats.misses;
+		stats->bypassed += rch->stats.bypassed;
+		stats->invalidated += rch->stats.invalidated;
+		stats->evicted += rch->stats.evicted;
+	}
+}
+
+static int
+blockdev_rcache_initialize(void)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "ReadCache");
+	struct spdk_bdev *base;
+	const char *name, *base_name, *val;
+	int i, line_size, cache_mb;
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	line_size = spdk_conf_section_get_intval(sp, "LineSize");
+	if (line_size < 0) {
+		line_size = RCACHE_DEFAULT_LINE_SIZE;
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "ReadCache", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "ReadCache", i, 0);
+		base_name = spdk_conf_section_get_nmval(sp, "ReadCache", i, 1);
+		val = spdk_conf_section_get_nmval(sp, "ReadCache", i, 2);
+		if (name == NULL || base_name == NULL || val == NULL) {
+			SPDK_ERRLOG("ReadCache line %d: format error\n", i);
+			return -1;
+		}
+
+		base = spdk_bdev_get_by_name(base_name);
+		if (base == NULL) {
+			SPDK_ERRLOG("%s: base blockdev %s not found\n", name, base_name);
+			return -1;
+		}
+
+		cache_mb = atoi(val);
+		if (cache_mb <= 0) {
+			SPDK_ERRLOG("%s: invalid cache size %s\n", name, val);
+			return -1;
+		}
+
+		if (create_rcache_disk(name, base, (uint64_t)cache_mb * 1024 * 1024, line_size) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_rcache_finish(void)
+{
+	struct rcache_disk *rdisk;
+
+	while ((rdisk = TAILQ_FIRST(&g_rcache_disks)) != NULL) {
+		TAILQ_REMOVE(&g_rcache_disks, rdisk, link);
+		rcache_free_disk(rdisk);
+	}
+}
+
+static void
+blockdev_rcache_get_spdk_running_config(FILE *fp)
+{
+	struct rcache_disk *rdisk;
+
+	rdisk = TAILQ_FIRST(&g_rcache_disks);
+	if (rdisk == NULL) {
+		return;
+	}
+
+	fprintf(fp,
+		"\n"
+		"[ReadCache]\n"
+		"  LineSize %u\n"
+		"  # ReadCache <name> <base blockdev> <cache size per lcore in MB>\n",
+		rdisk->line_size);
+	TAILQ_FOREACH(rdisk, &g_rcache_disks, link) {
+		fprintf(fp, "  ReadCache %s %s %" PRIu64 "\n", rdisk->disk.name, rdisk->base->name,
+			rdisk->lines_per_core * rdisk->line_size / (1024 * 1024));
+	}
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("rcache", SPDK_TRACE_RCACHE)
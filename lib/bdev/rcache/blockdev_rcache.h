@@ -0,0 +1,130 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SPDK_BLOCKDEV_RCACHE_H
+#define SPDK_BLOCKDEV_RCACHE_H
+
+#include <stdint.h>
+
+#include "spdk/queue.h"
+#include "spdk/bdev.h"
+
+#include "bdev_module.h"
+
+struct rcache_line {
+	/** Index of the cached line on the base blockdev */
+	uint64_t			line;
+
+	/** Invalidation epoch of the line's slot when the data was read */
+	uint32_t			epoch;
+
+	/** True while on the protected segment */
+	bool				protected;
+
+	void				*data;
+	struct rcache_line		*hash_next;
+	TAILQ_ENTRY(rcache_line)	lru;
+};
+
+TAILQ_HEAD(rcache_lru, rcache_line);
+
+struct rcache_stats {
+	/** Reads served entirely from the cache */
+	uint64_t	hits;
+
+	/** Reads that had to go to the base blockdev */
+	uint64_t	misses;
+
+	/** Reads not aligned to the cache line size, passed straight through */
+	uint64_t	bypassed;
+
+	/** Cached lines dropped because a write or unmap touched them */
+	uint64_t	invalidated;
+
+	/** Cached lines evicted to make room for new ones */
+	uint64_t	evicted;
+};
+
+/*
+ * Per-lcore cache partition, stored in spdk_bdev_channel::ctx.  Only the owning
+ *  lcore touches it, so lookups and the LRU lists need no locking.
+ */
+struct rcache_channel {
+	struct rcache_line	*lines;
+	void			*data;
+	struct rcache_line	**buckets;
+	uint64_t		bucket_mask;
+
+	/*
+	 * Segmented LRU: lines enter at the head of the probationary segment and
+	 *  move to the protected segment on their second hit.  Lines pushed off
+	 *  the protected segment go back to probation, and eviction takes the
+	 *  tail of probation, so a single scan cannot flush the hot set.
+	 */
+	struct rcache_lru	free;
+	struct rcache_lru	probation;
+	struct rcache_lru	protected;
+	uint64_t		num_protected;
+	uint64_t		max_protected;
+
+	struct rcache_stats	stats;
+};
+
+struct rcache_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+	uint32_t		line_size;
+	uint64_t		lines_per_core;
+
+	/*
+	 * Write-through invalidation.  Writes bump the epoch of every slot they
+	 *  touch, once when submitted and once when completed; a cached line is
+	 *  only valid while its slot still has the epoch it was filled with.
+	 *  Slots are hashed by line, so a collision only costs a spurious miss.
+	 *  This lets a write on one lcore invalidate copies cached on every
+	 *  other lcore with a single atomic increment.
+	 */
+	uint32_t		*epochs;
+	uint64_t		epoch_mask;
+
+	TAILQ_ENTRY(rcache_disk)	link;
+};
+
+struct rcache_disk *spdk_rcache_first(void);
+struct rcache_disk *spdk_rcache_next(struct rcache_disk *prev);
+
+/** Sum the statistics of all lcores caching this disk. */
+void spdk_rcache_get_stats(struct rcache_disk *rdisk, struct rcache_stats *stats);
+
+#endif // SPDK_BLOCKDEV_RCACHE_H
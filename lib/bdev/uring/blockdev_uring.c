@@ -0,0 +1,595 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "blockdev_uring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_memory.h>
+
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/fd.h"
+#include "spdk/log.h"
+
+#define URING_DEFAULT_QUEUE_DEPTH	128
+#define URING_SQPOLL_IDLE_MS		1000
+
+/* The kernel limits a single registered buffer to 1 GiB and a ring to UIO_MAXIOV buffers. */
+#define URING_MAX_FIXED_BUF_LEN		(1ULL << 30)
+#define URING_MAX_FIXED_BUFS		1024
+
+static int g_blockdev_count = 0;
+static bool g_uring_sqpoll = false;
+
+/*
+ * The bdev rbuf pools (and every other rte_malloc/rte_mempool buffer) live in
+ *  the DPDK memory segments, which are already pinned.  They are registered
+ *  with each ring so that single-buffer I/O can use READ_FIXED/WRITE_FIXED and
+ *  skip the per-I/O page pinning in the kernel.
+ */
+static struct iovec g_uring_fixed_bufs[URING_MAX_FIXED_BUFS];
+static unsigned g_uring_num_fixed_bufs = 0;
+
+static int blockdev_uring_initialize(void);
+static void uring_free_disk(struct uring_disk *udisk);
+
+static int
+blockdev_uring_get_ctx_size(void)
+{
+	return sizeof(struct blockdev_uring_task);
+}
+
+SPDK_BDEV_MODULE_REGISTER(blockdev_uring_initialize, NULL, NULL, blockdev_uring_get_ctx_size)
+
+static void
+blockdev_uring_init_fixed_bufs(void)
+{
+	const struct rte_memseg *ms = rte_eal_get_physmem_layout();
+	uint64_t addr, len, chunk;
+	int i;
+
+	g_uring_num_fixed_bufs = 0;
+
+	for (i = 0; i < RTE_MAX_MEMSEG && ms[i].addr != NULL; i++) {
+		addr = (uint64_t)(uintptr_t)ms[i].addr;
+		len = ms[i].len;
+
+		while (len > 0 && g_uring_num_fixed_bufs < URING_MAX_FIXED_BUFS) {
+			chunk = len < URING_MAX_FIXED_BUF_LEN ? len : URING_MAX_FIXED_BUF_LEN;
+			g_uring_fixed_bufs[g_uring_num_fixed_bufs].iov_base = (void *)(uintptr_t)addr;
+			g_uring_fixed_bufs[g_uring_num_fixed_bufs].iov_len = chunk;
+			g_uring_num_fixed_bufs++;
+			addr += chunk;
+			len -= chunk;
+		}
+	}
+}
+
+static int
+blockdev_uring_find_fixed_buf(const void *buf, uint64_t len)
+{
+	uintptr_t start = (uintptr_t)buf;
+	uintptr_t base;
+	unsigned i;
+
+	for (i = 0; i < g_uring_num_fixed_bufs; i++) {
+		base = (uintptr_t)g_uring_fixed_bufs[i].iov_base;
+		if (start >= base && start + len <= base + g_uring_fixed_bufs[i].iov_len) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int
+blockdev_uring_open(struct uring_disk *disk)
+{
+	int fd;
+
+	fd = open(disk->file, O_RDWR | O_DIRECT);
+	if (fd < 0 && errno == EINVAL) {
+		/* tmpfs and some other file systems do not support O_DIRECT. */
+		SPDK_NOTICELOG("%s does not support O_DIRECT, using buffered I/O\n", disk->file);
+		fd = open(disk->file, O_RDWR);
+	}
+	if (fd < 0) {
+		perror("open");
+		disk->fd = -1;
+		return -1;
+	}
+
+	disk->fd = fd;
+
+	return 0;
+}
+
+static int
+blockdev_uring_close(struct uring_disk *disk)
+{
+	int rc;
+
+	if (disk->fd == -1) {
+		return 0;
+	}
+
+	rc = close(disk->fd);
+	if (rc < 0) {
+		perror("close");
+		return -1;
+	}
+
+	disk->fd = -1;
+
+	return 0;
+}
+
+/*
+ * Hand every SQE prepared since the last call to the kernel.  With SQPOLL the
+ *  kernel thread picks them up and this only enters the kernel to wake it.
+ */
+static void
+blockdev_uring_submit(struct blockdev_uring_io_channel *uring_ch)
+{
+	int rc;
+
+	rc = io_uring_submit(&uring_ch->ring);
+	if (rc < 0) {
+		SPDK_ERRLOG("%s: io_uring_submit returned %d\n", __func__, rc);
+		return;
+	}
+
+	/* Anything not consumed this time stays in the SQ ring for the next call. */
+	uring_ch->num_inflight += rc;
+	if ((uint32_t)rc < uring_ch->num_pending) {
+		uring_ch->num_pending -= rc;
+	} else {
+		uring_ch->num_pending = 0;
+	}
+}
+
+static struct io_uring_sqe *
+blockdev_uring_get_sqe(struct blockdev_uring_io_channel *uring_ch)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(&uring_ch->ring);
+	if (sqe == NULL && uring_ch->num_pending > 0) {
+		/* The SQ ring is full of staged requests; push them out early. */
+		blockdev_uring_submit(uring_ch);
+		sqe = io_uring_get_sqe(&uring_ch->ring);
+	}
+
+	if (sqe == NULL) {
+		SPDK_ERRLOG("%s: io_uring submission queue full\n", __func__);
+	}
+
+	return sqe;
+}
+
+static void
+blockdev_uring_queue_sqe(struct blockdev_uring_io_channel *uring_ch, struct io_uring_sqe *sqe,
+			 struct blockdev_uring_task *uring_task)
+{
+	if (uring_ch->fixed_file) {
+		io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+	}
+	io_uring_sqe_set_data(sqe, uring_task);
+	uring_ch->num_pending++;
+}
+
+static int64_t
+blockdev_uring_rw(struct uring_disk *udisk, struct spdk_bdev_channel *ch,
+		  struct blockdev_uring_task *uring_task, bool write,
+		  struct iovec *iov, int iovcnt, uint64_t nbytes, uint64_t offset)
+{
+	struct blockdev_uring_io_channel *uring_ch = ch->ctx;
+	struct io_uring_sqe *sqe;
+	int fd = uring_ch->fixed_file ? 0 : udisk->fd;
+	int buf_index = -1;
+
+	sqe = blockdev_uring_get_sqe(uring_ch);
+	if (sqe == NULL) {
+		return -1;
+	}
+
+	if (iovcnt == 1 && uring_ch->fixed_buffers) {
+		buf_index = blockdev_uring_find_fixed_buf(iov[0].iov_base, iov[0].iov_len);
+	}
+
+	if (buf_index >= 0) {
+		if (write) {
+			io_uring_prep_write_fixed(sqe, fd, iov[0].iov_base, iov[0].iov_len, offset, buf_index);
+		} else {
+			io_uring_prep_read_fixed(sqe, fd, iov[0].iov_base, iov[0].iov_len, offset, buf_index);
+		}
+	} else {
+		if (write) {
+			io_uring_prep_writev(sqe, fd, iov, iovcnt, offset);
+		} else {
+			io_uring_prep_readv(sqe, fd, iov, iovcnt, offset);
+		}
+	}
+
+	uring_task->len = nbytes;
+	blockdev_uring_queue_sqe(uring_ch, sqe, uring_task);
+
+	SPDK_TRACELOG(SPDK_TRACE_URING, "%s %d iovs size %lu at off: %#lx%s\n",
+		      write ? "write" : "read", iovcnt, nbytes, offset,
+		      buf_index >= 0 ? " (fixed)" : "");
+
+	return nbytes;
+}
+
+static int64_t
+blockdev_uring_flush(struct uring_disk *udisk, struct spdk_bdev_channel *ch,
+		     struct blockdev_uring_task *uring_task)
+{
+	struct blockdev_uring_io_channel *uring_ch = ch->ctx;
+	struct io_uring_sqe *sqe;
+
+	sqe = blockdev_uring_get_sqe(uring_ch);
+	if (sqe == NULL) {
+		return -1;
+	}
+
+	io_uring_prep_fsync(sqe, uring_ch->fixed_file ? 0 : udisk->fd, IORING_FSYNC_DATASYNC);
+	uring_task->len = 0;
+	blockdev_uring_queue_sqe(uring_ch, sqe, uring_task);
+
+	return 0;
+}
+
+static int
+blockdev_uring_destruct(struct spdk_bdev *bdev)
+{
+	struct uring_disk *udisk = (struct uring_disk *)bdev;
+	int rc = 0;
+
+	rc = blockdev_uring_close(udisk);
+	if (rc < 0) {
+		SPDK_ERRLOG("blockdev_uring_close() failed\n");
+	}
+	uring_free_disk(udisk);
+	return rc;
+}
+
+static int
+blockdev_uring_check_io(struct spdk_bdev_channel *ch)
+{
+	struct blockdev_uring_io_channel *uring_ch = ch->ctx;
+	struct blockdev_uring_task *uring_task;
+	enum spdk_bdev_io_status status;
+	unsigned nr, i;
+
+	if (uring_ch->num_pending > 0) {
+		blockdev_uring_submit(uring_ch);
+	}
+
+	if (uring_ch->num_inflight == 0) {
+		return 0;
+	}
+
+	/* Completions are read straight from the shared CQ ring - no syscall. */
+	nr = io_uring_peek_batch_cqe(&uring_ch->ring, uring_ch->cqes, uring_ch->queue_depth);
+
+	for (i = 0; i < nr; i++) {
+		uring_task = io_uring_cqe_get_data(uring_ch->cqes[i]);
+		if (uring_ch->cqes[i]->res < 0 ||
+		    (uint64_t)uring_ch->cqes[i]->res != uring_task->len) {
+			status = SPDK_BDEV_IO_STATUS_FAILED;
+		} else {
+			status = SPDK_BDEV_IO_STATUS_SUCCESS;
+		}
+
+		spdk_bdev_io_complete(spdk_bdev_io_from_ctx(uring_task), status);
+	}
+
+	io_uring_cq_advance(&uring_ch->ring, nr);
+	uring_ch->num_inflight -= nr;
+
+	return 0;
+}
+
+static int
+blockdev_uring_reset(struct uring_disk *udisk, struct blockdev_uring_task *uring_task)
+{
+	spdk_bdev_io_complete(spdk_bdev_io_from_ctx(uring_task), SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	return 0;
+}
+
+static void blockdev_uring_get_rbuf_cb(struct spdk_bdev_io *bdev_io)
+{
+	int64_t ret;
+
+	ret = blockdev_uring_rw((struct uring_disk *)bdev_io->ctx,
+				bdev_io->ch,
+				(struct blockdev_uring_task *)bdev_io->driver_ctx,
+				false,
+				bdev_io->u.read.iovs,
+				bdev_io->u.read.iovcnt,
+				bdev_io->u.read.len,
+				bdev_io->u.read.offset);
+
+	if (ret < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static int _blockdev_uring_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		spdk_bdev_io_get_rbuf(bdev_io, blockdev_uring_get_rbuf_cb);
+		return 0;
+
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		return blockdev_uring_rw((struct uring_disk *)bdev_io->ctx,
+					 bdev_io->ch,
+					 (struct blockdev_uring_task *)bdev_io->driver_ctx,
+					 true,
+					 bdev_io->u.write.iovs,
+					 bdev_io->u.write.iovcnt,
+					 bdev_io->u.write.len,
+					 bdev_io->u.write.offset);
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		return blockdev_uring_flush((struct uring_disk *)bdev_io->ctx,
+					    bdev_io->ch,
+					    (struct blockdev_uring_task *)bdev_io->driver_ctx);
+
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return blockdev_uring_reset((struct uring_disk *)bdev_io->ctx,
+					    (struct blockdev_uring_task *)bdev_io->driver_ctx);
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static void blockdev_uring_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	if (_blockdev_uring_submit_request(bdev_io) < 0) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static bool
+blockdev_uring_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static int
+blockdev_uring_create_channel(struct spdk_bdev_channel *ch)
+{
+	struct uring_disk *udisk = (struct uring_disk *)ch->bdev;
+	struct blockdev_uring_io_channel *uring_ch;
+	struct io_uring_params params;
+	int rc;
+
+	uring_ch = calloc(1, sizeof(*uring_ch));
+	if (uring_ch == NULL) {
+		SPDK_ERRLOG("unable to allocate uring channel\n");
+		return -1;
+	}
+
+	uring_ch->queue_depth = udisk->queue_depth;
+
+	memset(&params, 0, sizeof(params));
+	if (g_uring_sqpoll) {
+		params.flags |= IORING_SETUP_SQPOLL;
+		params.sq_thread_idle = URING_SQPOLL_IDLE_MS;
+	}
+
+	rc = io_uring_queue_init_params(uring_ch->queue_depth, &uring_ch->ring, &params);
+	if (rc < 0 && g_uring_sqpoll) {
+		SPDK_NOTICELOG("SQPOLL ring setup failed (%d), falling back to a regular ring\n", rc);
+		memset(&params, 0, sizeof(params));
+		rc = io_uring_queue_init_params(uring_ch->queue_depth, &uring_ch->ring, &params);
+	}
+	if (rc < 0) {
+		SPDK_ERRLOG("io_uring setup failure: %d\n", rc);
+		free(uring_ch);
+		return -1;
+	}
+
+	uring_ch->cqes = calloc(uring_ch->queue_depth, sizeof(*uring_ch->cqes));
+	if (uring_ch->cqes == NULL) {
+		SPDK_ERRLOG("unable to allocate completion array\n");
+		io_uring_queue_exit(&uring_ch->ring);
+		free(uring_ch);
+		return -1;
+	}
+
+	/* Registered files and buffers are optimizations; carry on without them if refused. */
+	uring_ch->fixed_file = io_uring_register_files(&uring_ch->ring, &udisk->fd, 1) == 0;
+
+	if (g_uring_num_fixed_bufs > 0) {
+		rc = io_uring_register_buffers(&uring_ch->ring, g_uring_fixed_bufs, g_uring_num_fixed_bufs);
+		if (rc < 0) {
+			SPDK_TRACELOG(SPDK_TRACE_URING, "io_uring_register_buffers returned %d\n", rc);
+		}
+		uring_ch->fixed_buffers = rc == 0;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_URING, "%s: ring on lcore %u (sqpoll %d, fixed file %d, fixed bufs %d)\n",
+		      udisk->disk.name, ch->lcore, (params.flags & IORING_SETUP_SQPOLL) != 0,
+		      uring_ch->fixed_file, uring_ch->fixed_buffers);
+
+	ch->ctx = uring_ch;
+
+	return 0;
+}
+
+/* io_uring_queue_exit() would drop SQEs still staged or in flight on this ring. */
+static bool
+blockdev_uring_channel_busy(struct spdk_bdev_channel *ch)
+{
+	struct blockdev_uring_io_channel *uring_ch = ch->ctx;
+
+	return uring_ch->num_pending + uring_ch->num_inflight > 0;
+}
+
+static void
+blockdev_uring_destroy_channel(struct spdk_bdev_channel *ch)
+{
+	struct blockdev_uring_io_channel *uring_ch = ch->ctx;
+
+	io_uring_queue_exit(&uring_ch->ring);
+	free(uring_ch->cqes);
+	free(uring_ch);
+}
+
+static const struct spdk_bdev_fn_table uring_fn_table = {
+	.destruct		= blockdev_uring_destruct,
+	.check_io		= blockdev_uring_check_io,
+	.submit_request		= blockdev_uring_submit_request,
+	.io_type_supported	= blockdev_uring_io_type_supported,
+	.create_channel		= blockdev_uring_create_channel,
+	.destroy_channel	= blockdev_uring_destroy_channel,
+	.channel_busy		= blockdev_uring_channel_busy,
+};
+
+static void uring_free_disk(struct uring_disk *udisk)
+{
+	if (udisk == NULL)
+		return;
+	free(udisk);
+}
+
+struct uring_disk *
+create_uring_disk(char *fname)
+{
+	struct uring_disk *udisk;
+
+	udisk = calloc(sizeof(*udisk), 1);
+	if (!udisk) {
+		SPDK_ERRLOG("Unable to allocate enough memory for uring backend\n");
+		return NULL;
+	}
+
+	udisk->file = fname;
+	if (blockdev_uring_open(udisk)) {
+		SPDK_ERRLOG("Unable to open file %s. fd: %d errno: %d\n", fname, udisk->fd, errno);
+		goto error_return;
+	}
+
+	udisk->size = spdk_fd_get_size(udisk->fd);
+	udisk->queue_depth = URING_DEFAULT_QUEUE_DEPTH;
+
+	snprintf(udisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "Uring%d",
+		 g_blockdev_count);
+	snprintf(udisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "io_uring disk");
+
+	udisk->disk.need_aligned_buffer = 1;
+	udisk->disk.write_cache = 1;
+	udisk->disk.blocklen = spdk_fd_get_blocklen(udisk->fd);
+	udisk->disk.blockcnt = udisk->size / udisk->disk.blocklen;
+	udisk->disk.ctxt = udisk;
+
+	udisk->disk.fn_table = &uring_fn_table;
+
+	g_blockdev_count++;
+
+	spdk_bdev_register(&udisk->disk);
+	return udisk;
+
+error_return:
+	blockdev_uring_close(udisk);
+	uring_free_disk(udisk);
+	return NULL;
+}
+
+static int blockdev_uring_initialize(void)
+{
+	struct uring_disk *udisk;
+	int i;
+	const char *val = NULL;
+	char *file;
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "Uring");
+	bool skip_missing = false;
+
+	blockdev_uring_init_fixed_bufs();
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	val = spdk_conf_section_get_val(sp, "SkipMissingFiles");
+	if (val != NULL && !strcmp(val, "Yes")) {
+		skip_missing = true;
+	}
+
+	val = spdk_conf_section_get_val(sp, "SQPoll");
+	if (val != NULL && !strcmp(val, "Yes")) {
+		g_uring_sqpoll = true;
+	}
+
+	for (i = 0; ; i++) {
+		val = spdk_conf_section_get_nval(sp, "Uring", i);
+		if (val == NULL)
+			break;
+		file = spdk_conf_section_get_nmval(sp, "Uring", i, 0);
+		if (file == NULL) {
+			SPDK_ERRLOG("Uring%d: format error\n", i);
+			return -1;
+		}
+
+		udisk = create_uring_disk(file);
+
+		if (udisk == NULL && !skip_missing) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("uring", SPDK_TRACE_URING)
@@ -0,0 +1,79 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SPDK_BLOCKDEV_URING_H
+#define SPDK_BLOCKDEV_URING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <liburing.h>
+
+#include "spdk/bdev.h"
+
+#include "bdev_module.h"
+
+struct blockdev_uring_task {
+	uint64_t			len;
+};
+
+struct uring_disk {
+	struct spdk_bdev	disk;	/* this must be first element */
+	char			*file;
+	int			fd;
+	uint32_t		queue_depth;
+	uint64_t		size;
+};
+
+/* Per-lcore io_uring instance, stored in spdk_bdev_channel::ctx */
+struct blockdev_uring_io_channel {
+	struct io_uring		ring;
+	uint32_t		queue_depth;
+
+	/** SQEs prepared since the last io_uring_submit() call. */
+	uint32_t		num_pending;
+
+	/** Requests submitted to the kernel whose CQE has not been reaped yet. */
+	uint32_t		num_inflight;
+
+	/** The disk fd is registered with the ring as fixed file 0. */
+	bool			fixed_file;
+
+	/** The DPDK memory segments are registered with the ring as fixed buffers. */
+	bool			fixed_buffers;
+
+	struct io_uring_cqe	**cqes;
+};
+
+struct uring_disk *create_uring_disk(char *fname);
+
+#endif // SPDK_BLOCKDEV_URING_H
@@ -0,0 +1,1404 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Write-back cache virtual blockdev.  Writes are appended to a log on a small
+ *  fast blockdev and acknowledged as soon as they are logged; a poller on the
+ *  master lcore later copies them to the slow base blockdev in large batches
+ *  sorted by LBA.  Reads are served from the log for blocks not destaged yet
+ *  and from the base otherwise.  After a restart the log is replayed from the
+ *  tail recorded in its superblock, so acknowledged writes are not lost.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "blockdev_wbcache.h"
+#include "spdk/bdev.h"
+#include "spdk/conf.h"
+#include "spdk/log.h"
+
+/* Destage once this much is logged, or once the oldest write waited this long. */
+#define WBC_DESTAGE_MIN_SIZE	(512 * 1024)
+#define WBC_DESTAGE_DELAY_US	1000
+
+static TAILQ_HEAD(, wbc_disk) g_wbc_disks = TAILQ_HEAD_INITIALIZER(g_wbc_disks);
+
+static int blockdev_wbcache_initialize(void);
+static void blockdev_wbcache_finish(void);
+static void blockdev_wbcache_get_spdk_running_config(FILE *fp);
+
+static int
+blockdev_wbcache_get_ctx_size(void)
+{
+	return sizeof(struct wbc_task);
+}
+
+SPDK_VBDEV_MODULE_REGISTER(blockdev_wbcache_initialize, blockdev_wbcache_finish,
+			   blockdev_wbcache_get_spdk_running_config, blockdev_wbcache_get_ctx_size)
+
+static void wbc_submit_read(struct spdk_bdev_io *bdev_io);
+static void wbc_recover_read_hdr(struct wbc_disk *wdisk);
+static void wbc_format(struct wbc_disk *wdisk);
+
+static inline struct wbc_record *
+wbc_record(struct wbc_disk *wdisk, uint64_t idx)
+{
+	return &wdisk->records[idx % wdisk->max_records];
+}
+
+static uint64_t
+wbc_checksum(const struct iovec *iovs, int iovcnt)
+{
+	uint64_t a = 1, b = 0, word;
+	const uint8_t *p;
+	size_t off;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		p = iovs[i].iov_base;
+		for (off = 0; off + sizeof(word) <= iovs[i].iov_len; off += sizeof(word)) {
+			memcpy(&word, p + off, sizeof(word));
+			a += word;
+			b += a;
+		}
+		for (; off < iovs[i].iov_len; off++) {
+			a += p[off];
+			b += a;
+		}
+	}
+
+	return a ^ (b << 32 | b >> 32);
+}
+
+/*
+ * Map of base LBA to newest logged copy.
+ */
+
+static uint32_t
+wbc_map_lookup(struct wbc_disk *wdisk, uint64_t lba)
+{
+	uint32_t blk;
+
+	for (blk = wdisk->buckets[lba & wdisk->bucket_mask]; blk != WBC_NONE; blk = wdisk->map[blk].next) {
+		if (wdisk->map[blk].base_lba == lba) {
+			return blk;
+		}
+	}
+
+	return WBC_NONE;
+}
+
+static void
+wbc_map_remove(struct wbc_disk *wdisk, uint32_t blk)
+{
+	uint32_t *prev = &wdisk->buckets[wdisk->map[blk].base_lba & wdisk->bucket_mask];
+
+	while (*prev != blk) {
+		prev = &wdisk->map[*prev].next;
+	}
+	*prev = wdisk->map[blk].next;
+	wdisk->map[blk].hashed = false;
+}
+
+static void
+wbc_map_insert_record(struct wbc_disk *wdisk, struct wbc_record *rec)
+{
+	struct wbc_map_entry *entry;
+	uint32_t blk, old;
+	uint32_t i;
+
+	for (i = 0; i < rec->nblocks; i++) {
+		blk = rec->pos + 1 + i;
+		old = wbc_map_lookup(wdisk, rec->base_lba + i);
+		if (old != WBC_NONE) {
+			wbc_map_remove(wdisk, old);
+		}
+
+		entry = &wdisk->map[blk];
+		entry->base_lba = rec->base_lba + i;
+		entry->seq = rec->seq;
+		entry->hashed = true;
+		entry->next = wdisk->buckets[entry->base_lba & wdisk->bucket_mask];
+		wdisk->buckets[entry->base_lba & wdisk->bucket_mask] = blk;
+	}
+}
+
+/*
+ * Log space.  Must be called with the lock held.
+ */
+
+static bool
+wbc_log_alloc(struct wbc_disk *wdisk, uint64_t nblocks, uint64_t *pos, uint64_t *gap)
+{
+	uint64_t capacity = wdisk->log_end - wdisk->log_start;
+
+	*gap = 0;
+	if (wdisk->head + nblocks > wdisk->log_end) {
+		*gap = wdisk->log_end - wdisk->head;
+	}
+
+	if (wdisk->used + *gap + nblocks > capacity) {
+		return false;
+	}
+
+	*pos = *gap ? wdisk->log_start : wdisk->head;
+	wdisk->head = *pos + nblocks;
+	if (wdisk->head == wdisk->log_end) {
+		wdisk->head = wdisk->log_start;
+	}
+	wdisk->used += *gap + nblocks;
+
+	return true;
+}
+
+static void
+wbc_queue_task(struct wbc_disk *wdisk, struct wbc_task *task)
+{
+	TAILQ_INSERT_TAIL(&wdisk->waiting, task, link);
+}
+
+/*
+ * Write path: append a record to the log and acknowledge it once it and
+ *  every older record are on the log, so that recovery, which stops at the
+ *  first record missing from the log, never drops an acknowledged write.
+ */
+
+static void
+wbc_log_write_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct wbc_disk *wdisk = parent->ctx;
+	struct wbc_task *task = (struct wbc_task *)parent->driver_ctx;
+	TAILQ_HEAD(, wbc_task) done;
+	struct wbc_record *rec;
+
+	TAILQ_INIT(&done);
+
+	pthread_mutex_lock(&wdisk->lock);
+	rec = wbc_record(wdisk, task->record);
+	rec->logged = true;
+	wdisk->free_hdrs[wdisk->num_free_hdrs++] = rec->hdr;
+	rec->hdr = NULL;
+	if (child->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		SPDK_ERRLOG("%s: log write failed, no longer accepting writes\n", wdisk->disk.name);
+		rec->failed = true;
+		wdisk->state = WBC_STATE_LOG_FAILED;
+	}
+
+	while (wdisk->rec_ack != wdisk->rec_head) {
+		rec = wbc_record(wdisk, wdisk->rec_ack);
+		if (!rec->logged) {
+			break;
+		}
+
+		/* Once a record is lost, younger ones would not be found by recovery. */
+		if (wdisk->state != WBC_STATE_ONLINE) {
+			rec->failed = true;
+		}
+		if (!rec->failed) {
+			wbc_map_insert_record(wdisk, rec);
+		}
+		if (rec->task != NULL) {
+			rec->task->failed = rec->failed;
+			TAILQ_INSERT_TAIL(&done, rec->task, link);
+			rec->task = NULL;
+		}
+		wdisk->rec_ack++;
+	}
+	pthread_mutex_unlock(&wdisk->lock);
+
+	while ((task = TAILQ_FIRST(&done)) != NULL) {
+		TAILQ_REMOVE(&done, task, link);
+		spdk_bdev_io_complete(task->bdev_io, task->failed ? SPDK_BDEV_IO_STATUS_FAILED :
+				      SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+}
+
+/*
+ * Reserve a record, a header buffer and log space for a write, or return
+ *  NULL when the log is full.  Called with the lock held.
+ */
+static struct spdk_bdev_io *
+wbc_reserve_write(struct wbc_disk *wdisk, struct wbc_task *task)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct wbc_record *rec;
+	uint64_t nblocks = bdev_io->u.write.len / wdisk->blocklen;
+	uint64_t pos, gap;
+
+	if (wdisk->num_free_hdrs == 0 ||
+	    wdisk->rec_head - wdisk->rec_tail == wdisk->max_records ||
+	    !wbc_log_alloc(wdisk, nblocks + 1, &pos, &gap)) {
+		return NULL;
+	}
+
+	task->record = wdisk->rec_head++;
+	rec = wbc_record(wdisk, task->record);
+	rec->seq = wdisk->next_seq++;
+	rec->pos = pos;
+	rec->gap = gap;
+	rec->base_lba = bdev_io->u.write.offset / wdisk->blocklen;
+	rec->nblocks = nblocks;
+	rec->logged = false;
+	rec->failed = false;
+	rec->task = task;
+	rec->hdr = wdisk->free_hdrs[--wdisk->num_free_hdrs];
+
+	return spdk_bdev_get_child_io(bdev_io, wdisk->log, wbc_log_write_done, bdev_io);
+}
+
+static void
+wbc_issue_write(struct wbc_task *task, struct spdk_bdev_io *child)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct wbc_disk *wdisk = bdev_io->ctx;
+	struct wbc_record *rec = wbc_record(wdisk, task->record);
+	struct wbc_record_hdr *hdr = rec->hdr;
+
+	memset(hdr, 0, wdisk->blocklen);
+	hdr->magic = WBC_RECORD_MAGIC;
+	hdr->log_id = wdisk->log_id;
+	hdr->seq = rec->seq;
+	hdr->base_lba = rec->base_lba;
+	hdr->nblocks = rec->nblocks;
+	hdr->checksum = task->checksum;
+
+	task->log_iovs[0].iov_base = hdr;
+	task->log_iovs[0].iov_len = wdisk->blocklen;
+	memcpy(&task->log_iovs[1], bdev_io->u.write.iovs, bdev_io->u.write.iovcnt * sizeof(struct iovec));
+
+	child->u.write.iovs = task->log_iovs;
+	child->u.write.iovcnt = bdev_io->u.write.iovcnt + 1;
+	child->u.write.len = (rec->nblocks + 1) * wdisk->blocklen;
+	child->u.write.offset = rec->pos * wdisk->blocklen;
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		spdk_event_call(spdk_event_allocate(rte_lcore_id(), wbc_log_write_done, bdev_io, child, NULL));
+	}
+}
+
+static void
+wbc_submit_write(struct wbc_task *task)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct wbc_disk *wdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child = NULL;
+
+	pthread_mutex_lock(&wdisk->lock);
+
+	if (wdisk->state != WBC_STATE_RECOVERING && wdisk->state != WBC_STATE_REPLAYING &&
+	    wdisk->state != WBC_STATE_ONLINE) {
+		pthread_mutex_unlock(&wdisk->lock);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	/*
+	 * Writes get their sequence number in arrival order, so one may not
+	 *  overtake another that is still waiting for log space.
+	 */
+	if (wdisk->state == WBC_STATE_ONLINE && TAILQ_EMPTY(&wdisk->waiting)) {
+		child = wbc_reserve_write(wdisk, task);
+	}
+	if (child == NULL) {
+		/* Resubmitted by recovery or by the destage poller once it frees log space. */
+		wbc_queue_task(wdisk, task);
+		pthread_mutex_unlock(&wdisk->lock);
+		return;
+	}
+	pthread_mutex_unlock(&wdisk->lock);
+
+	wbc_issue_write(task, child);
+}
+
+/*
+ * Resubmit I/O that waited for recovery or log space, oldest first, until
+ *  a write still does not fit.  Called without the lock.
+ */
+static void
+wbc_resume_waiting(struct wbc_disk *wdisk)
+{
+	struct wbc_task *task;
+	struct spdk_bdev_io *child;
+
+	for (;;) {
+		pthread_mutex_lock(&wdisk->lock);
+		task = TAILQ_FIRST(&wdisk->waiting);
+		if (task == NULL || wdisk->state == WBC_STATE_RECOVERING) {
+			pthread_mutex_unlock(&wdisk->lock);
+			return;
+		}
+
+		if (task->bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+			TAILQ_REMOVE(&wdisk->waiting, task, link);
+			pthread_mutex_unlock(&wdisk->lock);
+			wbc_submit_read(task->bdev_io);
+			continue;
+		}
+
+		if (wdisk->state == WBC_STATE_REPLAYING) {
+			pthread_mutex_unlock(&wdisk->lock);
+			return;
+		}
+
+		if (wdisk->state != WBC_STATE_ONLINE) {
+			TAILQ_REMOVE(&wdisk->waiting, task, link);
+			pthread_mutex_unlock(&wdisk->lock);
+			spdk_bdev_io_complete(task->bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			continue;
+		}
+
+		child = wbc_reserve_write(wdisk, task);
+		if (child == NULL) {
+			pthread_mutex_unlock(&wdisk->lock);
+			return;
+		}
+		TAILQ_REMOVE(&wdisk->waiting, task, link);
+		pthread_mutex_unlock(&wdisk->lock);
+
+		wbc_issue_write(task, child);
+	}
+}
+
+/*
+ * Read path: split the read into runs of blocks that are either all in the
+ *  log, contiguously, or all still on the base only.
+ */
+
+static void
+wbc_read_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+	struct wbc_disk *wdisk = parent->ctx;
+	struct wbc_task *task = (struct wbc_task *)parent->driver_ctx;
+
+	if (child->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		task->failed = true;
+	}
+
+	if (--task->outstanding > 0) {
+		return;
+	}
+
+	if (task->log_read) {
+		pthread_mutex_lock(&wdisk->lock);
+		wdisk->log_reads[task->gen]--;
+		pthread_mutex_unlock(&wdisk->lock);
+	}
+
+	spdk_bdev_iov_slices_free(&task->iov_slices);
+
+	spdk_bdev_io_complete(parent, task->failed ? SPDK_BDEV_IO_STATUS_FAILED :
+			      SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+static int
+wbc_add_read_run(struct wbc_task *task, bool from_log, uint64_t src_blk,
+		 uint64_t first, uint64_t count, uint64_t max_runs)
+{
+	struct spdk_bdev_io *bdev_io = task->bdev_io;
+	struct wbc_disk *wdisk = bdev_io->ctx;
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, from_log ? wdisk->log : wdisk->base,
+				       wbc_read_done, bdev_io);
+	if (child == NULL) {
+		return -1;
+	}
+
+	if (spdk_bdev_io_slice_parent_iovs(child, &task->iov_slices, first * wdisk->blocklen,
+					   count * wdisk->blocklen, max_runs) != 0) {
+		return -1;
+	}
+
+	child->u.read.offset = src_blk * wdisk->blocklen;
+	task->outstanding++;
+	task->log_read |= from_log;
+
+	return 0;
+}
+
+static void
+wbc_submit_read(struct spdk_bdev_io *bdev_io)
+{
+	struct wbc_disk *wdisk = bdev_io->ctx;
+	struct wbc_task *task = (struct wbc_task *)bdev_io->driver_ctx;
+	struct spdk_bdev_io *child, *tmp;
+	uint64_t lba = bdev_io->u.read.offset / wdisk->blocklen;
+	uint64_t nblocks = bdev_io->u.read.len / wdisk->blocklen;
+	uint64_t i, run_first = 0, run_src = 0, src;
+	uint32_t blk;
+	bool run_log = false, in_log;
+	int rc = 0;
+
+	pthread_mutex_lock(&wdisk->lock);
+
+	if (wdisk->state == WBC_STATE_RECOVERING) {
+		wbc_queue_task(wdisk, task);
+		pthread_mutex_unlock(&wdisk->lock);
+		return;
+	}
+
+	if (wdisk->state == WBC_STATE_OFFLINE) {
+		pthread_mutex_unlock(&wdisk->lock);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	for (i = 0; i < nblocks && rc == 0; i++) {
+		blk = wbc_map_lookup(wdisk, lba + i);
+		in_log = blk != WBC_NONE;
+		src = in_log ? blk : lba + i;
+
+		if (i > 0 && (in_log != run_log || src != run_src + (i - run_first))) {
+			rc = wbc_add_read_run(task, run_log, run_src, run_first, i - run_first, nblocks);
+		}
+		if (i == 0 || in_log != run_log || src != run_src + (i - run_first)) {
+			run_first = i;
+			run_src = src;
+			run_log = in_log;
+		}
+	}
+	if (rc == 0) {
+		rc = wbc_add_read_run(task, run_log, run_src, run_first, nblocks - run_first, nblocks);
+	}
+
+	if (task->log_read) {
+		task->gen = wdisk->read_gen & 1;
+		wdisk->log_reads[task->gen]++;
+	}
+
+	pthread_mutex_unlock(&wdisk->lock);
+
+	if (rc != 0) {
+		/*
+		 * Nothing was submitted yet.  The children are released with the
+		 *  parent, which only frees those no longer marked pending.
+		 */
+		TAILQ_FOREACH(child, &bdev_io->child_io, link) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		}
+		if (task->log_read) {
+			pthread_mutex_lock(&wdisk->lock);
+			wdisk->log_reads[task->gen]--;
+			pthread_mutex_unlock(&wdisk->lock);
+		}
+		spdk_bdev_iov_slices_free(&task->iov_slices);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	TAILQ_FOREACH_SAFE(child, &bdev_io->child_io, link, tmp) {
+		if (spdk_bdev_io_submit(child) != 0) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			spdk_event_call(spdk_event_allocate(rte_lcore_id(), wbc_read_done, bdev_io, child, NULL));
+		}
+	}
+}
+
+static void
+wbc_passthru_done(spdk_event_t event)
+{
+	struct spdk_bdev_io *parent = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *child = spdk_event_get_arg2(event);
+
+	spdk_bdev_io_complete(parent, child->status);
+}
+
+static void
+wbc_submit_passthru(struct spdk_bdev_io *bdev_io, struct spdk_bdev *target)
+{
+	struct spdk_bdev_io *child;
+
+	child = spdk_bdev_get_child_io(bdev_io, target, wbc_passthru_done, bdev_io);
+	if (child == NULL) {
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (spdk_bdev_io_submit(child) != 0) {
+		child->status = SPDK_BDEV_IO_STATUS_FAILED;
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+blockdev_wbcache_submit_request(struct spdk_bdev_io *bdev_io)
+{
+	struct wbc_disk *wdisk = bdev_io->ctx;
+	struct wbc_task *task = (struct wbc_task *)bdev_io->driver_ctx;
+	struct spdk_bdev_io *child;
+
+	memset(task, 0, offsetof(struct wbc_task, log_iovs));
+	task->bdev_io = bdev_io;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		spdk_bdev_io_get_rbuf(bdev_io, wbc_submit_read);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		if (bdev_io->u.write.len > WBC_MAX_WRITE_SIZE ||
+		    bdev_io->u.write.iovcnt + 1 > WBC_MAX_IOVS) {
+			SPDK_ERRLOG("%s: write of %zu bytes in %d iovecs is too large for the log\n",
+				    wdisk->disk.name, bdev_io->u.write.len, bdev_io->u.write.iovcnt);
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		task->checksum = wbc_checksum(bdev_io->u.write.iovs, bdev_io->u.write.iovcnt);
+		wbc_submit_write(task);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		/* Acknowledged writes are already in the log; make the log durable. */
+		child = spdk_bdev_get_child_io(bdev_io, wdisk->log, wbc_passthru_done, bdev_io);
+		if (child == NULL) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			break;
+		}
+		child->u.flush.offset = 0;
+		child->u.flush.length = wdisk->log->blockcnt * wdisk->log->blocklen;
+		if (spdk_bdev_io_submit(child) != 0) {
+			child->status = SPDK_BDEV_IO_STATUS_FAILED;
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+		break;
+	case SPDK_BDEV_IO_TYPE_RESET:
+		wbc_submit_passthru(bdev_io, wdisk->base);
+		break;
+	default:
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+blockdev_wbcache_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	struct wbc_disk *wdisk = (struct wbc_disk *)bdev;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		return true;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		return spdk_bdev_io_type_supported(wdisk->log, io_type);
+	case SPDK_BDEV_IO_TYPE_RESET:
+		return spdk_bdev_io_type_supported(wdisk->base, io_type);
+
+	default:
+		return false;
+	}
+}
+
+/*
+ * Destage: read a run of the oldest logged records, write the blocks that
+ *  have not been overwritten since to the base sorted by LBA, flush the base,
+ *  move the tail in the superblock and finally release the log space.
+ */
+
+static void
+wbc_destage_release(struct wbc_disk *wdisk)
+{
+	struct wbc_record *rec;
+	uint64_t i;
+	bool replayed;
+
+	pthread_mutex_lock(&wdisk->lock);
+	for (i = wdisk->destage_first; i < wdisk->destage_end; i++) {
+		rec = wbc_record(wdisk, i);
+		wdisk->used -= rec->gap + 1 + rec->nblocks;
+	}
+	wdisk->rec_tail = wdisk->destage_end;
+	wdisk->tail = wdisk->destage_tail;
+	replayed = wdisk->state == WBC_STATE_REPLAYING && wdisk->rec_tail == wdisk->rec_head;
+	pthread_mutex_unlock(&wdisk->lock);
+
+	SPDK_TRACELOG(SPDK_TRACE_WBCACHE, "%s: destaged %" PRIu64 " records, log tail %" PRIu64 "\n",
+		      wdisk->disk.name, wdisk->destage_end - wdisk->destage_first, wdisk->tail);
+
+	wdisk->destage_state = WBC_DESTAGE_IDLE;
+	wdisk->last_destage_tsc = rte_get_timer_cycles();
+	if (replayed) {
+		wbc_format(wdisk);
+		return;
+	}
+	wbc_resume_waiting(wdisk);
+}
+
+static void
+wbc_super_write_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+
+	/*
+	 * If the superblock is stale, recovery replays records that were already
+	 *  destaged; replaying them in order is harmless, so carry on.
+	 */
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		SPDK_ERRLOG("%s: superblock update failed\n", wdisk->disk.name);
+	}
+	spdk_bdev_free_io(bdev_io);
+
+	wdisk->super_written = true;
+}
+
+static int
+wbc_write_super(struct wbc_disk *wdisk, uint64_t tail, uint64_t tail_seq, spdk_event_fn cb)
+{
+	struct wbc_super *super = wdisk->super_buf;
+
+	memset(super, 0, wdisk->blocklen);
+	super->magic = WBC_SUPER_MAGIC;
+	super->log_id = wdisk->log_id;
+	super->blocklen = wdisk->blocklen;
+	super->base_blockcnt = wdisk->base->blockcnt;
+	super->log_blockcnt = wdisk->log->blockcnt;
+	super->tail = tail;
+	super->tail_seq = tail_seq;
+
+	if (spdk_bdev_write(wdisk->log, super, 0, wdisk->blocklen, cb, wdisk) == NULL) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+wbc_destage_commit(struct wbc_disk *wdisk)
+{
+	struct wbc_record *rec, *last;
+	uint64_t i;
+	uint32_t j, blk;
+
+	pthread_mutex_lock(&wdisk->lock);
+	for (i = wdisk->destage_first; i < wdisk->destage_end; i++) {
+		rec = wbc_record(wdisk, i);
+		for (j = 0; j < rec->nblocks; j++) {
+			blk = rec->pos + 1 + j;
+			if (wdisk->map[blk].hashed && wdisk->map[blk].seq == rec->seq) {
+				wbc_map_remove(wdisk, blk);
+			}
+		}
+	}
+
+	/* Reads from now on cannot reach the destaged blocks; wait out the older ones. */
+	wdisk->destage_gen = wdisk->read_gen & 1;
+	wdisk->read_gen++;
+
+	last = wbc_record(wdisk, wdisk->destage_end - 1);
+	wdisk->destage_tail = last->pos + 1 + last->nblocks;
+	if (wdisk->destage_tail == wdisk->log_end) {
+		wdisk->destage_tail = wdisk->log_start;
+	}
+	wdisk->destage_tail_seq = last->seq + 1;
+	pthread_mutex_unlock(&wdisk->lock);
+
+	wdisk->destage_state = WBC_DESTAGE_RELEASING;
+	wdisk->super_written = false;
+	if (wbc_write_super(wdisk, wdisk->destage_tail, wdisk->destage_tail_seq,
+			    wbc_super_write_done) != 0) {
+		SPDK_ERRLOG("%s: could not submit superblock update\n", wdisk->disk.name);
+		wdisk->super_written = true;
+	}
+}
+
+static void
+wbc_destage_flush_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		/* The records are still in the log; try again on a later poll. */
+		SPDK_ERRLOG("%s: base flush failed during destage\n", wdisk->disk.name);
+		wdisk->destage_state = WBC_DESTAGE_IDLE;
+		return;
+	}
+
+	wbc_destage_commit(wdisk);
+}
+
+static void
+wbc_destage_flush(struct wbc_disk *wdisk)
+{
+	if (!spdk_bdev_io_type_supported(wdisk->base, SPDK_BDEV_IO_TYPE_FLUSH)) {
+		wbc_destage_commit(wdisk);
+		return;
+	}
+
+	wdisk->destage_state = WBC_DESTAGE_FLUSHING;
+	if (spdk_bdev_flush(wdisk->base, 0, wdisk->base->blockcnt * wdisk->base->blocklen,
+			    wbc_destage_flush_done, wdisk) == NULL) {
+		wdisk->destage_state = WBC_DESTAGE_IDLE;
+	}
+}
+
+static void
+wbc_destage_write_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		wdisk->destage_failed = true;
+	}
+	spdk_bdev_free_io(bdev_io);
+
+	if (--wdisk->destage_outstanding > 0) {
+		return;
+	}
+
+	if (wdisk->destage_failed) {
+		SPDK_ERRLOG("%s: base write failed during destage\n", wdisk->disk.name);
+		wdisk->destage_state = WBC_DESTAGE_IDLE;
+		return;
+	}
+
+	wbc_destage_flush(wdisk);
+}
+
+static int
+wbc_destage_block_cmp(const void *a, const void *b)
+{
+	const struct wbc_destage_block *x = a, *y = b;
+
+	if (x->base_lba < y->base_lba) {
+		return -1;
+	}
+	return x->base_lba > y->base_lba;
+}
+
+static void
+wbc_destage_read_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct wbc_destage_block *blocks = wdisk->destage_blocks;
+	struct iovec *iovs = wdisk->destage_iovs;
+	struct wbc_record *rec;
+	uint64_t first_pos, i, count = 0, run_start, run_iov;
+	uint32_t j, blk;
+	int niovs = 0;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: log read failed during destage\n", wdisk->disk.name);
+		wdisk->destage_state = WBC_DESTAGE_IDLE;
+		return;
+	}
+
+	/* Skip blocks that a younger record has overwritten; it is destaged later. */
+	first_pos = wbc_record(wdisk, wdisk->destage_first)->pos;
+	pthread_mutex_lock(&wdisk->lock);
+	for (i = wdisk->destage_first; i < wdisk->destage_end; i++) {
+		rec = wbc_record(wdisk, i);
+		for (j = 0; j < rec->nblocks; j++) {
+			blk = rec->pos + 1 + j;
+			if (!rec->failed && wdisk->map[blk].hashed && wdisk->map[blk].seq == rec->seq) {
+				blocks[count].base_lba = rec->base_lba + j;
+				blocks[count].buf = (char *)wdisk->destage_buf + (blk - first_pos) * wdisk->blocklen;
+				count++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&wdisk->lock);
+
+	if (count == 0) {
+		wbc_destage_commit(wdisk);
+		return;
+	}
+
+	qsort(blocks, count, sizeof(*blocks), wbc_destage_block_cmp);
+
+	wdisk->destage_state = WBC_DESTAGE_WRITING;
+	wdisk->destage_failed = false;
+	wdisk->destage_outstanding = 1;
+
+	run_start = 0;
+	run_iov = 0;
+	for (i = 0; i < count; i++) {
+		if (niovs > 0 && (char *)iovs[niovs - 1].iov_base + iovs[niovs - 1].iov_len == blocks[i].buf) {
+			iovs[niovs - 1].iov_len += wdisk->blocklen;
+		} else {
+			iovs[niovs].iov_base = blocks[i].buf;
+			iovs[niovs].iov_len = wdisk->blocklen;
+			niovs++;
+		}
+
+		/* One base write per run of consecutive LBAs. */
+		if (i + 1 == count || blocks[i + 1].base_lba != blocks[i].base_lba + 1) {
+			wdisk->destage_outstanding++;
+			if (spdk_bdev_writev(wdisk->base, &iovs[run_iov], niovs - run_iov,
+					     blocks[run_start].base_lba * wdisk->blocklen,
+					     (i + 1 - run_start) * wdisk->blocklen,
+					     wbc_destage_write_done, wdisk) == NULL) {
+				wdisk->destage_outstanding--;
+				wdisk->destage_failed = true;
+			}
+			run_start = i + 1;
+			run_iov = niovs;
+		}
+	}
+
+	/* Drop the reference held while submitting. */
+	if (--wdisk->destage_outstanding == 0) {
+		if (wdisk->destage_failed) {
+			wdisk->destage_state = WBC_DESTAGE_IDLE;
+		} else {
+			wbc_destage_flush(wdisk);
+		}
+	}
+}
+
+static void
+wbc_destage_start(struct wbc_disk *wdisk)
+{
+	struct wbc_record *first, *rec, *prev;
+	uint64_t end, bytes = 0, next_pos;
+	bool waiting, due;
+
+	pthread_mutex_lock(&wdisk->lock);
+
+	if (wdisk->state == WBC_STATE_RECOVERING || wdisk->state == WBC_STATE_OFFLINE ||
+	    wdisk->rec_tail == wdisk->rec_ack) {
+		pthread_mutex_unlock(&wdisk->lock);
+		return;
+	}
+
+	/* Take acknowledged records that are contiguous in the log and fit the buffer. */
+	first = wbc_record(wdisk, wdisk->rec_tail);
+	prev = NULL;
+	for (end = wdisk->rec_tail; end < wdisk->rec_ack; end++) {
+		rec = wbc_record(wdisk, end);
+		if (prev != NULL) {
+			next_pos = prev->pos + 1 + prev->nblocks;
+			if (rec->pos != next_pos) {
+				break;
+			}
+		}
+		if ((rec->pos + 1 + rec->nblocks - first->pos) * wdisk->blocklen > WBC_DESTAGE_BUF_SIZE) {
+			break;
+		}
+		bytes = (rec->pos + 1 + rec->nblocks - first->pos) * wdisk->blocklen;
+		prev = rec;
+	}
+
+	waiting = !TAILQ_EMPTY(&wdisk->waiting);
+	due = wdisk->state == WBC_STATE_REPLAYING ||
+	      rte_get_timer_cycles() - wdisk->last_destage_tsc >
+	      rte_get_timer_hz() * WBC_DESTAGE_DELAY_US / 1000000;
+	pthread_mutex_unlock(&wdisk->lock);
+
+	if (bytes < WBC_DESTAGE_MIN_SIZE && !waiting && !due) {
+		return;
+	}
+
+	wdisk->destage_first = wdisk->rec_tail;
+	wdisk->destage_end = end;
+	wdisk->destage_state = WBC_DESTAGE_READING;
+	if (spdk_bdev_read(wdisk->log, wdisk->destage_buf, first->pos * wdisk->blocklen, bytes,
+			   wbc_destage_read_done, wdisk) == NULL) {
+		wdisk->destage_state = WBC_DESTAGE_IDLE;
+	}
+}
+
+static void
+wbc_destage_poll(void *arg)
+{
+	struct wbc_disk *wdisk = arg;
+	bool reads_done;
+
+	switch (wdisk->destage_state) {
+	case WBC_DESTAGE_IDLE:
+		wbc_destage_start(wdisk);
+		break;
+	case WBC_DESTAGE_RELEASING:
+		pthread_mutex_lock(&wdisk->lock);
+		reads_done = wdisk->log_reads[wdisk->destage_gen] == 0;
+		pthread_mutex_unlock(&wdisk->lock);
+		if (wdisk->super_written && reads_done) {
+			wbc_destage_release(wdisk);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Recovery: read the superblock, then scan records from the tail for as
+ *  long as they carry the expected sequence number and a valid checksum.
+ *  The records found are destaged before new writes are accepted, and the
+ *  log is then formatted with a new log ID, so that records left behind
+ *  the end of the scan can never be mistaken for part of a later chain.
+ *  Runs asynchronously on the master lcore; I/O submitted meanwhile waits.
+ */
+
+static void
+wbc_recover_finish(struct wbc_disk *wdisk, enum wbc_state state)
+{
+	pthread_mutex_lock(&wdisk->lock);
+	wdisk->state = state;
+	pthread_mutex_unlock(&wdisk->lock);
+
+	wdisk->last_destage_tsc = rte_get_timer_cycles();
+	wbc_resume_waiting(wdisk);
+}
+
+static void
+wbc_format_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not format log on %s\n", wdisk->disk.name, wdisk->log->name);
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+		return;
+	}
+
+	wbc_recover_finish(wdisk, WBC_STATE_ONLINE);
+}
+
+/* Start a new, empty chain of records at the current head. */
+static void
+wbc_format(struct wbc_disk *wdisk)
+{
+	wdisk->log_id = rte_get_timer_cycles() ^ ((uint64_t)rand() << 32);
+	wdisk->tail = wdisk->head;
+	if (wbc_write_super(wdisk, wdisk->tail, wdisk->next_seq, wbc_format_done) != 0) {
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+	}
+}
+
+/* The scan reached the end of the log. */
+static void
+wbc_recover_done(struct wbc_disk *wdisk)
+{
+	if (wdisk->rec_head == wdisk->rec_tail) {
+		wbc_format(wdisk);
+		return;
+	}
+
+	SPDK_NOTICELOG("%s: recovered %" PRIu64 " records (%" PRIu64 " log blocks) from %s\n",
+		       wdisk->disk.name, wdisk->rec_head, wdisk->used, wdisk->log->name);
+	wbc_recover_finish(wdisk, WBC_STATE_REPLAYING);
+}
+
+static void
+wbc_recover_data_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct wbc_record_hdr *hdr = wdisk->destage_buf;
+	struct wbc_record *rec;
+	struct iovec iov;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: log read failed during recovery\n", wdisk->disk.name);
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+		return;
+	}
+
+	iov.iov_base = (char *)wdisk->destage_buf + wdisk->blocklen;
+	iov.iov_len = (uint64_t)hdr->nblocks * wdisk->blocklen;
+	if (wbc_checksum(&iov, 1) != hdr->checksum) {
+		/* A torn write: the end of the log. */
+		wbc_recover_done(wdisk);
+		return;
+	}
+
+	rec = wbc_record(wdisk, wdisk->rec_head++);
+	rec->seq = hdr->seq;
+	rec->pos = wdisk->scan_pos;
+	rec->gap = wdisk->scan_gap;
+	rec->base_lba = hdr->base_lba;
+	rec->nblocks = hdr->nblocks;
+	rec->logged = true;
+	rec->failed = false;
+	rec->task = NULL;
+	rec->hdr = NULL;
+	wdisk->rec_ack = wdisk->rec_head;
+	wbc_map_insert_record(wdisk, rec);
+
+	wdisk->used += rec->gap + 1 + rec->nblocks;
+	wdisk->next_seq = rec->seq + 1;
+	wdisk->scan_pos = rec->pos + 1 + rec->nblocks;
+	if (wdisk->scan_pos == wdisk->log_end) {
+		wdisk->scan_pos = wdisk->log_start;
+	}
+	wdisk->scan_gap = 0;
+	wdisk->head = wdisk->scan_pos;
+
+	if (wdisk->rec_head - wdisk->rec_tail == wdisk->max_records) {
+		wbc_recover_done(wdisk);
+		return;
+	}
+
+	wbc_recover_read_hdr(wdisk);
+}
+
+static void
+wbc_recover_hdr_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct wbc_record_hdr *hdr = wdisk->destage_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: log read failed during recovery\n", wdisk->disk.name);
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+		return;
+	}
+
+	if (hdr->magic != WBC_RECORD_MAGIC || hdr->log_id != wdisk->log_id ||
+	    hdr->seq != wdisk->next_seq || hdr->nblocks == 0 ||
+	    (uint64_t)hdr->nblocks * wdisk->blocklen > WBC_MAX_WRITE_SIZE ||
+	    hdr->base_lba + hdr->nblocks > wdisk->base->blockcnt ||
+	    wdisk->scan_pos + 1 + hdr->nblocks > wdisk->log_end) {
+		/* The next record may have been written at the start of the log instead. */
+		if (wdisk->scan_gap == 0 && wdisk->scan_pos != wdisk->log_start) {
+			wdisk->scan_gap = wdisk->log_end - wdisk->scan_pos;
+			wdisk->scan_pos = wdisk->log_start;
+			wbc_recover_read_hdr(wdisk);
+			return;
+		}
+
+		wbc_recover_done(wdisk);
+		return;
+	}
+
+	if (spdk_bdev_read(wdisk->log, (char *)wdisk->destage_buf + wdisk->blocklen,
+			   (wdisk->scan_pos + 1) * wdisk->blocklen,
+			   (uint64_t)hdr->nblocks * wdisk->blocklen,
+			   wbc_recover_data_done, wdisk) == NULL) {
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+	}
+}
+
+static void
+wbc_recover_read_hdr(struct wbc_disk *wdisk)
+{
+	if (spdk_bdev_read(wdisk->log, wdisk->destage_buf, wdisk->scan_pos * wdisk->blocklen,
+			   wdisk->blocklen, wbc_recover_hdr_done, wdisk) == NULL) {
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+	}
+}
+
+static void
+wbc_recover_super_done(spdk_event_t event)
+{
+	struct wbc_disk *wdisk = spdk_event_get_arg1(event);
+	struct spdk_bdev_io *bdev_io = spdk_event_get_arg2(event);
+	struct wbc_super *super = wdisk->super_buf;
+	bool success = bdev_io->status == SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		SPDK_ERRLOG("%s: could not read log superblock from %s\n", wdisk->disk.name,
+			    wdisk->log->name);
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+		return;
+	}
+
+	if (super->magic != WBC_SUPER_MAGIC) {
+		SPDK_NOTICELOG("%s: formatting log on %s\n", wdisk->disk.name, wdisk->log->name);
+		wdisk->head = wdisk->log_start;
+		wdisk->next_seq = 1;
+		wbc_format(wdisk);
+		return;
+	}
+
+	if (super->blocklen != wdisk->blocklen || super->base_blockcnt != wdisk->base->blockcnt ||
+	    super->log_blockcnt != wdisk->log->blockcnt ||
+	    super->tail < wdisk->log_start || super->tail >= wdisk->log_end) {
+		SPDK_ERRLOG("%s: log on %s belongs to a different configuration\n", wdisk->disk.name,
+			    wdisk->log->name);
+		wbc_recover_finish(wdisk, WBC_STATE_OFFLINE);
+		return;
+	}
+
+	wdisk->log_id = super->log_id;
+	wdisk->tail = wdisk->head = super->tail;
+	wdisk->next_seq = super->tail_seq;
+	wdisk->scan_pos = super->tail;
+	wdisk->scan_gap = 0;
+	wbc_recover_read_hdr(wdisk);
+}
+
+static void
+wbc_free_disk(struct wbc_disk *wdisk)
+{
+	if (wdisk->destage_poller != NULL) {
+		spdk_poller_unregister(&wdisk->destage_poller, NULL);
+	}
+
+	if (wdisk->base != NULL) {
+		wdisk->base->claimed = false;
+	}
+	if (wdisk->log != NULL) {
+		wdisk->log->claimed = false;
+	}
+
+	pthread_mutex_destroy(&wdisk->lock);
+	rte_free(wdisk->super_buf);
+	rte_free(wdisk->destage_buf);
+	rte_free(wdisk->hdr_bufs);
+	free(wdisk->destage_iovs);
+	free(wdisk->destage_blocks);
+	free(wdisk->buckets);
+	free(wdisk->map);
+	free(wdisk->records);
+	free(wdisk);
+}
+
+static int
+blockdev_wbcache_destruct(struct spdk_bdev *bdev)
+{
+	struct wbc_disk *wdisk = (struct wbc_disk *)bdev;
+
+	TAILQ_REMOVE(&g_wbc_disks, wdisk, link);
+	wbc_free_disk(wdisk);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table wbcache_fn_table = {
+	.destruct		= blockdev_wbcache_destruct,
+	.submit_request		= blockdev_wbcache_submit_request,
+	.io_type_supported	= blockdev_wbcache_io_type_supported,
+};
+
+static struct wbc_disk *
+create_wbcache_disk(const char *name, struct spdk_bdev *base, struct spdk_bdev *log)
+{
+	struct wbc_disk *wdisk;
+	uint64_t num_buckets, max_blocks, log_blocks;
+	uint32_t i;
+
+	if (base->claimed || log->claimed) {
+		SPDK_ERRLOG("%s: %s is already in use\n", name, base->claimed ? base->name : log->name);
+		return NULL;
+	}
+
+	if (base->blocklen != log->blocklen || base->blocklen < sizeof(struct wbc_super) ||
+	    base->blocklen < sizeof(struct wbc_record_hdr)) {
+		SPDK_ERRLOG("%s: base and log must have the same block size\n", name);
+		return NULL;
+	}
+
+	/* Room for a few of the largest writes, and indexable with 32-bit block numbers. */
+	log_blocks = log->blockcnt - 1;
+	if (log_blocks * log->blocklen < 4 * (WBC_MAX_WRITE_SIZE + log->blocklen) ||
+	    log->blockcnt >= WBC_NONE) {
+		SPDK_ERRLOG("%s: log blockdev %s is too small or too large\n", name, log->name);
+		return NULL;
+	}
+
+	wdisk = calloc(1, sizeof(*wdisk));
+	if (wdisk == NULL) {
+		SPDK_ERRLOG("could not allocate write cache disk\n");
+		return NULL;
+	}
+
+	pthread_mutex_init(&wdisk->lock, NULL);
+	TAILQ_INIT(&wdisk->waiting);
+	wdisk->blocklen = base->blocklen;
+	wdisk->log_start = 1;
+	wdisk->log_end = log->blockcnt;
+	wdisk->state = WBC_STATE_RECOVERING;
+
+	/* Every record has a header block and at least one data block. */
+	wdisk->max_records = log_blocks / 2;
+	wdisk->records = calloc(wdisk->max_records, sizeof(*wdisk->records));
+	wdisk->map = calloc(log->blockcnt, sizeof(*wdisk->map));
+	num_buckets = 1;
+	while (num_buckets < log->blockcnt) {
+		num_buckets <<= 1;
+	}
+	wdisk->bucket_mask = num_buckets - 1;
+	wdisk->buckets = malloc(num_buckets * sizeof(*wdisk->buckets));
+
+	max_blocks = WBC_DESTAGE_BUF_SIZE / wdisk->blocklen;
+	wdisk->destage_blocks = calloc(max_blocks, sizeof(*wdisk->destage_blocks));
+	wdisk->destage_iovs = calloc(max_blocks, sizeof(*wdisk->destage_iovs));
+	wdisk->destage_buf = rte_malloc(NULL, WBC_DESTAGE_BUF_SIZE, wdisk->blocklen);
+	wdisk->super_buf = rte_zmalloc(NULL, wdisk->blocklen, wdisk->blocklen);
+	wdisk->hdr_bufs = rte_zmalloc(NULL, WBC_MAX_INFLIGHT * wdisk->blocklen, wdisk->blocklen);
+
+	if (wdisk->records == NULL || wdisk->map == NULL || wdisk->buckets == NULL ||
+	    wdisk->destage_blocks == NULL || wdisk->destage_iovs == NULL ||
+	    wdisk->destage_buf == NULL || wdisk->super_buf == NULL || wdisk->hdr_bufs == NULL) {
+		SPDK_ERRLOG("%s: could not allocate write cache metadata\n", name);
+		wbc_free_disk(wdisk);
+		return NULL;
+	}
+
+	for (i = 0; i < num_buckets; i++) {
+		wdisk->buckets[i] = WBC_NONE;
+	}
+	for (i = 0; i < WBC_MAX_INFLIGHT; i++) {
+		wdisk->free_hdrs[i] = (char *)wdisk->hdr_bufs + i * wdisk->blocklen;
+	}
+	wdisk->num_free_hdrs = WBC_MAX_INFLIGHT;
+
+	snprintf(wdisk->disk.name, SPDK_BDEV_MAX_NAME_LENGTH, "%s", name);
+	snprintf(wdisk->disk.product_name, SPDK_BDEV_MAX_PRODUCT_NAME_LENGTH, "Write cache disk");
+
+	wdisk->disk.write_cache = 1;
+	wdisk->disk.need_aligned_buffer = base->need_aligned_buffer || log->need_aligned_buffer;
+	wdisk->disk.blocklen = base->blocklen;
+	wdisk->disk.blockcnt = base->blockcnt;
+	wdisk->disk.ctxt = wdisk;
+	wdisk->disk.fn_table = &wbcache_fn_table;
+
+	base->claimed = true;
+	log->claimed = true;
+	wdisk->base = base;
+	wdisk->log = log;
+
+	spdk_bdev_register(&wdisk->disk);
+	TAILQ_INSERT_TAIL(&g_wbc_disks, wdisk, link);
+
+	/* Replay the log before serving I/O; requests submitted meanwhile wait. */
+	if (spdk_bdev_read(log, wdisk->super_buf, 0, wdisk->blocklen, wbc_recover_super_done,
+			   wdisk) == NULL) {
+		wdisk->state = WBC_STATE_OFFLINE;
+	}
+
+	spdk_poller_register(&wdisk->destage_poller, wbc_destage_poll, wdisk,
+			     rte_get_master_lcore(), NULL, 0);
+
+	return wdisk;
+}
+
+static int
+blockdev_wbcache_initialize(void)
+{
+	struct spdk_conf_section *sp = spdk_conf_find_section(NULL, "WriteCache");
+	struct spdk_bdev *base, *log;
+	const char *name, *base_name, *log_name;
+	int i;
+
+	if (sp == NULL) {
+		return 0;
+	}
+
+	for (i = 0; ; i++) {
+		if (spdk_conf_section_get_nval(sp, "WriteCache", i) == NULL) {
+			break;
+		}
+
+		name = spdk_conf_section_get_nmval(sp, "WriteCache", i, 0);
+		base_name = spdk_conf_section_get_nmval(sp, "WriteCache", i, 1);
+		log_name = spdk_conf_section_get_nmval(sp, "WriteCache", i, 2);
+		if (name == NULL || base_name == NULL || log_name == NULL) {
+			SPDK_ERRLOG("WriteCache line %d: format error\n", i);
+			return -1;
+		}
+
+		base = spdk_bdev_get_by_name(base_name);
+		log = spdk_bdev_get_by_name(log_name);
+		if (base == NULL || log == NULL) {
+			SPDK_ERRLOG("%s: blockdev %s not found\n", name, base == NULL ? base_name : log_name);
+			return -1;
+		}
+
+		if (create_wbcache_disk(name, base, log) == NULL) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+blockdev_wbcache_finish(void)
+{
+	struct wbc_disk *wdisk;
+
+	/* Anything not destaged yet stays in the log and is replayed on the next start. */
+	while ((wdisk = TAILQ_FIRST(&g_wbc_disks)) != NULL) {
+		TAILQ_REMOVE(&g_wbc_disks, wdisk, link);
+		wbc_free_disk(wdisk);
+	}
+}
+
+static void
+blockdev_wbcache_get_spdk_running_config(FILE *fp)
+{
+	struct wbc_disk *wdisk;
+
+	if (TAILQ_EMPTY(&g_wbc_disks)) {
+		return;
+	}
+
+	fprintf(fp,
+		"\n"
+		"# WriteCache <name> <base blockdev> <log blockdev>\n"
+		"[WriteCache]\n");
+	TAILQ_FOREACH(wdisk, &g_wbc_disks, link) {
+		fprintf(fp, "  WriteCache %s %s %s\n", wdisk->disk.name, wdisk->base->name,
+			wdisk->log->name);
+	}
+}
+
+SPDK_LOG_REGISTER_TRACE_FLAG("wbcache", SPDK_TRACE_WBCACHE)
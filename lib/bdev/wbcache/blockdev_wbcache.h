@@ -0,0 +1,257 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SPDK_BLOCKDEV_WBCACHE_H
+#define SPDK_BLOCKDEV_WBCACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "spdk/queue.h"
+#include "spdk/bdev.h"
+
+#include "bdev_module.h"
+
+/*
+ * On-disk layout of the log blockdev: block 0 holds struct wbc_super, and
+ *  blocks 1 .. blockcnt - 1 are a circular log of records.  Each record is one
+ *  header block (struct wbc_record_hdr) followed by the data of one write.
+ *  A record that does not fit before the end of the log is written at block 1
+ *  instead, and the blocks skipped at the end are left unused.
+ */
+#define WBC_SUPER_MAGIC		0x314342574B445053ULL	/* "SPDKWBC1" */
+#define WBC_RECORD_MAGIC	0x524342574B445053ULL	/* "SPDKWBCR" */
+
+/* Largest write accepted; also the largest record replayed during recovery. */
+#define WBC_MAX_WRITE_SIZE	(1024 * 1024)
+
+/* Log reads done by one destage pass; always holds at least one whole record. */
+#define WBC_DESTAGE_BUF_SIZE	(2 * WBC_MAX_WRITE_SIZE)
+
+/* Maximum number of log writes in flight, i.e. of record header buffers. */
+#define WBC_MAX_INFLIGHT	256
+
+/* Header block plus the caller's iovecs for one log write. */
+#define WBC_MAX_IOVS		32
+
+#define WBC_NONE		UINT32_MAX
+
+struct wbc_super {
+	uint64_t	magic;
+
+	/** Random value chosen when the log was formatted; stamped on every record */
+	uint64_t	log_id;
+
+	uint32_t	blocklen;
+	uint32_t	reserved;
+	uint64_t	base_blockcnt;
+	uint64_t	log_blockcnt;
+
+	/** Log block and sequence number of the oldest record not yet destaged */
+	uint64_t	tail;
+	uint64_t	tail_seq;
+};
+
+struct wbc_record_hdr {
+	uint64_t	magic;
+	uint64_t	log_id;
+	uint64_t	seq;
+	uint64_t	base_lba;
+	uint32_t	nblocks;
+	uint32_t	reserved;
+
+	/** Checksum of the nblocks data blocks following the header */
+	uint64_t	checksum;
+};
+
+enum wbc_state {
+	/** Scanning the log; I/O is queued until this completes */
+	WBC_STATE_RECOVERING,
+
+	/**
+	 * Destaging the records found by recovery before the log is formatted
+	 *  afresh; reads are served but writes are queued
+	 */
+	WBC_STATE_REPLAYING,
+
+	WBC_STATE_ONLINE,
+
+	/** A log write failed; reads are still served but writes fail */
+	WBC_STATE_LOG_FAILED,
+
+	/** The log could not be read or belongs to another base; all I/O fails */
+	WBC_STATE_OFFLINE,
+};
+
+enum wbc_destage_state {
+	WBC_DESTAGE_IDLE,
+	WBC_DESTAGE_READING,
+	WBC_DESTAGE_WRITING,
+	WBC_DESTAGE_FLUSHING,
+
+	/** Waiting for the superblock write and for reads still using the log */
+	WBC_DESTAGE_RELEASING,
+};
+
+/* In-memory descriptor of a log record, kept in a ring in log order. */
+struct wbc_record {
+	uint64_t		seq;
+	uint64_t		pos;
+	uint64_t		gap;
+	uint64_t		base_lba;
+	uint32_t		nblocks;
+	bool			logged;
+	bool			failed;
+
+	/** Write to acknowledge once this and all older records are logged */
+	struct wbc_task		*task;
+	void			*hdr;
+};
+
+/*
+ * Index from base LBA to the newest logged copy of that block.  Entries are
+ *  indexed by log block, so each data block of the log has exactly one and
+ *  no allocation is needed; hashed entries are chained through next.
+ */
+struct wbc_map_entry {
+	uint64_t	base_lba;
+	uint64_t	seq;
+	uint32_t	next;
+	bool		hashed;
+};
+
+struct wbc_destage_block {
+	uint64_t	base_lba;
+	void		*buf;
+};
+
+struct wbc_task {
+	struct spdk_bdev_io	*bdev_io;
+
+	/** On wbc_disk::waiting, or on a local completion list */
+	TAILQ_ENTRY(wbc_task)	link;
+
+	/** Ring index of the record written for this I/O */
+	uint64_t		record;
+	uint64_t		checksum;
+	bool			failed;
+
+	/** Reads: child I/Os outstanding, and whether any of them read the log */
+	int			outstanding;
+	bool			log_read;
+	uint32_t		gen;
+
+	struct spdk_bdev_iov_slices	iov_slices;
+
+	struct iovec		log_iovs[WBC_MAX_IOVS];
+};
+
+struct wbc_disk {
+	struct spdk_bdev	disk;	/* this must be the first element */
+	struct spdk_bdev	*base;
+	struct spdk_bdev	*log;
+	uint32_t		blocklen;
+	uint64_t		log_start;
+	uint64_t		log_end;
+	uint64_t		log_id;
+
+	/*
+	 * Protects everything below.  Writes and reads may be submitted and
+	 *  completed on any lcore; destage and recovery run on the master lcore.
+	 */
+	pthread_mutex_t		lock;
+	enum wbc_state		state;
+
+	/** Next log block to write, oldest live log block, and blocks in use */
+	uint64_t		head;
+	uint64_t		tail;
+	uint64_t		used;
+	uint64_t		next_seq;
+
+	/*
+	 * Record ring.  [rec_tail, rec_ack) are logged and acknowledged,
+	 *  [rec_ack, rec_head) are still being written or wait for an older one.
+	 */
+	struct wbc_record	*records;
+	uint64_t		max_records;
+	uint64_t		rec_tail;
+	uint64_t		rec_ack;
+	uint64_t		rec_head;
+
+	struct wbc_map_entry	*map;
+	uint32_t		*buckets;
+	uint64_t		bucket_mask;
+
+	void			*hdr_bufs;
+	void			*free_hdrs[WBC_MAX_INFLIGHT];
+	int			num_free_hdrs;
+
+	/** I/O waiting for recovery to finish or for log space */
+	TAILQ_HEAD(, wbc_task)	waiting;
+
+	/*
+	 * Reads from the log in flight, counted separately for the current and
+	 *  the previous generation.  Destaged log space is only reused once every
+	 *  read that could still see it, i.e. of the generation in which it was
+	 *  removed from the map, has finished.
+	 */
+	uint32_t		read_gen;
+	uint64_t		log_reads[2];
+
+	struct spdk_poller	*destage_poller;
+	enum wbc_destage_state	destage_state;
+	uint64_t		destage_first;
+	uint64_t		destage_end;
+	uint64_t		destage_tail;
+	uint64_t		destage_tail_seq;
+	uint32_t		destage_gen;
+	int			destage_outstanding;
+	bool			destage_failed;
+	bool			super_written;
+	uint64_t		last_destage_tsc;
+	void			*destage_buf;
+	struct wbc_destage_block	*destage_blocks;
+	struct iovec		*destage_iovs;
+
+	/** Recovery scan position, and blocks skipped if it wrapped */
+	uint64_t		scan_pos;
+	uint64_t		scan_gap;
+
+	void			*super_buf;
+
+	TAILQ_ENTRY(wbc_disk)	link;
+};
+
+#endif // SPDK_BLOCKDEV_WBCACHE_H
@@ -224,6 +224,7 @@ spdk_app_opts_init(struct spdk_app_opts *opts)
 	opts->dpdk_mem_channel = SPDK_APP_DPDK_DEFAULT_MEM_CHANNEL;
 	opts->reactor_mask = NULL;
 	opts->max_delay_us = 0;
+	opts->spsc_event_rings = false;
 }
 
 void
@@ -323,7 +324,7 @@ spdk_app_init(struct spdk_app_opts *opts)
 	 *  reactor_mask will be NULL which will enable all cores to run
 	 *  reactors.
 	 */
-	if (spdk_reactors_init(opts->reactor_mask, opts->max_delay_us)) {
+	if (spdk_reactors_init(opts->reactor_mask, opts->max_delay_us, opts->spsc_event_rings)) {
 		fprintf(stderr, "Invalid reactor mask.\n");
 		exit(EXIT_FAILURE);
 	}
@@ -61,9 +61,16 @@
 
 #define SPDK_REACTOR_SPIN_TIME_US	1
 
+/* Initial number of slots in each reactor's timer heap.  It grows on demand. */
+#define SPDK_TIMER_HEAP_INIT_SIZE	64
+
 struct spdk_poller {
 	TAILQ_ENTRY(spdk_poller)	tailq;
 	uint32_t			lcore;
+
+	/* Position of this poller in its reactor's timer heap. */
+	uint32_t			heap_index;
+
 	uint64_t			period_ticks;
 	uint64_t			next_run_tick;
 	spdk_poller_fn			fn;
@@ -83,23 +90,48 @@ struct spdk_reactor {
 	uint32_t					lcore;
 
 	/*
-	 * Contains pollers actively running on this reactor.  Pollers
-	 *  are run round-robin. The reactor takes one poller from the head
-	 *  of the ring, executes it, then puts it back at the tail of
-	 *  the ring.
+	 * Contains pollers actively running on this reactor.  Every
+	 *  poller on this list is run once per reactor loop iteration.
 	 */
 	TAILQ_HEAD(, spdk_poller)			active_pollers;
 
 	/**
-	 * Contains pollers running on this reactor with a periodic timer.
+	 * Contains pollers running on this reactor with a periodic timer,
+	 *  kept as a binary min-heap ordered by next_run_tick so that the
+	 *  next timer to expire is always timer_heap[0].
 	 */
-	TAILQ_HEAD(timer_pollers_head, spdk_poller)	timer_pollers;
+	struct spdk_poller				**timer_heap;
+	uint32_t					timer_count;
+	uint32_t					timer_heap_size;
 
 	struct rte_ring					*events;
 
+	/**
+	 * Optional single-producer/single-consumer event rings, one per
+	 *  source reactor, indexed by the source lcore.  Events posted from
+	 *  a reactor that has a ring here bypass the multi-producer events
+	 *  ring.  spsc_sources lists the lcores that have a ring so the
+	 *  consumer does not have to scan all RTE_MAX_LCORE slots.
+	 */
+	struct rte_ring					*spsc_events[RTE_MAX_LCORE];
+	uint32_t					spsc_sources[RTE_MAX_LCORE];
+	uint32_t					spsc_source_count;
+
 	uint64_t					max_delay_us;
 };
 
+/*
+ * Size of each reactor's multi-producer event ring and of each
+ *  per-(source, destination) single-producer one.  A source posting to
+ *  its own ring can queue as many events as it could on the shared one;
+ *  enqueueing onto a full ring is fatal, and falling back to the other
+ *  ring would reorder the events of that source.
+ */
+#define SPDK_EVENT_RING_SIZE		65536
+
+/* Maximum number of events dequeued and dispatched as one batch. */
+#define SPDK_EVENT_BATCH_SIZE		32
+
 static struct spdk_reactor g_reactors[RTE_MAX_LCORE];
 static uint64_t	g_reactor_mask  = 0;
 static int	g_reactor_count = 0;
@@ -144,77 +176,86 @@ spdk_event_allocate(uint32_t lcore, spdk_event_fn fn, void *arg1, void *arg2,
 	return event;
 }
 
-static void
-spdk_event_free(uint32_t lcore, struct spdk_event *event)
-{
-	uint8_t socket_id = rte_lcore_to_socket_id(lcore);
-	RTE_VERIFY(socket_id < SPDK_MAX_SOCKET);
-
-	rte_mempool_put(g_spdk_event_mempool[socket_id], (void *)event);
-}
-
 void
 spdk_event_call(spdk_event_t event)
 {
 	int rc;
 	struct spdk_reactor *reactor;
+	unsigned src_lcore;
 
 	reactor = spdk_reactor_get(event->lcore);
 
-	RTE_VERIFY(reactor->events != NULL);
-	rc = rte_ring_enqueue(reactor->events, event);
+	src_lcore = rte_lcore_id();
+	if (src_lcore < RTE_MAX_LCORE && reactor->spsc_events[src_lcore] != NULL) {
+		rc = rte_ring_sp_enqueue(reactor->spsc_events[src_lcore], event);
+	} else {
+		RTE_VERIFY(reactor->events != NULL);
+		rc = rte_ring_enqueue(reactor->events, event);
+	}
 	RTE_VERIFY(rc == 0);
 }
 
+/*
+ * Run at most the number of events that were queued on the ring when this
+ *  function was called, dequeuing and dispatching them in batches.  Events
+ *  queued by the callbacks themselves are left for the next pass so that
+ *  an event which reposts itself cannot starve the reactor.
+ */
 static uint32_t
-spdk_event_queue_count(uint32_t lcore)
+spdk_event_queue_run_ring(uint32_t lcore, struct rte_ring *ring)
 {
-	struct spdk_reactor *reactor;
-
-	reactor = spdk_reactor_get(lcore);
+	void *events[SPDK_EVENT_BATCH_SIZE];
+	struct spdk_event *event;
+	uint32_t count, total, n, i;
+	uint8_t socket_id;
 
-	if (reactor->events == NULL) {
+	count = rte_ring_count(ring);
+	if (count == 0) {
 		return 0;
 	}
 
-	return rte_ring_count(reactor->events);
-}
-
-static void
-spdk_event_queue_run_single(uint32_t lcore)
-{
-	struct spdk_event *event = NULL;
-	struct spdk_reactor *reactor;
-	int rc;
+	/* Every event run here was allocated for this lcore, so it came from this socket's pool. */
+	socket_id = rte_lcore_to_socket_id(lcore);
+	RTE_VERIFY(socket_id < SPDK_MAX_SOCKET);
 
-	reactor = spdk_reactor_get(lcore);
+	total = 0;
+	while (count > 0) {
+		n = rte_ring_sc_dequeue_burst(ring, events,
+					      count < SPDK_EVENT_BATCH_SIZE ? count : SPDK_EVENT_BATCH_SIZE);
+		if (n == 0) {
+			break;
+		}
 
-	RTE_VERIFY(reactor->events != NULL);
-	rc = rte_ring_dequeue(reactor->events, (void **)&event);
+		for (i = 0; i < n; i++) {
+			event = events[i];
+			event->fn(event);
+		}
 
-	if ((rc != 0) || event == NULL) {
-		return;
+		rte_mempool_put_bulk(g_spdk_event_mempool[socket_id], events, n);
+		count -= n;
+		total += n;
 	}
 
-	event->fn(event);
-	spdk_event_free(lcore, event);
-}
-
-static void
-spdk_event_queue_run(uint32_t lcore, uint32_t count)
-{
-	while (count--) {
-		spdk_event_queue_run_single(lcore);
-	}
+	return total;
 }
 
 uint32_t
 spdk_event_queue_run_all(uint32_t lcore)
 {
-	uint32_t count;
+	struct spdk_reactor *reactor;
+	uint32_t count, i;
 
-	count = spdk_event_queue_count(lcore);
-	spdk_event_queue_run(lcore, count);
+	reactor = spdk_reactor_get(lcore);
+
+	if (reactor->events == NULL) {
+		return 0;
+	}
+
+	count = spdk_event_queue_run_ring(lcore, reactor->events);
+	for (i = 0; i < reactor->spsc_source_count; i++) {
+		count += spdk_event_queue_run_ring(lcore,
+						   reactor->spsc_events[reactor->spsc_sources[i]]);
+	}
 
 	return count;
 }
@@ -242,28 +283,127 @@ static void set_reactor_thread_name(void)
 #endif
 }
 
+static void
+spdk_timer_heap_set(struct spdk_reactor *reactor, uint32_t index, struct spdk_poller *poller)
+{
+	reactor->timer_heap[index] = poller;
+	poller->heap_index = index;
+}
+
+static void
+spdk_timer_heap_sift_up(struct spdk_reactor *reactor, uint32_t index)
+{
+	struct spdk_poller *poller = reactor->timer_heap[index];
+	struct spdk_poller *parent;
+
+	while (index > 0) {
+		parent = reactor->timer_heap[(index - 1) / 2];
+		if (parent->next_run_tick <= poller->next_run_tick) {
+			break;
+		}
+		spdk_timer_heap_set(reactor, index, parent);
+		index = (index - 1) / 2;
+	}
+
+	spdk_timer_heap_set(reactor, index, poller);
+}
+
+static void
+spdk_timer_heap_sift_down(struct spdk_reactor *reactor, uint32_t index)
+{
+	struct spdk_poller *poller = reactor->timer_heap[index];
+	struct spdk_poller *child;
+	uint32_t child_index;
+
+	while ((child_index = 2 * index + 1) < reactor->timer_count) {
+		child = reactor->timer_heap[child_index];
+		if (child_index + 1 < reactor->timer_count &&
+		    reactor->timer_heap[child_index + 1]->next_run_tick < child->next_run_tick) {
+			child_index++;
+			child = reactor->timer_heap[child_index];
+		}
+
+		if (poller->next_run_tick <= child->next_run_tick) {
+			break;
+		}
+		spdk_timer_heap_set(reactor, index, child);
+		index = child_index;
+	}
+
+	spdk_timer_heap_set(reactor, index, poller);
+}
+
 static void
 spdk_poller_insert_timer(struct spdk_reactor *reactor, struct spdk_poller *poller, uint64_t now)
 {
-	struct spdk_poller *iter;
-	uint64_t next_run_tick;
+	struct spdk_poller **heap;
+	uint32_t size;
+
+	poller->next_run_tick = now + poller->period_ticks;
+
+	if (reactor->timer_count == reactor->timer_heap_size) {
+		size = reactor->timer_heap_size ? reactor->timer_heap_size * 2 : SPDK_TIMER_HEAP_INIT_SIZE;
+		heap = realloc(reactor->timer_heap, size * sizeof(*heap));
+		if (heap == NULL) {
+			SPDK_ERRLOG("Timer heap memory allocation failed\n");
+			abort();
+		}
+		reactor->timer_heap = heap;
+		reactor->timer_heap_size = size;
+	}
+
+	reactor->timer_heap[reactor->timer_count] = poller;
+	reactor->timer_count++;
+	spdk_timer_heap_sift_up(reactor, reactor->timer_count - 1);
+}
+
+static void
+spdk_poller_remove_timer(struct spdk_reactor *reactor, struct spdk_poller *poller)
+{
+	uint32_t index = poller->heap_index;
+	struct spdk_poller *last;
+
+	RTE_VERIFY(index < reactor->timer_count && reactor->timer_heap[index] == poller);
+
+	reactor->timer_count--;
+	if (index == reactor->timer_count) {
+		return;
+	}
+
+	/* Move the last element into the hole and restore the heap property. */
+	last = reactor->timer_heap[reactor->timer_count];
+	spdk_timer_heap_set(reactor, index, last);
+	if (index > 0 && reactor->timer_heap[(index - 1) / 2]->next_run_tick > last->next_run_tick) {
+		spdk_timer_heap_sift_up(reactor, index);
+	} else {
+		spdk_timer_heap_sift_down(reactor, index);
+	}
+}
 
-	next_run_tick = now + poller->period_ticks;
-	poller->next_run_tick = next_run_tick;
+static void
+spdk_reactor_run_timers(struct spdk_reactor *reactor, uint64_t now)
+{
+	struct spdk_poller *poller;
 
 	/*
-	 * Insert poller in the reactor's timer_pollers list in sorted order by next scheduled
-	 * run time.
+	 * Run every timer that has expired as of now.  Each poller is rescheduled
+	 *  relative to the same now, so a poller is run at most once per call.
 	 */
-	TAILQ_FOREACH_REVERSE(iter, &reactor->timer_pollers, timer_pollers_head, tailq) {
-		if (iter->next_run_tick <= next_run_tick) {
-			TAILQ_INSERT_AFTER(&reactor->timer_pollers, iter, poller, tailq);
-			return;
+	while (reactor->timer_count > 0) {
+		poller = reactor->timer_heap[0];
+		if (now < poller->next_run_tick) {
+			break;
 		}
-	}
 
-	/* No earlier pollers were found, so this poller must be the new head */
-	TAILQ_INSERT_HEAD(&reactor->timer_pollers, poller, tailq);
+		poller->fn(poller->arg);
+
+		/*
+		 * Pollers are only added or removed via events, so the poller is
+		 *  still at the root of the heap here.
+		 */
+		poller->next_run_tick = now + poller->period_ticks;
+		spdk_timer_heap_sift_down(reactor, poller->heap_index);
+	}
 }
 
 /**
@@ -273,19 +413,14 @@ spdk_poller_insert_timer(struct spdk_reactor *reactor, struct spdk_poller *polle
 \code
 
 while (1)
-	if (new work items to be scheduled)
-		dequeue work item from new work item ring
-		enqueue work item to active work item ring
-	else if (active work item count > 0)
-		dequeue work item from active work item ring
-		invoke work item function pointer
-		if (work item state == RUNNING)
-			enqueue work item to active work item ring
-	else if (application state != RUNNING)
+	run all events queued to this reactor
+	run each active poller once
+	run every timer poller whose next run time has passed
+	if (no work was done for a while)
+		sleep until the next timer is due, at most max_delay_us
+	if (application state != RUNNING)
 		# exit the reactor loop
 		break
-	else
-		sleep for 100ms
 
 \endcode
 
@@ -320,23 +455,15 @@ _spdk_reactor_run(void *arg)
 
 		rte_timer_manage();
 
-		poller = TAILQ_FIRST(&reactor->active_pollers);
-		if (poller) {
-			TAILQ_REMOVE(&reactor->active_pollers, poller, tailq);
-			poller->fn(poller->arg);
-			TAILQ_INSERT_TAIL(&reactor->active_pollers, poller, tailq);
+		if (!TAILQ_EMPTY(&reactor->active_pollers)) {
+			TAILQ_FOREACH(poller, &reactor->active_pollers, tailq) {
+				poller->fn(poller->arg);
+			}
 			last_action = rte_get_timer_cycles();
 		}
 
-		poller = TAILQ_FIRST(&reactor->timer_pollers);
-		if (poller) {
-			now = rte_get_timer_cycles();
-
-			if (now >= poller->next_run_tick) {
-				TAILQ_REMOVE(&reactor->timer_pollers, poller, tailq);
-				poller->fn(poller->arg);
-				spdk_poller_insert_timer(reactor, poller, now);
-			}
+		if (reactor->timer_count > 0) {
+			spdk_reactor_run_timers(reactor, rte_get_timer_cycles());
 		}
 
 		/* Determine if the thread can sleep */
@@ -345,8 +472,8 @@ _spdk_reactor_run(void *arg)
 			if (now >= (last_action + spin_cycles)) {
 				sleep_us = reactor->max_delay_us;
 
-				poller = TAILQ_FIRST(&reactor->timer_pollers);
-				if (poller) {
+				if (reactor->timer_count > 0) {
+					poller = reactor->timer_heap[0];
 					/* There are timers registered, so don't sleep beyond
 					 * when the next timer should fire */
 					if (poller->next_run_tick < (now + sleep_cycles)) {
@@ -381,11 +508,16 @@ spdk_reactor_construct(struct spdk_reactor *reactor, uint32_t lcore, uint64_t ma
 	reactor->max_delay_us = max_delay_us;
 
 	TAILQ_INIT(&reactor->active_pollers);
-	TAILQ_INIT(&reactor->timer_pollers);
+	reactor->timer_heap = NULL;
+	reactor->timer_count = 0;
+	reactor->timer_heap_size = 0;
+	memset(reactor->spsc_events, 0, sizeof(reactor->spsc_events));
+	reactor->spsc_source_count = 0;
 
 	snprintf(ring_name, sizeof(ring_name) - 1, "spdk_event_queue_%u", lcore);
 	reactor->events =
-		rte_ring_create(ring_name, 65536, rte_lcore_to_socket_id(lcore), RING_F_SC_DEQ);
+		rte_ring_create(ring_name, SPDK_EVENT_RING_SIZE, rte_lcore_to_socket_id(lcore),
+				RING_F_SC_DEQ);
 	RTE_VERIFY(reactor->events != NULL);
 }
 
@@ -536,8 +668,36 @@ void spdk_reactors_stop(void)
 	g_reactor_state = SPDK_REACTOR_STATE_EXITING;
 }
 
+static void
+spdk_reactor_construct_spsc_rings(struct spdk_reactor *reactor)
+{
+	char		ring_name[64];
+	struct rte_ring	*ring;
+	uint32_t	src;
+
+	RTE_LCORE_FOREACH(src) {
+		if (!((1ULL << src) & spdk_app_get_core_mask())) {
+			continue;
+		}
+
+		snprintf(ring_name, sizeof(ring_name), "spdk_event_%u_%u", src, reactor->lcore);
+		ring = rte_ring_create(ring_name, SPDK_EVENT_RING_SIZE,
+				       rte_lcore_to_socket_id(reactor->lcore),
+				       RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (ring == NULL) {
+			/* Events from this source keep using the multi-producer ring. */
+			SPDK_ERRLOG("could not create event ring from lcore %u to lcore %u\n",
+				    src, reactor->lcore);
+			continue;
+		}
+
+		reactor->spsc_events[src] = ring;
+		reactor->spsc_sources[reactor->spsc_source_count++] = src;
+	}
+}
+
 int
-spdk_reactors_init(const char *mask, unsigned int max_delay_us)
+spdk_reactors_init(const char *mask, unsigned int max_delay_us, bool spsc_event_rings)
 {
 	uint32_t i;
 	int rc;
@@ -561,6 +721,14 @@ spdk_reactors_init(const char *mask, unsigned int max_delay_us)
 		}
 	}
 
+	if (spsc_event_rings) {
+		RTE_LCORE_FOREACH(i) {
+			if (((1ULL << i) & spdk_app_get_core_mask())) {
+				spdk_reactor_construct_spsc_rings(spdk_reactor_get(i));
+			}
+		}
+	}
+
 	socket_mask = spdk_reactor_get_socket_mask();
 	printf("Occupied cpu socket mask is 0x%lx\n", socket_mask);
 
@@ -678,7 +846,7 @@ _spdk_event_remove_poller(spdk_event_t event)
 	struct spdk_event *next = spdk_event_get_next(event);
 
 	if (poller->period_ticks) {
-		TAILQ_REMOVE(&reactor->timer_pollers, poller, tailq);
+		spdk_poller_remove_timer(reactor, poller);
 	} else {
 		TAILQ_REMOVE(&reactor->active_pollers, poller, tailq);
 	}
@@ -67,10 +67,51 @@
 static int64_t g_conn_idle_interval_in_tsc = -1;
 
 #define DEFAULT_CONNECTIONS_PER_LCORE	4
+
+/*
+ * Enough iovecs for a whole Data-In sequence of a large read to go out in
+ *  one writev: up to four per PDU, with digests.
+ */
+#define ISCSI_FLUSH_IOVEC_COUNT	512
 #define SPDK_MAX_POLLERS_PER_CORE	4096
 static int g_connections_per_lcore = DEFAULT_CONNECTIONS_PER_LCORE;
 static rte_atomic32_t g_num_connections[RTE_MAX_LCORE];
 
+/*
+ * Cycles each lcore spent running connections that had work to do, and the
+ *  share of its time that made up over the last sample period.  Only the
+ *  lcore itself adds to busy_tsc; the master lcore takes the samples.
+ */
+struct spdk_iscsi_lcore_load {
+	uint64_t	busy_tsc;
+	uint64_t	last_busy_tsc;
+	uint64_t	last_sample_tsc;
+	uint32_t	busy_pct;
+} __attribute__((aligned(64)));
+
+#define ISCSI_LOAD_SAMPLE_PERIOD_US	100000
+
+/* An lcore this busy, in percent of its time, takes no more connections. */
+#define ISCSI_LCORE_BUSY_PCT		90
+
+/* Loads that differ by less than this, in percent, count as the same. */
+#define ISCSI_LCORE_LOAD_STEP_PCT	10
+
+static struct spdk_iscsi_lcore_load g_lcore_load[RTE_MAX_LCORE];
+static struct spdk_poller *g_load_poller;
+
+/*
+ * The balancer moves a connection from the busiest lcore to a less busy one
+ *  when their loads differ by at least ISCSI_BALANCE_GAP_PCT.  A connection
+ *  that has not drained its tasks within ISCSI_MIGRATE_TIMEOUT_US stays put.
+ */
+#define DEFAULT_REBALANCE_INTERVAL_US	1000000
+#define ISCSI_BALANCE_GAP_PCT		20
+#define ISCSI_MIGRATE_TIMEOUT_US	10000
+
+static int g_rebalance_interval_in_us = DEFAULT_REBALANCE_INTERVAL_US;
+static struct spdk_poller *g_balance_poller;
+
 struct spdk_iscsi_conn *g_conns_array;
 static char g_shm_name[64];
 
@@ -78,7 +119,8 @@ static pthread_mutex_t g_conns_mutex;
 
 static struct rte_timer g_shutdown_timer;
 
-static uint32_t spdk_iscsi_conn_allocate_reactor(uint64_t cpumask);
+static uint32_t spdk_iscsi_conn_allocate_reactor(uint64_t cpumask,
+		struct spdk_iscsi_conn *conn);
 static void __add_idle_conn(spdk_event_t event);
 
 /** Global variables used for managing idle connections. */
@@ -89,12 +131,19 @@ static STAILQ_HEAD(idle_list, spdk_iscsi_conn) g_idle_conn_list_head;
 void spdk_iscsi_conn_login_do_work(void *arg);
 void spdk_iscsi_conn_full_feature_do_work(void *arg);
 void spdk_iscsi_conn_idle_do_work(void *arg);
+static void spdk_iscsi_conn_sample_load(void *arg);
+static void spdk_iscsi_conn_balance(void *arg);
 
 void spdk_iscsi_set_min_conn_idle_interval(int interval_in_us)
 {
 	g_conn_idle_interval_in_tsc = MICROSECOND_TO_TSC(interval_in_us);
 }
 
+void spdk_iscsi_conn_set_rebalance_interval(int interval_in_us)
+{
+	g_rebalance_interval_in_us = interval_in_us;
+}
+
 static struct spdk_iscsi_conn *
 allocate_conn(void)
 {
@@ -268,6 +317,7 @@ int spdk_initialize_iscsi_conns(void)
 	for (i = 0; i < RTE_MAX_LCORE; i++) {
 		rte_atomic32_set(&g_num_connections[i], 0);
 	}
+	memset(g_lcore_load, 0, sizeof(g_lcore_load));
 
 	if (g_conn_idle_interval_in_tsc == -1)
 		spdk_iscsi_set_min_conn_idle_interval(spdk_net_framework_idle_time());
@@ -279,6 +329,12 @@ int spdk_initialize_iscsi_conns(void)
 
 	spdk_poller_register(&g_idle_conn_poller, spdk_iscsi_conn_idle_do_work, NULL,
 			     rte_get_master_lcore(), NULL, 0);
+	spdk_poller_register(&g_load_poller, spdk_iscsi_conn_sample_load, NULL,
+			     rte_get_master_lcore(), NULL, ISCSI_LOAD_SAMPLE_PERIOD_US);
+	if (g_rebalance_interval_in_us > 0) {
+		spdk_poller_register(&g_balance_poller, spdk_iscsi_conn_balance, NULL,
+				     rte_get_master_lcore(), NULL, g_rebalance_interval_in_us);
+	}
 
 	return 0;
 }
@@ -346,6 +402,13 @@ spdk_iscsi_conn_construct(struct spdk_iscsi_portal *portal,
 	TAILQ_INIT(&conn->active_r2t_tasks);
 	TAILQ_INIT(&conn->queued_datain_tasks);
 
+	conn->recv_buf = malloc(ISCSI_RECV_BUF_SIZE);
+	conn->flush_iovs = calloc(ISCSI_FLUSH_IOVEC_COUNT, sizeof(struct iovec));
+	if (conn->recv_buf == NULL || conn->flush_iovs == NULL) {
+		SPDK_ERRLOG("Could not allocate connection buffers.\n");
+		goto error_return;
+	}
+
 	rc = spdk_sock_getaddr(sock, conn->target_addr,
 			       sizeof conn->target_addr,
 			       conn->initiator_addr, sizeof conn->initiator_addr);
@@ -354,6 +417,8 @@ spdk_iscsi_conn_construct(struct spdk_iscsi_portal *portal,
 		goto error_return;
 	}
 
+	conn->numa_node = spdk_sock_get_numa_node(sock);
+
 	bufsize = 2 * 1024 * 1024;
 	rc = spdk_sock_set_recvbuf(conn->sock, bufsize);
 	if (rc != 0)
@@ -380,8 +445,13 @@ spdk_iscsi_conn_construct(struct spdk_iscsi_portal *portal,
 		SPDK_ERRLOG("iscsi_conn_params_init() failed\n");
 error_return:
 		spdk_iscsi_param_free(conn->params);
-		if (conn)
+		if (conn) {
+			free(conn->recv_buf);
+			conn->recv_buf = NULL;
+			free(conn->flush_iovs);
+			conn->flush_iovs = NULL;
 			free_conn(conn);
+		}
 		return -1;
 	}
 	conn->is_idle = 0;
@@ -456,6 +526,10 @@ static void spdk_iscsi_conn_free(struct spdk_iscsi_conn *conn)
 	 */
 	spdk_put_pdu(conn->pdu_in_progress);
 
+	free(conn->recv_buf);
+	conn->recv_buf = NULL;
+	free(conn->flush_iovs);
+	conn->flush_iovs = NULL;
 	free(conn->auth.user);
 	free(conn->auth.secret);
 	free(conn->auth.muser);
@@ -730,6 +804,11 @@ spdk_iscsi_drop_conns(struct spdk_iscsi_conn *conn, const char *conn_match,
  The TCP socket is marked as non-blocking, so this function may not read
  all data requested.
 
+ Data is served from the connection's receive buffer first.  Once that is
+ empty, a request of at least ISCSI_RECV_BUF_SIZE bytes is received in
+ place; a smaller one refills the buffer with as much as the socket holds,
+ so that the PDUs behind it need no further system calls.
+
  Returns SPDK_ISCSI_CONNECTION_FATAL if the recv() operation indicates a fatal
  error with the TCP connection (including if the TCP connection was closed
  unexpectedly.
@@ -742,13 +821,34 @@ int
 spdk_iscsi_conn_read_data(struct spdk_iscsi_conn *conn, int bytes,
 			  void *buf)
 {
+	uint8_t *dst = buf;
+	int avail, copied = 0;
 	int ret;
 
 	if (bytes == 0) {
 		return 0;
 	}
 
-	ret = spdk_sock_recv(conn->sock, buf, bytes);
+	avail = conn->recv_buf_len - conn->recv_buf_offset;
+	if (avail > 0) {
+		copied = bytes < avail ? bytes : avail;
+		memcpy(dst, &conn->recv_buf[conn->recv_buf_offset], copied);
+		conn->recv_buf_offset += copied;
+		if (copied == bytes) {
+			return copied;
+		}
+		dst += copied;
+		bytes -= copied;
+	}
+
+	conn->recv_buf_offset = 0;
+	conn->recv_buf_len = 0;
+
+	if (bytes >= ISCSI_RECV_BUF_SIZE) {
+		ret = spdk_sock_recv(conn->sock, dst, bytes);
+	} else {
+		ret = spdk_sock_recv(conn->sock, conn->recv_buf, ISCSI_RECV_BUF_SIZE);
+	}
 
 	if (ret > 0) {
 		spdk_trace_record(TRACE_READ_FROM_SOCKET_DONE, conn->id, ret, 0, 0);
@@ -756,7 +856,7 @@ spdk_iscsi_conn_read_data(struct spdk_iscsi_conn *conn, int bytes,
 
 	if (ret < 0) {
 		if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			return 0;
+			return copied;
 		} else
 			SPDK_ERRLOG("Socket read error(%d): %s\n", errno, strerror(errno));
 		return SPDK_ISCSI_CONNECTION_FATAL;
@@ -767,7 +867,15 @@ spdk_iscsi_conn_read_data(struct spdk_iscsi_conn *conn, int bytes,
 		return SPDK_ISCSI_CONNECTION_FATAL;
 	}
 
-	return ret;
+	if (bytes >= ISCSI_RECV_BUF_SIZE) {
+		return copied + ret;
+	}
+
+	conn->recv_buf_len = ret;
+	conn->recv_buf_offset = bytes < ret ? bytes : ret;
+	memcpy(dst, conn->recv_buf, conn->recv_buf_offset);
+
+	return copied + conn->recv_buf_offset;
 }
 
 void
@@ -944,8 +1052,8 @@ spdk_iscsi_conn_handle_nop(struct spdk_iscsi_conn *conn)
 static int
 spdk_iscsi_conn_flush_pdus_internal(struct spdk_iscsi_conn *conn)
 {
-	const int array_size = 32;
-	struct iovec	iovec_array[array_size];
+	const int array_size = ISCSI_FLUSH_IOVEC_COUNT;
+	struct iovec	*iovec_array = conn->flush_iovs;
 	struct iovec	*iov = iovec_array;
 	int iovec_cnt = 0;
 	int bytes = 0;
@@ -1035,6 +1143,17 @@ spdk_iscsi_conn_flush_pdus_internal(struct spdk_iscsi_conn *conn)
 			} else {
 				if (pdu->task) {
 					if (pdu->bhs.opcode == ISCSI_OP_SCSI_DATAIN) {
+						/*
+						 * The read buffer is only needed until its last
+						 *  Data-In PDU is on the wire - hand it back to
+						 *  the bdev layer now rather than when the whole
+						 *  command (which may span several buffers)
+						 *  completes.
+						 */
+						if (--pdu->task->outstanding_datain == 0) {
+							spdk_scsi_task_free_data(&pdu->task->scsi);
+						}
+
 						if (pdu->task->scsi.offset > 0) {
 							conn->data_in_cnt--;
 							if (pdu->bhs.flags & ISCSI_DATAIN_STATUS) {
@@ -1043,6 +1162,14 @@ spdk_iscsi_conn_flush_pdus_internal(struct spdk_iscsi_conn *conn)
 						}
 
 						spdk_iscsi_conn_handle_queued_datain(conn);
+					} else if (pdu->bhs.opcode == ISCSI_OP_SCSI_RSP &&
+						   pdu->task->scsi.offset > 0) {
+						/*
+						 * The status of a split read that could not go in
+						 *  its last Data-In: drop the primary's reference
+						 *  here instead.
+						 */
+						spdk_iscsi_task_put(spdk_iscsi_task_get_primary(pdu->task));
 					}
 
 					spdk_iscsi_task_put(pdu->task);
@@ -1131,6 +1258,7 @@ spdk_iscsi_conn_handle_incoming_pdus(struct spdk_iscsi_conn *conn)
 			return SPDK_ISCSI_CONNECTION_FATAL;
 		}
 
+		conn->pdu_count++;
 		rc = spdk_iscsi_execute(conn, pdu);
 		spdk_put_pdu(pdu);
 		if (rc != 0) {
@@ -1149,9 +1277,14 @@ static void spdk_iscsi_conn_handle_idle(struct spdk_iscsi_conn *conn)
 	uint64_t current_tsc = rte_get_timer_cycles();
 	spdk_event_t event;
 
+	/*
+	 * Bytes left in the receive buffer would not wake the connection up
+	 *  again, so it only goes idle once it has parsed all of them.
+	 */
 	if (g_conn_idle_interval_in_tsc > 0 &&
 	    ((int64_t)(current_tsc - conn->last_activity_tsc)) >= g_conn_idle_interval_in_tsc &&
-	    conn->pending_task_cnt == 0) {
+	    conn->pending_task_cnt == 0 &&
+	    conn->recv_buf_offset == conn->recv_buf_len) {
 
 		spdk_trace_record(TRACE_ISCSI_CONN_IDLE, conn->id, 0, 0, 0);
 		rte_atomic32_dec(&g_num_connections[spdk_app_get_current_core()]);
@@ -1176,8 +1309,8 @@ spdk_iscsi_conn_execute(struct spdk_iscsi_conn *conn)
 		goto conn_exit;
 	}
 
-	/* Handle incoming PDUs */
-	rc = spdk_iscsi_conn_handle_incoming_pdus(conn);
+	/* Handle incoming PDUs, unless the connection is draining to move */
+	rc = conn->migrating ? 0 : spdk_iscsi_conn_handle_incoming_pdus(conn);
 	if (rc < 0) {
 		conn->state = ISCSI_CONN_STATE_EXITING;
 		spdk_iscsi_conn_flush_pdus(conn);
@@ -1220,6 +1353,63 @@ spdk_iscsi_conn_full_feature_migrate(struct spdk_event *event)
 			     conn->lcore, NULL, 0);
 }
 
+/*
+ * Move a draining connection to its new lcore once its last task is done,
+ *  or give up and resume reading if that takes too long.
+ */
+static void
+spdk_iscsi_conn_migrate(struct spdk_iscsi_conn *conn)
+{
+	struct spdk_event *event;
+	uint32_t lcore = conn->migrate_lcore;
+
+	if (conn->pending_task_cnt > 0) {
+		if (rte_get_timer_cycles() > conn->migrate_deadline_tsc) {
+			SPDK_TRACELOG(SPDK_TRACE_DEBUG, "conn %d did not drain, stays on lcore %u\n",
+				      conn->id, conn->lcore);
+			conn->migrating = false;
+		}
+		return;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "moving conn %d from lcore %u to lcore %u\n",
+		      conn->id, conn->lcore, lcore);
+	conn->migrating = false;
+	event = spdk_event_allocate(lcore, spdk_iscsi_conn_full_feature_migrate, conn, NULL, NULL);
+	rte_atomic32_dec(&g_num_connections[spdk_app_get_current_core()]);
+	rte_atomic32_inc(&g_num_connections[lcore]);
+	spdk_net_framework_clear_socket_association(conn->sock);
+	spdk_poller_unregister(&conn->poller, event);
+}
+
+/*
+ * Runs on the lcore of the connection the balancer picked.  The connection
+ *  may have gone idle, started to log out or moved since; it is only moved
+ *  if it is still running here and has no write waiting for Data-Out, which
+ *  it could not receive while it drains.
+ */
+static void
+spdk_iscsi_conn_start_migrate(spdk_event_t event)
+{
+	struct spdk_iscsi_conn *conn = spdk_event_get_arg1(event);
+	uint32_t lcore = (uint32_t)(uintptr_t)spdk_event_get_arg2(event);
+
+	if (!conn->is_valid || conn->is_idle || conn->poller == NULL ||
+	    conn->lcore != spdk_app_get_current_core() ||
+	    conn->state != ISCSI_CONN_STATE_RUNNING ||
+	    conn->login_phase != ISCSI_FULL_FEATURE_PHASE ||
+	    conn->migrating ||
+	    !TAILQ_EMPTY(&conn->queued_r2t_tasks) ||
+	    !TAILQ_EMPTY(&conn->active_r2t_tasks)) {
+		return;
+	}
+
+	conn->migrate_lcore = lcore;
+	conn->migrate_deadline_tsc = rte_get_timer_cycles() +
+				     MICROSECOND_TO_TSC(ISCSI_MIGRATE_TIMEOUT_US);
+	conn->migrating = true;
+}
+
 void
 spdk_iscsi_conn_login_do_work(void *arg)
 {
@@ -1237,7 +1427,7 @@ spdk_iscsi_conn_login_do_work(void *arg)
 	 * did, migrate it to a dedicated reactor for the target node.
 	 */
 	if (conn->login_phase == ISCSI_FULL_FEATURE_PHASE) {
-		lcore = spdk_iscsi_conn_allocate_reactor(conn->portal->cpumask);
+		lcore = spdk_iscsi_conn_allocate_reactor(conn->portal->cpumask, conn);
 		event = spdk_event_allocate(lcore, spdk_iscsi_conn_full_feature_migrate, conn, NULL, NULL);
 		rte_atomic32_dec(&g_num_connections[spdk_app_get_current_core()]);
 		rte_atomic32_inc(&g_num_connections[lcore]);
@@ -1250,13 +1440,22 @@ void
 spdk_iscsi_conn_full_feature_do_work(void *arg)
 {
 	struct spdk_iscsi_conn	*conn = arg;
+	struct spdk_iscsi_lcore_load	*load = &g_lcore_load[conn->lcore];
+	uint64_t			tsc;
 	int				rc = 0;
 
+	tsc = rte_get_timer_cycles();
 	rc = spdk_iscsi_conn_execute(conn);
 	if (rc < 0) {
 		return;
 	} else if (rc > 0) {
 		conn->last_activity_tsc = rte_get_timer_cycles();
+		load->busy_tsc += conn->last_activity_tsc - tsc;
+	}
+
+	if (conn->migrating) {
+		spdk_iscsi_conn_migrate(conn);
+		return;
 	}
 
 	/* Check if the session was idle during this access pass. If it was,
@@ -1314,7 +1513,7 @@ void spdk_iscsi_conn_idle_do_work(void *arg)
 			tconn->is_idle = 0;
 			del_idle_conn(tconn);
 			/* migrate work item to new core */
-			lcore = spdk_iscsi_conn_allocate_reactor(tconn->portal->cpumask);
+			lcore = spdk_iscsi_conn_allocate_reactor(tconn->portal->cpumask, tconn);
 			rte_atomic32_inc(&g_num_connections[lcore]);
 			spdk_net_framework_clear_socket_association(tconn->sock);
 			tconn->lcore = lcore;
@@ -1361,71 +1560,289 @@ spdk_iscsi_conn_set_min_per_core(int count)
 	g_connections_per_lcore = count;
 }
 
+static void
+spdk_iscsi_conn_sample_load(void *arg)
+{
+	struct spdk_iscsi_lcore_load *load;
+	uint64_t now, busy;
+	unsigned lcore;
+
+	now = rte_get_timer_cycles();
+	RTE_LCORE_FOREACH(lcore) {
+		load = &g_lcore_load[lcore];
+		busy = load->busy_tsc;
+		if (load->last_sample_tsc != 0 && now > load->last_sample_tsc) {
+			load->busy_pct = (busy - load->last_busy_tsc) * 100 /
+					 (now - load->last_sample_tsc);
+			if (load->busy_pct > 100) {
+				load->busy_pct = 100;
+			}
+		}
+		load->last_busy_tsc = busy;
+		load->last_sample_tsc = now;
+	}
+}
+
+/* Whether lcore already has a channel to the blockdev of one of the connection's LUNs */
+static bool
+spdk_iscsi_conn_lcore_has_channel(struct spdk_iscsi_conn *conn, uint32_t lcore)
+{
+	struct spdk_scsi_dev *dev = conn->dev;
+	struct spdk_bdev *bdev;
+	int i;
+
+	if (dev == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < dev->maxlun; i++) {
+		if (dev->lun[i] == NULL) {
+			continue;
+		}
+		bdev = dev->lun[i]->bdev;
+		if (bdev != NULL && bdev->channels != NULL && bdev->channels[lcore] != NULL) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * How well an lcore suits a connection.  Candidates are compared field by
+ *  field, lower first: a core with room comes before one that has its quota
+ *  of connections or is saturated, then one on the NIC's NUMA node, then one
+ *  that already runs connections, then one with a channel to the LUNs'
+ *  blockdevs, then the least busy, and last the one with fewest connections.
+ */
+struct spdk_iscsi_placement {
+	uint32_t	lcore;
+	int		full;
+	int		remote;
+	int		empty;
+	int		no_channel;
+	uint32_t	load_step;
+	int32_t		num_conns;
+};
+
+static bool
+spdk_iscsi_placement_better(const struct spdk_iscsi_placement *a,
+			    const struct spdk_iscsi_placement *b)
+{
+	if (a->full != b->full) {
+		return a->full < b->full;
+	}
+	if (a->remote != b->remote) {
+		return a->remote < b->remote;
+	}
+	if (a->empty != b->empty) {
+		return a->empty < b->empty;
+	}
+	if (a->no_channel != b->no_channel) {
+		return a->no_channel < b->no_channel;
+	}
+	if (a->load_step != b->load_step) {
+		return a->load_step < b->load_step;
+	}
+	return a->num_conns < b->num_conns;
+}
+
+static enum rte_lcore_state_t
+spdk_iscsi_lcore_state(uint32_t lcore)
+{
+	/*
+	 * DPDK returns WAIT for the master lcore instead of RUNNING.
+	 * So we always treat the reactor on master core as RUNNING.
+	 */
+	if (lcore == rte_get_master_lcore()) {
+		return RUNNING;
+	}
+	return rte_eal_get_lcore_state(lcore);
+}
+
+/* Whether a running lcore should take no more connections. */
+static bool
+spdk_iscsi_lcore_full(uint32_t lcore)
+{
+	return rte_atomic32_read(&g_num_connections[lcore]) >= g_connections_per_lcore ||
+	       g_lcore_load[lcore].busy_pct >= ISCSI_LCORE_BUSY_PCT;
+}
+
 static uint32_t
-spdk_iscsi_conn_allocate_reactor(uint64_t cpumask)
+spdk_iscsi_conn_allocate_reactor(uint64_t cpumask, struct spdk_iscsi_conn *conn)
 {
-	uint32_t i, selected_core;
+	uint32_t i;
 	enum rte_lcore_state_t state;
-	uint32_t master_lcore = rte_get_master_lcore();
-	int32_t num_pollers, min_pollers;
+	struct spdk_iscsi_placement candidate, best;
+	bool found = false;
 
 	cpumask &= spdk_app_get_core_mask();
 	if (cpumask == 0) {
 		return 0;
 	}
 
-	min_pollers = INT_MAX;
-	selected_core = 0;
-
 	/* we use u64 as CPU core mask */
 	for (i = 0; i < RTE_MAX_LCORE && i < 64; i++) {
 		if (!((1ULL << i) & cpumask)) {
 			continue;
 		}
 
-		/*
-		 * DPDK returns WAIT for the master lcore instead of RUNNING.
-		 * So we always treat the reactor on master core as RUNNING.
-		 */
-		if (i == master_lcore) {
-			state = RUNNING;
-		} else {
-			state = rte_eal_get_lcore_state(i);
-		}
+		state = spdk_iscsi_lcore_state(i);
 		if (state == FINISHED) {
 			rte_eal_wait_lcore(i);
 		}
 
-		switch (state) {
-		case WAIT:
-		case FINISHED:
+		candidate.lcore = i;
+		if (state == RUNNING) {
+			candidate.num_conns = rte_atomic32_read(&g_num_connections[i]);
+			candidate.load_step = g_lcore_load[i].busy_pct / ISCSI_LCORE_LOAD_STEP_PCT;
+			candidate.full = spdk_iscsi_lcore_full(i);
+		} else {
 			/* Idle cores have 0 pollers. */
-			if (0 < min_pollers) {
-				selected_core = i;
-				min_pollers = 0;
-			}
-			break;
-		case RUNNING:
-			/* This lcore is running. Check how many pollers it already has. */
-			num_pollers = rte_atomic32_read(&g_num_connections[i]);
+			candidate.num_conns = 0;
+			candidate.load_step = 0;
+			candidate.full = 0;
+		}
+		candidate.remote = conn->numa_node >= 0 &&
+				   rte_lcore_to_socket_id(i) != (unsigned)conn->numa_node;
+		candidate.empty = candidate.num_conns == 0;
+		candidate.no_channel = !spdk_iscsi_conn_lcore_has_channel(conn, i);
+
+		if (!found || spdk_iscsi_placement_better(&candidate, &best)) {
+			best = candidate;
+			found = true;
+		}
+	}
 
-			if ((num_pollers > 0) && (num_pollers < g_connections_per_lcore)) {
-				/* Fewer than the maximum connections per lcore,
-				 * but at least 1. Use this lcore.
-				 */
-				return i;
-			} else if (num_pollers < min_pollers) {
-				/* Track the core that has the minimum number of pollers
-				 * to be used if no cores meet our criteria
-				 */
-				selected_core = i;
-				min_pollers = num_pollers;
-			}
-			break;
+	if (!found) {
+		return 0;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "conn %d placed on lcore %u (%d conns, %u%% busy)\n",
+		      conn->id, best.lcore, best.num_conns, g_lcore_load[best.lcore].busy_pct);
+
+	return best.lcore;
+}
+
+/*
+ * Least busy lcore a connection may move to from one src_pct busy, preferring
+ *  the NUMA node of its NIC; -1 if no core is far enough below src_pct.
+ *  Like new connections, moved ones only go to running lcores that are not
+ *  full.
+ */
+static int
+spdk_iscsi_conn_balance_dest(struct spdk_iscsi_conn *conn, uint32_t src_pct)
+{
+	uint64_t cpumask = conn->portal->cpumask & spdk_app_get_core_mask();
+	uint32_t pct;
+	int i, dest = -1, remote, dest_remote = 0;
+
+	for (i = 0; i < RTE_MAX_LCORE && i < 64; i++) {
+		if (!((1ULL << i) & cpumask) || (uint32_t)i == conn->lcore) {
+			continue;
+		}
+
+		if (spdk_iscsi_lcore_state(i) != RUNNING || spdk_iscsi_lcore_full(i)) {
+			continue;
+		}
+
+		pct = g_lcore_load[i].busy_pct;
+		if (pct + ISCSI_BALANCE_GAP_PCT > src_pct) {
+			continue;
+		}
+
+		remote = conn->numa_node >= 0 && rte_lcore_to_socket_id(i) != (unsigned)conn->numa_node;
+		if (dest < 0 || remote < dest_remote ||
+		    (remote == dest_remote && pct < g_lcore_load[dest].busy_pct)) {
+			dest = i;
+			dest_remote = remote;
+		}
+	}
+
+	return dest;
+}
+
+/**
+
+\brief Periodic balancer of full feature connections, run on the master lcore.
+
+Each run samples how many PDUs each connection received since the last one
+and picks the busiest lcore.  A connection's share of that lcore's load is
+estimated from its share of the lcore's PDUs.  The connection moved is the
+one with the largest share that still fits in half the gap to its
+destination, so that the move narrows the gap rather than reversing it; a
+single connection that makes up most of a core's load is left alone, as
+moving it would only move the hot spot.  At most one connection moves per
+run, which lets the load samples catch up before the next move.
+
+*/
+static void
+spdk_iscsi_conn_balance(void *arg)
+{
+	static uint64_t lcore_pdus[RTE_MAX_LCORE];
+	struct spdk_iscsi_conn *conn, *best = NULL;
+	uint64_t count, share, best_share = 0;
+	uint32_t src_pct = 0;
+	int i, src = -1, dest, best_dest = -1;
+	unsigned lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (lcore < 64 && g_lcore_load[lcore].busy_pct > src_pct) {
+			src = lcore;
+			src_pct = g_lcore_load[lcore].busy_pct;
 		}
 	}
 
-	return selected_core;
+	memset(lcore_pdus, 0, sizeof(lcore_pdus));
+
+	pthread_mutex_lock(&g_conns_mutex);
+	for (i = 0; i < MAX_ISCSI_CONNECTIONS; i++) {
+		conn = spdk_find_iscsi_connection_by_id(i);
+		if (conn == NULL) {
+			continue;
+		}
+		count = conn->pdu_count;
+		conn->pdu_rate = count - conn->last_pdu_count;
+		conn->last_pdu_count = count;
+		if (!conn->is_idle && conn->lcore < RTE_MAX_LCORE) {
+			lcore_pdus[conn->lcore] += conn->pdu_rate;
+		}
+	}
+
+	if (src < 0 || src_pct < ISCSI_BALANCE_GAP_PCT || lcore_pdus[src] == 0) {
+		pthread_mutex_unlock(&g_conns_mutex);
+		return;
+	}
+
+	for (i = 0; i < MAX_ISCSI_CONNECTIONS; i++) {
+		conn = spdk_find_iscsi_connection_by_id(i);
+		if (conn == NULL || conn->is_idle || conn->lcore != (uint32_t)src ||
+		    conn->login_phase != ISCSI_FULL_FEATURE_PHASE || conn->portal == NULL) {
+			continue;
+		}
+
+		dest = spdk_iscsi_conn_balance_dest(conn, src_pct);
+		if (dest < 0) {
+			continue;
+		}
+
+		share = (uint64_t)src_pct * conn->pdu_rate / lcore_pdus[src];
+		if (share == 0 || share * 2 > src_pct - g_lcore_load[dest].busy_pct) {
+			continue;
+		}
+
+		if (share > best_share) {
+			best = conn;
+			best_share = share;
+			best_dest = dest;
+		}
+	}
+	pthread_mutex_unlock(&g_conns_mutex);
+
+	if (best != NULL) {
+		spdk_event_call(spdk_event_allocate(src, spdk_iscsi_conn_start_migrate, best,
+						    (void *)(uintptr_t)best_dest, NULL));
+	}
 }
 
 static void
@@ -55,6 +55,13 @@
 #define MAX_INITIATOR_ADDR (MAX_ADDRBUF)
 #define MAX_TARGET_ADDR (MAX_ADDRBUF)
 
+/*
+ * Bytes read from the socket ahead of the PDU being parsed.  Reads smaller
+ *  than this are served from the buffer, so that one recv brings in the
+ *  headers and small data segments of several PDUs.
+ */
+#define ISCSI_RECV_BUF_SIZE	8192
+
 #define OWNER_ISCSI_CONN		0x1
 
 #define OBJECT_ISCSI_PDU		0x1
@@ -82,6 +89,9 @@ struct spdk_iscsi_conn {
 	struct spdk_iscsi_portal		*portal;
 	uint32_t			lcore;
 	int				sock;
+
+	/* NUMA node of the NIC the connection came in on, or -1 if unknown */
+	int				numa_node;
 	struct spdk_iscsi_sess	*sess;
 
 	enum iscsi_connection_state	state;
@@ -140,6 +150,22 @@ struct spdk_iscsi_conn {
 	uint32_t data_in_cnt;
 	bool pending_activate_event;
 
+	/*
+	 * PDUs received, their count when the balancer last sampled it, and
+	 *  how many came in during the period before that sample.
+	 */
+	uint64_t pdu_count;
+	uint64_t last_pdu_count;
+	uint64_t pdu_rate;
+
+	/*
+	 * Set while the connection waits for its outstanding tasks to finish
+	 *  before it moves to migrate_lcore.  It reads no new PDUs meanwhile.
+	 */
+	bool migrating;
+	uint32_t migrate_lcore;
+	uint64_t migrate_deadline_tsc;
+
 	int timeout;
 	uint64_t nopininterval;
 	bool nop_outstanding;
@@ -162,6 +188,18 @@ struct spdk_iscsi_conn {
 	TAILQ_HEAD(queued_r2t_tasks, spdk_iscsi_task)	queued_r2t_tasks;
 	TAILQ_HEAD(active_r2t_tasks, spdk_iscsi_task)	active_r2t_tasks;
 	TAILQ_HEAD(queued_datain_tasks, spdk_iscsi_task)	queued_datain_tasks;
+
+	/*
+	 * Received bytes not yet parsed are recv_buf[recv_buf_offset..recv_buf_len).
+	 *  The ISCSI_RECV_BUF_SIZE buffer is allocated when the connection is
+	 *  accepted, so that it does not take up room in the shared connection array.
+	 */
+	uint32_t	recv_buf_offset;
+	uint32_t	recv_buf_len;
+	uint8_t		*recv_buf;
+
+	/* iovecs gathered for one writev() when flushing write_pdu_list */
+	struct iovec	*flush_iovs;
 };
 
 int spdk_initialize_iscsi_conns(void);
@@ -174,6 +212,7 @@ int spdk_iscsi_drop_conns(struct spdk_iscsi_conn *conn,
 			  const char *conn_match, int drop_all);
 void spdk_iscsi_conn_set_min_per_core(int count);
 void spdk_iscsi_set_min_conn_idle_interval(int interval_in_us);
+void spdk_iscsi_conn_set_rebalance_interval(int interval_in_us);
 
 int spdk_iscsi_conn_read_data(struct spdk_iscsi_conn *conn, int len,
 			      void *buf);
@@ -45,16 +45,159 @@
 
 #ifndef USE_ISAL
 #define SPDK_USE_CRC32C_TABLE
+#if defined(__x86_64__)
+#define SPDK_USE_CRC32C_SSE42
+#endif
+#endif
+
+#ifdef SPDK_USE_CRC32C_SSE42
+#include <cpuid.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
 #endif
 
 #ifdef SPDK_USE_CRC32C_TABLE
 static uint32_t spdk_crc32c_table[256];
 
+static uint32_t
+spdk_update_crc32c_table(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	size_t s;
+
+	for (s = 0; s < len; s++) {
+		crc = (crc >> 8) ^ spdk_crc32c_table[(crc ^ buf[s]) & 0xff];
+	}
+	return crc;
+}
+#endif /* SPDK_USE_CRC32C_TABLE */
+
+#ifdef SPDK_USE_CRC32C_SSE42
+/*
+ * Buffers of at least 3 * SPDK_CRC32C_LONG_BLOCK (or SHORT_BLOCK) bytes are
+ *  split into three consecutive blocks whose CRCs are computed in parallel,
+ *  hiding the 3 cycle latency of the crc32 instruction.  The three partial
+ *  CRCs are then combined by multiplying each one by x^(8 * n) mod P with
+ *  pclmulqdq, where n is the number of bytes that follow its block.
+ */
+#define SPDK_CRC32C_LONG_BLOCK	8192
+#define SPDK_CRC32C_SHORT_BLOCK	256
+
+struct spdk_crc32c_shift {
+	uint32_t	k1;	/* x^(8 * block - 33) mod P */
+	uint32_t	k2;	/* x^(8 * 2 * block - 33) mod P */
+};
+
+static struct spdk_crc32c_shift spdk_crc32c_long_shift;
+static struct spdk_crc32c_shift spdk_crc32c_short_shift;
+
+/* Compute x^n mod P, bit-reflected like the CRC itself. */
+static uint32_t
+spdk_crc32c_xpow_mod(uint32_t n)
+{
+	uint32_t val = 0x80000000U; /* x^0 */
+
+	while (n--) {
+		if (val & 1) {
+			val = (val >> 1) ^ SPDK_CRC32C_POLYNOMIAL_REFLECT;
+		} else {
+			val = (val >> 1);
+		}
+	}
+	return val;
+}
+
+static void
+spdk_crc32c_init_shift(struct spdk_crc32c_shift *shift, uint32_t block)
+{
+	shift->k1 = spdk_crc32c_xpow_mod(8 * block - 33);
+	shift->k2 = spdk_crc32c_xpow_mod(8 * 2 * block - 33);
+}
+
+__attribute__((target("sse4.2"))) static uint32_t
+spdk_update_crc32c_sse42(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	uint64_t crc64 = crc;
+
+	while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+		crc64 = _mm_crc32_u8((uint32_t)crc64, *buf++);
+		len--;
+	}
+
+	while (len >= 8) {
+		crc64 = _mm_crc32_u64(crc64, *(const uint64_t *)buf);
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len > 0) {
+		crc64 = _mm_crc32_u8((uint32_t)crc64, *buf++);
+		len--;
+	}
+	return (uint32_t)crc64;
+}
+
+__attribute__((target("sse4.2,pclmul"))) static uint32_t
+spdk_crc32c_3way(const uint8_t *buf, size_t block, const struct spdk_crc32c_shift *shift,
+		 uint32_t crc)
+{
+	const uint64_t *p0 = (const uint64_t *)buf;
+	const uint64_t *p1 = (const uint64_t *)(buf + block);
+	const uint64_t *p2 = (const uint64_t *)(buf + 2 * block);
+	uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+	__m128i t0, t1;
+	size_t i;
+
+	for (i = 0; i < block / 8; i++) {
+		crc0 = _mm_crc32_u64(crc0, p0[i]);
+		crc1 = _mm_crc32_u64(crc1, p1[i]);
+		crc2 = _mm_crc32_u64(crc2, p2[i]);
+	}
+
+	t0 = _mm_clmulepi64_si128(_mm_cvtsi32_si128((uint32_t)crc0),
+				  _mm_cvtsi32_si128(shift->k2), 0x00);
+	t1 = _mm_clmulepi64_si128(_mm_cvtsi32_si128((uint32_t)crc1),
+				  _mm_cvtsi32_si128(shift->k1), 0x00);
+	t0 = _mm_xor_si128(t0, t1);
+
+	return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(t0)) ^ (uint32_t)crc2;
+}
+
+__attribute__((target("sse4.2,pclmul"))) static uint32_t
+spdk_update_crc32c_pclmul(const uint8_t *buf, size_t len, uint32_t crc)
+{
+	while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *buf++);
+		len--;
+	}
+
+	while (len >= 3 * SPDK_CRC32C_LONG_BLOCK) {
+		crc = spdk_crc32c_3way(buf, SPDK_CRC32C_LONG_BLOCK, &spdk_crc32c_long_shift, crc);
+		buf += 3 * SPDK_CRC32C_LONG_BLOCK;
+		len -= 3 * SPDK_CRC32C_LONG_BLOCK;
+	}
+
+	while (len >= 3 * SPDK_CRC32C_SHORT_BLOCK) {
+		crc = spdk_crc32c_3way(buf, SPDK_CRC32C_SHORT_BLOCK, &spdk_crc32c_short_shift, crc);
+		buf += 3 * SPDK_CRC32C_SHORT_BLOCK;
+		len -= 3 * SPDK_CRC32C_SHORT_BLOCK;
+	}
+
+	return spdk_update_crc32c_sse42(buf, len, crc);
+}
+#endif /* SPDK_USE_CRC32C_SSE42 */
+
+#ifndef USE_ISAL
+static uint32_t (*spdk_update_crc32c_fn)(const uint8_t *buf, size_t len, uint32_t crc) =
+	spdk_update_crc32c_table;
+
 __attribute__((constructor)) static void
 spdk_init_crc32c(void)
 {
 	int i, j;
 	uint32_t val;
+#ifdef SPDK_USE_CRC32C_SSE42
+	unsigned int eax, ebx, ecx, edx;
+#endif
 
 	for (i = 0; i < 256; i++) {
 		val = i;
@@ -67,36 +210,24 @@ spdk_init_crc32c(void)
 		}
 		spdk_crc32c_table[i] = val;
 	}
-}
-#endif /* SPDK_USE_CRC32C_TABLE */
 
+#ifdef SPDK_USE_CRC32C_SSE42
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2)) {
+		if (ecx & bit_PCLMUL) {
+			spdk_crc32c_init_shift(&spdk_crc32c_long_shift, SPDK_CRC32C_LONG_BLOCK);
+			spdk_crc32c_init_shift(&spdk_crc32c_short_shift, SPDK_CRC32C_SHORT_BLOCK);
+			spdk_update_crc32c_fn = spdk_update_crc32c_pclmul;
+		} else {
+			spdk_update_crc32c_fn = spdk_update_crc32c_sse42;
+		}
+	}
+#endif
+}
 
-#ifndef USE_ISAL
 uint32_t
 spdk_update_crc32c(const uint8_t *buf, size_t len, uint32_t crc)
 {
-	size_t s;
-#ifndef SPDK_USE_CRC32C_TABLE
-	int i;
-	uint32_t val;
-#endif /* SPDK_USE_CRC32C_TABLE */
-
-	for (s = 0; s < len; s++) {
-#ifdef SPDK_USE_CRC32C_TABLE
-		crc = (crc >> 8) ^ spdk_crc32c_table[(crc ^ buf[s]) & 0xff];
-#else
-		val = buf[s];
-		for (i = 0; i < 8; i++) {
-			if ((crc ^ val) & 1) {
-				crc = (crc >> 1) ^ SPDK_CRC32C_POLYNOMIAL_REFLECT;
-			} else {
-				crc = (crc >> 1);
-			}
-			val = val >> 1;
-		}
-#endif /* SPDK_USE_CRC32C_TABLE */
-	}
-	return crc;
+	return spdk_update_crc32c_fn(buf, len, crc);
 }
 #endif /* USE_ISAL */
 
@@ -134,3 +265,33 @@ spdk_crc32c(const uint8_t *buf, size_t len)
 	crc32c = crc32c ^ SPDK_CRC32C_XOR;
 	return crc32c;
 }
+
+uint32_t
+spdk_update_crc32c_iov(const struct iovec *iov, int iovcnt, uint32_t crc)
+{
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		crc = spdk_update_crc32c(iov[i].iov_base, iov[i].iov_len, crc);
+	}
+	return crc;
+}
+
+uint32_t
+spdk_crc32c_iov(const struct iovec *iov, int iovcnt)
+{
+	uint32_t crc32c;
+	size_t total = 0;
+	int i;
+
+	crc32c = SPDK_CRC32C_INITIAL;
+	crc32c = spdk_update_crc32c_iov(iov, iovcnt, crc32c);
+	for (i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+	if ((total % ISCSI_ALIGNMENT) != 0) {
+		crc32c = spdk_fixup_crc32c(total, crc32c);
+	}
+	crc32c = crc32c ^ SPDK_CRC32C_XOR;
+	return crc32c;
+}
@@ -53,4 +53,9 @@ uint32_t spdk_update_crc32c(const uint8_t *buf, size_t len, uint32_t crc);
 uint32_t spdk_fixup_crc32c(size_t total, uint32_t crc);
 uint32_t spdk_crc32c(const uint8_t *buf, size_t len);
 
+/* Continue a CRC32C over the buffers described by iov, in order. */
+uint32_t spdk_update_crc32c_iov(const struct iovec *iov, int iovcnt, uint32_t crc);
+/* Compute an iSCSI digest over the concatenation of the buffers described by iov. */
+uint32_t spdk_crc32c_iov(const struct iovec *iov, int iovcnt);
+
 #endif /* SPDK_CRC32C_H */
@@ -325,7 +325,7 @@ int
 spdk_iscsi_read_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu **_pdu)
 {
 	struct spdk_iscsi_pdu *pdu;
-	struct rte_mempool *pool;
+	enum spdk_iscsi_cache_type cache_type;
 	uint32_t crc32c;
 	int ahs_len;
 	int data_len;
@@ -363,7 +363,7 @@ spdk_iscsi_read_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu **_pdu)
 	if (pdu->ahs_valid_bytes < ahs_len) {
 		rc = spdk_iscsi_conn_read_data(conn,
 					       ahs_len - pdu->ahs_valid_bytes,
-					       pdu->ahs + pdu->ahs_valid_bytes);
+					       (uint8_t *)pdu->ahs + pdu->ahs_valid_bytes);
 		if (rc < 0) {
 			*_pdu = NULL;
 			spdk_put_pdu(pdu);
@@ -402,9 +402,9 @@ spdk_iscsi_read_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu **_pdu)
 	if (pdu->data_valid_bytes < data_len) {
 		if (pdu->data_buf == NULL) {
 			if (data_len <= spdk_get_immediate_data_buffer_size()) {
-				pool = g_spdk_iscsi.pdu_immediate_data_pool;
+				cache_type = ISCSI_CACHE_IMMEDIATE_DATA;
 			} else if (data_len <= spdk_get_data_out_buffer_size()) {
-				pool = g_spdk_iscsi.pdu_data_out_pool;
+				cache_type = ISCSI_CACHE_DATA_OUT;
 			} else {
 				SPDK_ERRLOG("Data(%d) > MaxSegment(%d)\n",
 					    data_len, spdk_get_data_out_buffer_size());
@@ -413,7 +413,7 @@ spdk_iscsi_read_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu **_pdu)
 				conn->pdu_in_progress = NULL;
 				return SPDK_ISCSI_CONNECTION_FATAL;
 			}
-			rte_mempool_get(pool, (void **)&pdu->mobj);
+			pdu->mobj = spdk_iscsi_cache_get(cache_type);
 			if (pdu->mobj == NULL) {
 				*_pdu = NULL;
 				return SPDK_SUCCESS;
@@ -514,21 +514,18 @@ spdk_iscsi_read_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu **_pdu)
 
 	/* check digest */
 	if (conn->header_digest) {
-		if (ahs_len == 0) {
-			crc32c = spdk_crc32c((uint8_t *)&pdu->bhs,
-					     ISCSI_BHS_LEN);
-		} else {
-			int upd_total = 0;
-			crc32c = SPDK_CRC32C_INITIAL;
-			crc32c = spdk_update_crc32c((uint8_t *)&pdu->bhs,
-						    ISCSI_BHS_LEN, crc32c);
-			upd_total += ISCSI_BHS_LEN;
-			crc32c = spdk_update_crc32c((uint8_t *)pdu->ahs,
-						    ahs_len, crc32c);
-			upd_total += ahs_len;
-			crc32c = spdk_fixup_crc32c(upd_total, crc32c);
-			crc32c = crc32c ^ SPDK_CRC32C_XOR;
+		struct iovec hdr_iov[2];
+		int hdr_iovcnt = 0;
+
+		hdr_iov[hdr_iovcnt].iov_base = &pdu->bhs;
+		hdr_iov[hdr_iovcnt].iov_len = ISCSI_BHS_LEN;
+		hdr_iovcnt++;
+		if (ahs_len != 0) {
+			hdr_iov[hdr_iovcnt].iov_base = pdu->ahs;
+			hdr_iov[hdr_iovcnt].iov_len = ahs_len;
+			hdr_iovcnt++;
 		}
+		crc32c = spdk_crc32c_iov(hdr_iov, hdr_iovcnt);
 		rc = MATCH_DIGEST_WORD(pdu->header_digest, crc32c);
 		if (rc == 0) {
 			SPDK_ERRLOG("header digest error (%s)\n", conn->initiator_name);
@@ -583,23 +580,8 @@ spdk_iscsi_build_iovecs(struct spdk_iscsi_conn *conn, struct iovec *iovec,
 
 	/* Header Digest */
 	if (enable_digest && conn->header_digest) {
-		if (total_ahs_len == 0) {
-			crc32c = spdk_crc32c((uint8_t *)&pdu->bhs,
-					     ISCSI_BHS_LEN);
-		} else {
-			int upd_total = 0;
-			crc32c = SPDK_CRC32C_INITIAL;
-			crc32c = spdk_update_crc32c((uint8_t *)&pdu->bhs,
-						    ISCSI_BHS_LEN, crc32c);
-			upd_total += ISCSI_BHS_LEN;
-			crc32c = spdk_update_crc32c((uint8_t *)pdu->ahs,
-						    (4 * total_ahs_len),
-						    crc32c);
-			upd_total += (4 * total_ahs_len);
-			crc32c = spdk_fixup_crc32c(upd_total, crc32c);
-			crc32c = crc32c ^ SPDK_CRC32C_XOR;
-		}
-
+		/* BHS and AHS are the only entries in iovec so far. */
+		crc32c = spdk_crc32c_iov(iovec, iovec_cnt);
 		MAKE_DIGEST_WORD(pdu->header_digest, crc32c);
 
 		iovec[iovec_cnt].iov_base = pdu->header_digest;
@@ -616,8 +598,15 @@ spdk_iscsi_build_iovecs(struct spdk_iscsi_conn *conn, struct iovec *iovec,
 
 	/* Data Digest */
 	if (enable_digest && conn->data_digest && data_len != 0) {
-		crc32c = spdk_crc32c(pdu->data, ISCSI_ALIGN(data_len));
-		MAKE_DIGEST_WORD(pdu->data_digest, crc32c);
+		/*
+		 * A PDU's iovecs are rebuilt each time a flush does not get all
+		 *  of it out, but its data does not change once it is queued.
+		 */
+		if (!pdu->data_digest_valid) {
+			crc32c = spdk_crc32c_iov(&iovec[iovec_cnt - 1], 1);
+			MAKE_DIGEST_WORD(pdu->data_digest, crc32c);
+			pdu->data_digest_valid = true;
+		}
 
 		iovec[iovec_cnt].iov_base = pdu->data_digest;
 		iovec[iovec_cnt].iov_len = ISCSI_DIGEST_LEN;
@@ -2630,6 +2619,7 @@ spdk_iscsi_send_datain(struct spdk_iscsi_conn *conn,
 	rsph = (struct iscsi_bhs_data_in *)&rsp_pdu->bhs;
 	rsp_pdu->data = task->scsi.rbuf + offset;
 	rsp_pdu->data_ref++;
+	task->outstanding_datain++;
 
 	task_tag = task->scsi.id;
 	transfer_tag = 0xffffffffU;
@@ -2762,7 +2752,13 @@ spdk_iscsi_transfer_in(struct spdk_iscsi_conn *conn,
 				/* last PDU in a sequence */
 				datain_flag |= ISCSI_FLAG_FINAL;
 				datain_flag &= ~ISCSI_DATAIN_STATUS;
-				if (task->scsi.sense_data_len == 0) {
+				/*
+				 * The status goes in the last Data-In unless sense data has
+				 *  to follow in a SCSI Response.  A split read carries the
+				 *  status of any earlier part that failed in its primary.
+				 */
+				if (task->scsi.sense_data_len == 0 &&
+				    (task == primary || primary->scsi.status == SPDK_SCSI_STATUS_GOOD)) {
 					switch (task->scsi.status) {
 					case SPDK_SCSI_STATUS_GOOD:
 					case SPDK_SCSI_STATUS_CONDITION_MET:
@@ -3101,15 +3097,34 @@ void spdk_iscsi_task_response(struct spdk_iscsi_conn *conn,
 	int bidi_residual_len;
 	int rc;
 	struct spdk_iscsi_task *primary;
+	struct spdk_scsi_task *status_task;
 
 	primary = spdk_iscsi_task_get_primary(task);
 
 	transfer_len = primary->scsi.transfer_len;
 	task_tag = task->scsi.id;
+	status_task = &task->scsi;
 
 	/* transfer data from logical unit */
 	/* (direction is view of initiator side) */
 	if (spdk_iscsi_task_is_read(primary)) {
+		/*
+		 * The parts of a split read complete in whatever order the bdev
+		 *  finishes them, and whichever completes last answers for the
+		 *  whole command.  Keep the first failure in the primary so that
+		 *  response reports it, whichever part carries it.
+		 */
+		if (task != primary) {
+			if (task->scsi.status != SPDK_SCSI_STATUS_GOOD &&
+			    primary->scsi.status == SPDK_SCSI_STATUS_GOOD) {
+				primary->scsi.status = task->scsi.status;
+				memcpy(primary->scsi.sense_data, task->scsi.sense_data,
+				       task->scsi.sense_data_len);
+				primary->scsi.sense_data_len = task->scsi.sense_data_len;
+			}
+			status_task = &primary->scsi;
+		}
+
 		if ((task->scsi.status == SPDK_SCSI_STATUS_GOOD) ||
 		    (task->scsi.sense_data_len != 0)) {
 			rc = spdk_iscsi_transfer_in(conn, task);
@@ -3128,7 +3143,7 @@ void spdk_iscsi_task_response(struct spdk_iscsi_conn *conn,
 	data_len = primary->scsi.data_transferred;
 
 	if ((transfer_len != 0) &&
-	    (task->scsi.status == SPDK_SCSI_STATUS_GOOD)) {
+	    (status_task->status == SPDK_SCSI_STATUS_GOOD)) {
 		if (data_len < transfer_len) {
 			/* underflow */
 			SPDK_TRACELOG(SPDK_TRACE_DEBUG, "Underflow %zu/%u\n",
@@ -3150,7 +3165,7 @@ void spdk_iscsi_task_response(struct spdk_iscsi_conn *conn,
 	/* response PDU */
 	rsp_pdu = spdk_get_pdu();
 	rsph = (struct iscsi_bhs_scsi_resp *)&rsp_pdu->bhs;
-	rsp_pdu->data = task->scsi.sense_data;
+	rsp_pdu->data = status_task->sense_data;
 	rsp_pdu->data_ref++;
 
 	/*
@@ -3175,8 +3190,8 @@ void spdk_iscsi_task_response(struct spdk_iscsi_conn *conn,
 	if (U_bit)
 		rsph->flags |= ISCSI_SCSI_UNDERFLOW;
 
-	rsph->status = task->scsi.status;
-	DSET24(rsph->data_segment_len, task->scsi.sense_data_len);
+	rsph->status = status_task->status;
+	DSET24(rsph->data_segment_len, status_task->sense_data_len);
 	to_be32(&rsph->itt, task_tag);
 
 	to_be32(&rsph->stat_sn, conn->StatSN);
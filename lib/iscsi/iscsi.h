@@ -41,8 +41,11 @@
 #include <sys/uio.h>
 #include <stdbool.h>
 
+#include <rte_config.h>
+
 #include "spdk/bdev.h"
 #include "spdk/iscsi_spec.h"
+#include "spdk/trace.h"
 
 #include "iscsi/param.h"
 #include "iscsi/tgt_node.h"
@@ -170,6 +173,10 @@ struct spdk_iscsi_pdu {
 	int data_valid_bytes;
 	int hdigest_valid_bytes;
 	int ddigest_valid_bytes;
+
+	/* Set once data_digest holds the digest of the data segment to send */
+	bool data_digest_valid;
+
 	int ref;
 	int data_ref;
 	struct spdk_iscsi_task *task; /* data tied to a task buffer */
@@ -290,14 +297,53 @@ struct spdk_iscsi_globals {
 	uint32_t AllowDuplicateIsid;
 
 	struct rte_mempool *pdu_pool;
-	struct rte_mempool *pdu_immediate_data_pool;
-	struct rte_mempool *pdu_data_out_pool;
+
+	/** Data buffer pools of each NUMA node that runs reactors, indexed by node */
+	struct rte_mempool *pdu_immediate_data_pool[RTE_MAX_NUMA_NODES];
+	struct rte_mempool *pdu_data_out_pool[RTE_MAX_NUMA_NODES];
+
 	struct rte_mempool *session_pool;
 	struct rte_mempool *task_pool;
 
 	struct spdk_iscsi_sess	**session;
 };
 
+/*
+ * Each core keeps free lists of objects of the global pools, so that the
+ *  connections it runs seldom touch the pools' shared rings.  A list that
+ *  runs empty takes a batch from its pool, and one that fills up returns a
+ *  batch to it.
+ */
+enum spdk_iscsi_cache_type {
+	ISCSI_CACHE_PDU,
+	ISCSI_CACHE_IMMEDIATE_DATA,
+	ISCSI_CACHE_DATA_OUT,
+	ISCSI_CACHE_TASK,
+	ISCSI_CACHE_COUNT,
+};
+
+struct spdk_iscsi_cache_stats {
+	/** Gets served from the core's free list */
+	uint64_t	hits;
+
+	/** Gets that found the free list empty and went to the global pool */
+	uint64_t	misses;
+
+	/** Puts that found the free list full and returned a batch to the global pool */
+	uint64_t	drains;
+};
+
+/*
+ * Counters of the free lists of one core.  They are kept in shared memory
+ *  named SPDK_ISCSI_CACHE_SHM_NAME, one entry per lcore up to
+ *  SPDK_TRACE_MAX_LCORE, for iscsi_top to read.
+ */
+struct spdk_iscsi_lcore_cache_stats {
+	struct spdk_iscsi_cache_stats	cache[ISCSI_CACHE_COUNT];
+} __attribute__((aligned(64)));
+
+#define SPDK_ISCSI_CACHE_SHM_NAME	"spdk_iscsi_caches.%d"
+
 #define ISCSI_SECURITY_NEGOTIATION_PHASE	0
 #define ISCSI_OPERATIONAL_NEGOTIATION_PHASE	1
 #define ISCSI_NSG_RESERVED_CODE			2
@@ -358,6 +404,9 @@ void process_task_mgmt_completion(spdk_event_t event);
 /* Memory management */
 void spdk_put_pdu(struct spdk_iscsi_pdu *pdu);
 struct spdk_iscsi_pdu *spdk_get_pdu(void);
+void *spdk_iscsi_cache_get(enum spdk_iscsi_cache_type type);
+void spdk_iscsi_cache_put(enum spdk_iscsi_cache_type type, void *obj);
+void spdk_iscsi_cache_put_mobj(struct spdk_mobj *mobj);
 int spdk_iscsi_conn_handle_queued_datain(struct spdk_iscsi_conn *conn);
 
 static inline int
@@ -54,8 +54,10 @@
 #include <rte_malloc.h>
 #include <rte_version.h>
 
+#include <fcntl.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "iscsi/iscsi.h"
 #include "iscsi/init_grp.h"
@@ -341,6 +343,36 @@ spdk_mobj_ctor(struct rte_mempool *mp, __attribute__((unused)) void *arg,
 #define IMMEDIATE_DATA_POOL_SIZE(iscsi)	(iscsi->MaxConnections * 128)
 #define DATA_OUT_POOL_SIZE(iscsi)	(iscsi->MaxConnections * MAX_DATA_OUT_PER_CONNECTION)
 
+/*
+ * Part of a data buffer pool kept on the given NUMA node: its share of the
+ *  lcores, plus what rounding leaves over on the node of the master lcore.
+ */
+static uint32_t
+spdk_iscsi_socket_pool_size(uint32_t total, unsigned socket)
+{
+	uint32_t socket_lcores[RTE_MAX_NUMA_NODES] = {0};
+	uint32_t lcores = 0, assigned = 0, size = 0;
+	unsigned lcore, i;
+
+	RTE_LCORE_FOREACH(lcore) {
+		socket_lcores[rte_lcore_to_socket_id(lcore)]++;
+		lcores++;
+	}
+
+	for (i = 0; i < RTE_MAX_NUMA_NODES; i++) {
+		if (i == socket) {
+			size = (uint64_t)total * socket_lcores[i] / lcores;
+		}
+		assigned += (uint64_t)total * socket_lcores[i] / lcores;
+	}
+
+	if (socket == rte_lcore_to_socket_id(rte_get_master_lcore())) {
+		size += total - assigned;
+	}
+
+	return size;
+}
+
 static int spdk_iscsi_initialize_pdu_pool(void)
 {
 	struct spdk_iscsi_globals *iscsi = &g_spdk_iscsi;
@@ -348,12 +380,15 @@ static int spdk_iscsi_initialize_pdu_pool(void)
 			    sizeof(struct spdk_mobj) + 512;
 	int dout_mobj_size = spdk_get_data_out_buffer_size() +
 			     sizeof(struct spdk_mobj) + 512;
+	char name[RTE_MEMPOOL_NAMESIZE];
+	uint32_t size;
+	unsigned socket;
 
 	/* create PDU pool */
 	iscsi->pdu_pool = rte_mempool_create("PDU_Pool",
 					     PDU_POOL_SIZE(iscsi),
 					     sizeof(struct spdk_iscsi_pdu),
-					     256, 0,
+					     0, 0,
 					     NULL, NULL, NULL, NULL,
 					     SOCKET_ID_ANY, 0);
 	if (!iscsi->pdu_pool) {
@@ -361,27 +396,42 @@ static int spdk_iscsi_initialize_pdu_pool(void)
 		return -1;
 	}
 
-	iscsi->pdu_immediate_data_pool =
-		rte_mempool_create("PDU_immediate_data_Pool",
-				   IMMEDIATE_DATA_POOL_SIZE(iscsi),
-				   imm_mobj_size,
-				   0, 0, NULL, NULL,
-				   spdk_mobj_ctor, NULL,
-				   rte_socket_id(), 0);
-	if (!iscsi->pdu_immediate_data_pool) {
-		SPDK_ERRLOG("create PDU 8k pool failed\n");
-		return -1;
-	}
+	/*
+	 * Data buffers are what the connections copy payload into and out of,
+	 *  so each NUMA node that runs reactors gets its own pools.
+	 */
+	for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+		size = spdk_iscsi_socket_pool_size(IMMEDIATE_DATA_POOL_SIZE(iscsi), socket);
+		if (size == 0) {
+			continue;
+		}
 
-	iscsi->pdu_data_out_pool = rte_mempool_create("PDU_data_out_Pool",
-				   DATA_OUT_POOL_SIZE(iscsi),
-				   dout_mobj_size,
-				   0, 0, NULL, NULL,
-				   spdk_mobj_ctor, NULL,
-				   rte_socket_id(), 0);
-	if (!iscsi->pdu_data_out_pool) {
-		SPDK_ERRLOG("create PDU 64k pool failed\n");
-		return -1;
+		snprintf(name, sizeof(name), "PDU_immediate_data_Pool_%u", socket);
+		iscsi->pdu_immediate_data_pool[socket] =
+			rte_mempool_create(name,
+					   size,
+					   imm_mobj_size,
+					   0, 0, NULL, NULL,
+					   spdk_mobj_ctor, NULL,
+					   socket, 0);
+		if (!iscsi->pdu_immediate_data_pool[socket]) {
+			SPDK_ERRLOG("create PDU 8k pool on socket %u failed\n", socket);
+			return -1;
+		}
+
+		size = spdk_iscsi_socket_pool_size(DATA_OUT_POOL_SIZE(iscsi), socket);
+		snprintf(name, sizeof(name), "PDU_data_out_Pool_%u", socket);
+		iscsi->pdu_data_out_pool[socket] =
+			rte_mempool_create(name,
+					   size,
+					   dout_mobj_size,
+					   0, 0, NULL, NULL,
+					   spdk_mobj_ctor, NULL,
+					   socket, 0);
+		if (!iscsi->pdu_data_out_pool[socket]) {
+			SPDK_ERRLOG("create PDU 64k pool on socket %u failed\n", socket);
+			return -1;
+		}
 	}
 
 	return 0;
@@ -410,7 +460,7 @@ spdk_iscsi_initialize_task_pool(void)
 	iscsi->task_pool = rte_mempool_create("SCSI_TASK_Pool",
 					      DEFAULT_TASK_POOL_SIZE,
 					      sizeof(struct spdk_iscsi_task),
-					      128, 0,
+					      0, 0,
 					      NULL, NULL, NULL, NULL,
 					      SOCKET_ID_ANY, 0);
 	if (!iscsi->task_pool) {
@@ -441,6 +491,259 @@ static int spdk_iscsi_initialize_session_pool(void)
 	return 0;
 }
 
+/*
+ * A core's free list of one type of object.  Only the core that owns it
+ *  uses it, so it needs no locking; the pools have no rte_mempool cache of
+ *  their own, as these lists take its place.
+ */
+struct spdk_iscsi_cache {
+	struct rte_mempool	*pool;
+	uint32_t		count;
+	uint32_t		size;
+
+	/** Objects taken from or returned to the pool at a time */
+	uint32_t		batch;
+
+	void			*objs[];
+};
+
+static struct spdk_iscsi_cache *g_caches[SPDK_TRACE_MAX_LCORE][ISCSI_CACHE_COUNT];
+static struct spdk_iscsi_lcore_cache_stats *g_cache_stats;
+static char g_cache_shm_name[64];
+
+/* Pool of the given type on the given NUMA node; PDUs and tasks have one pool for all nodes. */
+static struct rte_mempool *
+spdk_iscsi_cache_pool(enum spdk_iscsi_cache_type type, unsigned socket)
+{
+	switch (type) {
+	case ISCSI_CACHE_PDU:
+		return g_spdk_iscsi.pdu_pool;
+	case ISCSI_CACHE_IMMEDIATE_DATA:
+		return socket < RTE_MAX_NUMA_NODES ? g_spdk_iscsi.pdu_immediate_data_pool[socket] : NULL;
+	case ISCSI_CACHE_DATA_OUT:
+		return socket < RTE_MAX_NUMA_NODES ? g_spdk_iscsi.pdu_data_out_pool[socket] : NULL;
+	case ISCSI_CACHE_TASK:
+	default:
+		return g_spdk_iscsi.task_pool;
+	}
+}
+
+/*
+ * Take one object from the pool of the given node, or, for data buffers,
+ *  from another node's pool once the local one is used up.
+ */
+static void *
+spdk_iscsi_pool_get(enum spdk_iscsi_cache_type type, unsigned socket)
+{
+	struct rte_mempool *pool;
+	void *obj;
+	unsigned i;
+
+	pool = spdk_iscsi_cache_pool(type, socket);
+	if (pool != NULL && rte_mempool_get(pool, &obj) == 0) {
+		return obj;
+	}
+
+	if (type != ISCSI_CACHE_IMMEDIATE_DATA && type != ISCSI_CACHE_DATA_OUT) {
+		return NULL;
+	}
+
+	for (i = 0; i < RTE_MAX_NUMA_NODES; i++) {
+		pool = spdk_iscsi_cache_pool(type, i);
+		if (i != socket && pool != NULL && rte_mempool_get(pool, &obj) == 0) {
+			return obj;
+		}
+	}
+
+	return NULL;
+}
+
+static uint32_t
+spdk_iscsi_cache_pool_size(enum spdk_iscsi_cache_type type)
+{
+	struct spdk_iscsi_globals *iscsi = &g_spdk_iscsi;
+
+	switch (type) {
+	case ISCSI_CACHE_PDU:
+		return PDU_POOL_SIZE(iscsi);
+	case ISCSI_CACHE_IMMEDIATE_DATA:
+		return IMMEDIATE_DATA_POOL_SIZE(iscsi);
+	case ISCSI_CACHE_DATA_OUT:
+		return DATA_OUT_POOL_SIZE(iscsi);
+	case ISCSI_CACHE_TASK:
+	default:
+		return DEFAULT_TASK_POOL_SIZE;
+	}
+}
+
+static int
+spdk_iscsi_initialize_caches(void)
+{
+	struct spdk_iscsi_cache *cache;
+	size_t stats_size;
+	uint32_t size;
+	int fd, type;
+	unsigned lcore;
+
+	snprintf(g_cache_shm_name, sizeof(g_cache_shm_name), SPDK_ISCSI_CACHE_SHM_NAME,
+		 spdk_app_get_instance_id());
+	fd = shm_open(g_cache_shm_name, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		SPDK_ERRLOG("could not shm_open %s\n", g_cache_shm_name);
+		return -1;
+	}
+
+	stats_size = sizeof(*g_cache_stats) * SPDK_TRACE_MAX_LCORE;
+	if (ftruncate(fd, stats_size) != 0) {
+		SPDK_ERRLOG("could not ftruncate %s\n", g_cache_shm_name);
+		close(fd);
+		shm_unlink(g_cache_shm_name);
+		return -1;
+	}
+
+	g_cache_stats = mmap(NULL, stats_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (g_cache_stats == MAP_FAILED) {
+		SPDK_ERRLOG("could not mmap %s\n", g_cache_shm_name);
+		g_cache_stats = NULL;
+		shm_unlink(g_cache_shm_name);
+		return -1;
+	}
+	memset(g_cache_stats, 0, stats_size);
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (lcore >= SPDK_TRACE_MAX_LCORE) {
+			continue;
+		}
+
+		for (type = 0; type < ISCSI_CACHE_COUNT; type++) {
+			/*
+			 * A core keeps at most half its share of the pool, that is of what
+			 *  its connections use if they are spread evenly over the cores,
+			 *  so that the pool always has objects left for a busier core.
+			 */
+			size = spdk_iscsi_cache_pool_size(type) / (2 * spdk_app_get_core_count());
+			if (size < 2) {
+				continue;
+			}
+
+			cache = rte_zmalloc_socket(NULL, sizeof(*cache) + size * sizeof(void *),
+						   RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore));
+			if (cache == NULL) {
+				SPDK_ERRLOG("could not allocate the free lists of lcore %u\n", lcore);
+				return -1;
+			}
+			cache->pool = spdk_iscsi_cache_pool(type, rte_lcore_to_socket_id(lcore));
+			cache->size = size;
+			cache->batch = size / 2;
+			g_caches[lcore][type] = cache;
+		}
+	}
+
+	return 0;
+}
+
+/* Return all cached objects to their pools, once no reactor runs any more. */
+static void
+spdk_iscsi_free_caches(void)
+{
+	struct spdk_iscsi_cache *cache;
+	int lcore, type;
+
+	for (lcore = 0; lcore < SPDK_TRACE_MAX_LCORE; lcore++) {
+		for (type = 0; type < ISCSI_CACHE_COUNT; type++) {
+			cache = g_caches[lcore][type];
+			if (cache == NULL) {
+				continue;
+			}
+			if (cache->count > 0) {
+				rte_mempool_put_bulk(cache->pool, cache->objs, cache->count);
+			}
+			rte_free(cache);
+			g_caches[lcore][type] = NULL;
+		}
+	}
+
+	if (g_cache_stats != NULL) {
+		munmap(g_cache_stats, sizeof(*g_cache_stats) * SPDK_TRACE_MAX_LCORE);
+		g_cache_stats = NULL;
+		shm_unlink(g_cache_shm_name);
+	}
+}
+
+void *
+spdk_iscsi_cache_get(enum spdk_iscsi_cache_type type)
+{
+	struct spdk_iscsi_cache *cache = NULL;
+	unsigned lcore = rte_lcore_id();
+
+	if (lcore < SPDK_TRACE_MAX_LCORE) {
+		cache = g_caches[lcore][type];
+	}
+
+	if (cache == NULL) {
+		return spdk_iscsi_pool_get(type, rte_socket_id());
+	}
+
+	if (cache->count > 0) {
+		g_cache_stats[lcore].cache[type].hits++;
+		return cache->objs[--cache->count];
+	}
+
+	g_cache_stats[lcore].cache[type].misses++;
+	if (rte_mempool_get_bulk(cache->pool, cache->objs, cache->batch) == 0) {
+		cache->count = cache->batch - 1;
+		return cache->objs[cache->count];
+	}
+
+	/* The pool has less than a batch left; take a single object. */
+	return spdk_iscsi_pool_get(type, rte_lcore_to_socket_id(lcore));
+}
+
+void
+spdk_iscsi_cache_put(enum spdk_iscsi_cache_type type, void *obj)
+{
+	struct spdk_iscsi_cache *cache = NULL;
+	unsigned lcore = rte_lcore_id();
+
+	if (lcore < SPDK_TRACE_MAX_LCORE) {
+		cache = g_caches[lcore][type];
+	}
+
+	if (cache == NULL) {
+		rte_mempool_put(spdk_iscsi_cache_pool(type, rte_socket_id()), obj);
+		return;
+	}
+
+	if (cache->count == cache->size) {
+		g_cache_stats[lcore].cache[type].drains++;
+		cache->count -= cache->batch;
+		rte_mempool_put_bulk(cache->pool, &cache->objs[cache->count], cache->batch);
+	}
+	cache->objs[cache->count++] = obj;
+}
+
+void
+spdk_iscsi_cache_put_mobj(struct spdk_mobj *mobj)
+{
+	struct spdk_iscsi_cache *imm = NULL, *dout = NULL;
+	unsigned lcore = rte_lcore_id();
+
+	if (lcore < SPDK_TRACE_MAX_LCORE) {
+		imm = g_caches[lcore][ISCSI_CACHE_IMMEDIATE_DATA];
+		dout = g_caches[lcore][ISCSI_CACHE_DATA_OUT];
+	}
+
+	/* A buffer of another node's pool goes straight back to it. */
+	if (imm != NULL && mobj->mp == imm->pool) {
+		spdk_iscsi_cache_put(ISCSI_CACHE_IMMEDIATE_DATA, mobj);
+	} else if (dout != NULL && mobj->mp == dout->pool) {
+		spdk_iscsi_cache_put(ISCSI_CACHE_DATA_OUT, mobj);
+	} else {
+		rte_mempool_put(mobj->mp, mobj);
+	}
+}
+
 static int
 spdk_iscsi_initialize_all_pools(void)
 {
@@ -456,6 +759,10 @@ spdk_iscsi_initialize_all_pools(void)
 		return -1;
 	}
 
+	if (spdk_iscsi_initialize_caches() != 0) {
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -485,12 +792,20 @@ spdk_iscsi_check_pool(struct rte_mempool *pool, uint32_t count)
 static int spdk_iscsi_check_pools(void)
 {
 	int rc = 0;
+	unsigned socket;
 	struct spdk_iscsi_globals *iscsi = &g_spdk_iscsi;
 
 	rc += spdk_iscsi_check_pool(iscsi->pdu_pool, PDU_POOL_SIZE(iscsi));
 	rc += spdk_iscsi_check_pool(iscsi->session_pool, SESSION_POOL_SIZE(iscsi));
-	rc += spdk_iscsi_check_pool(iscsi->pdu_immediate_data_pool, IMMEDIATE_DATA_POOL_SIZE(iscsi));
-	rc += spdk_iscsi_check_pool(iscsi->pdu_data_out_pool, DATA_OUT_POOL_SIZE(iscsi));
+	for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+		if (iscsi->pdu_immediate_data_pool[socket] == NULL) {
+			continue;
+		}
+		rc += spdk_iscsi_check_pool(iscsi->pdu_immediate_data_pool[socket],
+					    spdk_iscsi_socket_pool_size(IMMEDIATE_DATA_POOL_SIZE(iscsi), socket));
+		rc += spdk_iscsi_check_pool(iscsi->pdu_data_out_pool[socket],
+					    spdk_iscsi_socket_pool_size(DATA_OUT_POOL_SIZE(iscsi), socket));
+	}
 
 	if (rc == 0) {
 		return 0;
@@ -513,28 +828,28 @@ void spdk_put_pdu(struct spdk_iscsi_pdu *pdu)
 
 	if (pdu->ref == 0) {
 		if (pdu->mobj)
-			rte_mempool_put(pdu->mobj->mp, (void *)pdu->mobj);
+			spdk_iscsi_cache_put_mobj(pdu->mobj);
 
 		if (pdu->data && !pdu->data_ref)
 			free(pdu->data);
 
-		rte_mempool_put(g_spdk_iscsi.pdu_pool, (void *)pdu);
+		spdk_iscsi_cache_put(ISCSI_CACHE_PDU, pdu);
 	}
 }
 
 struct spdk_iscsi_pdu *spdk_get_pdu(void)
 {
 	struct spdk_iscsi_pdu *pdu;
-	int rc;
 
-	rc = rte_mempool_get(g_spdk_iscsi.pdu_pool, (void **)&pdu);
-	if ((rc < 0) || !pdu) {
+	pdu = spdk_iscsi_cache_get(ISCSI_CACHE_PDU);
+	if (!pdu) {
 		SPDK_ERRLOG("Unable to get PDU\n");
 		rte_panic("no memory\n");
 	}
 
 	/* we do not want to zero out the last 60 bytes reserved for AHS */
 	memset(pdu, 0, offsetof(struct spdk_iscsi_pdu, ahs_data));
+	pdu->ahs = (struct iscsi_ahs *)pdu->ahs_data;
 	pdu->ref = 1;
 
 	return pdu;
@@ -563,6 +878,7 @@ spdk_iscsi_app_read_parameters(void)
 	int AllowDuplicateIsid;
 	int min_conn_per_core = 0;
 	int conn_idle_interval = 0;
+	int rebalance_interval = 0;
 
 	/* Process parameters */
 	SPDK_TRACELOG(SPDK_TRACE_DEBUG, "spdk_iscsi_app_read_parameters\n");
@@ -922,6 +1238,10 @@ spdk_iscsi_app_read_parameters(void)
 	if (conn_idle_interval > 0)
 		spdk_iscsi_set_min_conn_idle_interval(conn_idle_interval);
 
+	rebalance_interval = spdk_conf_section_get_intval(sp, "ConnectionRebalanceInterval");
+	if (rebalance_interval >= 0)
+		spdk_iscsi_conn_set_rebalance_interval(rebalance_interval);
+
 	/* portal groups */
 	rc = spdk_iscsi_portal_grp_array_create();
 	if (rc < 0) {
@@ -1004,6 +1324,7 @@ spdk_iscsi_subsystem_fini(void)
 {
 	int rc;
 
+	spdk_iscsi_free_caches();
 	rc = spdk_iscsi_check_pools();
 
 	spdk_iscsi_shutdown_tgt_nodes();
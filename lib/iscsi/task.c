@@ -42,17 +42,16 @@ static void
 spdk_iscsi_task_free(struct spdk_scsi_task *task)
 {
 	spdk_iscsi_task_disassociate_pdu((struct spdk_iscsi_task *)task);
-	rte_mempool_put(g_spdk_iscsi.task_pool, (void *)task);
+	spdk_iscsi_cache_put(ISCSI_CACHE_TASK, task);
 }
 
 struct spdk_iscsi_task *
 spdk_iscsi_task_get(uint32_t *owner_task_ctr, struct spdk_iscsi_task *parent)
 {
 	struct spdk_iscsi_task *task;
-	int rc;
 
-	rc = rte_mempool_get(g_spdk_iscsi.task_pool, (void **)&task);
-	if ((rc < 0) || !task) {
+	task = spdk_iscsi_cache_get(ISCSI_CACHE_TASK);
+	if (!task) {
 		SPDK_ERRLOG("Unable to get task\n");
 		rte_panic("no memory\n");
 	}
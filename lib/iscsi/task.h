@@ -49,6 +49,12 @@ struct spdk_iscsi_task {
 	 */
 	uint32_t current_datain_offset;
 
+	/*
+	 * Number of Data-In PDUs pointing into this task's rbuf that have
+	 *  not been written to the socket yet.
+	 */
+	uint32_t outstanding_datain;
+
 	/*
 	 * next_expected_r2t_offset is used when we receive
 	 * the DataOUT PDU.
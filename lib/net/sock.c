@@ -32,6 +32,7 @@
  */
 
 #include <errno.h>
+#include <ifaddrs.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -39,6 +40,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -346,3 +348,68 @@ spdk_sock_is_ipv4(int sock)
 
 	return (sa.ss_family == AF_INET);
 }
+
+static bool
+spdk_sock_addr_equal(const struct sockaddr *a, const struct sockaddr *b)
+{
+	if (a->sa_family != b->sa_family) {
+		return false;
+	}
+
+	switch (a->sa_family) {
+	case AF_INET:
+		return ((const struct sockaddr_in *)a)->sin_addr.s_addr ==
+		       ((const struct sockaddr_in *)b)->sin_addr.s_addr;
+	case AF_INET6:
+		return memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+			      &((const struct sockaddr_in6 *)b)->sin6_addr,
+			      sizeof(struct in6_addr)) == 0;
+	default:
+		return false;
+	}
+}
+
+int
+spdk_sock_get_numa_node(int sock)
+{
+	struct sockaddr_storage sa;
+	socklen_t salen;
+	struct ifaddrs *ifaddrs, *ifa;
+	char path[128];
+	FILE *fp;
+	int node = -1;
+
+	memset(&sa, 0, sizeof sa);
+	salen = sizeof sa;
+	if (getsockname(sock, (struct sockaddr *) &sa, &salen) != 0) {
+		SPDK_ERRLOG("getsockname() failed (errno=%d)\n", errno);
+		return -1;
+	}
+
+	if (getifaddrs(&ifaddrs) != 0) {
+		SPDK_ERRLOG("getifaddrs() failed (errno=%d)\n", errno);
+		return -1;
+	}
+
+	for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL ||
+		    !spdk_sock_addr_equal(ifa->ifa_addr, (struct sockaddr *)&sa)) {
+			continue;
+		}
+
+		/* Virtual interfaces such as lo have no device, and so no node. */
+		snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifa->ifa_name);
+		fp = fopen(path, "r");
+		if (fp != NULL) {
+			if (fscanf(fp, "%d", &node) != 1) {
+				node = -1;
+			}
+			fclose(fp);
+		}
+		break;
+	}
+
+	freeifaddrs(ifaddrs);
+
+	return node;
+}
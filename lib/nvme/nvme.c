@@ -44,7 +44,7 @@ struct nvme_driver *g_spdk_nvme_driver = &_g_nvme_driver;
 int32_t		spdk_nvme_retry_count;
 
 static struct spdk_nvme_ctrlr *
-nvme_attach(void *devhandle)
+nvme_attach(void *devhandle, struct spdk_nvme_emu_ctrlr *emu)
 {
 	struct spdk_nvme_ctrlr	*ctrlr;
 	int			status;
@@ -57,6 +57,7 @@ nvme_attach(void *devhandle)
 		return NULL;
 	}
 
+	ctrlr->emu = emu;
 	status = nvme_ctrlr_construct(ctrlr, devhandle);
 	if (status != 0) {
 		nvme_free(ctrlr);
@@ -241,26 +242,16 @@ struct nvme_enum_ctx {
 
 /* This function must only be called while holding g_spdk_nvme_driver->lock */
 static int
-nvme_enum_cb(void *ctx, struct spdk_pci_device *pci_dev)
+nvme_probe_ctrlr(struct nvme_enum_ctx *enum_ctx, struct spdk_pci_device *pci_dev,
+		 struct spdk_nvme_emu_ctrlr *emu)
 {
-	struct nvme_enum_ctx *enum_ctx = ctx;
 	struct spdk_nvme_ctrlr *ctrlr;
 	struct spdk_nvme_ctrlr_opts opts;
 
-	/* Verify that this controller is not already attached */
-	TAILQ_FOREACH(ctrlr, &g_spdk_nvme_driver->attached_ctrlrs, tailq) {
-		/* NOTE: This assumes that the PCI abstraction layer will use the same device handle
-		 *  across enumerations; we could compare by BDF instead if this is not true.
-		 */
-		if (pci_dev == ctrlr->devhandle) {
-			return 0;
-		}
-	}
-
 	spdk_nvme_ctrlr_opts_set_defaults(&opts);
 
 	if (enum_ctx->probe_cb(enum_ctx->cb_ctx, pci_dev, &opts)) {
-		ctrlr = nvme_attach(pci_dev);
+		ctrlr = nvme_attach(pci_dev, emu);
 		if (ctrlr == NULL) {
 			nvme_printf(NULL, "nvme_attach() failed\n");
 			return -1;
@@ -274,6 +265,40 @@ nvme_enum_cb(void *ctx, struct spdk_pci_device *pci_dev)
 	return 0;
 }
 
+/* This function must only be called while holding g_spdk_nvme_driver->lock */
+static int
+nvme_enum_cb(void *ctx, struct spdk_pci_device *pci_dev)
+{
+	struct spdk_nvme_ctrlr *ctrlr;
+
+	/* Verify that this controller is not already attached */
+	TAILQ_FOREACH(ctrlr, &g_spdk_nvme_driver->attached_ctrlrs, tailq) {
+		/* NOTE: This assumes that the PCI abstraction layer will use the same device handle
+		 *  across enumerations; we could compare by BDF instead if this is not true.
+		 */
+		if (pci_dev == ctrlr->devhandle) {
+			return 0;
+		}
+	}
+
+	return nvme_probe_ctrlr(ctx, pci_dev, NULL);
+}
+
+/* This function must only be called while holding g_spdk_nvme_driver->lock */
+static int
+nvme_emu_enum_cb(void *ctx, struct spdk_nvme_emu_ctrlr *emu)
+{
+	struct spdk_nvme_ctrlr *ctrlr;
+
+	TAILQ_FOREACH(ctrlr, &g_spdk_nvme_driver->attached_ctrlrs, tailq) {
+		if (emu == ctrlr->emu) {
+			return 0;
+		}
+	}
+
+	return nvme_probe_ctrlr(ctx, NULL, emu);
+}
+
 int
 spdk_nvme_probe(void *cb_ctx, spdk_nvme_probe_cb probe_cb, spdk_nvme_attach_cb attach_cb,
 		spdk_nvme_remove_cb remove_cb)
@@ -288,6 +313,9 @@ spdk_nvme_probe(void *cb_ctx, spdk_nvme_probe_cb probe_cb, spdk_nvme_attach_cb a
 	enum_ctx.cb_ctx = cb_ctx;
 
 	rc = nvme_pci_enumerate(nvme_enum_cb, &enum_ctx);
+	if (nvme_emu_enumerate(nvme_emu_enum_cb, &enum_ctx) != 0) {
+		rc = -1;
+	}
 	/*
 	 * Keep going even if one or more nvme_attach() calls failed,
 	 *  but maintain the value of rc to signal errors when we return.
@@ -1046,6 +1046,12 @@ nvme_ctrlr_allocate_bars(struct spdk_nvme_ctrlr *ctrlr)
 	int rc;
 	void *addr;
 
+	if (ctrlr->emu != NULL) {
+		/* The emulated register file lives in host memory and has no CMB. */
+		ctrlr->regs = nvme_emu_ctrlr_get_regs(ctrlr->emu);
+		return 0;
+	}
+
 	rc = nvme_pcicfg_map_bar(ctrlr->devhandle, 0, 0 /* writable */, &addr);
 	ctrlr->regs = (volatile struct spdk_nvme_registers *)addr;
 	if ((ctrlr->regs == NULL) || (rc != 0)) {
@@ -1064,6 +1070,10 @@ nvme_ctrlr_free_bars(struct spdk_nvme_ctrlr *ctrlr)
 	int rc = 0;
 	void *addr = (void *)ctrlr->regs;
 
+	if (ctrlr->emu != NULL) {
+		return 0;
+	}
+
 	rc = nvme_ctrlr_unmap_cmb(ctrlr);
 	if (rc != 0) {
 		nvme_printf(ctrlr, "nvme_ctrlr_unmap_cmb failed with error code %d\n", rc);
@@ -1110,10 +1120,12 @@ nvme_ctrlr_construct(struct spdk_nvme_ctrlr *ctrlr, void *devhandle)
 		return status;
 	}
 
-	/* Enable PCI busmaster and disable INTx */
-	nvme_pcicfg_read32(devhandle, &cmd_reg, 4);
-	cmd_reg |= 0x0404;
-	nvme_pcicfg_write32(devhandle, cmd_reg, 4);
+	if (ctrlr->emu == NULL) {
+		/* Enable PCI busmaster and disable INTx */
+		nvme_pcicfg_read32(devhandle, &cmd_reg, 4);
+		cmd_reg |= 0x0404;
+		nvme_pcicfg_write32(devhandle, cmd_reg, 4);
+	}
 
 	cap.raw = nvme_mmio_read_8(ctrlr, cap.raw);
 
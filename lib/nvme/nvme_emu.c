@@ -0,0 +1,778 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ * Software-emulated NVMe controller.
+ *
+ * The emulated controller exposes a register file in host memory that the
+ *  regular driver maps in place of BAR0.  A dedicated thread polls CC and the
+ *  doorbells, services the admin and I/O submission queues and posts
+ *  completions, so the full driver submission/completion path is exercised
+ *  without any hardware.
+ */
+
+#include "nvme_internal.h"
+
+#define NVME_EMU_DEFAULT_IO_QUEUES	8
+#define NVME_EMU_DEFAULT_QUEUE_ENTRIES	1024
+#define NVME_EMU_DEFAULT_BLOCK_SIZE	512
+#define NVME_EMU_DEFAULT_NUM_BLOCKS	(1ULL << 21)	/* 1 GiB with 512 byte blocks */
+#define NVME_EMU_MDTS			5
+
+struct nvme_emu_sq {
+	struct spdk_nvme_cmd		*cmds;
+	uint32_t			num_entries;
+	uint32_t			head;
+	uint16_t			cqid;
+	bool				valid;
+};
+
+struct nvme_emu_cq {
+	struct spdk_nvme_cpl		*cpls;
+	uint32_t			num_entries;
+	uint32_t			tail;
+	uint8_t				phase;
+	bool				valid;
+};
+
+struct spdk_nvme_emu_ctrlr {
+	struct spdk_nvme_emu_opts	opts;
+
+	volatile struct spdk_nvme_registers *regs;
+
+	/* Index 0 is the admin queue pair; I/O queue IDs map directly to indices. */
+	struct nvme_emu_sq		*sq;
+	struct nvme_emu_cq		*cq;
+	uint32_t			num_queues;
+
+	uint32_t			page_size;
+	bool				enabled;
+	bool				shutdown;
+
+	uint8_t				*data;
+
+	pthread_t			thread;
+	volatile bool			stop;
+
+	TAILQ_ENTRY(spdk_nvme_emu_ctrlr) tailq;
+};
+
+/* Protected by g_spdk_nvme_driver->lock. */
+static TAILQ_HEAD(, spdk_nvme_emu_ctrlr) g_nvme_emu_ctrlrs =
+	TAILQ_HEAD_INITIALIZER(g_nvme_emu_ctrlrs);
+
+static void
+nvme_emu_set_status(struct spdk_nvme_cpl *cpl, int sct, int sc)
+{
+	cpl->status.sct = sct;
+	cpl->status.sc = sc;
+}
+
+static void
+nvme_emu_reset_queues(struct spdk_nvme_emu_ctrlr *emu)
+{
+	memset(emu->sq, 0, emu->num_queues * sizeof(*emu->sq));
+	memset(emu->cq, 0, emu->num_queues * sizeof(*emu->cq));
+}
+
+static bool
+nvme_emu_cq_full(struct spdk_nvme_emu_ctrlr *emu, uint16_t cqid)
+{
+	struct nvme_emu_cq *cq = &emu->cq[cqid];
+	uint32_t next = cq->tail + 1;
+
+	if (next == cq->num_entries) {
+		next = 0;
+	}
+
+	return next == emu->regs->doorbell[cqid].cq_hdbl;
+}
+
+static void
+nvme_emu_post_cpl(struct spdk_nvme_emu_ctrlr *emu, uint16_t cqid, struct spdk_nvme_cpl *cpl)
+{
+	struct nvme_emu_cq *cq = &emu->cq[cqid];
+	struct spdk_nvme_cpl *entry = &cq->cpls[cq->tail];
+
+	entry->cdw0 = cpl->cdw0;
+	entry->rsvd1 = 0;
+	entry->sqhd = cpl->sqhd;
+	entry->sqid = cpl->sqid;
+	entry->cid = cpl->cid;
+
+	/* The phase tag must not become visible before the rest of the entry. */
+	spdk_wmb();
+	cpl->status.p = cq->phase;
+	entry->status = cpl->status;
+
+	if (++cq->tail == cq->num_entries) {
+		cq->tail = 0;
+		cq->phase = !cq->phase;
+	}
+}
+
+/*
+ * Copy len bytes between buf and the host memory described by the command's PRPs.
+ */
+static int
+nvme_emu_prp_copy(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+		  void *buf, uint32_t len, bool to_host)
+{
+	uint64_t page_mask = emu->page_size - 1;
+	uint64_t *prp_list = NULL;
+	uint32_t list_idx = 0, list_entries = 0;
+	uint64_t prp = cmd->dptr.prp.prp1;
+	uint8_t *p = buf;
+	uint32_t chunk;
+	void *host;
+
+	chunk = nvme_min(len, emu->page_size - (uint32_t)(prp & page_mask));
+
+	while (len > 0) {
+		host = nvme_phys_to_virt(prp);
+		if (host == NULL) {
+			return -1;
+		}
+
+		if (to_host) {
+			memcpy(host, p, chunk);
+		} else {
+			memcpy(p, host, chunk);
+		}
+		p += chunk;
+		len -= chunk;
+		if (len == 0) {
+			break;
+		}
+
+		if (prp_list == NULL && len <= emu->page_size) {
+			/* PRP2 points directly at the second (and last) page. */
+			prp = cmd->dptr.prp.prp2;
+		} else {
+			if (prp_list == NULL) {
+				prp_list = nvme_phys_to_virt(cmd->dptr.prp.prp2);
+				list_entries = (emu->page_size - (cmd->dptr.prp.prp2 & page_mask)) / sizeof(uint64_t);
+			} else if (list_idx == list_entries - 1 && len > emu->page_size) {
+				/* Last entry of a full list page chains to the next list page. */
+				prp_list = nvme_phys_to_virt(prp_list[list_idx]);
+				list_idx = 0;
+				list_entries = emu->page_size / sizeof(uint64_t);
+			}
+			if (prp_list == NULL) {
+				return -1;
+			}
+			prp = prp_list[list_idx++];
+		}
+
+		if (prp & page_mask) {
+			return -1;
+		}
+		chunk = nvme_min(len, emu->page_size);
+	}
+
+	return 0;
+}
+
+static void
+nvme_emu_identify_ctrlr(struct spdk_nvme_emu_ctrlr *emu, struct spdk_nvme_ctrlr_data *cdata)
+{
+	memset(cdata, 0, sizeof(*cdata));
+
+	memset(cdata->sn, ' ', sizeof(cdata->sn));
+	memcpy(cdata->sn, "EMU0000001", 10);
+	memset(cdata->mn, ' ', sizeof(cdata->mn));
+	memcpy(cdata->mn, "SPDK Emulated Controller", 24);
+	memset(cdata->fr, ' ', sizeof(cdata->fr));
+	memcpy(cdata->fr, "1.0", 3);
+
+	cdata->mdts = NVME_EMU_MDTS;
+	cdata->ver.raw = emu->regs->vs.raw;
+	cdata->aerl = 0;
+	cdata->sqes.min = 6;
+	cdata->sqes.max = 6;
+	cdata->cqes.min = 4;
+	cdata->cqes.max = 4;
+	cdata->nn = 1;
+	cdata->oncs.dsm = 1;
+	cdata->oncs.write_zeroes = 1;
+	cdata->vwc.present = 1;
+}
+
+static void
+nvme_emu_identify_ns(struct spdk_nvme_emu_ctrlr *emu, struct spdk_nvme_ns_data *nsdata)
+{
+	memset(nsdata, 0, sizeof(*nsdata));
+
+	nsdata->nsze = emu->opts.num_blocks;
+	nsdata->ncap = emu->opts.num_blocks;
+	nsdata->nuse = emu->opts.num_blocks;
+	nsdata->nlbaf = 0;
+	nsdata->flbas.format = 0;
+	nsdata->lbaf[0].lbads = nvme_u32log2(emu->opts.block_size);
+}
+
+static void
+nvme_emu_admin_identify(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			struct spdk_nvme_cpl *cpl)
+{
+	uint8_t payload[4096];
+
+	memset(payload, 0, sizeof(payload));
+
+	switch (cmd->cdw10 & 0xFF) {
+	case SPDK_NVME_IDENTIFY_CTRLR:
+		nvme_emu_identify_ctrlr(emu, (struct spdk_nvme_ctrlr_data *)payload);
+		break;
+	case SPDK_NVME_IDENTIFY_NS:
+		if (cmd->nsid != 1) {
+			nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC,
+					    SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+			return;
+		}
+		nvme_emu_identify_ns(emu, (struct spdk_nvme_ns_data *)payload);
+		break;
+	case SPDK_NVME_IDENTIFY_ACTIVE_NS_LIST:
+		if (cmd->nsid == 0) {
+			*(uint32_t *)payload = 1;
+		}
+		break;
+	default:
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	if (nvme_emu_prp_copy(emu, cmd, payload, sizeof(payload), true) != 0) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+	}
+}
+
+static void
+nvme_emu_admin_create_io_cq(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			    struct spdk_nvme_cpl *cpl)
+{
+	uint16_t qid = cmd->cdw10 & 0xFFFF;
+	uint32_t num_entries = (cmd->cdw10 >> 16) + 1;
+	struct nvme_emu_cq *cq;
+
+	if (qid == 0 || qid >= emu->num_queues || emu->cq[qid].valid) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_INVALID_QUEUE_IDENTIFIER);
+		return;
+	}
+
+	if (num_entries < 2 || num_entries > emu->opts.max_queue_entries) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_MAXIMUM_QUEUE_SIZE_EXCEEDED);
+		return;
+	}
+
+	/* CAP.CQR is set, so only physically contiguous queues are accepted. */
+	cq = &emu->cq[qid];
+	cq->cpls = nvme_phys_to_virt(cmd->dptr.prp.prp1);
+	if (!(cmd->cdw11 & 0x1) || cq->cpls == NULL) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	cq->num_entries = num_entries;
+	cq->tail = 0;
+	cq->phase = 1;
+	cq->valid = true;
+}
+
+static void
+nvme_emu_admin_create_io_sq(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			    struct spdk_nvme_cpl *cpl)
+{
+	uint16_t qid = cmd->cdw10 & 0xFFFF;
+	uint32_t num_entries = (cmd->cdw10 >> 16) + 1;
+	uint16_t cqid = cmd->cdw11 >> 16;
+	struct nvme_emu_sq *sq;
+
+	if (qid == 0 || qid >= emu->num_queues || emu->sq[qid].valid) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_INVALID_QUEUE_IDENTIFIER);
+		return;
+	}
+
+	if (cqid == 0 || cqid >= emu->num_queues || !emu->cq[cqid].valid) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_COMPLETION_QUEUE_INVALID);
+		return;
+	}
+
+	if (num_entries < 2 || num_entries > emu->opts.max_queue_entries) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_MAXIMUM_QUEUE_SIZE_EXCEEDED);
+		return;
+	}
+
+	sq = &emu->sq[qid];
+	sq->cmds = nvme_phys_to_virt(cmd->dptr.prp.prp1);
+	if (!(cmd->cdw11 & 0x1) || sq->cmds == NULL) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	sq->num_entries = num_entries;
+	sq->head = 0;
+	sq->cqid = cqid;
+	sq->valid = true;
+	/* The host restarts its tail at 0 for a newly created queue. */
+	emu->regs->doorbell[qid].sq_tdbl = 0;
+}
+
+static void
+nvme_emu_admin_delete_io_sq(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			    struct spdk_nvme_cpl *cpl)
+{
+	uint16_t qid = cmd->cdw10 & 0xFFFF;
+
+	if (qid == 0 || qid >= emu->num_queues || !emu->sq[qid].valid) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_INVALID_QUEUE_IDENTIFIER);
+		return;
+	}
+
+	memset(&emu->sq[qid], 0, sizeof(emu->sq[qid]));
+}
+
+static void
+nvme_emu_admin_delete_io_cq(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			    struct spdk_nvme_cpl *cpl)
+{
+	uint16_t qid = cmd->cdw10 & 0xFFFF;
+	uint32_t i;
+
+	if (qid == 0 || qid >= emu->num_queues || !emu->cq[qid].valid) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+				    SPDK_NVME_SC_INVALID_QUEUE_IDENTIFIER);
+		return;
+	}
+
+	for (i = 1; i < emu->num_queues; i++) {
+		if (emu->sq[i].valid && emu->sq[i].cqid == qid) {
+			nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+					    SPDK_NVME_SC_INVALID_QUEUE_DELETION);
+			return;
+		}
+	}
+
+	memset(&emu->cq[qid], 0, sizeof(emu->cq[qid]));
+	emu->regs->doorbell[qid].cq_hdbl = 0;
+}
+
+static void
+nvme_emu_admin_get_log_page(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			    struct spdk_nvme_cpl *cpl)
+{
+	uint8_t payload[4096];
+	uint32_t len = (((cmd->cdw10 >> 16) & 0xFFF) + 1) * sizeof(uint32_t);
+
+	switch (cmd->cdw10 & 0xFF) {
+	case SPDK_NVME_LOG_ERROR:
+	case SPDK_NVME_LOG_HEALTH_INFORMATION:
+	case SPDK_NVME_LOG_FIRMWARE_SLOT:
+		break;
+	default:
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_COMMAND_SPECIFIC, SPDK_NVME_SC_INVALID_LOG_PAGE);
+		return;
+	}
+
+	/* The emulated controller never logs errors and has no health data to report. */
+	memset(payload, 0, sizeof(payload));
+	len = nvme_min(len, sizeof(payload));
+	if (nvme_emu_prp_copy(emu, cmd, payload, len, true) != 0) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+	}
+}
+
+/*
+ * Returns false if the command must not be completed now.
+ */
+static bool
+nvme_emu_process_admin_cmd(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			   struct spdk_nvme_cpl *cpl)
+{
+	uint32_t nq = emu->num_queues - 1;
+
+	switch (cmd->opc) {
+	case SPDK_NVME_OPC_IDENTIFY:
+		nvme_emu_admin_identify(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_CREATE_IO_CQ:
+		nvme_emu_admin_create_io_cq(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_CREATE_IO_SQ:
+		nvme_emu_admin_create_io_sq(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_DELETE_IO_SQ:
+		nvme_emu_admin_delete_io_sq(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_DELETE_IO_CQ:
+		nvme_emu_admin_delete_io_cq(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_GET_LOG_PAGE:
+		nvme_emu_admin_get_log_page(emu, cmd, cpl);
+		break;
+	case SPDK_NVME_OPC_SET_FEATURES:
+	case SPDK_NVME_OPC_GET_FEATURES:
+		if ((cmd->cdw10 & 0xFF) == SPDK_NVME_FEAT_NUMBER_OF_QUEUES) {
+			/* Both counts are 0-based; the requested count is ignored. */
+			cpl->cdw0 = ((nq - 1) << 16) | (nq - 1);
+		}
+		break;
+	case SPDK_NVME_OPC_ASYNC_EVENT_REQUEST:
+		/* No asynchronous events are ever generated; hold the request. */
+		return false;
+	case SPDK_NVME_OPC_ABORT:
+		/* Commands are executed as soon as they are fetched, so nothing is aborted. */
+		cpl->cdw0 = 1;
+		break;
+	case SPDK_NVME_OPC_KEEP_ALIVE:
+		break;
+	default:
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_OPCODE);
+		break;
+	}
+
+	return true;
+}
+
+static void
+nvme_emu_process_io_cmd(struct spdk_nvme_emu_ctrlr *emu, const struct spdk_nvme_cmd *cmd,
+			struct spdk_nvme_cpl *cpl)
+{
+	uint64_t lba = ((uint64_t)cmd->cdw11 << 32) | cmd->cdw10;
+	uint32_t lba_count = (cmd->cdw12 & 0xFFFF) + 1;
+	uint8_t *data;
+	uint32_t len;
+
+	if (cmd->nsid != 1) {
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+		return;
+	}
+
+	switch (cmd->opc) {
+	case SPDK_NVME_OPC_READ:
+	case SPDK_NVME_OPC_WRITE:
+	case SPDK_NVME_OPC_WRITE_ZEROES:
+		if (lba >= emu->opts.num_blocks || lba_count > emu->opts.num_blocks - lba) {
+			nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+			return;
+		}
+		if (emu->data == NULL) {
+			return;
+		}
+
+		data = emu->data + lba * emu->opts.block_size;
+		len = lba_count * emu->opts.block_size;
+		if (cmd->opc == SPDK_NVME_OPC_WRITE_ZEROES) {
+			memset(data, 0, len);
+		} else if (nvme_emu_prp_copy(emu, cmd, data, len, cmd->opc == SPDK_NVME_OPC_READ) != 0) {
+			nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+		}
+		break;
+	case SPDK_NVME_OPC_FLUSH:
+	case SPDK_NVME_OPC_DATASET_MANAGEMENT:
+		break;
+	default:
+		nvme_emu_set_status(cpl, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_OPCODE);
+		break;
+	}
+}
+
+static void
+nvme_emu_process_sq(struct spdk_nvme_emu_ctrlr *emu, uint16_t qid)
+{
+	struct nvme_emu_sq *sq = &emu->sq[qid];
+	struct spdk_nvme_cmd cmd;
+	struct spdk_nvme_cpl cpl;
+	uint32_t tail;
+
+	tail = emu->regs->doorbell[qid].sq_tdbl;
+	if (tail == sq->head || tail >= sq->num_entries) {
+		return;
+	}
+
+	/* Do not read submission queue entries ahead of the doorbell. */
+	spdk_mb();
+
+	while (sq->head != tail && sq->valid) {
+		if (nvme_emu_cq_full(emu, sq->cqid)) {
+			break;
+		}
+
+		cmd = sq->cmds[sq->head];
+		if (++sq->head == sq->num_entries) {
+			sq->head = 0;
+		}
+
+		memset(&cpl, 0, sizeof(cpl));
+		if (qid == 0) {
+			if (!nvme_emu_process_admin_cmd(emu, &cmd, &cpl)) {
+				continue;
+			}
+		} else {
+			nvme_emu_process_io_cmd(emu, &cmd, &cpl);
+		}
+
+		cpl.sqhd = sq->head;
+		cpl.sqid = qid;
+		cpl.cid = cmd.cid;
+		nvme_emu_post_cpl(emu, sq->cqid, &cpl);
+	}
+}
+
+static void
+nvme_emu_enable(struct spdk_nvme_emu_ctrlr *emu, union spdk_nvme_cc_register cc)
+{
+	union spdk_nvme_aqa_register aqa;
+	union spdk_nvme_csts_register csts;
+
+	nvme_emu_reset_queues(emu);
+
+	aqa.raw = emu->regs->aqa.raw;
+	emu->sq[0].cmds = nvme_phys_to_virt(emu->regs->asq);
+	emu->sq[0].num_entries = aqa.bits.asqs + 1;
+	emu->cq[0].cpls = nvme_phys_to_virt(emu->regs->acq);
+	emu->cq[0].num_entries = aqa.bits.acqs + 1;
+
+	csts.raw = 0;
+	if (emu->sq[0].cmds == NULL || emu->cq[0].cpls == NULL ||
+	    emu->sq[0].num_entries < 2 || emu->cq[0].num_entries < 2) {
+		csts.bits.cfs = 1;
+		emu->regs->csts.raw = csts.raw;
+		return;
+	}
+
+	emu->sq[0].valid = true;
+	emu->cq[0].phase = 1;
+	emu->cq[0].valid = true;
+	emu->regs->doorbell[0].sq_tdbl = 0;
+	emu->regs->doorbell[0].cq_hdbl = 0;
+
+	emu->page_size = 1u << (12 + cc.bits.mps);
+	emu->enabled = true;
+	emu->shutdown = false;
+
+	csts.bits.rdy = 1;
+	emu->regs->csts.raw = csts.raw;
+}
+
+static void
+nvme_emu_process_cc(struct spdk_nvme_emu_ctrlr *emu)
+{
+	union spdk_nvme_cc_register cc;
+	union spdk_nvme_csts_register csts;
+
+	cc.raw = emu->regs->cc.raw;
+
+	if (cc.bits.en && !emu->enabled && !emu->shutdown) {
+		if (emu->regs->csts.bits.cfs == 0) {
+			nvme_emu_enable(emu, cc);
+		}
+	} else if (!cc.bits.en && (emu->enabled || emu->shutdown || emu->regs->csts.raw != 0)) {
+		nvme_emu_reset_queues(emu);
+		emu->enabled = false;
+		emu->shutdown = false;
+		emu->regs->csts.raw = 0;
+	}
+
+	if (cc.bits.shn != 0 && !emu->shutdown && emu->enabled) {
+		/* Nothing is cached, so shutdown processing completes immediately. */
+		emu->enabled = false;
+		emu->shutdown = true;
+		csts.raw = emu->regs->csts.raw;
+		csts.bits.shst = SPDK_NVME_SHST_COMPLETE;
+		emu->regs->csts.raw = csts.raw;
+	}
+}
+
+static void *
+nvme_emu_thread(void *arg)
+{
+	struct spdk_nvme_emu_ctrlr *emu = arg;
+	uint32_t i;
+
+	while (!emu->stop) {
+		nvme_emu_process_cc(emu);
+		if (!emu->enabled) {
+			usleep(100);
+			continue;
+		}
+
+		for (i = 0; i < emu->num_queues; i++) {
+			if (emu->sq[i].valid) {
+				nvme_emu_process_sq(emu, i);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void
+spdk_nvme_emu_opts_set_defaults(struct spdk_nvme_emu_opts *opts)
+{
+	opts->num_io_queues = NVME_EMU_DEFAULT_IO_QUEUES;
+	opts->max_queue_entries = NVME_EMU_DEFAULT_QUEUE_ENTRIES;
+	opts->num_blocks = NVME_EMU_DEFAULT_NUM_BLOCKS;
+	opts->block_size = NVME_EMU_DEFAULT_BLOCK_SIZE;
+	opts->store_data = false;
+}
+
+struct spdk_nvme_emu_ctrlr *
+spdk_nvme_emu_ctrlr_create(const struct spdk_nvme_emu_opts *opts)
+{
+	struct spdk_nvme_emu_ctrlr *emu;
+	union spdk_nvme_cap_register cap;
+	union spdk_nvme_vs_register vs;
+	size_t regs_size;
+	void *regs = NULL;
+
+	if (opts->num_io_queues == 0 || opts->num_io_queues > SPDK_NVME_MAX_IO_QUEUES ||
+	    opts->max_queue_entries < 2 || opts->max_queue_entries > 65536 ||
+	    opts->block_size < 512 || (opts->block_size & (opts->block_size - 1)) ||
+	    opts->num_blocks == 0) {
+		nvme_printf(NULL, "invalid emulated controller options\n");
+		return NULL;
+	}
+
+	emu = calloc(1, sizeof(*emu));
+	if (emu == NULL) {
+		return NULL;
+	}
+
+	emu->opts = *opts;
+	emu->num_queues = opts->num_io_queues + 1;
+	emu->page_size = PAGE_SIZE;
+
+	/* struct spdk_nvme_registers already includes the admin queue doorbells. */
+	regs_size = sizeof(struct spdk_nvme_registers) +
+		    opts->num_io_queues * sizeof(emu->regs->doorbell[0]);
+	emu->sq = calloc(emu->num_queues, sizeof(*emu->sq));
+	emu->cq = calloc(emu->num_queues, sizeof(*emu->cq));
+	if (emu->sq == NULL || emu->cq == NULL || posix_memalign(&regs, PAGE_SIZE, regs_size)) {
+		goto fail;
+	}
+	memset(regs, 0, regs_size);
+	emu->regs = regs;
+
+	if (opts->store_data) {
+		emu->data = calloc(opts->num_blocks, opts->block_size);
+		if (emu->data == NULL) {
+			nvme_printf(NULL, "could not allocate emulated namespace data\n");
+			goto fail;
+		}
+	}
+
+	cap.raw = 0;
+	cap.bits.mqes = opts->max_queue_entries - 1;
+	cap.bits.cqr = 1;
+	cap.bits.to = 1;
+	cap.bits.dstrd = 0;
+	cap.bits.css_nvm = 1;
+	cap.bits.mpsmin = 0;
+	cap.bits.mpsmax = 0;
+	emu->regs->cap.raw = cap.raw;
+
+	vs.raw = 0;
+	vs.bits.mjr = 1;
+	vs.bits.mnr = 2;
+	emu->regs->vs.raw = vs.raw;
+
+	if (pthread_create(&emu->thread, NULL, nvme_emu_thread, emu) != 0) {
+		nvme_printf(NULL, "could not start emulated controller thread\n");
+		goto fail;
+	}
+
+	pthread_mutex_lock(&g_spdk_nvme_driver->lock);
+	TAILQ_INSERT_TAIL(&g_nvme_emu_ctrlrs, emu, tailq);
+	pthread_mutex_unlock(&g_spdk_nvme_driver->lock);
+
+	return emu;
+
+fail:
+	free(emu->data);
+	free(regs);
+	free(emu->cq);
+	free(emu->sq);
+	free(emu);
+	return NULL;
+}
+
+void
+spdk_nvme_emu_ctrlr_destroy(struct spdk_nvme_emu_ctrlr *emu)
+{
+	if (emu == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_spdk_nvme_driver->lock);
+	TAILQ_REMOVE(&g_nvme_emu_ctrlrs, emu, tailq);
+	pthread_mutex_unlock(&g_spdk_nvme_driver->lock);
+
+	emu->stop = true;
+	pthread_join(emu->thread, NULL);
+
+	free(emu->data);
+	free((void *)emu->regs);
+	free(emu->cq);
+	free(emu->sq);
+	free(emu);
+}
+
+/* This function must only be called while holding g_spdk_nvme_driver->lock */
+int
+nvme_emu_enumerate(int (*enum_cb)(void *enum_ctx, struct spdk_nvme_emu_ctrlr *emu), void *enum_ctx)
+{
+	struct spdk_nvme_emu_ctrlr *emu;
+	int rc = 0;
+
+	TAILQ_FOREACH(emu, &g_nvme_emu_ctrlrs, tailq) {
+		if (enum_cb(enum_ctx, emu) != 0) {
+			rc = -1;
+		}
+	}
+
+	return rc;
+}
+
+volatile struct spdk_nvme_registers *
+nvme_emu_ctrlr_get_regs(struct spdk_nvme_emu_ctrlr *emu)
+{
+	return emu->regs;
+}
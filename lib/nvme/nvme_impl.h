@@ -55,6 +55,7 @@
 #include <rte_config.h>
 #include <rte_cycles.h>
 #include <rte_malloc.h>
+#include <rte_memory.h>
 #include <rte_mempool.h>
 #include <rte_version.h>
 #include <rte_memzone.h>
@@ -173,6 +174,27 @@ nvme_process_is_primary(void)
 #define nvme_vtophys(buf)		spdk_vtophys(buf)
 #define NVME_VTOPHYS_ERROR		SPDK_VTOPHYS_ERROR
 
+/**
+ * Return the virtual address for the specified physical address, or NULL if it
+ *  does not belong to any of the pinned memory segments.  This is only used by
+ *  the software-emulated controller to access host queues and data buffers.
+ */
+static inline void *
+nvme_phys_to_virt(uint64_t phys_addr)
+{
+	const struct rte_memseg *seg = rte_eal_get_physmem_layout();
+	unsigned i;
+
+	for (i = 0; i < RTE_MAX_MEMSEG && seg[i].addr != NULL; i++) {
+		if (phys_addr >= seg[i].phys_addr &&
+		    phys_addr - seg[i].phys_addr < seg[i].len) {
+			return (uint8_t *)seg[i].addr + (phys_addr - seg[i].phys_addr);
+		}
+	}
+
+	return NULL;
+}
+
 extern struct rte_mempool *request_mempool;
 
 /**
@@ -319,6 +319,13 @@ struct spdk_nvme_qpair {
 	bool				is_enabled;
 	bool				sq_in_cmb;
 
+	/*
+	 * If batch_doorbell is set, submissions only advance sq_tail and the SQ tail
+	 *  doorbell is written by nvme_qpair_ring_sq_doorbell() once per batch.
+	 */
+	bool				batch_doorbell;
+	bool				sq_doorbell_pending;
+
 	/*
 	 * Fields below this point should not be touched on the normal I/O happy path.
 	 */
@@ -418,6 +425,9 @@ struct spdk_nvme_ctrlr {
 	/* Opaque handle to associated PCI device. */
 	struct spdk_pci_device		*devhandle;
 
+	/* Software-emulated controller backing this ctrlr (NULL for PCI devices). */
+	struct spdk_nvme_emu_ctrlr	*emu;
+
 	/** maximum i/o size in bytes */
 	uint32_t			max_xfer_size;
 
@@ -597,4 +607,8 @@ void	spdk_nvme_ctrlr_opts_set_defaults(struct spdk_nvme_ctrlr_opts *opts);
 
 int	nvme_mutex_init_shared(pthread_mutex_t *mtx);
 
+int	nvme_emu_enumerate(int (*enum_cb)(void *enum_ctx, struct spdk_nvme_emu_ctrlr *emu),
+			   void *enum_ctx);
+volatile struct spdk_nvme_registers *nvme_emu_ctrlr_get_regs(struct spdk_nvme_emu_ctrlr *emu);
+
 #endif /* __NVME_INTERNAL_H__ */
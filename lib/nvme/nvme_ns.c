@@ -174,7 +174,7 @@ spdk_nvme_ns_get_data(struct spdk_nvme_ns *ns)
 int nvme_ns_construct(struct spdk_nvme_ns *ns, uint16_t id,
 		      struct spdk_nvme_ctrlr *ctrlr)
 {
-	uint32_t				pci_devid;
+	uint32_t				pci_devid = 0;
 
 	assert(id > 0);
 
@@ -182,7 +182,9 @@ int nvme_ns_construct(struct spdk_nvme_ns *ns, uint16_t id,
 	ns->id = id;
 	ns->stripe_size = 0;
 
-	nvme_pcicfg_read32(ctrlr->devhandle, &pci_devid, 0);
+	if (ctrlr->emu == NULL) {
+		nvme_pcicfg_read32(ctrlr->devhandle, &pci_devid, 0);
+	}
 	if (pci_devid == INTEL_DC_P3X00_DEVID && ctrlr->cdata.vs[3] != 0) {
 		ns->stripe_size = (1 << ctrlr->cdata.vs[3]) * ctrlr->min_page_size;
 	}
@@ -341,6 +341,14 @@ nvme_copy_command(struct spdk_nvme_cmd *dst, const struct spdk_nvme_cmd *src)
 #endif
 }
 
+static inline void
+nvme_qpair_ring_sq_doorbell(struct spdk_nvme_qpair *qpair)
+{
+	spdk_wmb();
+	spdk_mmio_write_4(qpair->sq_tdbl, qpair->sq_tail);
+	qpair->sq_doorbell_pending = false;
+}
+
 static void
 nvme_qpair_submit_tracker(struct spdk_nvme_qpair *qpair, struct nvme_tracker *tr)
 {
@@ -356,8 +364,11 @@ nvme_qpair_submit_tracker(struct spdk_nvme_qpair *qpair, struct nvme_tracker *tr
 		qpair->sq_tail = 0;
 	}
 
-	spdk_wmb();
-	spdk_mmio_write_4(qpair->sq_tdbl, qpair->sq_tail);
+	if (qpair->batch_doorbell) {
+		qpair->sq_doorbell_pending = true;
+	} else {
+		nvme_qpair_ring_sq_doorbell(qpair);
+	}
 }
 
 static void
@@ -482,6 +493,11 @@ spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair, uint32_t max_
 		return 0;
 	}
 
+	/* Hand any staged submissions to the controller before looking for completions. */
+	if (qpair->sq_doorbell_pending) {
+		nvme_qpair_ring_sq_doorbell(qpair);
+	}
+
 	if (max_completions == 0 || (max_completions > (qpair->num_entries - 1U))) {
 
 		/*
@@ -523,9 +539,40 @@ spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair, uint32_t max_
 		spdk_mmio_write_4(qpair->cq_hdbl, qpair->cq_head);
 	}
 
+	/*
+	 * Retries and requests resubmitted from completion callbacks were only
+	 *  staged; ring the SQ doorbell once for all of them.
+	 */
+	if (qpair->sq_doorbell_pending) {
+		nvme_qpair_ring_sq_doorbell(qpair);
+	}
+
 	return num_completions;
 }
 
+int
+spdk_nvme_qpair_set_batch_doorbell(struct spdk_nvme_qpair *qpair, bool enable)
+{
+	if (nvme_qpair_is_admin_queue(qpair)) {
+		return -EINVAL;
+	}
+
+	if (!enable && qpair->sq_doorbell_pending) {
+		nvme_qpair_ring_sq_doorbell(qpair);
+	}
+	qpair->batch_doorbell = enable;
+
+	return 0;
+}
+
+void
+spdk_nvme_qpair_flush(struct spdk_nvme_qpair *qpair)
+{
+	if (qpair->sq_doorbell_pending && nvme_qpair_check_enabled(qpair)) {
+		nvme_qpair_ring_sq_doorbell(qpair);
+	}
+}
+
 int
 nvme_qpair_construct(struct spdk_nvme_qpair *qpair, uint16_t id,
 		     uint16_t num_entries, uint16_t num_trackers,
@@ -971,6 +1018,7 @@ void
 nvme_qpair_reset(struct spdk_nvme_qpair *qpair)
 {
 	qpair->sq_tail = qpair->cq_head = 0;
+	qpair->sq_doorbell_pending = false;
 
 	/*
 	 * First time through the completion queue, HW will set phase
@@ -0,0 +1,1404 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_malloc.h>
+
+#include "nvmf_internal.h"
+#include "request.h"
+#include "session.h"
+#include "subsystem.h"
+#include "transport.h"
+#include "spdk/assert.h"
+#include "spdk/log.h"
+#include "spdk/net.h"
+#include "spdk/nvmf_spec.h"
+#include "spdk/string.h"
+#include "spdk/trace.h"
+
+/* Size of the per-connection staging buffer that incoming PDU headers and
+ * small payloads are read through. Payloads at least this large are
+ * received directly into their destination buffer.
+ */
+#define NVMF_TCP_RECV_BUF_SIZE		8192
+
+/* Maximum number of iovecs handed to a single writev() call */
+#define NVMF_TCP_MAX_WRITEV_IOVCNT	32
+
+#define NVMF_TCP_PDU_MAX_HDR_LEN	128
+
+union nvmf_tcp_pdu_hdr {
+	struct spdk_nvme_tcp_common_pdu_hdr	common;
+	struct spdk_nvme_tcp_ic_req		ic_req;
+	struct spdk_nvme_tcp_ic_resp		ic_resp;
+	struct spdk_nvme_tcp_term_req_hdr	term_req;
+	struct spdk_nvme_tcp_cmd		capsule_cmd;
+	struct spdk_nvme_tcp_rsp		capsule_resp;
+	struct spdk_nvme_tcp_h2c_data_hdr	h2c_data;
+	struct spdk_nvme_tcp_c2h_data_hdr	c2h_data;
+	struct spdk_nvme_tcp_r2t_hdr		r2t;
+	uint8_t					raw[NVMF_TCP_PDU_MAX_HDR_LEN];
+};
+
+struct spdk_nvmf_tcp_request;
+
+/* An outgoing PDU: a header followed by an optional payload */
+struct spdk_nvmf_tcp_pdu {
+	union nvmf_tcp_pdu_hdr			hdr;
+
+	void					*data;
+	uint32_t				data_len;
+
+	/* Number of bytes of header and payload already written to the socket */
+	uint32_t				writev_offset;
+
+	/* Request to release once this PDU has been completely sent */
+	struct spdk_nvmf_tcp_request		*release_req;
+
+	TAILQ_ENTRY(spdk_nvmf_tcp_pdu)		link;
+};
+
+struct spdk_nvmf_tcp_buf {
+	SLIST_ENTRY(spdk_nvmf_tcp_buf) link;
+};
+
+struct spdk_nvmf_tcp_request {
+	struct spdk_nvmf_request		req;
+
+	/* Copy of the command from the capsule */
+	union nvmf_h2c_msg			cmd;
+
+	/* In Capsule data buffer */
+	uint8_t					*buf;
+
+	/* True if req.data was taken from the session's large buffer pool */
+	bool					data_from_pool;
+
+	/* True while waiting for H2CData PDUs solicited by an R2T */
+	bool					h2c_pending;
+
+	/* Number of bytes of host to controller data received so far */
+	uint32_t				h2c_offset;
+
+	/* R2T or C2HData PDU */
+	struct spdk_nvmf_tcp_pdu		data_pdu;
+
+	/* Response capsule. req.rsp points into this PDU's header. */
+	struct spdk_nvmf_tcp_pdu		rsp_pdu;
+
+	TAILQ_ENTRY(spdk_nvmf_tcp_request)	link;
+};
+
+enum nvmf_tcp_recv_state {
+	/* Waiting for the 8 byte common header of the next PDU */
+	NVMF_TCP_RECV_STATE_AWAIT_PDU_CH,
+
+	/* Waiting for the rest of the PDU header */
+	NVMF_TCP_RECV_STATE_AWAIT_PDU_PSH,
+
+	/* Waiting for the PDU payload */
+	NVMF_TCP_RECV_STATE_AWAIT_PDU_PAYLOAD,
+};
+
+struct spdk_nvmf_tcp_conn {
+	struct spdk_nvmf_conn			conn;
+
+	int					sock;
+
+	/* Set once the ICReq/ICResp exchange has taken place */
+	bool					ic_done;
+
+	/* The maximum number of I/O outstanding on this connection at one time */
+	uint16_t				max_queue_depth;
+
+	/* The current number of I/O outstanding on this connection. This number
+	 * includes all I/O from the time the capsule is first received until the
+	 * response has been sent.
+	 */
+	uint16_t				cur_queue_depth;
+
+	/* Array of size "max_queue_depth" containing TCP requests. */
+	struct spdk_nvmf_tcp_request		*reqs;
+
+	/* Array of size "max_queue_depth * InCapsuleDataSize" containing
+	 * buffers to be used for in capsule data.
+	 */
+	uint8_t					*bufs;
+
+	TAILQ_HEAD(, spdk_nvmf_tcp_request)	free_queue;
+
+	/* Requests that are waiting to obtain a data buffer */
+	TAILQ_HEAD(, spdk_nvmf_tcp_request)	pending_data_buf_queue;
+
+	/* PDUs waiting to be written to the socket */
+	TAILQ_HEAD(, spdk_nvmf_tcp_pdu)		send_queue;
+
+	struct spdk_nvmf_tcp_pdu		ic_resp_pdu;
+
+	/* Receive state for the PDU currently being read */
+	enum nvmf_tcp_recv_state		recv_state;
+	union nvmf_tcp_pdu_hdr			recv_hdr;
+	uint32_t				recv_hdr_offset;
+	uint8_t					*recv_payload;
+	uint32_t				recv_payload_len;
+	uint32_t				recv_payload_offset;
+	struct spdk_nvmf_tcp_request		*recv_req;
+
+	uint32_t				recv_buf_offset;
+	uint32_t				recv_buf_len;
+	uint8_t					recv_buf[NVMF_TCP_RECV_BUF_SIZE];
+
+	TAILQ_ENTRY(spdk_nvmf_tcp_conn)		link;
+
+	/* Link in the list of connections whose CONNECT failed */
+	TAILQ_ENTRY(spdk_nvmf_tcp_conn)		close_link;
+};
+
+/* List of TCP connections that have not yet received a CONNECT capsule */
+static TAILQ_HEAD(, spdk_nvmf_tcp_conn) g_pending_conns = TAILQ_HEAD_INITIALIZER(g_pending_conns);
+
+struct spdk_nvmf_tcp_session {
+	SLIST_HEAD(, spdk_nvmf_tcp_buf)		data_buf_pool;
+
+	uint8_t					*buf;
+};
+
+struct spdk_nvmf_tcp_listen_addr {
+	char					*traddr;
+	char					*trsvcid;
+	int					sock;
+	TAILQ_ENTRY(spdk_nvmf_tcp_listen_addr)	link;
+};
+
+struct spdk_nvmf_tcp {
+	uint16_t max_queue_depth;
+	uint32_t max_io_size;
+	uint32_t in_capsule_data_size;
+
+	pthread_mutex_t lock;
+	TAILQ_HEAD(, spdk_nvmf_tcp_listen_addr)	listen_addrs;
+
+	/* Connections whose CONNECT was rejected. The response is sent from
+	 * the subsystem's core, after which the acceptor closes them. */
+	TAILQ_HEAD(, spdk_nvmf_tcp_conn)	closing_conns;
+};
+
+static struct spdk_nvmf_tcp g_tcp = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.listen_addrs = TAILQ_HEAD_INITIALIZER(g_tcp.listen_addrs),
+	.closing_conns = TAILQ_HEAD_INITIALIZER(g_tcp.closing_conns),
+};
+
+static inline struct spdk_nvmf_tcp_conn *
+get_tcp_conn(struct spdk_nvmf_conn *conn)
+{
+	return (struct spdk_nvmf_tcp_conn *)((uintptr_t)conn - offsetof(struct spdk_nvmf_tcp_conn, conn));
+}
+
+static inline struct spdk_nvmf_tcp_request *
+get_tcp_req(struct spdk_nvmf_request *req)
+{
+	return (struct spdk_nvmf_tcp_request *)((uintptr_t)req - offsetof(struct spdk_nvmf_tcp_request,
+			req));
+}
+
+static void
+spdk_nvmf_tcp_conn_destroy(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	if (tcp_conn->sock >= 0) {
+		spdk_sock_close(tcp_conn->sock);
+	}
+
+	rte_free(tcp_conn->bufs);
+	free(tcp_conn->reqs);
+	free(tcp_conn);
+}
+
+static struct spdk_nvmf_tcp_conn *
+spdk_nvmf_tcp_conn_create(int sock, uint16_t max_queue_depth)
+{
+	struct spdk_nvmf_tcp_conn	*tcp_conn;
+	struct spdk_nvmf_tcp_request	*tcp_req;
+	int				i;
+
+	tcp_conn = calloc(1, sizeof(struct spdk_nvmf_tcp_conn));
+	if (tcp_conn == NULL) {
+		SPDK_ERRLOG("Could not allocate new connection.\n");
+		return NULL;
+	}
+
+	tcp_conn->sock = sock;
+	tcp_conn->max_queue_depth = max_queue_depth;
+	tcp_conn->recv_state = NVMF_TCP_RECV_STATE_AWAIT_PDU_CH;
+	TAILQ_INIT(&tcp_conn->free_queue);
+	TAILQ_INIT(&tcp_conn->pending_data_buf_queue);
+	TAILQ_INIT(&tcp_conn->send_queue);
+
+	tcp_conn->reqs = calloc(max_queue_depth, sizeof(*tcp_conn->reqs));
+	tcp_conn->bufs = rte_calloc("nvmf_tcp_in_capsule_bufs", max_queue_depth,
+				    g_tcp.in_capsule_data_size, 0x1000);
+	if (!tcp_conn->reqs || !tcp_conn->bufs) {
+		SPDK_ERRLOG("Unable to allocate sufficient memory for TCP queue.\n");
+		tcp_conn->sock = -1;
+		spdk_nvmf_tcp_conn_destroy(tcp_conn);
+		return NULL;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_TCP, "In Capsule Data Array: %p (%d x %u)\n",
+		      tcp_conn->bufs, max_queue_depth, g_tcp.in_capsule_data_size);
+
+	for (i = 0; i < max_queue_depth; i++) {
+		tcp_req = &tcp_conn->reqs[i];
+		tcp_req->buf = (void *)((uintptr_t)tcp_conn->bufs + (i * g_tcp.in_capsule_data_size));
+		tcp_req->req.conn = &tcp_conn->conn;
+		tcp_req->req.cmd = &tcp_req->cmd;
+		tcp_req->req.rsp = (union nvmf_c2h_msg *)&tcp_req->rsp_pdu.hdr.capsule_resp.rccqe;
+		TAILQ_INSERT_TAIL(&tcp_conn->free_queue, tcp_req, link);
+	}
+
+	tcp_conn->conn.transport = &spdk_nvmf_transport_tcp;
+
+	return tcp_conn;
+}
+
+static void
+spdk_nvmf_tcp_pdu_init(struct spdk_nvmf_tcp_pdu *pdu, enum spdk_nvme_tcp_pdu_type type,
+		       uint32_t hlen, void *data, uint32_t data_len)
+{
+	pdu->hdr.common.pdu_type = type;
+	pdu->hdr.common.flags = 0;
+	pdu->hdr.common.hlen = hlen;
+	pdu->hdr.common.pdo = data_len ? hlen : 0;
+	pdu->hdr.common.plen = hlen + data_len;
+	pdu->data = data;
+	pdu->data_len = data_len;
+	pdu->writev_offset = 0;
+	pdu->release_req = NULL;
+}
+
+static void
+spdk_nvmf_tcp_request_free(struct spdk_nvmf_tcp_request *tcp_req)
+{
+	struct spdk_nvmf_conn		*conn = tcp_req->req.conn;
+	struct spdk_nvmf_tcp_conn	*tcp_conn = get_tcp_conn(conn);
+	struct spdk_nvmf_tcp_session	*tcp_sess;
+	struct spdk_nvmf_tcp_buf	*buf;
+
+	if (tcp_req->data_from_pool) {
+		/* Put the buffer back in the pool */
+		tcp_sess = conn->sess->trctx;
+		buf = tcp_req->req.data;
+
+		SLIST_INSERT_HEAD(&tcp_sess->data_buf_pool, buf, link);
+		tcp_req->data_from_pool = false;
+	}
+	tcp_req->req.data = NULL;
+	tcp_req->req.length = 0;
+
+	assert(tcp_conn->cur_queue_depth > 0);
+	tcp_conn->cur_queue_depth--;
+	TAILQ_INSERT_HEAD(&tcp_conn->free_queue, tcp_req, link);
+}
+
+static int
+spdk_nvmf_tcp_pdu_build_iovs(struct spdk_nvmf_tcp_pdu *pdu, struct iovec *iovs)
+{
+	uint32_t hlen = pdu->hdr.common.hlen;
+	int iovcnt = 0;
+
+	if (pdu->writev_offset < hlen) {
+		iovs[iovcnt].iov_base = &pdu->hdr.raw[pdu->writev_offset];
+		iovs[iovcnt].iov_len = hlen - pdu->writev_offset;
+		iovcnt++;
+		if (pdu->data_len) {
+			iovs[iovcnt].iov_base = pdu->data;
+			iovs[iovcnt].iov_len = pdu->data_len;
+			iovcnt++;
+		}
+	} else {
+		iovs[iovcnt].iov_base = (uint8_t *)pdu->data + (pdu->writev_offset - hlen);
+		iovs[iovcnt].iov_len = pdu->data_len - (pdu->writev_offset - hlen);
+		iovcnt++;
+	}
+
+	return iovcnt;
+}
+
+/* Write as much of the send queue to the socket as it will accept,
+ * gathering several PDUs into each writev() call.
+ */
+static int
+spdk_nvmf_tcp_conn_flush(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct iovec			iovs[NVMF_TCP_MAX_WRITEV_IOVCNT];
+	struct spdk_nvmf_tcp_pdu	*pdu;
+	int				iovcnt;
+	size_t				total, remaining;
+	ssize_t				rc;
+	int				i;
+
+	while (!TAILQ_EMPTY(&tcp_conn->send_queue)) {
+		iovcnt = 0;
+		TAILQ_FOREACH(pdu, &tcp_conn->send_queue, link) {
+			if (iovcnt + 2 > NVMF_TCP_MAX_WRITEV_IOVCNT) {
+				break;
+			}
+			iovcnt += spdk_nvmf_tcp_pdu_build_iovs(pdu, &iovs[iovcnt]);
+		}
+
+		total = 0;
+		for (i = 0; i < iovcnt; i++) {
+			total += iovs[i].iov_len;
+		}
+
+		rc = spdk_sock_writev(tcp_conn->sock, iovs, iovcnt);
+		if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return 0;
+			}
+			SPDK_ERRLOG("writev() failed on connection %p: %s\n",
+				    &tcp_conn->conn, strerror(errno));
+			return -1;
+		}
+
+		/* Retire the PDUs that were completely sent */
+		remaining = rc;
+		while (remaining > 0) {
+			pdu = TAILQ_FIRST(&tcp_conn->send_queue);
+			assert(pdu != NULL);
+			if (remaining < pdu->hdr.common.plen - pdu->writev_offset) {
+				pdu->writev_offset += remaining;
+				break;
+			}
+			remaining -= pdu->hdr.common.plen - pdu->writev_offset;
+			TAILQ_REMOVE(&tcp_conn->send_queue, pdu, link);
+			if (pdu->release_req) {
+				spdk_nvmf_tcp_request_free(pdu->release_req);
+			}
+		}
+
+		if ((size_t)rc < total) {
+			/* The socket buffer is full */
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+static void
+spdk_nvmf_tcp_conn_queue_pdu(struct spdk_nvmf_tcp_conn *tcp_conn, struct spdk_nvmf_tcp_pdu *pdu)
+{
+	TAILQ_INSERT_TAIL(&tcp_conn->send_queue, pdu, link);
+}
+
+static void
+spdk_nvmf_tcp_send_r2t(struct spdk_nvmf_tcp_conn *tcp_conn, struct spdk_nvmf_tcp_request *tcp_req)
+{
+	struct spdk_nvmf_tcp_pdu	*pdu = &tcp_req->data_pdu;
+	struct spdk_nvme_tcp_r2t_hdr	*r2t = &pdu->hdr.r2t;
+
+	spdk_nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_R2T, sizeof(*r2t), NULL, 0);
+	r2t->cccid = tcp_req->cmd.nvme_cmd.cid;
+	r2t->ttag = tcp_req - tcp_conn->reqs;
+	r2t->r2to = 0;
+	r2t->r2tl = tcp_req->req.length;
+	memset(r2t->reserved20, 0, sizeof(r2t->reserved20));
+
+	tcp_req->h2c_offset = 0;
+	tcp_req->h2c_pending = true;
+
+	SPDK_TRACELOG(SPDK_TRACE_TCP, "R2T for request %p: ttag %u length 0x%x\n",
+		      &tcp_req->req, r2t->ttag, r2t->r2tl);
+	spdk_nvmf_tcp_conn_queue_pdu(tcp_conn, pdu);
+}
+
+/*
+
+The following functions are used to complete a request. A request is
+finished once its response capsule has been completely written to the
+socket, at which point its buffers are returned and it is put back on
+the connection's free list.
+
+*/
+
+static int
+spdk_nvmf_tcp_request_complete(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_tcp_request	*tcp_req = get_tcp_req(req);
+	struct spdk_nvmf_conn		*conn = req->conn;
+	struct spdk_nvmf_tcp_conn	*tcp_conn = get_tcp_conn(conn);
+	struct spdk_nvme_cpl		*rsp = &req->rsp->nvme_cpl;
+	struct spdk_nvmf_tcp_pdu	*pdu;
+	struct spdk_nvme_tcp_c2h_data_hdr *c2h;
+
+	/* Advance our sq_head pointer */
+	if (conn->sq_head == conn->sq_head_max) {
+		conn->sq_head = 0;
+	} else {
+		conn->sq_head++;
+	}
+	rsp->sqhd = conn->sq_head;
+
+	if (rsp->status.sc == SPDK_NVME_SC_SUCCESS &&
+	    req->xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST && req->length > 0) {
+		pdu = &tcp_req->data_pdu;
+		c2h = &pdu->hdr.c2h_data;
+		spdk_nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_C2H_DATA, sizeof(*c2h),
+				       req->data, req->length);
+		pdu->hdr.common.flags = SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU;
+		c2h->cccid = tcp_req->cmd.nvme_cmd.cid;
+		memset(c2h->reserved10, 0, sizeof(c2h->reserved10));
+		c2h->datao = 0;
+		c2h->datal = req->length;
+		memset(c2h->reserved20, 0, sizeof(c2h->reserved20));
+		spdk_nvmf_tcp_conn_queue_pdu(tcp_conn, pdu);
+	}
+
+	/* The completion queue entry is already in place in the response PDU */
+	pdu = &tcp_req->rsp_pdu;
+	spdk_nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_CAPSULE_RESP,
+			       sizeof(struct spdk_nvme_tcp_rsp), NULL, 0);
+	pdu->release_req = tcp_req;
+	spdk_nvmf_tcp_conn_queue_pdu(tcp_conn, pdu);
+
+	if (conn->sess == NULL) {
+		/* The CONNECT was rejected, so no session will ever poll this
+		 * connection. Send the response now and let the acceptor close it. */
+		spdk_nvmf_tcp_conn_flush(tcp_conn);
+		pthread_mutex_lock(&g_tcp.lock);
+		TAILQ_INSERT_TAIL(&g_tcp.closing_conns, tcp_conn, close_link);
+		pthread_mutex_unlock(&g_tcp.lock);
+	}
+
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_request_release(struct spdk_nvmf_request *req)
+{
+	struct spdk_nvmf_conn *conn = req->conn;
+
+	/* Advance our sq_head pointer */
+	if (conn->sq_head == conn->sq_head_max) {
+		conn->sq_head = 0;
+	} else {
+		conn->sq_head++;
+	}
+
+	spdk_nvmf_tcp_request_free(get_tcp_req(req));
+
+	return 0;
+}
+
+typedef enum _spdk_nvmf_request_prep_type {
+	SPDK_NVMF_REQUEST_PREP_ERROR = -1,
+	SPDK_NVMF_REQUEST_PREP_READY = 0,
+	SPDK_NVMF_REQUEST_PREP_PENDING_BUFFER = 1,
+	SPDK_NVMF_REQUEST_PREP_PENDING_DATA = 2,
+} spdk_nvmf_request_prep_type;
+
+static spdk_nvmf_request_prep_type
+spdk_nvmf_tcp_request_prep_data(struct spdk_nvmf_request *req, uint32_t in_capsule_len)
+{
+	struct spdk_nvme_cmd		*cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl		*rsp = &req->rsp->nvme_cpl;
+	struct spdk_nvmf_tcp_request	*tcp_req = get_tcp_req(req);
+	struct spdk_nvmf_tcp_session	*tcp_sess;
+	struct spdk_nvme_sgl_descriptor *sgl;
+
+	req->length = 0;
+	req->data = NULL;
+
+	if (cmd->opc == SPDK_NVME_OPC_FABRIC) {
+		req->xfer = spdk_nvme_opc_get_data_transfer(req->cmd->nvmf_cmd.fctype);
+	} else {
+		req->xfer = spdk_nvme_opc_get_data_transfer(cmd->opc);
+	}
+
+	if (req->xfer == SPDK_NVME_DATA_NONE) {
+		return SPDK_NVMF_REQUEST_PREP_READY;
+	}
+
+	sgl = &cmd->dptr.sgl1;
+
+	if (sgl->generic.type == SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK &&
+	    sgl->unkeyed.subtype == SPDK_NVME_SGL_SUBTYPE_TRANSPORT) {
+		if (sgl->unkeyed.length > g_tcp.max_io_size) {
+			SPDK_ERRLOG("SGL length 0x%x exceeds max io size 0x%x\n",
+				    sgl->unkeyed.length, g_tcp.max_io_size);
+			rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+			return SPDK_NVMF_REQUEST_PREP_ERROR;
+		}
+
+		if (sgl->unkeyed.length == 0) {
+			req->xfer = SPDK_NVME_DATA_NONE;
+			return SPDK_NVMF_REQUEST_PREP_READY;
+		}
+
+		req->length = sgl->unkeyed.length;
+
+		if (sgl->unkeyed.length > g_tcp.in_capsule_data_size) {
+			if (req->conn->sess == NULL) {
+				SPDK_ERRLOG("SGL length 0x%x exceeds capsule length 0x%x before CONNECT\n",
+					    sgl->unkeyed.length, g_tcp.in_capsule_data_size);
+				rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+				return SPDK_NVMF_REQUEST_PREP_ERROR;
+			}
+
+			tcp_sess = req->conn->sess->trctx;
+			req->data = SLIST_FIRST(&tcp_sess->data_buf_pool);
+			if (!req->data) {
+				/* No available buffers. Queue this request up. */
+				SPDK_TRACELOG(SPDK_TRACE_TCP, "No available large data buffers. Queueing request %p\n", req);
+				return SPDK_NVMF_REQUEST_PREP_PENDING_BUFFER;
+			}
+
+			SPDK_TRACELOG(SPDK_TRACE_TCP, "Request %p took buffer from central pool\n", req);
+			SLIST_REMOVE_HEAD(&tcp_sess->data_buf_pool, link);
+			tcp_req->data_from_pool = true;
+		} else {
+			/* Use the in capsule data buffer, even though this isn't in capsule data */
+			SPDK_TRACELOG(SPDK_TRACE_TCP, "Request using in capsule buffer for non-capsule data\n");
+			req->data = tcp_req->buf;
+		}
+		if (req->xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
+			return SPDK_NVMF_REQUEST_PREP_PENDING_DATA;
+		} else {
+			return SPDK_NVMF_REQUEST_PREP_READY;
+		}
+	} else if (sgl->generic.type == SPDK_NVME_SGL_TYPE_DATA_BLOCK &&
+		   sgl->unkeyed.subtype == SPDK_NVME_SGL_SUBTYPE_OFFSET) {
+		uint64_t offset = sgl->address;
+		uint32_t max_len = in_capsule_len;
+
+		SPDK_TRACELOG(SPDK_TRACE_NVMF, "In-capsule data: offset 0x%" PRIx64 ", length 0x%x\n",
+			      offset, sgl->unkeyed.length);
+
+		if (offset > max_len) {
+			SPDK_ERRLOG("In-capsule offset 0x%" PRIx64 " exceeds capsule length 0x%x\n",
+				    offset, max_len);
+			rsp->status.sc = SPDK_NVME_SC_INVALID_SGL_OFFSET;
+			return SPDK_NVMF_REQUEST_PREP_ERROR;
+		}
+		max_len -= (uint32_t)offset;
+
+		if (sgl->unkeyed.length > max_len) {
+			SPDK_ERRLOG("In-capsule data length 0x%x exceeds capsule length 0x%x\n",
+				    sgl->unkeyed.length, max_len);
+			rsp->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+			return SPDK_NVMF_REQUEST_PREP_ERROR;
+		}
+
+		if (sgl->unkeyed.length == 0) {
+			req->xfer = SPDK_NVME_DATA_NONE;
+			return SPDK_NVMF_REQUEST_PREP_READY;
+		}
+
+		req->data = tcp_req->buf + offset;
+		req->length = sgl->unkeyed.length;
+		return SPDK_NVMF_REQUEST_PREP_READY;
+	}
+
+	SPDK_ERRLOG("Invalid NVMf I/O Command SGL:  Type 0x%x, Subtype 0x%x\n",
+		    sgl->generic.type, sgl->generic.subtype);
+	rsp->status.sc = SPDK_NVME_SC_SGL_DESCRIPTOR_TYPE_INVALID;
+	return SPDK_NVMF_REQUEST_PREP_ERROR;
+}
+
+/* Returns the number of times that spdk_nvmf_request_exec was called,
+ * or -1 on error.
+ */
+static int
+spdk_nvmf_tcp_capsule_handle(struct spdk_nvmf_tcp_conn *tcp_conn,
+			     struct spdk_nvmf_tcp_request *tcp_req, uint32_t in_capsule_len)
+{
+	struct spdk_nvmf_request *req = &tcp_req->req;
+	int rc;
+
+	switch (spdk_nvmf_tcp_request_prep_data(req, in_capsule_len)) {
+	case SPDK_NVMF_REQUEST_PREP_READY:
+		SPDK_TRACELOG(SPDK_TRACE_TCP, "Request %p is ready for execution\n", req);
+		rc = spdk_nvmf_request_exec(req);
+		if (rc < 0) {
+			return -1;
+		}
+		return 1;
+	case SPDK_NVMF_REQUEST_PREP_PENDING_BUFFER:
+		SPDK_TRACELOG(SPDK_TRACE_TCP, "Request %p needs data buffer\n", req);
+		TAILQ_INSERT_TAIL(&tcp_conn->pending_data_buf_queue, tcp_req, link);
+		return 0;
+	case SPDK_NVMF_REQUEST_PREP_PENDING_DATA:
+		SPDK_TRACELOG(SPDK_TRACE_TCP, "Request %p needs data transfer\n", req);
+		spdk_nvmf_tcp_send_r2t(tcp_conn, tcp_req);
+		return 0;
+	case SPDK_NVMF_REQUEST_PREP_ERROR:
+		if (tcp_conn->conn.sess == NULL) {
+			/* Nothing to report the error to yet */
+			return -1;
+		}
+		return spdk_nvmf_request_complete(req);
+	}
+
+	return -1;
+}
+
+static int
+spdk_nvmf_tcp_handle_pending_data_buf(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct spdk_nvmf_tcp_session	*tcp_sess;
+	struct spdk_nvmf_tcp_request	*tcp_req, *tmp;
+	int rc;
+	int count = 0;
+
+	if (tcp_conn->conn.sess == NULL) {
+		return 0;
+	}
+
+	tcp_sess = tcp_conn->conn.sess->trctx;
+	TAILQ_FOREACH_SAFE(tcp_req, &tcp_conn->pending_data_buf_queue, link, tmp) {
+		assert(tcp_req->req.data == NULL);
+		tcp_req->req.data = SLIST_FIRST(&tcp_sess->data_buf_pool);
+		if (!tcp_req->req.data) {
+			break;
+		}
+		SLIST_REMOVE_HEAD(&tcp_sess->data_buf_pool, link);
+		tcp_req->data_from_pool = true;
+		TAILQ_REMOVE(&tcp_conn->pending_data_buf_queue, tcp_req, link);
+		if (tcp_req->req.xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER) {
+			spdk_nvmf_tcp_send_r2t(tcp_conn, tcp_req);
+		} else {
+			rc = spdk_nvmf_request_exec(&tcp_req->req);
+			if (rc < 0) {
+				return -1;
+			}
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Copy up to len bytes of the incoming stream into dst, draining the
+ * staging buffer first. Returns the number of bytes copied, 0 if no data
+ * is available right now, or -1 if the connection was closed or failed.
+ */
+static int
+spdk_nvmf_tcp_conn_read(struct spdk_nvmf_tcp_conn *tcp_conn, void *dst, uint32_t len)
+{
+	uint32_t	avail = tcp_conn->recv_buf_len - tcp_conn->recv_buf_offset;
+	ssize_t		rc;
+
+	if (avail == 0) {
+		tcp_conn->recv_buf_offset = 0;
+		tcp_conn->recv_buf_len = 0;
+
+		if (len >= sizeof(tcp_conn->recv_buf)) {
+			rc = spdk_sock_recv(tcp_conn->sock, dst, len);
+		} else {
+			rc = spdk_sock_recv(tcp_conn->sock, tcp_conn->recv_buf, sizeof(tcp_conn->recv_buf));
+		}
+
+		if (rc == 0) {
+			SPDK_TRACELOG(SPDK_TRACE_TCP, "Connection %p closed by peer\n", &tcp_conn->conn);
+			return -1;
+		} else if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return 0;
+			}
+			SPDK_ERRLOG("recv() failed on connection %p: %s\n",
+				    &tcp_conn->conn, strerror(errno));
+			return -1;
+		}
+
+		if (len >= sizeof(tcp_conn->recv_buf)) {
+			return rc;
+		}
+		tcp_conn->recv_buf_len = rc;
+		avail = rc;
+	}
+
+	len = nvmf_min(len, avail);
+	memcpy(dst, &tcp_conn->recv_buf[tcp_conn->recv_buf_offset], len);
+	tcp_conn->recv_buf_offset += len;
+
+	return len;
+}
+
+static void
+spdk_nvmf_tcp_conn_recv_payload(struct spdk_nvmf_tcp_conn *tcp_conn, void *payload, uint32_t len)
+{
+	tcp_conn->recv_payload = payload;
+	tcp_conn->recv_payload_len = len;
+	tcp_conn->recv_payload_offset = 0;
+	tcp_conn->recv_state = NVMF_TCP_RECV_STATE_AWAIT_PDU_PAYLOAD;
+}
+
+static int
+spdk_nvmf_tcp_pdu_ch_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct spdk_nvme_tcp_common_pdu_hdr *ch = &tcp_conn->recv_hdr.common;
+	uint32_t expected_hlen;
+
+	switch (ch->pdu_type) {
+	case SPDK_NVME_TCP_PDU_TYPE_IC_REQ:
+		expected_hlen = sizeof(struct spdk_nvme_tcp_ic_req);
+		break;
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_TERM_REQ:
+		expected_hlen = sizeof(struct spdk_nvme_tcp_term_req_hdr);
+		break;
+	case SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD:
+		expected_hlen = sizeof(struct spdk_nvme_tcp_cmd);
+		break;
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_DATA:
+		expected_hlen = sizeof(struct spdk_nvme_tcp_h2c_data_hdr);
+		break;
+	default:
+		SPDK_ERRLOG("Unexpected PDU type 0x%x\n", ch->pdu_type);
+		return -1;
+	}
+
+	if (ch->hlen != expected_hlen) {
+		SPDK_ERRLOG("PDU type 0x%x has invalid header length %u\n", ch->pdu_type, ch->hlen);
+		return -1;
+	}
+
+	if (ch->flags & (SPDK_NVME_TCP_CH_FLAGS_HDGSTF | SPDK_NVME_TCP_CH_FLAGS_DDGSTF)) {
+		SPDK_ERRLOG("Digests were not negotiated but PDU flags are 0x%x\n", ch->flags);
+		return -1;
+	}
+
+	if (ch->plen < ch->hlen || (ch->plen > ch->hlen && ch->pdo != ch->hlen)) {
+		SPDK_ERRLOG("PDU type 0x%x has invalid length %u (hlen %u, pdo %u)\n",
+			    ch->pdu_type, ch->plen, ch->hlen, ch->pdo);
+		return -1;
+	}
+
+	if (!tcp_conn->ic_done && ch->pdu_type != SPDK_NVME_TCP_PDU_TYPE_IC_REQ) {
+		SPDK_ERRLOG("PDU type 0x%x received before ICReq\n", ch->pdu_type);
+		return -1;
+	}
+
+	tcp_conn->recv_state = NVMF_TCP_RECV_STATE_AWAIT_PDU_PSH;
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_ic_req_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct spdk_nvme_tcp_ic_req	*ic_req = &tcp_conn->recv_hdr.ic_req;
+	struct spdk_nvmf_tcp_pdu	*pdu = &tcp_conn->ic_resp_pdu;
+	struct spdk_nvme_tcp_ic_resp	*ic_resp = &pdu->hdr.ic_resp;
+
+	if (tcp_conn->ic_done) {
+		SPDK_ERRLOG("Duplicate ICReq\n");
+		return -1;
+	}
+
+	if (ic_req->common.plen != sizeof(*ic_req) || ic_req->pfv != SPDK_NVME_TCP_PFV_1_0) {
+		SPDK_ERRLOG("Unsupported ICReq: plen %u pfv %u\n", ic_req->common.plen, ic_req->pfv);
+		return -1;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_TCP, "ICReq: hpda %u dgst 0x%x maxr2t %u\n",
+		      ic_req->hpda, ic_req->dgst, ic_req->maxr2t);
+
+	/* Header and data digests are not supported, and are left disabled
+	 * regardless of what the host asked for. */
+	memset(&pdu->hdr, 0, sizeof(*ic_resp));
+	spdk_nvmf_tcp_pdu_init(pdu, SPDK_NVME_TCP_PDU_TYPE_IC_RESP, sizeof(*ic_resp), NULL, 0);
+	ic_resp->pfv = SPDK_NVME_TCP_PFV_1_0;
+	ic_resp->cpda = 0;
+	ic_resp->dgst = 0;
+	ic_resp->maxh2cdata = g_tcp.max_io_size;
+
+	tcp_conn->ic_done = true;
+	spdk_nvmf_tcp_conn_queue_pdu(tcp_conn, pdu);
+
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_capsule_cmd_hdr_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct spdk_nvme_tcp_cmd	*capsule = &tcp_conn->recv_hdr.capsule_cmd;
+	struct spdk_nvmf_tcp_request	*tcp_req;
+	uint32_t			in_capsule_len = capsule->common.plen - capsule->common.hlen;
+
+	if (in_capsule_len > g_tcp.in_capsule_data_size) {
+		SPDK_ERRLOG("In-capsule data length 0x%x exceeds 0x%x\n",
+			    in_capsule_len, g_tcp.in_capsule_data_size);
+		return -1;
+	}
+
+	tcp_req = TAILQ_FIRST(&tcp_conn->free_queue);
+	if (tcp_req == NULL) {
+		SPDK_ERRLOG("Host exceeded the queue depth of %u on connection %p\n",
+			    tcp_conn->max_queue_depth, &tcp_conn->conn);
+		return -1;
+	}
+	TAILQ_REMOVE(&tcp_conn->free_queue, tcp_req, link);
+	tcp_conn->cur_queue_depth++;
+
+	SPDK_TRACELOG(SPDK_TRACE_TCP,
+		      "CapsuleCmd received. Request: %p Connection: %p Outstanding I/O: %d\n",
+		      &tcp_req->req, &tcp_conn->conn, tcp_conn->cur_queue_depth);
+	spdk_trace_record(TRACE_NVMF_IO_START, 0, 0, (uint64_t)&tcp_req->req, 0);
+
+	memcpy(&tcp_req->cmd, &capsule->ccsqe, sizeof(tcp_req->cmd));
+	memset(tcp_req->req.rsp, 0, sizeof(*tcp_req->req.rsp));
+	tcp_req->h2c_pending = false;
+
+	tcp_conn->recv_req = tcp_req;
+	if (in_capsule_len) {
+		spdk_nvmf_tcp_conn_recv_payload(tcp_conn, tcp_req->buf, in_capsule_len);
+	}
+
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_h2c_data_hdr_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	struct spdk_nvme_tcp_h2c_data_hdr	*h2c = &tcp_conn->recv_hdr.h2c_data;
+	struct spdk_nvmf_tcp_request		*tcp_req;
+	uint32_t				datal = h2c->common.plen - h2c->common.hlen;
+
+	if (h2c->ttag >= tcp_conn->max_queue_depth) {
+		SPDK_ERRLOG("H2CData with invalid ttag %u\n", h2c->ttag);
+		return -1;
+	}
+
+	tcp_req = &tcp_conn->reqs[h2c->ttag];
+	if (!tcp_req->h2c_pending || h2c->cccid != tcp_req->cmd.nvme_cmd.cid) {
+		SPDK_ERRLOG("Unsolicited H2CData for ttag %u cccid %u\n", h2c->ttag, h2c->cccid);
+		return -1;
+	}
+
+	if (h2c->datal != datal || datal == 0 || h2c->datao != tcp_req->h2c_offset ||
+	    datal > tcp_req->req.length - tcp_req->h2c_offset) {
+		SPDK_ERRLOG("H2CData out of range: datao 0x%x datal 0x%x (expected offset 0x%x of 0x%x)\n",
+			    h2c->datao, h2c->datal, tcp_req->h2c_offset, tcp_req->req.length);
+		return -1;
+	}
+
+	tcp_conn->recv_req = tcp_req;
+	spdk_nvmf_tcp_conn_recv_payload(tcp_conn, (uint8_t *)tcp_req->req.data + h2c->datao, datal);
+
+	return 0;
+}
+
+/* Called once the whole PDU (header and payload) has been received.
+ * Returns the number of times that spdk_nvmf_request_exec was called,
+ * or -1 on error.
+ */
+static int
+spdk_nvmf_tcp_pdu_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	union nvmf_tcp_pdu_hdr		*hdr = &tcp_conn->recv_hdr;
+	struct spdk_nvmf_tcp_request	*tcp_req = tcp_conn->recv_req;
+	int				rc;
+
+	tcp_conn->recv_req = NULL;
+	tcp_conn->recv_hdr_offset = 0;
+	tcp_conn->recv_state = NVMF_TCP_RECV_STATE_AWAIT_PDU_CH;
+
+	switch (hdr->common.pdu_type) {
+	case SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD:
+		return spdk_nvmf_tcp_capsule_handle(tcp_conn, tcp_req,
+						    hdr->common.plen - hdr->common.hlen);
+
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_DATA:
+		tcp_req->h2c_offset += hdr->h2c_data.datal;
+		if (tcp_req->h2c_offset < tcp_req->req.length) {
+			if (hdr->common.flags & SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU) {
+				SPDK_ERRLOG("H2CData ended early at 0x%x of 0x%x\n",
+					    tcp_req->h2c_offset, tcp_req->req.length);
+				return -1;
+			}
+			return 0;
+		}
+
+		tcp_req->h2c_pending = false;
+		rc = spdk_nvmf_request_exec(&tcp_req->req);
+		if (rc < 0) {
+			return -1;
+		}
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* Called once the PDU header has been received. Either sets up the receive
+ * of a payload or handles the PDU directly.
+ */
+static int
+spdk_nvmf_tcp_pdu_psh_handle(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	union nvmf_tcp_pdu_hdr *hdr = &tcp_conn->recv_hdr;
+	int rc;
+
+	switch (hdr->common.pdu_type) {
+	case SPDK_NVME_TCP_PDU_TYPE_IC_REQ:
+		rc = spdk_nvmf_tcp_ic_req_handle(tcp_conn);
+		break;
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_TERM_REQ:
+		SPDK_ERRLOG("Host terminated connection %p: fes 0x%x\n",
+			    &tcp_conn->conn, hdr->term_req.fes);
+		return -1;
+	case SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD:
+		rc = spdk_nvmf_tcp_capsule_cmd_hdr_handle(tcp_conn);
+		break;
+	case SPDK_NVME_TCP_PDU_TYPE_H2C_DATA:
+		rc = spdk_nvmf_tcp_h2c_data_hdr_handle(tcp_conn);
+		break;
+	default:
+		return -1;
+	}
+
+	if (rc < 0) {
+		return -1;
+	}
+
+	if (tcp_conn->recv_state == NVMF_TCP_RECV_STATE_AWAIT_PDU_PAYLOAD) {
+		return 0;
+	}
+
+	return spdk_nvmf_tcp_pdu_handle(tcp_conn);
+}
+
+/* Read and process as many PDUs as are available on the socket.
+ * Returns the number of times that spdk_nvmf_request_exec was called,
+ * or -1 on error.
+ */
+static int
+spdk_nvmf_tcp_conn_recv(struct spdk_nvmf_tcp_conn *tcp_conn)
+{
+	union nvmf_tcp_pdu_hdr	*hdr = &tcp_conn->recv_hdr;
+	int			rc;
+	int			count = 0;
+
+	while (true) {
+		switch (tcp_conn->recv_state) {
+		case NVMF_TCP_RECV_STATE_AWAIT_PDU_CH:
+			rc = spdk_nvmf_tcp_conn_read(tcp_conn, &hdr->raw[tcp_conn->recv_hdr_offset],
+						     sizeof(hdr->common) - tcp_conn->recv_hdr_offset);
+			if (rc <= 0) {
+				return rc < 0 ? -1 : count;
+			}
+			tcp_conn->recv_hdr_offset += rc;
+			if (tcp_conn->recv_hdr_offset < sizeof(hdr->common)) {
+				continue;
+			}
+			rc = spdk_nvmf_tcp_pdu_ch_handle(tcp_conn);
+			if (rc < 0) {
+				return -1;
+			}
+			break;
+
+		case NVMF_TCP_RECV_STATE_AWAIT_PDU_PSH:
+			rc = spdk_nvmf_tcp_conn_read(tcp_conn, &hdr->raw[tcp_conn->recv_hdr_offset],
+						     hdr->common.hlen - tcp_conn->recv_hdr_offset);
+			if (rc <= 0) {
+				return rc < 0 ? -1 : count;
+			}
+			tcp_conn->recv_hdr_offset += rc;
+			if (tcp_conn->recv_hdr_offset < hdr->common.hlen) {
+				continue;
+			}
+			rc = spdk_nvmf_tcp_pdu_psh_handle(tcp_conn);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+			break;
+
+		case NVMF_TCP_RECV_STATE_AWAIT_PDU_PAYLOAD:
+			rc = spdk_nvmf_tcp_conn_read(tcp_conn,
+						     tcp_conn->recv_payload + tcp_conn->recv_payload_offset,
+						     tcp_conn->recv_payload_len - tcp_conn->recv_payload_offset);
+			if (rc <= 0) {
+				return rc < 0 ? -1 : count;
+			}
+			tcp_conn->recv_payload_offset += rc;
+			if (tcp_conn->recv_payload_offset < tcp_conn->recv_payload_len) {
+				continue;
+			}
+			rc = spdk_nvmf_tcp_pdu_handle(tcp_conn);
+			if (rc < 0) {
+				return -1;
+			}
+			count += rc;
+			break;
+		}
+
+		if (tcp_conn->conn.sess == NULL && count > 0) {
+			/* The CONNECT capsule has been handed off to the subsystem's
+			 * core, which now owns this connection. */
+			return count;
+		}
+	}
+}
+
+/* Returns the number of times that spdk_nvmf_request_exec was called,
+ * or -1 on error.
+ */
+static int
+spdk_nvmf_tcp_poll(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_tcp_conn *tcp_conn = get_tcp_conn(conn);
+	int rc;
+	int count = 0;
+
+	/* First, try to assign free data buffers to requests that need one */
+	rc = spdk_nvmf_tcp_handle_pending_data_buf(tcp_conn);
+	if (rc < 0) {
+		return -1;
+	}
+	count += rc;
+
+	rc = spdk_nvmf_tcp_conn_recv(tcp_conn);
+	if (rc < 0) {
+		return -1;
+	}
+	count += rc;
+
+	if (conn->sess == NULL && count > 0) {
+		return count;
+	}
+
+	/* Send all responses, data and R2Ts queued up since the last poll */
+	if (spdk_nvmf_tcp_conn_flush(tcp_conn) < 0) {
+		return -1;
+	}
+
+	return count;
+}
+
+static void
+spdk_nvmf_tcp_accept(struct spdk_nvmf_tcp_listen_addr *listen_addr)
+{
+	struct spdk_nvmf_tcp_conn	*tcp_conn;
+	int				sock;
+	int				flags;
+	int				val = 1;
+
+	while (true) {
+		sock = spdk_sock_accept(listen_addr->sock);
+		if (sock < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				SPDK_ERRLOG("accept() failed on %s:%s: %s\n",
+					    listen_addr->traddr, listen_addr->trsvcid, strerror(errno));
+			}
+			return;
+		}
+
+		flags = fcntl(sock, F_GETFL);
+		if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+			SPDK_ERRLOG("fcntl to set fd to non-blocking failed\n");
+			spdk_sock_close(sock);
+			continue;
+		}
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+
+		tcp_conn = spdk_nvmf_tcp_conn_create(sock, g_tcp.max_queue_depth);
+		if (tcp_conn == NULL) {
+			SPDK_ERRLOG("Error on nvmf connection creation\n");
+			spdk_sock_close(sock);
+			continue;
+		}
+
+		SPDK_TRACELOG(SPDK_TRACE_TCP, "Accepted connection %p on %s:%s\n",
+			      &tcp_conn->conn, listen_addr->traddr, listen_addr->trsvcid);
+
+		/* Add this TCP connection to the global list until a CONNECT capsule
+		 * is received. */
+		TAILQ_INSERT_TAIL(&g_pending_conns, tcp_conn, link);
+	}
+}
+
+static void
+spdk_nvmf_tcp_acceptor_poll(void)
+{
+	struct spdk_nvmf_tcp_listen_addr	*listen_addr;
+	struct spdk_nvmf_tcp_conn		*tcp_conn, *tmp;
+	TAILQ_HEAD(, spdk_nvmf_tcp_conn)	closing_conns;
+	int					rc;
+
+	/* Process pending connections for incoming capsules. The only capsule
+	 * this should ever find is a CONNECT request. */
+	TAILQ_FOREACH_SAFE(tcp_conn, &g_pending_conns, link, tmp) {
+		rc = spdk_nvmf_tcp_poll(&tcp_conn->conn);
+		if (rc < 0) {
+			TAILQ_REMOVE(&g_pending_conns, tcp_conn, link);
+			spdk_nvmf_tcp_conn_destroy(tcp_conn);
+		} else if (rc > 0) {
+			/* At least one request was processed which is assumed to be
+			 * a CONNECT. Remove this connection from our list. */
+			TAILQ_REMOVE(&g_pending_conns, tcp_conn, link);
+		}
+	}
+
+	TAILQ_INIT(&closing_conns);
+
+	pthread_mutex_lock(&g_tcp.lock);
+	TAILQ_FOREACH(listen_addr, &g_tcp.listen_addrs, link) {
+		if (listen_addr->sock >= 0) {
+			spdk_nvmf_tcp_accept(listen_addr);
+		}
+	}
+	TAILQ_CONCAT(&closing_conns, &g_tcp.closing_conns, close_link);
+	pthread_mutex_unlock(&g_tcp.lock);
+
+	/* Close connections whose CONNECT was rejected, making one last
+	 * attempt to deliver the response. */
+	TAILQ_FOREACH_SAFE(tcp_conn, &closing_conns, close_link, tmp) {
+		TAILQ_REMOVE(&closing_conns, tcp_conn, close_link);
+		spdk_nvmf_tcp_conn_flush(tcp_conn);
+		spdk_nvmf_tcp_conn_destroy(tcp_conn);
+	}
+}
+
+static int
+spdk_nvmf_tcp_acceptor_init(void)
+{
+	struct spdk_nvmf_tcp_listen_addr *listen_addr;
+
+	pthread_mutex_lock(&g_tcp.lock);
+	TAILQ_FOREACH(listen_addr, &g_tcp.listen_addrs, link) {
+		if (listen_addr->sock >= 0) {
+			continue;
+		}
+
+		listen_addr->sock = spdk_sock_listen(listen_addr->traddr,
+						     (int)strtol(listen_addr->trsvcid, NULL, 10));
+		if (listen_addr->sock < 0) {
+			SPDK_ERRLOG("Unable to listen on %s:%s\n", listen_addr->traddr, listen_addr->trsvcid);
+			goto listen_error;
+		}
+		SPDK_NOTICELOG("*** NVMf Target Listening on %s port %s (TCP) ***\n",
+			       listen_addr->traddr, listen_addr->trsvcid);
+	}
+
+	pthread_mutex_unlock(&g_tcp.lock);
+	return 0;
+
+listen_error:
+	TAILQ_FOREACH(listen_addr, &g_tcp.listen_addrs, link) {
+		if (listen_addr->sock >= 0) {
+			spdk_sock_close(listen_addr->sock);
+			listen_addr->sock = -1;
+		}
+	}
+	pthread_mutex_unlock(&g_tcp.lock);
+	return -1;
+}
+
+static void
+spdk_nvmf_tcp_acceptor_fini(void)
+{
+	struct spdk_nvmf_tcp_listen_addr *listen_addr, *tmp;
+
+	pthread_mutex_lock(&g_tcp.lock);
+	TAILQ_FOREACH_SAFE(listen_addr, &g_tcp.listen_addrs, link, tmp) {
+		TAILQ_REMOVE(&g_tcp.listen_addrs, listen_addr, link);
+		if (listen_addr->sock >= 0) {
+			spdk_sock_close(listen_addr->sock);
+		}
+		free(listen_addr);
+	}
+	pthread_mutex_unlock(&g_tcp.lock);
+}
+
+static int
+spdk_nvmf_tcp_session_init(struct nvmf_session *session, struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_tcp_session	*tcp_sess;
+	int				i;
+	struct spdk_nvmf_tcp_buf	*buf;
+
+	tcp_sess = calloc(1, sizeof(*tcp_sess));
+	if (!tcp_sess) {
+		return -1;
+	}
+
+	/* One large buffer per queue slot, so a full queue never waits for a buffer. */
+	tcp_sess->buf = rte_calloc("large_buf_pool", g_tcp.max_queue_depth, g_tcp.max_io_size,
+				   0x20000);
+	if (!tcp_sess->buf) {
+		SPDK_ERRLOG("Large buffer pool allocation failed (%d x %d)\n",
+			    g_tcp.max_queue_depth, g_tcp.max_io_size);
+		free(tcp_sess);
+		return -1;
+	}
+
+	SPDK_TRACELOG(SPDK_TRACE_TCP, "Session Shared Data Pool: %p Length: %x\n",
+		      tcp_sess->buf, g_tcp.max_queue_depth * g_tcp.max_io_size);
+
+	SLIST_INIT(&tcp_sess->data_buf_pool);
+	for (i = 0; i < g_tcp.max_queue_depth; i++) {
+		buf = (struct spdk_nvmf_tcp_buf *)(tcp_sess->buf + (i * g_tcp.max_io_size));
+		SLIST_INSERT_HEAD(&tcp_sess->data_buf_pool, buf, link);
+	}
+
+	session->transport = conn->transport;
+	session->trctx = tcp_sess;
+
+	return 0;
+}
+
+static void
+spdk_nvmf_tcp_session_fini(struct nvmf_session *session)
+{
+	struct spdk_nvmf_tcp_session *tcp_sess = session->trctx;
+
+	if (!tcp_sess) {
+		return;
+	}
+
+	rte_free(tcp_sess->buf);
+	free(tcp_sess);
+	session->trctx = NULL;
+}
+
+static int
+spdk_nvmf_tcp_init(uint16_t max_queue_depth, uint32_t max_io_size,
+		   uint32_t in_capsule_data_size)
+{
+	SPDK_NOTICELOG("*** TCP Transport Init ***\n");
+
+	g_tcp.max_queue_depth = max_queue_depth;
+	g_tcp.max_io_size = max_io_size;
+	g_tcp.in_capsule_data_size = in_capsule_data_size;
+
+	return 0;
+}
+
+static int
+spdk_nvmf_tcp_fini(void)
+{
+	/* Nothing to do */
+	return 0;
+}
+
+static void
+spdk_nvmf_tcp_close_conn(struct spdk_nvmf_conn *conn)
+{
+	struct spdk_nvmf_tcp_conn *tcp_conn = get_tcp_conn(conn);
+
+	return spdk_nvmf_tcp_conn_destroy(tcp_conn);
+}
+
+static void
+spdk_nvmf_tcp_discover(struct spdk_nvmf_listen_addr *listen_addr,
+		       struct spdk_nvmf_discovery_log_page_entry *entry)
+{
+	entry->trtype = SPDK_NVMF_TRTYPE_TCP;
+	entry->adrfam = SPDK_NVMF_ADRFAM_IPV4;
+	entry->treq.secure_channel = SPDK_NVMF_TREQ_SECURE_CHANNEL_NOT_SPECIFIED;
+
+	spdk_strcpy_pad(entry->trsvcid, listen_addr->trsvcid, sizeof(entry->trsvcid), ' ');
+	spdk_strcpy_pad(entry->traddr, listen_addr->traddr, sizeof(entry->traddr), ' ');
+
+	memset(&entry->tsas, 0, sizeof(entry->tsas));
+}
+
+static int
+spdk_nvmf_tcp_listen(struct spdk_nvmf_listen_addr *listen_addr)
+{
+	struct spdk_nvmf_tcp_listen_addr *addr;
+
+	pthread_mutex_lock(&g_tcp.lock);
+	TAILQ_FOREACH(addr, &g_tcp.listen_addrs, link) {
+		if ((!strcasecmp(addr->traddr, listen_addr->traddr)) &&
+		    (!strcasecmp(addr->trsvcid, listen_addr->trsvcid))) {
+			pthread_mutex_unlock(&g_tcp.lock);
+			return 0;
+		}
+	}
+
+	addr = calloc(1, sizeof(*addr));
+	if (!addr) {
+		pthread_mutex_unlock(&g_tcp.lock);
+		return -1;
+	}
+
+	addr->traddr = listen_addr->traddr;
+	addr->trsvcid = listen_addr->trsvcid;
+	addr->sock = -1;
+
+	TAILQ_INSERT_TAIL(&g_tcp.listen_addrs, addr, link);
+	pthread_mutex_unlock(&g_tcp.lock);
+
+	return 0;
+}
+
+const struct spdk_nvmf_transport spdk_nvmf_transport_tcp = {
+	.name = "tcp",
+	.transport_init = spdk_nvmf_tcp_init,
+	.transport_fini = spdk_nvmf_tcp_fini,
+
+	.acceptor_init = spdk_nvmf_tcp_acceptor_init,
+	.acceptor_poll = spdk_nvmf_tcp_acceptor_poll,
+	.acceptor_fini = spdk_nvmf_tcp_acceptor_fini,
+
+	.listen_addr_add = spdk_nvmf_tcp_listen,
+	.listen_addr_discover = spdk_nvmf_tcp_discover,
+
+	.session_init = spdk_nvmf_tcp_session_init,
+	.session_fini = spdk_nvmf_tcp_session_fini,
+
+	.req_complete = spdk_nvmf_tcp_request_complete,
+	.req_release = spdk_nvmf_tcp_request_release,
+
+	.conn_fini = spdk_nvmf_tcp_close_conn,
+	.conn_poll = spdk_nvmf_tcp_poll,
+};
+
+SPDK_LOG_REGISTER_TRACE_FLAG("tcp", SPDK_TRACE_TCP)
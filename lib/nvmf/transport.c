@@ -45,6 +45,7 @@ static const struct spdk_nvmf_transport *const g_transports[] = {
 #ifdef SPDK_CONFIG_RDMA
 	&spdk_nvmf_transport_rdma,
 #endif
+	&spdk_nvmf_transport_tcp,
 };
 
 #define NUM_TRANSPORTS (sizeof(g_transports) / sizeof(*g_transports))
@@ -131,5 +131,6 @@ void spdk_nvmf_acceptor_poll(void);
 void spdk_nvmf_acceptor_fini(void);
 
 extern const struct spdk_nvmf_transport spdk_nvmf_transport_rdma;
+extern const struct spdk_nvmf_transport spdk_nvmf_transport_tcp;
 
 #endif /* SPDK_NVMF_TRANSPORT_H */
@@ -1300,8 +1300,8 @@ spdk_bdev_scsi_task_complete(spdk_event_t event)
 		}
 	}
 
-	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
-		task->rbuf = bdev_io->u.read.buf;
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ && task->iovcnt == 0) {
+		task->rbuf = bdev_io->u.read.iovs[0].iov_base;
 	}
 
 	spdk_scsi_lun_complete_task(task->lun, task);
@@ -1334,8 +1334,13 @@ spdk_bdev_scsi_read(struct spdk_bdev *bdev,
 		return -1;
 	}
 
-	task->blockdev_io = spdk_bdev_read(bdev, task->rbuf, offset, nbytes,
-					   spdk_bdev_scsi_task_complete, task);
+	if (task->iovcnt > 0) {
+		task->blockdev_io = spdk_bdev_readv(bdev, task->iovs, task->iovcnt, offset, nbytes,
+						    spdk_bdev_scsi_task_complete, task);
+	} else {
+		task->blockdev_io = spdk_bdev_read(bdev, task->rbuf, offset, nbytes,
+						   spdk_bdev_scsi_task_complete, task);
+	}
 	if (!task->blockdev_io) {
 		SPDK_ERRLOG("spdk_bdev_read() failed\n");
 		return -1;
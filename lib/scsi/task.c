@@ -49,24 +49,12 @@ spdk_put_task(struct spdk_scsi_task *task)
 	task->ref--;
 
 	if (task->ref == 0) {
-		struct spdk_bdev_io *bdev_io = task->blockdev_io;
-
 		if (task->parent) {
 			spdk_put_task(task->parent);
 			task->parent = NULL;
 		}
 
-		if (bdev_io) {
-			/* due to lun reset, the bdev_io status could be pending */
-			if (bdev_io->status == SPDK_BDEV_IO_STATUS_PENDING) {
-				bdev_io->status = SPDK_BDEV_IO_STATUS_FAILED;
-			}
-			spdk_bdev_free_io(bdev_io);
-		} else {
-			rte_free(task->rbuf);
-		}
-
-		task->rbuf = NULL;
+		spdk_scsi_task_free_data(task);
 
 		RTE_VERIFY(task->owner_task_ctr != NULL);
 		if (*(task->owner_task_ctr) > 0) {
@@ -79,6 +67,25 @@ spdk_put_task(struct spdk_scsi_task *task)
 	}
 }
 
+void
+spdk_scsi_task_free_data(struct spdk_scsi_task *task)
+{
+	struct spdk_bdev_io *bdev_io = task->blockdev_io;
+
+	if (bdev_io) {
+		/* due to lun reset, the bdev_io status could be pending */
+		if (bdev_io->status == SPDK_BDEV_IO_STATUS_PENDING) {
+			bdev_io->status = SPDK_BDEV_IO_STATUS_FAILED;
+		}
+		spdk_bdev_free_io(bdev_io);
+		task->blockdev_io = NULL;
+	} else {
+		rte_free(task->rbuf);
+	}
+
+	task->rbuf = NULL;
+}
+
 void
 spdk_scsi_task_construct(struct spdk_scsi_task *task, uint32_t *owner_task_ctr,
 			 struct spdk_scsi_task *parent)
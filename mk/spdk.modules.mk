@@ -1,11 +1,25 @@
 BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/malloc/libspdk_bdev_malloc.a
 
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/raid/libspdk_bdev_raid.a
+
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/rcache/libspdk_bdev_rcache.a
+
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/wbcache/libspdk_bdev_wbcache.a
+
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/lvol/libspdk_bdev_lvol.a
+
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/compress/libspdk_bdev_compress.a
+
 BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/nvme/libspdk_bdev_nvme.a \
 		    $(SPDK_ROOT_DIR)/lib/nvme/libspdk_nvme.a
 
 ifeq ($(OS),Linux)
 BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/aio/libspdk_bdev_aio.a
 BLOCKDEV_MODULES_DEPS += -laio
+ifeq ($(CONFIG_URING),y)
+BLOCKDEV_MODULES += $(SPDK_ROOT_DIR)/lib/bdev/uring/libspdk_bdev_uring.a
+BLOCKDEV_MODULES_DEPS += -luring
+endif
 endif
 
 COPY_MODULES += $(SPDK_ROOT_DIR)/lib/copy/ioat/libspdk_copy_ioat.a \
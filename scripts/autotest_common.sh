@@ -27,6 +27,10 @@ if [ -f /usr/include/infiniband/verbs.h ]; then
 	MAKECONFIG="$MAKECONFIG CONFIG_RDMA=y"
 fi
 
+if [ -f /usr/include/liburing.h ]; then
+	MAKECONFIG="$MAKECONFIG CONFIG_URING=y"
+fi
+
 if [ -z "$output_dir" ]; then
 	if [ -z "$rootdir" ] || [ ! -d "$rootdir/../output" ]; then
 		output_dir=.
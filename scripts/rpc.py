@@ -163,6 +163,94 @@ p.add_argument('fname', help='Path to device or file (ex: /dev/sda)')
 p.set_defaults(func=construct_aio_lun)
 
 
+def construct_uring_lun(args):
+    params = {'fname': args.fname}
+    jsonrpc_call('construct_uring_lun', params)
+
+p = subparsers.add_parser('construct_uring_lun', help='Add a LUN with io_uring backend')
+p.add_argument('fname', help='Path to device or file (ex: /dev/sda)')
+p.set_defaults(func=construct_uring_lun)
+
+
+def get_read_cache_stats(args):
+    print_dict(jsonrpc_call('get_read_cache_stats'))
+
+p = subparsers.add_parser('get_read_cache_stats', help='Display read cache hit/miss counters')
+p.set_defaults(func=get_read_cache_stats)
+
+
+def construct_lvol(args):
+    params = {'lvol_store': args.lvol_store, 'name': args.name, 'size_mb': args.size_mb}
+    jsonrpc_call('construct_lvol', params)
+
+p = subparsers.add_parser('construct_lvol', help='Add a thin-provisioned logical volume')
+p.add_argument('lvol_store', help='Name of the volume store')
+p.add_argument('name', help='Name of the new volume')
+p.add_argument('size_mb', help='Size of the volume in MB (int > 0)', type=int)
+p.set_defaults(func=construct_lvol)
+
+
+def delete_lvol(args):
+    params = {'name': args.name}
+    jsonrpc_call('delete_lvol', params)
+
+p = subparsers.add_parser('delete_lvol', help='Delete a logical volume and release its clusters')
+p.add_argument('name', help='Name of the volume')
+p.set_defaults(func=delete_lvol)
+
+
+def get_lvol_stores(args):
+    print_dict(jsonrpc_call('get_lvol_stores'))
+
+p = subparsers.add_parser('get_lvol_stores', help='Display volume stores and their volumes')
+p.set_defaults(func=get_lvol_stores)
+
+
+def construct_lvol_snapshot(args):
+    params = {'lvol': args.lvol, 'name': args.name}
+    jsonrpc_call('construct_lvol_snapshot', params)
+
+p = subparsers.add_parser('construct_lvol_snapshot', help='Take a read-only copy-on-write snapshot of a logical volume')
+p.add_argument('lvol', help='Name of the volume')
+p.add_argument('name', help='Name of the new snapshot')
+p.set_defaults(func=construct_lvol_snapshot)
+
+
+def construct_lvol_clone(args):
+    params = {'lvol_store': args.lvol_store, 'snapshot': args.snapshot, 'name': args.name}
+    jsonrpc_call('construct_lvol_clone', params)
+
+p = subparsers.add_parser('construct_lvol_clone', help='Add a writable volume that starts as a copy of a snapshot')
+p.add_argument('lvol_store', help='Name of the volume store')
+p.add_argument('snapshot', help='Name of the snapshot')
+p.add_argument('name', help='Name of the new volume')
+p.set_defaults(func=construct_lvol_clone)
+
+
+def get_lvol_snapshots(args):
+    print_dict(jsonrpc_call('get_lvol_snapshots'))
+
+p = subparsers.add_parser('get_lvol_snapshots', help='Display the snapshots in all volume stores')
+p.set_defaults(func=get_lvol_snapshots)
+
+
+def delete_lvol_snapshot(args):
+    params = {'lvol_store': args.lvol_store, 'name': args.name}
+    jsonrpc_call('delete_lvol_snapshot', params)
+
+p = subparsers.add_parser('delete_lvol_snapshot', help='Delete a snapshot and fold its clusters into its volume')
+p.add_argument('lvol_store', help='Name of the volume store')
+p.add_argument('name', help='Name of the snapshot')
+p.set_defaults(func=delete_lvol_snapshot)
+
+
+def get_compress_stats(args):
+    print_dict(jsonrpc_call('get_compress_stats'))
+
+p = subparsers.add_parser('get_compress_stats', help='Display compressed blockdev usage and compression ratios')
+p.set_defaults(func=get_compress_stats)
+
+
 def set_trace_flag(args):
     params = {'flag': args.flag}
     jsonrpc_call('set_trace_flag', params)
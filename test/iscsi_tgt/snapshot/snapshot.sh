@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+
+set -xe
+
+testdir=$(readlink -f $(dirname $0))
+rootdir=$testdir/../../..
+source $rootdir/scripts/autotest_common.sh
+
+if [ -z "$TARGET_IP" ]; then
+	echo "TARGET_IP not defined in environment"
+	exit 1
+fi
+
+if [ -z "$INITIATOR_IP" ]; then
+	echo "INITIATOR_IP not defined in environment"
+	exit 1
+fi
+
+timing_enter snapshot
+
+# iSCSI target configuration
+PORT=3260
+RPC_PORT=5260
+INITIATOR_TAG=2
+INITIATOR_NAME=ALL
+NETMASK=$INITIATOR_IP/32
+NODE_BASE=iqn.2016-06.io.spdk
+
+rpc_py="python $rootdir/scripts/rpc.py"
+tmp=$(mktemp -d)
+
+./app/iscsi_tgt/iscsi_tgt -c $testdir/iscsi.conf &
+pid=$!
+echo "Process pid: $pid"
+
+trap "rm -rf $tmp; process_core; killprocess $pid; exit 1" SIGINT SIGTERM EXIT
+
+waitforlisten $pid ${RPC_PORT}
+echo "iscsi_tgt is listening. Running tests..."
+
+$rpc_py add_portal_group 1 $TARGET_IP:$PORT
+$rpc_py add_initiator_group $INITIATOR_TAG $INITIATOR_NAME $NETMASK
+$rpc_py construct_lvol Store0 Lvol0 16
+$rpc_py construct_target_node Target0 Target0_alias 'Lvol0:0' '1:2' 64 1 0 0 0
+sleep 1
+
+iscsiadm -m discovery -t sendtargets -p $TARGET_IP:$PORT
+iscsiadm -m node --login -T $NODE_BASE:Target0 -p $TARGET_IP:$PORT
+
+trap "iscsicleanup; rm -rf $tmp; process_core; killprocess $pid; exit 1" SIGINT SIGTERM EXIT
+
+sleep 1
+
+origin_dev=/dev/disk/by-path/ip-$TARGET_IP:$PORT-iscsi-$NODE_BASE:Target0-lun-0
+
+# 4 MiB of data in the first 64 clusters of Lvol0; the rest stays unallocated
+dd if=/dev/urandom of=$tmp/pattern bs=1M count=4
+dd if=$tmp/pattern of=$origin_dev bs=1M oflag=direct
+
+# What the first 6 MiB of the snapshot must hold
+dd if=/dev/zero of=$tmp/snapshot bs=1M count=6
+dd if=$tmp/pattern of=$tmp/snapshot conv=notrunc
+cp $tmp/snapshot $tmp/origin
+
+$rpc_py construct_lvol_snapshot Lvol0 Snap0
+$rpc_py get_lvol_snapshots
+
+# Write fresh data at offset $1 KiB, length $2 KiB, to Lvol0 and to the
+#  copy of what it must hold
+function overwrite() {
+	dd if=/dev/urandom of=$tmp/chunk bs=1k count=$2
+	dd if=$tmp/chunk of=$origin_dev bs=1k seek=$1 oflag=direct
+	dd if=$tmp/chunk of=$tmp/origin bs=1k seek=$1 conv=notrunc
+}
+
+# The head of a shared cluster: the rest of it is copied from Snap0
+overwrite 0 4
+# Across a cluster boundary, into a cluster now owned and one still shared
+overwrite 60 8
+# The middle of a shared cluster
+overwrite 200 16
+# A whole shared cluster, which needs no copy
+overwrite 320 64
+# A cluster Snap0 never had, which is filled with zeroes
+overwrite 5120 4
+
+dd if=$origin_dev of=$tmp/origin_read bs=1M count=6 iflag=direct
+cmp $tmp/origin_read $tmp/origin
+
+$rpc_py construct_target_node Target1 Target1_alias 'Snap0:0' '1:2' 64 1 0 0 0
+sleep 1
+
+iscsiadm -m discovery -t sendtargets -p $TARGET_IP:$PORT
+iscsiadm -m node --login -T $NODE_BASE:Target1 -p $TARGET_IP:$PORT
+sleep 1
+
+snapshot_dev=/dev/disk/by-path/ip-$TARGET_IP:$PORT-iscsi-$NODE_BASE:Target1-lun-0
+
+dd if=$snapshot_dev of=$tmp/snapshot_read bs=1M count=6 iflag=direct
+cmp $tmp/snapshot_read $tmp/snapshot
+
+trap - SIGINT SIGTERM EXIT
+
+iscsicleanup
+rm -rf $tmp
+killprocess $pid
+timing_exit snapshot
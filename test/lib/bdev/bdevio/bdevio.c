@@ -33,6 +33,7 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -74,6 +75,13 @@ bdevio_construct_targets(void)
 			continue;
 		}
 
+		/* The tests write to every blockdev; snapshots are read-only. */
+		if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_WRITE)) {
+			printf("Skipping %s because it is read-only\n", bdev->name);
+			bdev = spdk_bdev_next(bdev);
+			continue;
+		}
+
 		target = malloc(sizeof(struct io_target));
 		if (target == NULL) {
 			return -ENOMEM;
@@ -169,6 +177,25 @@ blockdev_read(struct io_target *target, void *bdev_task_ctx, char *rx_buf,
 	return data_len;
 }
 
+static int
+blockdev_readv(struct io_target *target, void *bdev_task_ctx, struct iovec *rx_iov,
+	       int iovcnt, uint64_t offset, int data_len)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	complete = 0;
+	completion_status_per_io = SPDK_BDEV_IO_STATUS_FAILED;
+
+	bdev_io = spdk_bdev_readv(target->bdev, rx_iov, iovcnt, offset, data_len,
+				  quick_test_complete, bdev_task_ctx);
+
+	if (!bdev_io) {
+		return -1;
+	}
+
+	return data_len;
+}
+
 static int
 blockdev_write_read_data_match(char *rx_buf, char *tx_buf, int data_length)
 {
@@ -242,6 +269,161 @@ blockdev_write_read(uint32_t data_length, int pattern, uint64_t offset,
 	}
 }
 
+#define READV_MAX_IOVS	4
+
+/*
+ * Write a pattern that differs from byte to byte, then read it back with
+ *  spdk_bdev_readv() into the iovecs described by layout.  Each layout entry
+ *  gives the offset of that iovec inside one receive buffer and its length;
+ *  the receive buffer is left zeroed between the iovecs so that data landing
+ *  in the wrong element or past its end is caught.
+ */
+static void
+blockdev_write_readv(struct io_target *target, const struct iovec *layout, int iovcnt,
+		     uint64_t offset)
+{
+	char		bdev_task_ctx[BDEV_TASK_ARRAY_SIZE];
+	struct iovec	rx_iov[READV_MAX_IOVS];
+	char		*tx_buf = NULL;
+	char		*rx_buf = NULL;
+	size_t		rx_buf_len, tx_pos, rx_pos, off;
+	uint32_t	data_length = 0;
+	int		i, rc;
+
+	CU_ASSERT_FATAL(iovcnt <= READV_MAX_IOVS);
+
+	for (i = 0; i < iovcnt; i++) {
+		data_length += layout[i].iov_len;
+	}
+	rx_buf_len = (uintptr_t)layout[iovcnt - 1].iov_base + layout[iovcnt - 1].iov_len;
+
+	initialize_buffer(&tx_buf, 0, data_length);
+	initialize_buffer(&rx_buf, 0, rx_buf_len);
+	for (tx_pos = 0; tx_pos < data_length; tx_pos++) {
+		tx_buf[tx_pos] = (char)(tx_pos % 251);
+	}
+	for (i = 0; i < iovcnt; i++) {
+		rx_iov[i].iov_base = rx_buf + (uintptr_t)layout[i].iov_base;
+		rx_iov[i].iov_len = layout[i].iov_len;
+	}
+
+	rc = blockdev_write(target, (void *)bdev_task_ctx, tx_buf, offset, data_length);
+	CU_ASSERT_EQUAL(rc, (int)data_length);
+	if (rc == (int)data_length) {
+		check_io_completion();
+		CU_ASSERT_EQUAL(completion_status_per_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+
+	rc = blockdev_readv(target, (void *)bdev_task_ctx, rx_iov, iovcnt, offset, data_length);
+	CU_ASSERT_EQUAL(rc, (int)data_length);
+	if (rc != (int)data_length) {
+		goto out;
+	}
+	check_io_completion();
+	CU_ASSERT_EQUAL(completion_status_per_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	tx_pos = 0;
+	rx_pos = 0;
+	for (i = 0; i < iovcnt; i++) {
+		off = (uintptr_t)layout[i].iov_base;
+		for (; rx_pos < off; rx_pos++) {
+			CU_ASSERT_EQUAL(rx_buf[rx_pos], 0);
+		}
+		CU_ASSERT_EQUAL(memcmp(rx_iov[i].iov_base, tx_buf + tx_pos, layout[i].iov_len), 0);
+		tx_pos += layout[i].iov_len;
+		rx_pos += layout[i].iov_len;
+	}
+
+out:
+	rte_free(rx_buf);
+	rte_free(tx_buf);
+}
+
+static void
+blockdev_write_readv_layout(const struct iovec *layout, int iovcnt, uint64_t offset)
+{
+	struct io_target *target;
+	uint32_t data_length = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		data_length += layout[i].iov_len;
+	}
+
+	target = g_io_targets;
+	while (target != NULL) {
+		if (data_length % target->bdev->blocklen == 0) {
+			blockdev_write_readv(target, layout, iovcnt, offset);
+		}
+		target = target->next;
+	}
+}
+
+static void
+blockdev_write_readv_16k_4_iovs(void)
+{
+	/* Page-sized iovecs with a page-sized hole after each. */
+	const struct iovec layout[] = {
+		{ (void *)0, 4096 },
+		{ (void *)8192, 4096 },
+		{ (void *)16384, 4096 },
+		{ (void *)24576, 4096 },
+	};
+
+	blockdev_write_readv_layout(layout, 4, 8192);
+}
+
+static void
+blockdev_write_readv_uneven_iovs(void)
+{
+	const struct iovec layout[] = {
+		{ (void *)0, 8192 },
+		{ (void *)12288, 4096 },
+		{ (void *)20480, 8192 },
+	};
+
+	blockdev_write_readv_layout(layout, 3, 4096);
+}
+
+static void
+blockdev_write_readv_split_block(void)
+{
+	struct io_target *target;
+	struct iovec layout[3];
+	uint32_t half, middle;
+
+	target = g_io_targets;
+	while (target != NULL) {
+		/*
+		 * O_DIRECT backends cannot take iovecs shorter than a sector, and
+		 *  a half block must still fit in the first page.
+		 */
+		if (target->bdev->need_aligned_buffer || target->bdev->blocklen > 8192) {
+			target = target->next;
+			continue;
+		}
+
+		/*
+		 * Half a block, then whole pages, then the other half: every
+		 *  iovec boundary falls in the middle of a block.  The first
+		 *  iovec ends and the others start on a page boundary so that
+		 *  PRP-based backends can still map the list.
+		 */
+		half = target->bdev->blocklen / 2;
+		middle = target->bdev->blocklen > 4096 ? target->bdev->blocklen : 4096;
+		layout[0].iov_base = (void *)(uintptr_t)(4096 - half % 4096);
+		layout[0].iov_len = half;
+		layout[1].iov_base = (void *)(uintptr_t)8192;
+		layout[1].iov_len = middle;
+		layout[2].iov_base = (void *)(uintptr_t)(8192 + middle);
+		layout[2].iov_len = half;
+
+		blockdev_write_readv(target, layout, 3, 0);
+
+		target = target->next;
+	}
+}
+
 static void
 blockdev_write_read_4k(void)
 {
@@ -533,6 +715,12 @@ main(int argc, char **argv)
 			       blockdev_write_read_max_offset) == NULL
 		|| CU_add_test(suite, "blockdev write read 8k on overlapped address offset",
 			       blockdev_overlapped_write_read_8k) == NULL
+		|| CU_add_test(suite, "blockdev write readv 16k in 4 iovs",
+			       blockdev_write_readv_16k_4_iovs) == NULL
+		|| CU_add_test(suite, "blockdev write readv uneven iovs",
+			       blockdev_write_readv_uneven_iovs) == NULL
+		|| CU_add_test(suite, "blockdev write readv iovs splitting a block",
+			       blockdev_write_readv_split_block) == NULL
 	) {
 		CU_cleanup_registry();
 		return CU_get_error();
@@ -32,6 +32,7 @@
  *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,6 +58,9 @@ struct bdevperf_task {
 	struct iovec		iov;
 	struct io_target	*target;
 	void			*buf;
+
+	/* Called when a write finishes, whether or not it used zero copy. */
+	spdk_bdev_io_completion_cb	write_cb;
 };
 
 static int g_io_size = 0;
@@ -66,14 +70,31 @@ static int g_is_random;
 static bool g_verify = false;
 static bool g_reset = false;
 static bool g_unmap = false;
+static bool g_flush = false;
 static int g_queue_depth;
 static int g_time_in_sec;
 static int g_show_performance_real_time = 0;
 static bool g_run_failed = false;
 static bool g_zcopy = true;
+/* Zipfian skew of random offsets; 0 means uniform. */
+static double g_zipf_theta = 0;
+/* Percentage of written data that compresses well; -1 leaves the buffers as allocated. */
+static int g_compressible = -1;
 
 static struct rte_timer g_perf_timer;
 
+/*
+ * Longest time between two consecutive runs of an active poller on each core,
+ *  i.e. the worst stall of that reactor's loop during the run.
+ */
+struct reactor_stall {
+	struct spdk_poller	*poller;
+	uint64_t		last_tsc;
+	uint64_t		max_tsc;
+};
+
+static struct reactor_stall g_stall[RTE_MAX_LCORE];
+
 static void bdevperf_submit_single(struct io_target *target);
 
 #include "../common.c"
@@ -83,10 +104,14 @@ struct io_target {
 	struct io_target	*next;
 	unsigned		lcore;
 	int			io_completed;
+	int			flush_completed;
 	int			current_queue_depth;
 	uint64_t		size_in_ios;
 	uint64_t		offset_in_ios;
 	bool			is_draining;
+	bool			zcopy_write;
+	double			zipf_zetan;
+	double			zipf_eta;
 	struct rte_timer	run_timer;
 	struct rte_timer	reset_timer;
 };
@@ -102,6 +127,53 @@ static int g_target_count = 0;
  */
 static uint32_t g_min_alignment = 8;
 
+static double
+zipf_zeta(uint64_t n, double theta)
+{
+	double sum = 0;
+	uint64_t i;
+
+	for (i = 1; i <= n; i++) {
+		sum += 1.0 / pow((double)i, theta);
+	}
+
+	return sum;
+}
+
+/*
+ * Zipfian offsets after Gray et al., "Quickly Generating Billion-Record
+ *  Synthetic Databases": offset i is picked with probability proportional to
+ *  1 / (i + 1)^theta, so the lowest offsets are the hot set.
+ */
+static void
+zipf_init(struct io_target *target)
+{
+	uint64_t n = target->size_in_ios;
+
+	target->zipf_zetan = zipf_zeta(n, g_zipf_theta);
+	target->zipf_eta = (1 - pow(2.0 / n, 1 - g_zipf_theta)) /
+			   (1 - zipf_zeta(2, g_zipf_theta) / target->zipf_zetan);
+}
+
+static uint64_t
+zipf_next(struct io_target *target, unsigned int *seedp)
+{
+	double u = rand_r(seedp) / ((double)RAND_MAX + 1);
+	double uz = u * target->zipf_zetan;
+	uint64_t offset;
+
+	if (uz < 1) {
+		return 0;
+	}
+	if (uz < 1 + pow(0.5, g_zipf_theta)) {
+		return 1;
+	}
+
+	offset = target->size_in_ios * pow(target->zipf_eta * u - target->zipf_eta + 1,
+					   1 / (1 - g_zipf_theta));
+	return offset < target->size_in_ios ? offset : target->size_in_ios - 1;
+}
+
 static void
 blockdev_heads_init(void)
 {
@@ -133,6 +205,12 @@ bdevperf_construct_targets(void)
 			continue;
 		}
 
+		if (g_rw_percentage < 100 && !spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_WRITE)) {
+			printf("Skipping %s because it is read-only\n", bdev->name);
+			bdev = spdk_bdev_next(bdev);
+			continue;
+		}
+
 		target = malloc(sizeof(struct io_target));
 		if (!target) {
 			fprintf(stderr, "Unable to allocate memory for new target.\n");
@@ -145,6 +223,7 @@ bdevperf_construct_targets(void)
 		target->next = head[index];
 		target->lcore = index;
 		target->io_completed = 0;
+		target->flush_completed = 0;
 		target->current_queue_depth = 0;
 		target->offset_in_ios = 0;
 		target->size_in_ios = (bdev->blockcnt * bdev->blocklen) /
@@ -153,7 +232,13 @@ bdevperf_construct_targets(void)
 			g_min_alignment = bdev->blocklen;
 		}
 
+		target->zipf_zetan = 0;
+		if (g_zipf_theta > 0 && target->size_in_ios > 2) {
+			zipf_init(target);
+		}
+
 		target->is_draining = false;
+		target->zcopy_write = g_zcopy && spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_ZCOPY);
 		rte_timer_init(&target->run_timer);
 		rte_timer_init(&target->reset_timer);
 
@@ -188,7 +273,7 @@ bdevperf_complete(spdk_event_t event)
 	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
 		g_run_failed = true;
 	} else if (g_verify || g_reset || g_unmap) {
-		if (memcmp(task->buf, bdev_io->u.read.buf, g_io_size) != 0) {
+		if (memcmp(task->buf, bdev_io->u.read.iovs[0].iov_base, g_io_size) != 0) {
 			printf("Buffer mismatch! Disk Offset: %lu\n", bdev_io->u.read.offset);
 			g_run_failed = true;
 		}
@@ -217,6 +302,56 @@ bdevperf_complete(spdk_event_t event)
 	}
 }
 
+static void bdevperf_submit_flush(struct io_target *target);
+
+static void
+bdevperf_flush_complete(spdk_event_t event)
+{
+	struct io_target	*target = spdk_event_get_arg1(event);
+	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
+	spdk_event_t		complete;
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		g_run_failed = true;
+	}
+
+	target->current_queue_depth--;
+	target->flush_completed++;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!target->is_draining) {
+		bdevperf_submit_flush(target);
+	} else if (target->current_queue_depth == 0) {
+		complete = spdk_event_allocate(rte_get_master_lcore(), end_run, NULL, NULL, NULL);
+		spdk_event_call(complete);
+	}
+}
+
+static void
+bdevperf_submit_flush(struct io_target *target)
+{
+	if (spdk_bdev_flush(target->bdev, 0, target->bdev->blockcnt * target->bdev->blocklen,
+			    bdevperf_flush_complete, target) == NULL) {
+		printf("Flush submission to %s failed\n", target->bdev->name);
+		abort();
+	}
+
+	target->current_queue_depth++;
+}
+
+static void
+stall_poll(void *arg)
+{
+	struct reactor_stall *stall = arg;
+	uint64_t now = rte_get_timer_cycles();
+
+	if (now - stall->last_tsc > stall->max_tsc) {
+		stall->max_tsc = now - stall->last_tsc;
+	}
+	stall->last_tsc = now;
+}
+
 static void
 bdevperf_unmap_complete(spdk_event_t event)
 {
@@ -246,9 +381,18 @@ bdevperf_verify_write_complete(spdk_event_t event)
 	struct io_target	*target;
 	struct bdevperf_task	*task = spdk_event_get_arg1(event);
 	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
+	uint64_t		offset, len;
 
 	target = task->target;
 
+	if (bdev_io->type == SPDK_BDEV_IO_TYPE_ZCOPY) {
+		offset = bdev_io->u.zcopy.offset;
+		len = bdev_io->u.zcopy.len;
+	} else {
+		offset = bdev_io->u.write.offset;
+		len = bdev_io->u.write.len;
+	}
+
 	if (g_unmap) {
 		/* Unmap the data */
 		struct spdk_scsi_unmap_bdesc *bdesc = calloc(1, sizeof(*bdesc));
@@ -257,28 +401,98 @@ bdevperf_verify_write_complete(spdk_event_t event)
 			exit(1);
 		}
 
-		to_be64(&bdesc->lba, bdev_io->u.write.offset / target->bdev->blocklen);
-		to_be32(&bdesc->block_count, bdev_io->u.write.len / target->bdev->blocklen);
+		to_be64(&bdesc->lba, offset / target->bdev->blocklen);
+		to_be32(&bdesc->block_count, len / target->bdev->blocklen);
 
 		spdk_bdev_unmap(target->bdev, bdesc, 1, bdevperf_unmap_complete,
 				task);
 	} else {
 		/* Read the data back in */
-		spdk_bdev_read(target->bdev, NULL,
-			       bdev_io->u.write.offset,
-			       bdev_io->u.write.len,
+		spdk_bdev_read(target->bdev, NULL, offset, len,
 			       bdevperf_complete, task);
 	}
 
 	spdk_bdev_free_io(bdev_io);
 }
 
+static void
+bdevperf_zcopy_start_complete(spdk_event_t event)
+{
+	struct bdevperf_task	*task = spdk_event_get_arg1(event);
+	struct spdk_bdev_io	*bdev_io = spdk_event_get_arg2(event);
+	size_t			copied = 0;
+	int			i;
+
+	if (bdev_io->status != SPDK_BDEV_IO_STATUS_SUCCESS) {
+		bdevperf_complete(event);
+		return;
+	}
+
+	/* Fill the backend's buffers in place, as a transport receiving the data would. */
+	for (i = 0; i < bdev_io->u.zcopy.iovcnt; i++) {
+		memcpy(bdev_io->u.zcopy.iovs[i].iov_base, (char *)task->buf + copied,
+		       bdev_io->u.zcopy.iovs[i].iov_len);
+		copied += bdev_io->u.zcopy.iovs[i].iov_len;
+	}
+
+	if (spdk_bdev_zcopy_commit(bdev_io, true, task->write_cb, task) != 0) {
+		printf("zcopy commit to %s failed\n", task->target->bdev->name);
+		abort();
+	}
+}
+
+static void
+bdevperf_submit_write(struct io_target *target, struct bdevperf_task *task,
+		      uint64_t offset, spdk_bdev_io_completion_cb cb)
+{
+	if (target->zcopy_write) {
+		task->write_cb = cb;
+		spdk_bdev_zcopy_start(target->bdev, offset, g_io_size,
+				      bdevperf_zcopy_start_complete, task);
+		return;
+	}
+
+	task->iov.iov_base = task->buf;
+	task->iov.iov_len = g_io_size;
+	spdk_bdev_writev(target->bdev, &task->iov, 1, offset, g_io_size, cb, task);
+}
+
+/*
+ * Fill buf with 64-byte records, g_compressible percent of them a line of
+ *  text in the manner of a log file, the others random bytes.
+ */
+static void
+fill_compressible(void *buf, unsigned int *fill_seed)
+{
+	static const char line[] = "2016-08-01 12:00:00.000 INFO  request served, status 200, ok   \n";
+	const int rec = sizeof(line) - 1;
+	uint8_t *p = buf;
+	int i, j;
+
+	for (i = 0; i + rec <= g_io_size; i += rec) {
+		if ((int)(rand_r(fill_seed) % 100) < g_compressible) {
+			memcpy(p + i, line, rec);
+			/* Vary the timestamp, as a real log would. */
+			p[i + 20] = '0' + i / rec % 10;
+		} else {
+			for (j = 0; j < rec; j++) {
+				p[i + j] = rand_r(fill_seed);
+			}
+		}
+	}
+	memset(p + i, 0, g_io_size - i);
+}
+
 static void
 task_ctor(struct rte_mempool *mp, void *arg, void *__task, unsigned id)
 {
 	struct bdevperf_task *task = __task;
+	unsigned int fill_seed = id;
 
 	task->buf = rte_malloc(NULL, g_io_size, g_min_alignment);
+	if (task->buf != NULL && g_compressible >= 0) {
+		fill_compressible(task->buf, &fill_seed);
+	}
 }
 
 static __thread unsigned int seed = 0;
@@ -300,7 +514,9 @@ bdevperf_submit_single(struct io_target *target)
 
 	task->target = target;
 
-	if (g_is_random) {
+	if (g_is_random && target->zipf_zetan > 0) {
+		offset_in_ios = zipf_next(target, &seed);
+	} else if (g_is_random) {
 		offset_in_ios = rand_r(&seed) % target->size_in_ios;
 	} else {
 		offset_in_ios = target->offset_in_ios++;
@@ -310,21 +526,20 @@ bdevperf_submit_single(struct io_target *target)
 	}
 
 	if (g_verify || g_reset || g_unmap) {
-		memset(task->buf, rand_r(&seed) % 256, g_io_size);
-		task->iov.iov_base = task->buf;
-		task->iov.iov_len = g_io_size;
-		spdk_bdev_writev(bdev, &task->iov, 1, offset_in_ios * g_io_size, g_io_size,
-				 bdevperf_verify_write_complete, task);
+		if (g_compressible >= 0) {
+			fill_compressible(task->buf, &seed);
+		} else {
+			memset(task->buf, rand_r(&seed) % 256, g_io_size);
+		}
+		bdevperf_submit_write(target, task, offset_in_ios * g_io_size,
+				      bdevperf_verify_write_complete);
 	} else if ((g_rw_percentage == 100) ||
 		   (g_rw_percentage != 0 && ((rand_r(&seed) % 100) < g_rw_percentage))) {
 		rbuf = g_zcopy ? NULL : task->buf;
 		spdk_bdev_read(bdev, rbuf, offset_in_ios * g_io_size, g_io_size,
 			       bdevperf_complete, task);
 	} else {
-		task->iov.iov_base = task->buf;
-		task->iov.iov_len = g_io_size;
-		spdk_bdev_writev(bdev, &task->iov, 1, offset_in_ios * g_io_size, g_io_size,
-				 bdevperf_complete, task);
+		bdevperf_submit_write(target, task, offset_in_ios * g_io_size, bdevperf_complete);
 	}
 
 	target->current_queue_depth++;
@@ -347,6 +562,10 @@ end_target(struct rte_timer *timer, void *arg)
 		rte_timer_stop_sync(&target->reset_timer);
 	}
 
+	if (g_flush && target == head[target->lcore]) {
+		spdk_poller_unregister(&g_stall[target->lcore].poller, NULL);
+	}
+
 	target->is_draining = true;
 }
 
@@ -388,6 +607,13 @@ static void
 bdevperf_submit_on_core(spdk_event_t event)
 {
 	struct io_target *target = spdk_event_get_arg1(event);
+	struct reactor_stall *stall;
+
+	if (g_flush) {
+		stall = &g_stall[rte_lcore_id()];
+		stall->last_tsc = rte_get_timer_cycles();
+		spdk_poller_register(&stall->poller, stall_poll, stall, rte_lcore_id(), NULL, 0);
+	}
 
 	/* Submit initial I/O for each block device. Each time one
 	 * completes, another will be submitted. */
@@ -400,6 +626,10 @@ bdevperf_submit_on_core(spdk_event_t event)
 					target->lcore, reset_target, target);
 		}
 		bdevperf_submit_io(target, g_queue_depth);
+		if (g_flush) {
+			/* Keep one flush outstanding alongside the reads. */
+			bdevperf_submit_flush(target);
+		}
 		target = target->next;
 	}
 }
@@ -413,10 +643,12 @@ static void usage(char *program_name)
 	printf("\t[-q io depth]\n");
 	printf("\t[-s io size in bytes]\n");
 	printf("\t[-w io pattern type, must be one of\n");
-	printf("\t\t(read, write, randread, randwrite, rw, randrw, verify, reset)]\n");
+	printf("\t\t(read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush)]\n");
 	printf("\t[-M rwmixread (100 for reads, 0 for writes)]\n");
 	printf("\t[-t time in seconds]\n");
 	printf("\t[-S Show performance result in real time]\n");
+	printf("\t[-Z zipfian skew of random offsets, 0 < theta < 1 (default: uniform)]\n");
+	printf("\t[-C percentage of written data that compresses well, 0 to 100]\n");
 }
 
 static void
@@ -444,6 +676,10 @@ performance_dump(int io_time)
 			printf("\r %-20s: %10.2f IO/s %10.2f MB/s\n",
 			       target->bdev->name, io_per_second,
 			       mb_per_second);
+			if (g_flush) {
+				printf("\r %-20s  %10.2f flushes/s\n", "",
+				       (float)target->flush_completed / io_time);
+			}
 			total_io_per_second += io_per_second;
 			total_mb_per_second += mb_per_second;
 			target = target->next;
@@ -453,6 +689,15 @@ performance_dump(int io_time)
 	printf("\r =====================================================\n");
 	printf("\r %-20s: %10.2f IO/s %10.2f MB/s\n",
 	       "Total", total_io_per_second, total_mb_per_second);
+
+	if (g_flush) {
+		for (index = 0; index < spdk_app_get_core_count(); index++) {
+			if (head[index] != NULL) {
+				printf("\r Logical core %d max reactor stall: %10.2f us\n", index,
+				       (float)g_stall[index].max_tsc * 1000000 / rte_get_timer_hz());
+			}
+		}
+	}
 	fflush(stdout);
 
 }
@@ -511,7 +756,7 @@ main(int argc, char **argv)
 	mix_specified = false;
 	core_mask = NULL;
 
-	while ((op = getopt(argc, argv, "c:m:q:s:t:w:M:S")) != -1) {
+	while ((op = getopt(argc, argv, "c:m:q:s:t:w:C:M:SZ:")) != -1) {
 		switch (op) {
 		case 'c':
 			config_file = optarg;
@@ -531,6 +776,13 @@ main(int argc, char **argv)
 		case 'w':
 			workload_type = optarg;
 			break;
+		case 'C':
+			g_compressible = atoi(optarg);
+			if (g_compressible < 0 || g_compressible > 100) {
+				fprintf(stderr, "-C must be from 0 to 100.\n");
+				exit(1);
+			}
+			break;
 		case 'M':
 			g_rw_percentage = atoi(optarg);
 			mix_specified = true;
@@ -538,6 +790,13 @@ main(int argc, char **argv)
 		case 'S':
 			g_show_performance_real_time = 1;
 			break;
+		case 'Z':
+			g_zipf_theta = atof(optarg);
+			if (g_zipf_theta <= 0 || g_zipf_theta >= 1) {
+				fprintf(stderr, "-Z must be between 0 and 1 (exclusive).\n");
+				exit(1);
+			}
+			break;
 		default:
 			usage(argv[0]);
 			exit(1);
@@ -573,10 +832,11 @@ main(int argc, char **argv)
 	    strcmp(workload_type, "randrw") &&
 	    strcmp(workload_type, "verify") &&
 	    strcmp(workload_type, "reset") &&
-	    strcmp(workload_type, "unmap")) {
+	    strcmp(workload_type, "unmap") &&
+	    strcmp(workload_type, "flush")) {
 		fprintf(stderr,
 			"io pattern type must be one of\n"
-			"(read, write, randread, randwrite, rw, randrw, verify, reset, unmap)\n");
+			"(read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush)\n");
 		exit(1);
 	}
 
@@ -585,6 +845,12 @@ main(int argc, char **argv)
 		g_rw_percentage = 100;
 	}
 
+	/* flush: random reads with one flush per target always outstanding */
+	if (!strcmp(workload_type, "flush")) {
+		g_rw_percentage = 100;
+		g_flush = true;
+	}
+
 	if (!strcmp(workload_type, "write") ||
 	    !strcmp(workload_type, "randwrite")) {
 		g_rw_percentage = 0;
@@ -618,7 +884,8 @@ main(int argc, char **argv)
 	    !strcmp(workload_type, "randwrite") ||
 	    !strcmp(workload_type, "verify") ||
 	    !strcmp(workload_type, "reset") ||
-	    !strcmp(workload_type, "unmap")) {
+	    !strcmp(workload_type, "unmap") ||
+	    !strcmp(workload_type, "flush")) {
 		if (mix_specified) {
 			fprintf(stderr, "Ignoring -M option... Please use -M option"
 				" only when using rw or randrw.\n");
@@ -10,6 +10,13 @@ testdir=$(readlink -f $(dirname $0))
 
 timing_enter blockdev
 
+# Backing file for the io_uring blockdev in bdev.conf
+dd if=/dev/zero of=/dev/shm/spdk_uring_test bs=1M count=64 &> /dev/null
+# Backing file for the volume store in snapshot_fill.conf and
+#  snapshot_full.conf; AIO needs O_DIRECT, which tmpfs lacks
+snapshot_file=/var/tmp/spdk_snapshot_test
+trap "rm -f /dev/shm/spdk_uring_test $snapshot_file; exit 1" SIGINT SIGTERM EXIT
+
 timing_enter bounds
 $testdir/bdevio/bdevio $testdir/bdev.conf
 process_core
@@ -20,6 +27,58 @@ $testdir/bdevperf/bdevperf -c $testdir/bdev.conf -q 32 -s 4096 -w verify -t 5
 process_core
 timing_exit verify
 
+timing_enter raid0
+$testdir/bdevio/bdevio $testdir/raid0.conf
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/raid0.conf -q 32 -s 4096 -w verify -t 5
+process_core
+timing_exit raid0
+
+timing_enter rcache
+$testdir/bdevperf/bdevperf -c $testdir/readcache.conf -q 32 -s 4096 -w verify -t 5
+process_core
+timing_exit rcache
+
+timing_enter wbcache
+$testdir/bdevio/bdevio $testdir/writecache.conf
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/writecache.conf -q 32 -s 4096 -w verify -t 5
+process_core
+timing_exit wbcache
+
+timing_enter lvol
+$testdir/bdevio/bdevio $testdir/lvol.conf
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/lvol.conf -q 32 -s 4096 -w verify -t 5
+process_core
+timing_exit lvol
+
+timing_enter snapshot
+$testdir/bdevio/bdevio $testdir/snapshot.conf
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/snapshot.conf -q 32 -s 4096 -w verify -t 5
+process_core
+# Fill Lvol0, then snapshot it, so that first writes copy Snap0's clusters
+dd if=/dev/zero of=$snapshot_file bs=1M count=64 &> /dev/null
+$testdir/bdevperf/bdevperf -c $testdir/snapshot_fill.conf -q 32 -s 65536 -w write -t 5
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/snapshot_full.conf -q 32 -s 4096 -w verify -t 5
+process_core
+timing_exit snapshot
+
+timing_enter compress
+$testdir/bdevio/bdevio $testdir/compress.conf
+process_core
+$testdir/bdevperf/bdevperf -c $testdir/compress.conf -q 32 -s 4096 -w verify -C 75 -t 5
+process_core
+timing_exit compress
+
+# Reads with a flush always outstanding; reports the worst reactor stall per core
+timing_enter flush
+$testdir/bdevperf/bdevperf -c $testdir/bdev.conf -q 32 -s 4096 -w flush -t 5
+process_core
+timing_exit flush
+
 if [ $RUN_NIGHTLY -eq 1 ]; then
 	# Use size 192KB which both exceeds typical 128KB max NVMe I/O
 	#  size and will cross 128KB Intel DC P3700 stripe boundaries.
@@ -28,6 +87,72 @@ if [ $RUN_NIGHTLY -eq 1 ]; then
 	process_core
 	timing_exit perf
 
+	# Compare the single malloc baseline against the 4-way RAID-0 stripe,
+	#  with I/Os both smaller and larger than the 64KB strip size
+	timing_enter raid0_perf
+	$testdir/bdevperf/bdevperf -c $testdir/raid0.conf -q 128 -w randread -s 4096 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/raid0.conf -q 128 -w write -s 262144 -t 5
+	process_core
+	timing_exit raid0_perf
+
+	# Skewed reads, so most of them hit in the read cache
+	timing_enter rcache_perf
+	$testdir/bdevperf/bdevperf -c $testdir/readcache.conf -q 128 -w randread -s 4096 -Z 0.99 -t 5
+	process_core
+	timing_exit rcache_perf
+
+	# Small random writes, which the write cache turns into sorted batches
+	timing_enter wbcache_perf
+	$testdir/bdevperf/bdevperf -c $testdir/writecache.conf -q 128 -w randwrite -s 4096 -t 5
+	process_core
+	timing_exit wbcache_perf
+
+	# Random writes allocate clusters on first touch; unmapping whole
+	#  64KB clusters returns them to the store and must read back zeroes
+	timing_enter lvol_perf
+	$testdir/bdevperf/bdevperf -c $testdir/lvol.conf -q 128 -w randwrite -s 4096 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/lvol.conf -q 1 -w unmap -s 65536 -t 5
+	process_core
+	timing_exit lvol_perf
+
+	# Random writes to a volume with a snapshot against the raw Malloc0
+	#  baseline, then random reads of all three
+	timing_enter snapshot_perf
+	$testdir/bdevperf/bdevperf -c $testdir/snapshot.conf -q 128 -w randwrite -s 4096 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/snapshot.conf -q 128 -w randread -s 4096 -t 5
+	process_core
+	timing_exit snapshot_perf
+
+	# Random writes to Lvol0 with a snapshot taken while it was empty,
+	#  where first writes fill from zeroes, against the same volume with
+	#  a snapshot taken after filling it, where each first write to a
+	#  cluster also reads 64 KiB from Snap0
+	timing_enter snapshot_full_perf
+	dd if=/dev/zero of=$snapshot_file bs=1M count=64 &> /dev/null
+	$testdir/bdevperf/bdevperf -c $testdir/snapshot_full.conf -q 128 -w randwrite -s 4096 -t 5
+	process_core
+	dd if=/dev/zero of=$snapshot_file bs=1M count=64 &> /dev/null
+	$testdir/bdevperf/bdevperf -c $testdir/snapshot_fill.conf -q 32 -w write -s 65536 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/snapshot_full.conf -q 128 -w randwrite -s 4096 -t 5
+	process_core
+	timing_exit snapshot_full_perf
+
+	# Whole-chunk writes of data that is 75% compressible against the raw
+	#  Malloc0 baseline, then small random writes, each of which reads
+	#  and recompresses its chunk, and small random reads
+	timing_enter compress_perf
+	$testdir/bdevperf/bdevperf -c $testdir/compress.conf -q 128 -w write -s 65536 -C 75 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/compress.conf -q 128 -w randwrite -s 4096 -C 75 -t 5
+	process_core
+	$testdir/bdevperf/bdevperf -c $testdir/compress.conf -q 128 -w randread -s 4096 -t 5
+	process_core
+	timing_exit compress_perf
+
 	timing_enter reset
 	$testdir/bdevperf/bdevperf -c $testdir/bdev.conf -q 16 -w reset -s 4096 -t 60
 	process_core
@@ -39,4 +164,7 @@ if [ $RUN_NIGHTLY -eq 1 ]; then
 	timing_exit unmap
 fi
 
+rm -f /dev/shm/spdk_uring_test $snapshot_file
+trap - SIGINT SIGTERM EXIT
+
 timing_exit blockdev
@@ -0,0 +1,657 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spdk_cunit.h"
+
+#include "nvme/blockdev_nvme.c"
+
+#define UT_SECTOR_SIZE		512
+#define UT_NUM_SECTORS		(1 << 21)
+#define UT_MAX_OUTSTANDING	16
+
+struct spdk_nvme_ns {
+	uint32_t			id;
+};
+
+struct spdk_nvme_ctrlr {
+	struct spdk_nvme_ctrlr_data	cdata;
+	struct spdk_nvme_ns		ns;
+	uint32_t			num_io_queues;
+};
+
+struct ut_nvme_cmd {
+	spdk_nvme_cmd_cb		cb_fn;
+	void				*cb_arg;
+};
+
+struct spdk_nvme_qpair {
+	/* lcore that this qpair was handed out to - set by the test */
+	uint32_t			lcore;
+	uint32_t			num_submitted;
+	uint32_t			num_polled;
+	uint32_t			num_outstanding;
+	struct ut_nvme_cmd		cmds[UT_MAX_OUTSTANDING];
+};
+
+struct spdk_poller {
+	spdk_poller_fn			fn;
+	void				*arg;
+	uint32_t			lcore;
+	TAILQ_ENTRY(spdk_poller)	tailq;
+};
+
+int32_t spdk_nvme_retry_count;
+
+uint64_t
+spdk_vtophys(void *buf)
+{
+	return (uintptr_t)buf;
+}
+
+/* lcore that the test is currently "running" on */
+static uint32_t g_ut_lcore;
+static uint64_t g_ut_core_mask;
+static int g_cross_core_access;
+static int g_num_completed;
+static enum spdk_bdev_io_status g_last_status;
+static TAILQ_HEAD(, spdk_poller) g_ut_pollers = TAILQ_HEAD_INITIALIZER(g_ut_pollers);
+
+uint64_t
+spdk_app_get_core_mask(void)
+{
+	return g_ut_core_mask;
+}
+
+void
+spdk_poller_register(struct spdk_poller **ppoller, spdk_poller_fn fn, void *arg,
+		     uint32_t lcore, struct spdk_event *complete, uint64_t period_microseconds)
+{
+	struct spdk_poller *poller;
+
+	poller = calloc(1, sizeof(*poller));
+	SPDK_CU_ASSERT_FATAL(poller != NULL);
+	poller->fn = fn;
+	poller->arg = arg;
+	poller->lcore = lcore;
+	TAILQ_INSERT_TAIL(&g_ut_pollers, poller, tailq);
+	*ppoller = poller;
+}
+
+void
+spdk_poller_unregister(struct spdk_poller **ppoller, struct spdk_event *complete)
+{
+	struct spdk_poller *poller = *ppoller;
+
+	CU_ASSERT(poller->lcore == g_ut_lcore);
+	TAILQ_REMOVE(&g_ut_pollers, poller, tailq);
+	free(poller);
+	*ppoller = NULL;
+}
+
+void
+spdk_bdev_register(struct spdk_bdev *bdev)
+{
+}
+
+void
+spdk_bdev_module_list_add(struct spdk_bdev_module_if *bdev_module)
+{
+}
+
+void
+spdk_bdev_io_get_rbuf(struct spdk_bdev_io *bdev_io, spdk_bdev_io_get_rbuf_cb cb)
+{
+	cb(bdev_io);
+}
+
+void
+spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	g_last_status = status;
+	g_num_completed++;
+}
+
+uint16_t
+spdk_pci_device_get_domain(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+uint8_t
+spdk_pci_device_get_bus(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+uint8_t
+spdk_pci_device_get_dev(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+uint8_t
+spdk_pci_device_get_func(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+const char *
+spdk_pci_device_get_device_name(struct spdk_pci_device *dev)
+{
+	return "ut_nvme";
+}
+
+int
+spdk_pci_device_has_non_uio_driver(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+int
+spdk_pci_device_bind_uio_driver(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+int
+spdk_pci_device_switch_to_uio_driver(struct spdk_pci_device *pci_dev)
+{
+	return 0;
+}
+
+int
+spdk_pci_device_claim(struct spdk_pci_device *dev)
+{
+	return 0;
+}
+
+int
+spdk_nvme_probe(void *cb_ctx, spdk_nvme_probe_cb probe_cb, spdk_nvme_attach_cb attach_cb,
+		spdk_nvme_remove_cb remove_cb)
+{
+	return 0;
+}
+
+int
+spdk_nvme_detach(struct spdk_nvme_ctrlr *ctrlr)
+{
+	return 0;
+}
+
+int
+spdk_nvme_ctrlr_reset(struct spdk_nvme_ctrlr *ctrlr)
+{
+	return 0;
+}
+
+size_t
+spdk_nvme_request_size(void)
+{
+	return 0;
+}
+
+const struct spdk_nvme_ctrlr_data *
+spdk_nvme_ctrlr_get_data(struct spdk_nvme_ctrlr *ctrlr)
+{
+	return &ctrlr->cdata;
+}
+
+uint32_t
+spdk_nvme_ctrlr_get_num_ns(struct spdk_nvme_ctrlr *ctrlr)
+{
+	return 1;
+}
+
+struct spdk_nvme_ns *
+spdk_nvme_ctrlr_get_ns(struct spdk_nvme_ctrlr *ctrlr, uint32_t ns_id)
+{
+	return &ctrlr->ns;
+}
+
+uint32_t
+spdk_nvme_ns_get_id(struct spdk_nvme_ns *ns)
+{
+	return ns->id;
+}
+
+uint32_t
+spdk_nvme_ns_get_sector_size(struct spdk_nvme_ns *ns)
+{
+	return UT_SECTOR_SIZE;
+}
+
+uint64_t
+spdk_nvme_ns_get_num_sectors(struct spdk_nvme_ns *ns)
+{
+	return UT_NUM_SECTORS;
+}
+
+struct spdk_nvme_qpair *
+spdk_nvme_ctrlr_alloc_io_qpair(struct spdk_nvme_ctrlr *ctrlr, enum spdk_nvme_qprio qprio)
+{
+	if (ctrlr->num_io_queues == 0) {
+		return NULL;
+	}
+
+	ctrlr->num_io_queues--;
+	return calloc(1, sizeof(struct spdk_nvme_qpair));
+}
+
+int
+spdk_nvme_ctrlr_free_io_qpair(struct spdk_nvme_qpair *qpair)
+{
+	free(qpair);
+	return 0;
+}
+
+static int
+ut_qpair_submit(struct spdk_nvme_qpair *qpair, spdk_nvme_cmd_cb cb_fn, void *cb_arg)
+{
+	if (qpair->lcore != g_ut_lcore) {
+		g_cross_core_access++;
+	}
+
+	SPDK_CU_ASSERT_FATAL(qpair->num_outstanding < UT_MAX_OUTSTANDING);
+	qpair->cmds[qpair->num_outstanding].cb_fn = cb_fn;
+	qpair->cmds[qpair->num_outstanding].cb_arg = cb_arg;
+	qpair->num_outstanding++;
+	qpair->num_submitted++;
+
+	return 0;
+}
+
+int
+spdk_nvme_ns_cmd_readv(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+		       uint64_t lba, uint32_t lba_count,
+		       spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint32_t io_flags,
+		       spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+		       spdk_nvme_req_next_sge_cb next_sge_fn)
+{
+	return ut_qpair_submit(qpair, cb_fn, cb_arg);
+}
+
+int
+spdk_nvme_ns_cmd_writev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			uint64_t lba, uint32_t lba_count,
+			spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint32_t io_flags,
+			spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+			spdk_nvme_req_next_sge_cb next_sge_fn)
+{
+	return ut_qpair_submit(qpair, cb_fn, cb_arg);
+}
+
+int
+spdk_nvme_ns_cmd_deallocate(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			    void *payload, uint16_t num_ranges,
+			    spdk_nvme_cmd_cb cb_fn, void *cb_arg)
+{
+	return ut_qpair_submit(qpair, cb_fn, cb_arg);
+}
+
+int32_t
+spdk_nvme_qpair_process_completions(struct spdk_nvme_qpair *qpair, uint32_t max_completions)
+{
+	struct spdk_nvme_cpl cpl = {};
+	uint32_t i, num_completions;
+
+	if (qpair->lcore != g_ut_lcore) {
+		g_cross_core_access++;
+	}
+
+	qpair->num_polled++;
+	num_completions = qpair->num_outstanding;
+	qpair->num_outstanding = 0;
+	for (i = 0; i < num_completions; i++) {
+		qpair->cmds[i].cb_fn(qpair->cmds[i].cb_arg, &cpl);
+	}
+
+	return num_completions;
+}
+
+/* Run one iteration of every poller registered on the given lcore. */
+static void
+ut_run_reactor(uint32_t lcore)
+{
+	struct spdk_poller *poller;
+
+	g_ut_lcore = lcore;
+	TAILQ_FOREACH(poller, &g_ut_pollers, tailq) {
+		if (poller->lcore == lcore) {
+			poller->fn(poller->arg);
+		}
+	}
+}
+
+static int
+ut_num_pollers(uint32_t lcore)
+{
+	struct spdk_poller *poller;
+	int count = 0;
+
+	TAILQ_FOREACH(poller, &g_ut_pollers, tailq) {
+		if (poller->lcore == lcore) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static struct nvme_device *
+ut_attach(struct spdk_nvme_ctrlr *ctrlr, uint64_t core_mask, uint32_t num_io_queues,
+	  int luns_per_ns)
+{
+	struct nvme_probe_ctx probe_ctx = {};
+	struct nvme_device *dev;
+	uint32_t lcore;
+
+	memset(ctrlr, 0, sizeof(*ctrlr));
+	ctrlr->cdata.oncs.dsm = 1;
+	ctrlr->ns.id = 1;
+	ctrlr->num_io_queues = num_io_queues;
+
+	g_ut_core_mask = core_mask;
+	nvme_luns_per_ns = luns_per_ns;
+	probe_ctx.controllers_remaining = -1;
+
+	attach_cb(&probe_ctx, NULL, ctrlr, NULL);
+
+	dev = TAILQ_FIRST(&g_nvme_devices);
+	SPDK_CU_ASSERT_FATAL(dev != NULL);
+	CU_ASSERT(dev->ctrlr == ctrlr);
+
+	/* Tag each qpair with the lcore it was handed out to. */
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (dev->ch[lcore].qpair != NULL) {
+			dev->ch[lcore].qpair->lcore = lcore;
+		}
+	}
+
+	return dev;
+}
+
+static void
+ut_detach(void)
+{
+	nvme_library_fini();
+	blockdev_index_max = 0;
+	nvme_controller_index = 0;
+	CU_ASSERT(TAILQ_EMPTY(&g_ut_pollers));
+}
+
+static void
+ut_submit(struct spdk_bdev_channel *ch, enum spdk_bdev_io_type type)
+{
+	struct spdk_bdev_io *bdev_io;
+	char buf[UT_SECTOR_SIZE];
+
+	bdev_io = calloc(1, sizeof(*bdev_io) + sizeof(struct nvme_blockio));
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	bdev_io->bdev = ch->bdev;
+	bdev_io->ch = ch;
+	bdev_io->ctx = ch->bdev->ctxt;
+	bdev_io->type = type;
+
+	switch (type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+		bdev_io->u.read.iov.iov_base = buf;
+		bdev_io->u.read.iov.iov_len = sizeof(buf);
+		bdev_io->u.read.iovs = &bdev_io->u.read.iov;
+		bdev_io->u.read.iovcnt = 1;
+		bdev_io->u.read.len = sizeof(buf);
+		break;
+	case SPDK_BDEV_IO_TYPE_WRITE:
+		bdev_io->u.write.iov.iov_base = buf;
+		bdev_io->u.write.iov.iov_len = sizeof(buf);
+		bdev_io->u.write.iovs = &bdev_io->u.write.iov;
+		bdev_io->u.write.iovcnt = 1;
+		bdev_io->u.write.len = sizeof(buf);
+		break;
+	default:
+		CU_ASSERT(false);
+		break;
+	}
+
+	g_num_completed = 0;
+	g_last_status = SPDK_BDEV_IO_STATUS_PENDING;
+	blockdev_nvme_submit_request(bdev_io);
+	CU_ASSERT(g_num_completed == 0);
+
+	/* Nothing should complete until the submitting lcore polls. */
+	ut_run_reactor(ch->lcore);
+	CU_ASSERT(g_num_completed == 1);
+	CU_ASSERT(g_last_status == SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	free(bdev_io);
+}
+
+static void
+qpair_per_core_test(void)
+{
+	struct spdk_nvme_ctrlr ctrlr;
+	struct nvme_device *dev;
+	uint32_t lcore, other;
+
+	/* lcores 0, 1 and 3 */
+	dev = ut_attach(&ctrlr, 0xB, 8, 2);
+
+	CU_ASSERT(blockdev_index_max == 2);
+	CU_ASSERT(g_blockdev[0].dev == dev);
+	CU_ASSERT(g_blockdev[1].dev == dev);
+	CU_ASSERT(ctrlr.num_io_queues == 5);
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (lcore < 64 && (g_ut_core_mask & (1ULL << lcore))) {
+			CU_ASSERT(dev->ch[lcore].qpair != NULL);
+		} else {
+			CU_ASSERT(dev->ch[lcore].qpair == NULL);
+		}
+		CU_ASSERT(dev->ch[lcore].ref == 0);
+		CU_ASSERT(dev->ch[lcore].poller == NULL);
+	}
+
+	for (lcore = 0; lcore < 4; lcore++) {
+		for (other = lcore + 1; other < 4; other++) {
+			if (dev->ch[lcore].qpair != NULL) {
+				CU_ASSERT(dev->ch[lcore].qpair != dev->ch[other].qpair);
+			}
+		}
+	}
+
+	ut_detach();
+}
+
+static void
+submit_per_core_test(void)
+{
+	struct spdk_nvme_ctrlr ctrlr;
+	struct nvme_device *dev;
+	struct spdk_bdev_channel ch[2][4];
+	uint32_t lcore;
+	int i, rc;
+
+	/* lcores 0-3, two blockdevs sharing the controller */
+	dev = ut_attach(&ctrlr, 0xF, 8, 2);
+	g_cross_core_access = 0;
+
+	for (lcore = 0; lcore < 4; lcore++) {
+		g_ut_lcore = lcore;
+		for (i = 0; i < 2; i++) {
+			memset(&ch[i][lcore], 0, sizeof(ch[i][lcore]));
+			ch[i][lcore].bdev = &g_blockdev[i].disk;
+			ch[i][lcore].lcore = lcore;
+			rc = blockdev_nvme_create_channel(&ch[i][lcore]);
+			CU_ASSERT(rc == 0);
+			CU_ASSERT(ch[i][lcore].ctx == dev->ch[lcore].qpair);
+		}
+
+		/* Both blockdevs share one qpair and one poller on each lcore. */
+		CU_ASSERT(dev->ch[lcore].ref == 2);
+		CU_ASSERT(ut_num_pollers(lcore) == 1);
+	}
+
+	for (lcore = 0; lcore < 4; lcore++) {
+		g_ut_lcore = lcore;
+		for (i = 0; i < 2; i++) {
+			ut_submit(&ch[i][lcore], SPDK_BDEV_IO_TYPE_READ);
+			ut_submit(&ch[i][lcore], SPDK_BDEV_IO_TYPE_WRITE);
+		}
+	}
+
+	/* Poll every lcore again - each must only touch its own qpair. */
+	for (lcore = 0; lcore < 4; lcore++) {
+		ut_run_reactor(lcore);
+	}
+
+	CU_ASSERT(g_cross_core_access == 0);
+	for (lcore = 0; lcore < 4; lcore++) {
+		CU_ASSERT(dev->ch[lcore].qpair->num_submitted == 4);
+		CU_ASSERT(dev->ch[lcore].qpair->num_outstanding == 0);
+		CU_ASSERT(dev->ch[lcore].qpair->num_polled == 5);
+	}
+
+	for (lcore = 0; lcore < 4; lcore++) {
+		g_ut_lcore = lcore;
+		blockdev_nvme_destroy_channel(&ch[0][lcore]);
+		CU_ASSERT(ut_num_pollers(lcore) == 1);
+		blockdev_nvme_destroy_channel(&ch[1][lcore]);
+		CU_ASSERT(ut_num_pollers(lcore) == 0);
+		CU_ASSERT(dev->ch[lcore].ref == 0);
+	}
+
+	ut_detach();
+}
+
+static void
+qpair_exhausted_test(void)
+{
+	struct spdk_nvme_ctrlr ctrlr;
+	struct nvme_device *dev;
+	struct spdk_bdev_channel ch = {};
+	int rc;
+
+	/* Three lcores, but the controller only has two I/O queues. */
+	dev = ut_attach(&ctrlr, 0x7, 2, 1);
+	CU_ASSERT(dev->ch[0].qpair != NULL);
+	CU_ASSERT(dev->ch[1].qpair != NULL);
+	CU_ASSERT(dev->ch[2].qpair == NULL);
+
+	g_ut_lcore = 2;
+	ch.bdev = &g_blockdev[0].disk;
+	ch.lcore = 2;
+	rc = blockdev_nvme_create_channel(&ch);
+	CU_ASSERT(rc != 0);
+	CU_ASSERT(ut_num_pollers(2) == 0);
+
+	ut_detach();
+}
+
+static void
+sgl_walk_test(void)
+{
+	struct nvme_blockio bio = {};
+	struct iovec iov[3];
+	char buf[3][UT_SECTOR_SIZE * 2];
+	uint64_t address;
+	uint32_t length;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+	}
+
+	bio.iovs = iov;
+	bio.iovcnt = 3;
+
+	/* Start of the payload */
+	queued_reset_sgl(&bio, 0);
+	for (i = 0; i < 3; i++) {
+		CU_ASSERT(queued_next_sge(&bio, &address, &length) == 0);
+		CU_ASSERT(address == (uintptr_t)buf[i]);
+		CU_ASSERT(length == sizeof(buf[i]));
+	}
+
+	/* Restart in the middle of the second element */
+	queued_reset_sgl(&bio, sizeof(buf[0]) + UT_SECTOR_SIZE);
+	CU_ASSERT(queued_next_sge(&bio, &address, &length) == 0);
+	CU_ASSERT(address == (uintptr_t)buf[1] + UT_SECTOR_SIZE);
+	CU_ASSERT(length == UT_SECTOR_SIZE);
+	CU_ASSERT(queued_next_sge(&bio, &address, &length) == 0);
+	CU_ASSERT(address == (uintptr_t)buf[2]);
+	CU_ASSERT(length == sizeof(buf[2]));
+
+	/* Restart exactly on an element boundary */
+	queued_reset_sgl(&bio, sizeof(buf[0]) * 2);
+	CU_ASSERT(queued_next_sge(&bio, &address, &length) == 0);
+	CU_ASSERT(address == (uintptr_t)buf[2]);
+	CU_ASSERT(length == sizeof(buf[2]));
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("blockdev_nvme", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "qpair per core", qpair_per_core_test) == NULL
+		|| CU_add_test(suite, "submit per core", submit_per_core_test) == NULL
+		|| CU_add_test(suite, "qpair exhausted", qpair_exhausted_test) == NULL
+		|| CU_add_test(suite, "sgl walk", sgl_walk_test) == NULL
+	) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
@@ -6,6 +6,8 @@ source $rootdir/scripts/autotest_common.sh
 
 timing_enter event
 $testdir/event/event -m 0xF -t 5
+$testdir/event/event -m 0xF -t 5 -s
 $testdir/reactor/reactor -t 1
+$testdir/reactor_perf/reactor_perf -t 1
 $testdir/subsystem/subsystem_ut
 timing_exit event
@@ -53,6 +53,7 @@ static uint64_t g_tsc_rate;
 static uint64_t g_tsc_us_rate;
 
 static int g_time_in_sec;
+static int g_queue_depth;
 
 static __thread uint64_t __call_count = 0;
 static uint64_t call_count[RTE_MAX_LCORE];
@@ -75,13 +76,13 @@ static int
 event_work_fn(void *arg)
 {
 	uint64_t tsc_end;
+	int i;
 
 	tsc_end = rte_get_timer_cycles() + g_time_in_sec * g_tsc_rate;
 
-	submit_new_event(NULL);
-	submit_new_event(NULL);
-	submit_new_event(NULL);
-	submit_new_event(NULL);
+	for (i = 0; i < g_queue_depth; i++) {
+		submit_new_event(NULL);
+	}
 
 	while (1) {
 
@@ -103,6 +104,8 @@ usage(char *program_name)
 	printf("%s options\n", program_name);
 	printf("\t[-m core mask for distributing I/O submission/completion work\n");
 	printf("\t\t(default: 0x1 - use core 0 only)]\n");
+	printf("\t[-q events in flight per lcore (default: 4)]\n");
+	printf("\t[-s use a single-producer event ring per core pair]\n");
 	printf("\t[-t time in seconds]\n");
 }
 
@@ -110,11 +113,14 @@ static void
 performance_dump(int io_time)
 {
 	uint32_t i;
+	uint64_t total = 0;
 
 	printf("\n");
 	RTE_LCORE_FOREACH(i) {
 		printf("lcore %2d: %8ju\n", i, call_count[i] / g_time_in_sec);
+		total += call_count[i];
 	}
+	printf("total:    %8ju events/s\n", total / g_time_in_sec);
 
 	fflush(stdout);
 }
@@ -130,12 +136,19 @@ main(int argc, char **argv)
 	opts.name = "event";
 
 	g_time_in_sec = 0;
+	g_queue_depth = 4;
 
-	while ((op = getopt(argc, argv, "m:t:")) != -1) {
+	while ((op = getopt(argc, argv, "m:q:st:")) != -1) {
 		switch (op) {
 		case 'm':
 			opts.reactor_mask = optarg;
 			break;
+		case 'q':
+			g_queue_depth = atoi(optarg);
+			break;
+		case 's':
+			opts.spsc_event_rings = true;
+			break;
 		case 't':
 			g_time_in_sec = atoi(optarg);
 			break;
@@ -145,7 +158,7 @@ main(int argc, char **argv)
 		}
 	}
 
-	if (!g_time_in_sec) {
+	if (!g_time_in_sec || g_queue_depth <= 0) {
 		usage(argv[0]);
 		exit(1);
 	}
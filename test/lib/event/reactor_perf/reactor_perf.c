@@ -0,0 +1,215 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+
+#include "spdk/event.h"
+
+static int g_time_in_sec;
+static int g_num_timer_pollers = 10000;
+static int g_num_active_pollers;
+static int g_max_period_us = 1000;
+
+static struct spdk_poller *test_end_poller;
+static struct spdk_poller *iteration_poller;
+static struct spdk_poller **timer_pollers;
+static struct spdk_poller **active_pollers;
+
+static uint64_t g_iterations;
+static uint64_t g_timer_calls;
+static uint64_t g_active_calls;
+static uint64_t g_start_tsc;
+
+static void
+test_end(void *arg)
+{
+	uint64_t elapsed = rte_get_timer_cycles() - g_start_tsc;
+	uint64_t hz = rte_get_timer_hz();
+	uint64_t cycles_per_iteration, ns_per_iteration;
+
+	printf("timer pollers:       %d\n", g_num_timer_pollers);
+	printf("active pollers:      %d\n", g_num_active_pollers);
+	printf("iterations:          %" PRIu64 "\n", g_iterations);
+	printf("timer poller calls:  %" PRIu64 "\n", g_timer_calls);
+	printf("active poller calls: %" PRIu64 "\n", g_active_calls);
+	if (g_iterations > 0) {
+		cycles_per_iteration = elapsed / g_iterations;
+		ns_per_iteration = cycles_per_iteration * 1000000000ULL / hz;
+		printf("cycles/iteration:    %" PRIu64 "\n", cycles_per_iteration);
+		printf("ns/iteration:        %" PRIu64 "\n", ns_per_iteration);
+	}
+
+	spdk_app_stop(0);
+}
+
+/* Active poller run once per reactor loop iteration - counts iterations. */
+static void
+count_iteration(void *arg)
+{
+	if (g_iterations++ == 0) {
+		g_start_tsc = rte_get_timer_cycles();
+	}
+}
+
+static void
+timer_fn(void *arg)
+{
+	g_timer_calls++;
+}
+
+static void
+active_fn(void *arg)
+{
+	g_active_calls++;
+}
+
+static void
+test_start(spdk_event_t evt)
+{
+	uint32_t lcore = rte_lcore_id();
+	int i;
+
+	printf("test_start\n");
+
+	/* Spread the periods so that timers expire at different times. */
+	for (i = 0; i < g_num_timer_pollers; i++) {
+		spdk_poller_register(&timer_pollers[i], timer_fn, NULL, lcore, NULL,
+				     1 + (i % g_max_period_us));
+	}
+
+	for (i = 0; i < g_num_active_pollers; i++) {
+		spdk_poller_register(&active_pollers[i], active_fn, NULL, lcore, NULL, 0);
+	}
+
+	spdk_poller_register(&iteration_poller, count_iteration, NULL, lcore, NULL, 0);
+
+	spdk_poller_register(&test_end_poller, test_end, NULL, lcore, NULL,
+			     g_time_in_sec * 1000000ULL);
+}
+
+static void
+test_cleanup(void)
+{
+	int i;
+
+	spdk_poller_unregister(&test_end_poller, NULL);
+	spdk_poller_unregister(&iteration_poller, NULL);
+
+	for (i = 0; i < g_num_timer_pollers; i++) {
+		spdk_poller_unregister(&timer_pollers[i], NULL);
+	}
+
+	for (i = 0; i < g_num_active_pollers; i++) {
+		spdk_poller_unregister(&active_pollers[i], NULL);
+	}
+}
+
+static void
+usage(const char *program_name)
+{
+	printf("%s options\n", program_name);
+	printf("\t[-t time in seconds]\n");
+	printf("\t[-n number of timer pollers (default 10000)]\n");
+	printf("\t[-a number of active pollers (default 0)]\n");
+	printf("\t[-p maximum timer poller period in microseconds (default 1000)]\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct spdk_app_opts opts;
+	int op;
+
+	spdk_app_opts_init(&opts);
+	opts.name = "reactor_perf";
+	/* Never sleep, so that only the poller overhead is measured. */
+	opts.max_delay_us = 0;
+
+	g_time_in_sec = 0;
+
+	while ((op = getopt(argc, argv, "a:n:p:t:")) != -1) {
+		switch (op) {
+		case 'a':
+			g_num_active_pollers = atoi(optarg);
+			break;
+		case 'n':
+			g_num_timer_pollers = atoi(optarg);
+			break;
+		case 'p':
+			g_max_period_us = atoi(optarg);
+			break;
+		case 't':
+			g_time_in_sec = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (!g_time_in_sec || g_num_timer_pollers < 0 || g_num_active_pollers < 0 ||
+	    g_max_period_us <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	timer_pollers = calloc(g_num_timer_pollers + 1, sizeof(*timer_pollers));
+	active_pollers = calloc(g_num_active_pollers + 1, sizeof(*active_pollers));
+	if (timer_pollers == NULL || active_pollers == NULL) {
+		fprintf(stderr, "Unable to allocate poller arrays\n");
+		exit(1);
+	}
+
+	optind = 1;
+
+	opts.shutdown_cb = test_cleanup;
+
+	spdk_app_init(&opts);
+
+	spdk_app_start(test_start, NULL, NULL);
+
+	test_cleanup();
+
+	spdk_app_fini();
+
+	free(timer_pollers);
+	free(active_pollers);
+
+	return 0;
+}
@@ -0,0 +1,721 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spdk_cunit.h"
+
+#include "iscsi/conn.c"
+#include "iscsi/iscsi.c"
+#include "iscsi/crc32c.c"
+
+SPDK_LOG_REGISTER_TRACE_FLAG("iscsi", SPDK_TRACE_ISCSI)
+
+struct spdk_iscsi_globals g_spdk_iscsi;
+
+/*
+ * The socket: recv returns bytes of g_stream up to g_arrived, the part that
+ *  has reached the target so far, and EAGAIN once it has returned all of them.
+ */
+static uint8_t *g_stream;
+static size_t g_stream_len;
+static size_t g_arrived;
+static size_t g_recv_pos;
+static int g_recv_calls;
+static bool g_closed;
+
+ssize_t
+spdk_sock_recv(int sock, void *buf, size_t len)
+{
+	size_t n;
+
+	g_recv_calls++;
+	if (g_recv_pos == g_arrived) {
+		if (g_closed) {
+			return 0;
+		}
+		errno = EAGAIN;
+		return -1;
+	}
+
+	n = g_arrived - g_recv_pos;
+	if (n > len) {
+		n = len;
+	}
+	memcpy(buf, g_stream + g_recv_pos, n);
+	g_recv_pos += n;
+
+	return n;
+}
+
+ssize_t
+spdk_sock_writev(int sock, struct iovec *iov, int iovcnt)
+{
+	return 0;
+}
+
+int
+spdk_sock_getaddr(int sock, char *saddr, int slen, char *caddr, int clen)
+{
+	return 0;
+}
+
+int
+spdk_sock_get_numa_node(int sock)
+{
+	return -1;
+}
+
+int
+spdk_sock_close(int sock)
+{
+	return 0;
+}
+
+int
+spdk_sock_set_recvlowat(int sock, int nbytes)
+{
+	return 0;
+}
+
+int
+spdk_sock_set_recvbuf(int sock, int sz)
+{
+	return 0;
+}
+
+int
+spdk_sock_set_sendbuf(int sock, int sz)
+{
+	return 0;
+}
+
+void
+spdk_net_framework_clear_socket_association(int sock)
+{
+}
+
+int
+spdk_net_framework_idle_time(void)
+{
+	return 0;
+}
+
+
+
+
+
+
+
+int
+spdk_iscsi_conn_params_init(struct iscsi_param **params)
+{
+	return 0;
+}
+
+void
+spdk_iscsi_param_free(struct iscsi_param *params)
+{
+}
+
+
+
+
+
+
+int
+spdk_iscsi_tgt_node_cleanup_luns(struct spdk_iscsi_conn *conn,
+				 struct spdk_iscsi_tgt_node *target)
+{
+	return 0;
+}
+
+
+void
+spdk_iscsi_acceptor_stop(void)
+{
+}
+
+int
+spdk_iscsi_portal_grp_close_all(void)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_sess_params_init(struct iscsi_param **params)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_copy_param2var(struct spdk_iscsi_conn *conn)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_negotiate_params(struct spdk_iscsi_conn *conn, struct iscsi_param *params,
+			    uint8_t *data, int alloc_len, int data_len)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_parse_params(struct iscsi_param **params, const uint8_t *data,
+			int len, bool cbit_enabled, char **partial_parameter)
+{
+	return 0;
+}
+
+struct iscsi_param *
+spdk_iscsi_param_find(struct iscsi_param *params, const char *key)
+{
+	return NULL;
+}
+
+int
+spdk_iscsi_param_del(struct iscsi_param **params, const char *key)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_param_add(struct iscsi_param **params, const char *key,
+		     const char *val, const char *list, int type)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_param_set(struct iscsi_param *params, const char *key, const char *val)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_param_set_int(struct iscsi_param *params, const char *key, uint32_t val)
+{
+	return 0;
+}
+
+char *
+spdk_iscsi_param_get_val(struct iscsi_param *params, const char *key)
+{
+	return NULL;
+}
+
+int
+spdk_iscsi_param_eq_val(struct iscsi_param *params, const char *key, const char *val)
+{
+	return 0;
+}
+
+struct spdk_iscsi_tgt_node *
+spdk_iscsi_find_tgt_node(const char *target_name)
+{
+	return NULL;
+}
+
+int
+spdk_iscsi_tgt_node_access(struct spdk_iscsi_conn *conn, struct spdk_iscsi_tgt_node *target,
+			   const char *iqn, const char *addr)
+{
+	return 0;
+}
+
+int
+spdk_iscsi_send_tgts(struct spdk_iscsi_conn *conn, const char *iiqn, const char *iaddr,
+		     const char *tiqn, uint8_t *data, int alloc_len, int data_len)
+{
+	return 0;
+}
+
+int
+spdk_md5init(struct spdk_md5ctx *md5ctx)
+{
+	return 0;
+}
+
+int
+spdk_md5update(struct spdk_md5ctx *md5ctx, const void *data, size_t len)
+{
+	return 0;
+}
+
+int
+spdk_md5final(void *md5, struct spdk_md5ctx *md5ctx)
+{
+	return 0;
+}
+
+struct spdk_iscsi_task *
+spdk_iscsi_task_get(uint32_t *owner_task_ctr, struct spdk_iscsi_task *parent)
+{
+	return NULL;
+}
+
+void
+spdk_scsi_dev_queue_task(struct spdk_scsi_dev *dev, struct spdk_scsi_task *task)
+{
+}
+
+void
+spdk_scsi_dev_queue_mgmt_task(struct spdk_scsi_dev *dev, struct spdk_scsi_task *task)
+{
+}
+
+struct spdk_scsi_port *
+spdk_scsi_dev_find_port_by_id(struct spdk_scsi_dev *dev, uint64_t id)
+{
+	return NULL;
+}
+
+int
+spdk_scsi_port_construct(struct spdk_scsi_port *port, uint64_t id, uint16_t index,
+			 const char *name)
+{
+	return 0;
+}
+
+/* PDUs and their data buffers come from the heap instead of the per-core caches. */
+struct spdk_iscsi_pdu *
+spdk_get_pdu(void)
+{
+	struct spdk_iscsi_pdu *pdu;
+
+	pdu = calloc(1, sizeof(*pdu));
+	SPDK_CU_ASSERT_FATAL(pdu != NULL);
+	pdu->ahs = (struct iscsi_ahs *)pdu->ahs_data;
+	pdu->ref = 1;
+
+	return pdu;
+}
+
+void *
+spdk_iscsi_cache_get(enum spdk_iscsi_cache_type type)
+{
+	struct spdk_mobj *mobj;
+	size_t len;
+
+	if (type == ISCSI_CACHE_IMMEDIATE_DATA) {
+		len = spdk_get_immediate_data_buffer_size();
+	} else {
+		len = spdk_get_data_out_buffer_size();
+	}
+
+	mobj = calloc(1, sizeof(*mobj) + len);
+	SPDK_CU_ASSERT_FATAL(mobj != NULL);
+	mobj->buf = mobj + 1;
+	mobj->len = len;
+
+	return mobj;
+}
+
+void
+spdk_iscsi_cache_put_mobj(struct spdk_mobj *mobj)
+{
+	free(mobj);
+}
+
+void
+spdk_put_pdu(struct spdk_iscsi_pdu *pdu)
+{
+	if (pdu == NULL || --pdu->ref > 0) {
+		return;
+	}
+
+	spdk_iscsi_cache_put_mobj(pdu->mobj);
+	free(pdu);
+}
+
+void
+spdk_put_task(struct spdk_scsi_task *task)
+{
+}
+
+void
+spdk_scsi_task_free_data(struct spdk_scsi_task *task)
+{
+}
+
+static struct spdk_iscsi_sess g_sess;
+
+/*
+ * A connection in full feature phase as far as spdk_iscsi_read_pdu() is
+ *  concerned: data segments are limited by the negotiated lengths.
+ */
+static struct spdk_iscsi_conn *
+ut_conn_alloc(void)
+{
+	struct spdk_iscsi_conn *conn;
+
+	g_spdk_iscsi.FirstBurstLength = DEFAULT_FIRSTBURSTLENGTH;
+	g_spdk_iscsi.MaxRecvDataSegmentLength = SPDK_ISCSI_MAX_RECV_DATA_SEGMENT_LENGTH;
+
+	conn = calloc(1, sizeof(*conn));
+	SPDK_CU_ASSERT_FATAL(conn != NULL);
+	conn->recv_buf = malloc(ISCSI_RECV_BUF_SIZE);
+	SPDK_CU_ASSERT_FATAL(conn->recv_buf != NULL);
+	conn->sess = &g_sess;
+
+	return conn;
+}
+
+static void
+ut_conn_free(struct spdk_iscsi_conn *conn)
+{
+	spdk_put_pdu(conn->pdu_in_progress);
+	free(conn->recv_buf);
+	free(conn);
+}
+
+#define UT_MAX_PDUS	64
+
+/* Where each PDU starts in g_stream */
+static size_t g_pdu_offset[UT_MAX_PDUS + 1];
+static int g_num_pdus;
+
+static void
+ut_stream_reset(void)
+{
+	free(g_stream);
+	g_stream = NULL;
+	g_stream_len = 0;
+	g_arrived = 0;
+	g_recv_pos = 0;
+	g_recv_calls = 0;
+	g_closed = false;
+	g_num_pdus = 0;
+}
+
+/* Append a PDU with a random payload, as an initiator would send it. */
+static void
+ut_stream_add(struct spdk_iscsi_conn *conn, uint8_t opcode, int ahs_len, int data_len)
+{
+	struct iscsi_bhs bhs;
+	uint8_t *p;
+	size_t len, i;
+
+	SPDK_CU_ASSERT_FATAL(g_num_pdus < UT_MAX_PDUS);
+
+	len = ISCSI_BHS_LEN + ahs_len;
+	if (conn->header_digest) {
+		len += ISCSI_DIGEST_LEN;
+	}
+	if (data_len != 0) {
+		len += ISCSI_ALIGN(data_len);
+		if (conn->data_digest) {
+			len += ISCSI_DIGEST_LEN;
+		}
+	}
+
+	g_stream = realloc(g_stream, g_stream_len + len);
+	SPDK_CU_ASSERT_FATAL(g_stream != NULL);
+	for (i = g_stream_len; i < g_stream_len + len; i++) {
+		g_stream[i] = rand();
+	}
+
+	/* PDUs follow each other unaligned in the stream. */
+	memcpy(&bhs, g_stream + g_stream_len, sizeof(bhs));
+	bhs.opcode = opcode;
+	bhs.total_ahs_len = ahs_len / 4;
+	DSET24(bhs.data_segment_len, data_len);
+	memcpy(g_stream + g_stream_len, &bhs, sizeof(bhs));
+
+	/* Correct digests, so that spdk_iscsi_read_pdu() accepts the PDU. */
+	p = g_stream + g_stream_len + ISCSI_BHS_LEN + ahs_len;
+	if (conn->header_digest) {
+		MAKE_DIGEST_WORD(p, spdk_crc32c(g_stream + g_stream_len, ISCSI_BHS_LEN + ahs_len));
+		p += ISCSI_DIGEST_LEN;
+	}
+	if (data_len != 0 && conn->data_digest) {
+		MAKE_DIGEST_WORD(p + ISCSI_ALIGN(data_len), spdk_crc32c(p, ISCSI_ALIGN(data_len)));
+	}
+
+	g_pdu_offset[g_num_pdus++] = g_stream_len;
+	g_stream_len += len;
+	g_pdu_offset[g_num_pdus] = g_stream_len;
+}
+
+/* A login, small and large writes, a burst of reads and odd-sized text. */
+static void
+ut_stream_build(struct spdk_iscsi_conn *conn)
+{
+	int i;
+
+	ut_stream_reset();
+
+	ut_stream_add(conn, ISCSI_OP_LOGIN, 0, 301);
+	ut_stream_add(conn, ISCSI_OP_SCSI, 0, 4096);
+	for (i = 0; i < 32; i++) {
+		ut_stream_add(conn, ISCSI_OP_SCSI, 0, 0);
+	}
+	ut_stream_add(conn, ISCSI_OP_SCSI, 20, 0);
+	ut_stream_add(conn, ISCSI_OP_SCSI_DATAOUT, 0, 65536);
+	ut_stream_add(conn, ISCSI_OP_SCSI_DATAOUT, 0, ISCSI_RECV_BUF_SIZE);
+	ut_stream_add(conn, ISCSI_OP_SCSI_DATAOUT, 0, ISCSI_RECV_BUF_SIZE - 1);
+	ut_stream_add(conn, ISCSI_OP_NOPOUT, 0, 0);
+	ut_stream_add(conn, ISCSI_OP_TEXT, 0, 7);
+}
+
+/* Check that pdu holds the bytes of the n-th PDU of the stream. */
+static void
+ut_check_pdu(struct spdk_iscsi_conn *conn, struct spdk_iscsi_pdu *pdu, int n)
+{
+	uint8_t *p = g_stream + g_pdu_offset[n];
+	int ahs_len = pdu->bhs.total_ahs_len * 4;
+	int data_len = ISCSI_ALIGN(DGET24(pdu->bhs.data_segment_len));
+
+	CU_ASSERT(memcmp(&pdu->bhs, p, ISCSI_BHS_LEN) == 0);
+	p += ISCSI_BHS_LEN;
+	CU_ASSERT(memcmp(pdu->ahs, p, ahs_len) == 0);
+	p += ahs_len;
+	if (conn->header_digest) {
+		CU_ASSERT(memcmp(pdu->header_digest, p, ISCSI_DIGEST_LEN) == 0);
+		p += ISCSI_DIGEST_LEN;
+	}
+	if (data_len != 0) {
+		CU_ASSERT(memcmp(pdu->data, p, data_len) == 0);
+		p += data_len;
+		if (conn->data_digest) {
+			CU_ASSERT(memcmp(pdu->data_digest, p, ISCSI_DIGEST_LEN) == 0);
+			p += ISCSI_DIGEST_LEN;
+		}
+	}
+	CU_ASSERT(p == g_stream + g_pdu_offset[n + 1]);
+}
+
+/*
+ * Replay the stream arriving in pieces of 1 to max_piece bytes, and parse
+ *  whatever PDUs are complete after each piece, as the connection's poller
+ *  would.  Returns the number of PDUs parsed.
+ */
+static int
+ut_replay(struct spdk_iscsi_conn *conn, size_t max_piece)
+{
+	struct spdk_iscsi_pdu *pdu;
+	int n = 0, rc;
+
+	conn->recv_buf_offset = 0;
+	conn->recv_buf_len = 0;
+
+	while (n < g_num_pdus) {
+		if (g_arrived < g_stream_len) {
+			g_arrived += 1 + rand() % max_piece;
+			if (g_arrived > g_stream_len) {
+				g_arrived = g_stream_len;
+			}
+		}
+
+		while (n < g_num_pdus) {
+			rc = spdk_iscsi_read_pdu(conn, &pdu);
+			SPDK_CU_ASSERT_FATAL(rc >= 0);
+			if (rc == 0) {
+				/* Nothing is left unread that has arrived. */
+				CU_ASSERT(pdu == NULL);
+				CU_ASSERT(g_recv_pos == g_arrived);
+				CU_ASSERT(conn->recv_buf_offset == conn->recv_buf_len);
+				break;
+			}
+			SPDK_CU_ASSERT_FATAL(pdu != NULL);
+			ut_check_pdu(conn, pdu, n++);
+			spdk_put_pdu(pdu);
+		}
+
+		if (g_arrived == g_stream_len && n < g_num_pdus) {
+			CU_FAIL("stream ended in the middle of a PDU");
+			break;
+		}
+	}
+
+	CU_ASSERT(conn->pdu_in_progress == NULL);
+	CU_ASSERT(conn->recv_buf_offset == conn->recv_buf_len);
+	return n;
+}
+
+static void
+read_pdu_split_test(void)
+{
+	struct spdk_iscsi_conn *conn;
+	size_t pieces[] = { 1, 3, 47, 49, 512, ISCSI_RECV_BUF_SIZE, 3 * ISCSI_RECV_BUF_SIZE, 1 << 20 };
+	int digest, seed;
+	size_t i;
+
+	conn = ut_conn_alloc();
+
+	for (digest = 0; digest < 4; digest++) {
+		conn->header_digest = digest & 1;
+		conn->data_digest = (digest >> 1) & 1;
+		for (i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+			for (seed = 0; seed < 8; seed++) {
+				srand(seed);
+				ut_stream_build(conn);
+				CU_ASSERT(ut_replay(conn, pieces[i]) == g_num_pdus);
+				CU_ASSERT(g_recv_pos == g_stream_len);
+			}
+		}
+	}
+
+	ut_stream_reset();
+	ut_conn_free(conn);
+}
+
+static void
+read_pdu_batch_test(void)
+{
+	struct spdk_iscsi_conn *conn;
+	struct spdk_iscsi_pdu *pdu;
+	int i;
+
+	conn = ut_conn_alloc();
+
+	/* A burst of commands that arrived together takes one recv. */
+	ut_stream_reset();
+	for (i = 0; i < 32; i++) {
+		ut_stream_add(conn, ISCSI_OP_SCSI, 0, 0);
+	}
+	g_arrived = g_stream_len;
+	for (i = 0; i < 32; i++) {
+		CU_ASSERT(spdk_iscsi_read_pdu(conn, &pdu) == 1);
+		SPDK_CU_ASSERT_FATAL(pdu != NULL);
+		ut_check_pdu(conn, pdu, i);
+		spdk_put_pdu(pdu);
+	}
+	CU_ASSERT(g_recv_calls == 1);
+
+	/* The next read finds the buffer empty and the socket drained. */
+	CU_ASSERT(spdk_iscsi_read_pdu(conn, &pdu) == 0);
+	CU_ASSERT(pdu == NULL);
+	CU_ASSERT(g_recv_calls == 2);
+
+	/*
+	 * A large data segment is received in place once the part that came
+	 *  in with its header has been copied out of the buffer.
+	 */
+	ut_stream_reset();
+	ut_stream_add(conn, ISCSI_OP_SCSI_DATAOUT, 0, 65536);
+	g_arrived = g_stream_len;
+	CU_ASSERT(spdk_iscsi_read_pdu(conn, &pdu) == 1);
+	SPDK_CU_ASSERT_FATAL(pdu != NULL);
+	ut_check_pdu(conn, pdu, 0);
+	spdk_put_pdu(pdu);
+	CU_ASSERT(g_recv_calls == 2);
+	CU_ASSERT(conn->recv_buf_len == 0);
+
+	ut_stream_reset();
+	ut_conn_free(conn);
+}
+
+static void
+read_pdu_digest_error_test(void)
+{
+	struct spdk_iscsi_conn *conn;
+	struct spdk_iscsi_pdu *pdu;
+
+	conn = ut_conn_alloc();
+	conn->header_digest = 1;
+
+	/* A corrupted header digest is fatal to the connection. */
+	ut_stream_reset();
+	ut_stream_add(conn, ISCSI_OP_NOPOUT, 0, 0);
+	g_stream[ISCSI_BHS_LEN] ^= 0x01;
+	g_arrived = g_stream_len;
+	CU_ASSERT(spdk_iscsi_read_pdu(conn, &pdu) == SPDK_ISCSI_CONNECTION_FATAL);
+
+	ut_stream_reset();
+	ut_conn_free(conn);
+}
+
+static void
+read_data_closed_test(void)
+{
+	struct spdk_iscsi_conn *conn;
+	uint8_t buf[ISCSI_BHS_LEN];
+
+	conn = ut_conn_alloc();
+
+	ut_stream_reset();
+	ut_stream_add(conn, ISCSI_OP_NOPOUT, 0, 0);
+	g_arrived = g_stream_len;
+	g_closed = true;
+
+	/* Bytes received before the peer closed the connection are still read. */
+	CU_ASSERT(spdk_iscsi_conn_read_data(conn, 0, buf) == 0);
+	CU_ASSERT(spdk_iscsi_conn_read_data(conn, 20, buf) == 20);
+	CU_ASSERT(spdk_iscsi_conn_read_data(conn, 28, buf + 20) == 28);
+	CU_ASSERT(memcmp(buf, g_stream, ISCSI_BHS_LEN) == 0);
+	CU_ASSERT(g_recv_calls == 1);
+
+	CU_ASSERT(spdk_iscsi_conn_read_data(conn, ISCSI_BHS_LEN, buf) ==
+		  SPDK_ISCSI_CONNECTION_FATAL);
+
+	ut_stream_reset();
+	ut_conn_free(conn);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("iscsi_conn_suite", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "read pdu split test", read_pdu_split_test) == NULL ||
+		CU_add_test(suite, "read pdu batch test", read_pdu_batch_test) == NULL ||
+		CU_add_test(suite, "read pdu digest error test", read_pdu_digest_error_test) == NULL ||
+		CU_add_test(suite, "read data closed test", read_data_closed_test) == NULL
+	) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
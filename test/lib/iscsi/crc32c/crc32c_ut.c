@@ -0,0 +1,200 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "spdk_cunit.h"
+
+#include "iscsi/crc32c.c"
+
+#define TEST_BUF_LEN	(3 * 3 * 8192 + 3 * 256 + 64)
+
+static uint8_t g_buf[TEST_BUF_LEN + 8];
+
+static void
+fill_buf(uint8_t *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	srand(seed);
+	for (i = 0; i < len; i++) {
+		buf[i] = rand() & 0xff;
+	}
+}
+
+static void
+crc32c_known_vectors(void)
+{
+	const char *check = "123456789";
+	uint8_t buf[32];
+	uint32_t crc;
+	int i;
+
+	crc = spdk_update_crc32c((const uint8_t *)check, strlen(check), SPDK_CRC32C_INITIAL);
+	CU_ASSERT((crc ^ SPDK_CRC32C_XOR) == 0xe3069283);
+
+	/* RFC 3720 B.4 */
+	memset(buf, 0, sizeof(buf));
+	CU_ASSERT(spdk_crc32c(buf, sizeof(buf)) == 0x8a9136aa);
+
+	memset(buf, 0xff, sizeof(buf));
+	CU_ASSERT(spdk_crc32c(buf, sizeof(buf)) == 0x62a8ab43);
+
+	for (i = 0; i < 32; i++) {
+		buf[i] = i;
+	}
+	CU_ASSERT(spdk_crc32c(buf, sizeof(buf)) == 0x46dd794e);
+
+	for (i = 0; i < 32; i++) {
+		buf[i] = 31 - i;
+	}
+	CU_ASSERT(spdk_crc32c(buf, sizeof(buf)) == 0x113fdb5c);
+}
+
+static void
+check_against_table(uint32_t (*fn)(const uint8_t *, size_t, uint32_t))
+{
+	size_t lens[] = { 0, 1, 7, 8, 9, 63, 768, 769, 3 * 8192, 3 * 8192 + 3 * 256 + 5, TEST_BUF_LEN };
+	size_t i, offset;
+	uint32_t seed = 0x12345678;
+
+	fill_buf(g_buf, sizeof(g_buf), 1);
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		for (offset = 0; offset < 8; offset++) {
+			CU_ASSERT(fn(g_buf + offset, lens[i], seed) ==
+				  spdk_update_crc32c_table(g_buf + offset, lens[i], seed));
+		}
+	}
+
+	/* Every length around the block boundaries. */
+	for (i = 3 * 256 - 16; i < 3 * 256 + 16; i++) {
+		CU_ASSERT(fn(g_buf + 3, i, seed) == spdk_update_crc32c_table(g_buf + 3, i, seed));
+	}
+}
+
+static void
+crc32c_dispatch_test(void)
+{
+	check_against_table(spdk_update_crc32c);
+}
+
+static void
+crc32c_sse42_test(void)
+{
+#ifdef SPDK_USE_CRC32C_SSE42
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_2)) {
+		return;
+	}
+	check_against_table(spdk_update_crc32c_sse42);
+
+	if (!(ecx & bit_PCLMUL)) {
+		return;
+	}
+	CU_ASSERT(spdk_update_crc32c_fn == spdk_update_crc32c_pclmul);
+	check_against_table(spdk_update_crc32c_pclmul);
+#endif
+}
+
+static void
+crc32c_iov_test(void)
+{
+	struct iovec iov[16];
+	size_t len, remaining, pos;
+	int iovcnt;
+
+	fill_buf(g_buf, sizeof(g_buf), 2);
+	srand(3);
+
+	for (len = 1; len < TEST_BUF_LEN; len = len * 3 + 1) {
+		iovcnt = 0;
+		pos = 0;
+		remaining = len;
+		while (remaining > 0) {
+			iov[iovcnt].iov_base = g_buf + pos;
+			if (iovcnt == 15) {
+				iov[iovcnt].iov_len = remaining;
+			} else {
+				iov[iovcnt].iov_len = (rand() % remaining) + 1;
+			}
+			pos += iov[iovcnt].iov_len;
+			remaining -= iov[iovcnt].iov_len;
+			iovcnt++;
+		}
+
+		CU_ASSERT(spdk_crc32c_iov(iov, iovcnt) == spdk_crc32c(g_buf, len));
+		CU_ASSERT(spdk_update_crc32c_iov(iov, iovcnt, SPDK_CRC32C_INITIAL) ==
+			  spdk_update_crc32c_table(g_buf, len, SPDK_CRC32C_INITIAL));
+	}
+
+	/* An empty iovec array gives the same result as an empty buffer. */
+	CU_ASSERT(spdk_crc32c_iov(iov, 0) == spdk_crc32c(g_buf, 0));
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("crc32c", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "known vectors", crc32c_known_vectors) == NULL ||
+		CU_add_test(suite, "dispatch", crc32c_dispatch_test) == NULL ||
+		CU_add_test(suite, "sse4.2", crc32c_sse42_test) == NULL ||
+		CU_add_test(suite, "iovec", crc32c_iov_test) == NULL
+	) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
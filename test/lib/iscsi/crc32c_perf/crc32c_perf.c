@@ -0,0 +1,157 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iscsi/crc32c.c"
+
+#define MAX_IOVCNT	64
+
+static size_t g_buf_size = 8192;
+static int g_iovcnt = 1;
+static int g_time_in_sec = 1;
+
+static uint8_t *g_buf;
+static struct iovec g_iov[MAX_IOVCNT];
+
+static uint64_t
+get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+run(const char *name, uint32_t (*fn)(const uint8_t *buf, size_t len, uint32_t crc))
+{
+	uint64_t start, end, now, count = 0, bytes;
+	uint32_t crc = SPDK_CRC32C_INITIAL;
+	int i;
+
+	start = get_ns();
+	end = start + (uint64_t)g_time_in_sec * 1000000000ULL;
+	do {
+		for (i = 0; i < g_iovcnt; i++) {
+			crc = fn(g_iov[i].iov_base, g_iov[i].iov_len, crc);
+		}
+		count++;
+		now = get_ns();
+	} while (now < end);
+
+	bytes = count * g_buf_size;
+	printf("%-8s %10.1f MiB/s %10.1f ns/buffer (crc 0x%08x)\n", name,
+	       (double)bytes / (1024 * 1024) / ((double)(now - start) / 1000000000),
+	       (double)(now - start) / count, crc);
+}
+
+static void
+usage(const char *program_name)
+{
+	printf("%s options\n", program_name);
+	printf("\t[-s buffer size in bytes (default: 8192)]\n");
+	printf("\t[-i number of iovecs to split the buffer into (default: 1, max: %d)]\n",
+	       MAX_IOVCNT);
+	printf("\t[-t time in seconds per implementation (default: 1)]\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t iov_len, offset;
+	int op, i;
+
+	while ((op = getopt(argc, argv, "i:s:t:")) != -1) {
+		switch (op) {
+		case 'i':
+			g_iovcnt = atoi(optarg);
+			break;
+		case 's':
+			g_buf_size = strtoull(optarg, NULL, 10);
+			break;
+		case 't':
+			g_time_in_sec = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (g_iovcnt <= 0 || g_iovcnt > MAX_IOVCNT || g_buf_size < (size_t)g_iovcnt ||
+	    g_time_in_sec <= 0) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	g_buf = malloc(g_buf_size);
+	if (g_buf == NULL) {
+		fprintf(stderr, "could not allocate %zu byte buffer\n", g_buf_size);
+		exit(1);
+	}
+	for (offset = 0; offset < g_buf_size; offset++) {
+		g_buf[offset] = rand() & 0xff;
+	}
+
+	iov_len = g_buf_size / g_iovcnt;
+	for (i = 0, offset = 0; i < g_iovcnt; i++, offset += iov_len) {
+		g_iov[i].iov_base = g_buf + offset;
+		g_iov[i].iov_len = (i == g_iovcnt - 1) ? g_buf_size - offset : iov_len;
+	}
+
+	printf("CRC32C over %zu bytes in %d iovec(s)\n", g_buf_size, g_iovcnt);
+
+#ifdef USE_ISAL
+	run("isa-l", spdk_update_crc32c);
+#else
+	run("table", spdk_update_crc32c_table);
+#ifdef SPDK_USE_CRC32C_SSE42
+	if (spdk_update_crc32c_fn != spdk_update_crc32c_table) {
+		run("sse4.2", spdk_update_crc32c_sse42);
+	}
+	if (spdk_update_crc32c_fn == spdk_update_crc32c_pclmul) {
+		run("pclmul", spdk_update_crc32c_pclmul);
+	}
+#endif
+#endif
+
+	free(g_buf);
+	return 0;
+}
@@ -8,6 +8,15 @@ source $rootdir/scripts/autotest_common.sh
 
 timing_enter iscsi
 
+timing_enter crc32c
+$testdir/crc32c/crc32c_ut
+$testdir/crc32c_perf/crc32c_perf -t 1
+timing_exit crc32c
+
+timing_enter conn
+$testdir/conn/conn_ut
+timing_exit conn
+
 timing_enter param
 $testdir/param/param_ut
 timing_exit param
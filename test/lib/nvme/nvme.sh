@@ -18,6 +18,7 @@ $valgrind $testdir/unit/nvme_c/nvme_ut
 $valgrind $testdir/unit/nvme_qpair_c/nvme_qpair_ut
 $valgrind $testdir/unit/nvme_ctrlr_c/nvme_ctrlr_ut
 $valgrind $testdir/unit/nvme_ctrlr_cmd_c/nvme_ctrlr_cmd_ut
+$valgrind $testdir/unit/nvme_emu_c/nvme_emu_ut
 timing_exit unit
 
 if [ $RUN_NIGHTLY -eq 1 ]; then
@@ -32,6 +33,8 @@ timing_exit identify
 
 timing_enter perf
 $rootdir/examples/nvme/perf/perf -q 128 -w read -s 12288 -t 1
+$rootdir/examples/nvme/perf/perf -E -q 128 -w randread -s 4096 -t 1
+$rootdir/examples/nvme/perf/perf -E -B -q 128 -w randwrite -s 4096 -t 1
 timing_exit perf
 
 timing_enter reserve
@@ -44,6 +47,7 @@ timing_exit
 
 timing_enter overhead
 $rootdir/test/lib/nvme/overhead/overhead -s 4096 -t 1
+$rootdir/test/lib/nvme/overhead/overhead -E -s 4096 -t 1
 timing_exit overhead
 
 if [ -d /usr/src/fio ]; then
@@ -110,6 +110,9 @@ static int g_time_in_sec;
 
 static int g_aio_optind; /* Index of first AIO filename in argv */
 
+static bool g_use_emu = false;
+static struct spdk_nvme_emu_ctrlr *g_emu_ctrlr;
+
 struct perf_task *g_task;
 uint64_t g_tsc_submit = 0;
 uint64_t g_tsc_submit_min = UINT64_MAX;
@@ -478,6 +481,7 @@ static void usage(char *program_name)
 	printf("\t[-s io size in bytes]\n");
 	printf("\t[-t time in seconds]\n");
 	printf("\t\t(default: 1)]\n");
+	printf("\t[-E measure against a software-emulated NVMe controller instead of hardware]\n");
 }
 
 static void
@@ -502,8 +506,11 @@ parse_args(int argc, char **argv)
 	g_io_size_bytes = 0;
 	g_time_in_sec = 0;
 
-	while ((op = getopt(argc, argv, "s:t:")) != -1) {
+	while ((op = getopt(argc, argv, "Es:t:")) != -1) {
 		switch (op) {
+		case 'E':
+			g_use_emu = true;
+			break;
 		case 's':
 			g_io_size_bytes = atoi(optarg);
 			break;
@@ -535,6 +542,15 @@ probe_cb(void *cb_ctx, struct spdk_pci_device *dev, struct spdk_nvme_ctrlr_opts
 {
 	static uint32_t ctrlr_found = 0;
 
+	if (dev == NULL) {
+		printf("Attaching to emulated controller\n");
+		return true;
+	}
+
+	if (g_use_emu) {
+		return false;
+	}
+
 	if (spdk_pci_device_has_non_uio_driver(dev)) {
 		fprintf(stderr, "non-uio kernel driver attached to NVMe\n");
 		fprintf(stderr, " controller at PCI address %04x:%02x:%02x.%02x\n",
@@ -570,11 +586,15 @@ static void
 attach_cb(void *cb_ctx, struct spdk_pci_device *dev, struct spdk_nvme_ctrlr *ctrlr,
 	  const struct spdk_nvme_ctrlr_opts *opts)
 {
-	printf("Attached to %04x:%02x:%02x.%02x\n",
-	       spdk_pci_device_get_domain(dev),
-	       spdk_pci_device_get_bus(dev),
-	       spdk_pci_device_get_dev(dev),
-	       spdk_pci_device_get_func(dev));
+	if (dev == NULL) {
+		printf("Attached to emulated controller\n");
+	} else {
+		printf("Attached to %04x:%02x:%02x.%02x\n",
+		       spdk_pci_device_get_domain(dev),
+		       spdk_pci_device_get_bus(dev),
+		       spdk_pci_device_get_dev(dev),
+		       spdk_pci_device_get_func(dev));
+	}
 
 	register_ctrlr(ctrlr);
 }
@@ -584,6 +604,18 @@ register_controllers(void)
 {
 	printf("Initializing NVMe Controllers\n");
 
+	if (g_use_emu) {
+		struct spdk_nvme_emu_opts emu_opts;
+
+		spdk_nvme_emu_opts_set_defaults(&emu_opts);
+		emu_opts.num_io_queues = 1;
+		g_emu_ctrlr = spdk_nvme_emu_ctrlr_create(&emu_opts);
+		if (g_emu_ctrlr == NULL) {
+			fprintf(stderr, "spdk_nvme_emu_ctrlr_create() failed\n");
+			return 1;
+		}
+	}
+
 	if (spdk_nvme_probe(NULL, probe_cb, attach_cb, NULL) != 0) {
 		fprintf(stderr, "spdk_nvme_probe() failed\n");
 		return 1;
@@ -666,6 +698,7 @@ cleanup:
 		spdk_nvme_detach(g_ctrlr->ctrlr);
 		free(g_ctrlr);
 	}
+	spdk_nvme_emu_ctrlr_destroy(g_emu_ctrlr);
 
 	if (rc != 0) {
 		fprintf(stderr, "%s: errors occured\n", argv[0]);
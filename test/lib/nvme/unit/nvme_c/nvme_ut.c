@@ -71,6 +71,12 @@ spdk_nvme_ctrlr_opts_set_defaults(struct spdk_nvme_ctrlr_opts *opts)
 	memset(opts, 0, sizeof(*opts));
 }
 
+int
+nvme_emu_enumerate(int (*enum_cb)(void *enum_ctx, struct spdk_nvme_emu_ctrlr *emu), void *enum_ctx)
+{
+	return 0;
+}
+
 static void
 test_opc_data_transfer(void)
 {
@@ -75,6 +75,12 @@ spdk_pci_device_get_subdevice_id(struct spdk_pci_device *dev)
 	return g_pci_subdevice_id;
 }
 
+volatile struct spdk_nvme_registers *
+nvme_emu_ctrlr_get_regs(struct spdk_nvme_emu_ctrlr *emu)
+{
+	return &g_ut_nvme_regs;
+}
+
 int nvme_qpair_construct(struct spdk_nvme_qpair *qpair, uint16_t id,
 			 uint16_t num_entries, uint16_t num_trackers,
 			 struct spdk_nvme_ctrlr *ctrlr)
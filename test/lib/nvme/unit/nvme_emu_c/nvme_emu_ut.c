@@ -0,0 +1,445 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "spdk_cunit.h"
+
+#include "nvme/nvme_emu.c"
+
+struct nvme_driver _g_nvme_driver = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+struct nvme_driver *g_spdk_nvme_driver = &_g_nvme_driver;
+
+char outbuf[OUTBUF_SIZE];
+
+#define UT_QUEUE_ENTRIES	8
+#define UT_POLL_TIMEOUT_US	(5 * 1000 * 1000)
+
+struct ut_queue {
+	struct spdk_nvme_cmd	*cmds;
+	struct spdk_nvme_cpl	*cpls;
+	uint16_t		id;
+	uint16_t		tail;
+	uint16_t		head;
+	uint8_t			phase;
+};
+
+static void *
+ut_alloc(size_t size)
+{
+	void *buf = NULL;
+	int rc;
+
+	rc = posix_memalign(&buf, 4096, size);
+	SPDK_CU_ASSERT_FATAL(rc == 0);
+	memset(buf, 0, size);
+	return buf;
+}
+
+static bool
+ut_wait_csts(struct spdk_nvme_emu_ctrlr *emu, uint32_t mask, uint32_t value)
+{
+	int waited;
+
+	for (waited = 0; waited < UT_POLL_TIMEOUT_US; waited += 10) {
+		if ((emu->regs->csts.raw & mask) == value) {
+			return true;
+		}
+		usleep(10);
+	}
+
+	return false;
+}
+
+static void
+ut_queue_init(struct ut_queue *q, uint16_t id)
+{
+	q->cmds = ut_alloc(UT_QUEUE_ENTRIES * sizeof(struct spdk_nvme_cmd));
+	q->cpls = ut_alloc(UT_QUEUE_ENTRIES * sizeof(struct spdk_nvme_cpl));
+	q->id = id;
+	q->tail = 0;
+	q->head = 0;
+	q->phase = 1;
+}
+
+static void
+ut_queue_free(struct ut_queue *q)
+{
+	free(q->cmds);
+	free(q->cpls);
+}
+
+/* Submit one command and wait for its completion. */
+static struct spdk_nvme_cpl
+ut_execute(struct spdk_nvme_emu_ctrlr *emu, struct ut_queue *q, struct spdk_nvme_cmd *cmd)
+{
+	volatile struct spdk_nvme_cpl *cpl;
+	struct spdk_nvme_cpl result;
+	int waited;
+
+	cmd->cid = q->tail;
+	q->cmds[q->tail] = *cmd;
+	q->tail = (q->tail + 1) % UT_QUEUE_ENTRIES;
+	spdk_wmb();
+	emu->regs->doorbell[q->id].sq_tdbl = q->tail;
+
+	cpl = &q->cpls[q->head];
+	for (waited = 0; cpl->status.p != q->phase; waited++) {
+		SPDK_CU_ASSERT_FATAL(waited < UT_POLL_TIMEOUT_US);
+		usleep(1);
+	}
+
+	result = *(struct spdk_nvme_cpl *)cpl;
+	CU_ASSERT(result.cid == cmd->cid);
+	CU_ASSERT(result.sqid == q->id);
+	CU_ASSERT(result.sqhd == q->tail);
+
+	if (++q->head == UT_QUEUE_ENTRIES) {
+		q->head = 0;
+		q->phase = !q->phase;
+	}
+	emu->regs->doorbell[q->id].cq_hdbl = q->head;
+
+	return result;
+}
+
+static struct spdk_nvme_emu_ctrlr *
+ut_enable(struct spdk_nvme_emu_opts *opts, struct ut_queue *adminq)
+{
+	struct spdk_nvme_emu_ctrlr *emu;
+	union spdk_nvme_aqa_register aqa;
+	union spdk_nvme_cc_register cc;
+
+	emu = spdk_nvme_emu_ctrlr_create(opts);
+	SPDK_CU_ASSERT_FATAL(emu != NULL);
+
+	ut_queue_init(adminq, 0);
+	emu->regs->asq = (uint64_t)(uintptr_t)adminq->cmds;
+	emu->regs->acq = (uint64_t)(uintptr_t)adminq->cpls;
+	aqa.raw = 0;
+	aqa.bits.asqs = UT_QUEUE_ENTRIES - 1;
+	aqa.bits.acqs = UT_QUEUE_ENTRIES - 1;
+	emu->regs->aqa.raw = aqa.raw;
+
+	cc.raw = 0;
+	cc.bits.en = 1;
+	cc.bits.iosqes = 6;
+	cc.bits.iocqes = 4;
+	emu->regs->cc.raw = cc.raw;
+
+	CU_ASSERT(ut_wait_csts(emu, 1, 1));
+
+	return emu;
+}
+
+static void
+ut_disable(struct spdk_nvme_emu_ctrlr *emu, struct ut_queue *adminq)
+{
+	emu->regs->cc.raw = 0;
+	CU_ASSERT(ut_wait_csts(emu, 0xFFFFFFFF, 0));
+	spdk_nvme_emu_ctrlr_destroy(emu);
+	ut_queue_free(adminq);
+}
+
+static void
+test_create_invalid_opts(void)
+{
+	struct spdk_nvme_emu_opts opts;
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	opts.num_io_queues = 0;
+	CU_ASSERT(spdk_nvme_emu_ctrlr_create(&opts) == NULL);
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	opts.block_size = 1000;
+	CU_ASSERT(spdk_nvme_emu_ctrlr_create(&opts) == NULL);
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	opts.max_queue_entries = 1;
+	CU_ASSERT(spdk_nvme_emu_ctrlr_create(&opts) == NULL);
+}
+
+static void
+test_enable_identify(void)
+{
+	struct spdk_nvme_emu_opts opts;
+	struct spdk_nvme_emu_ctrlr *emu;
+	struct ut_queue adminq;
+	struct spdk_nvme_cmd cmd;
+	struct spdk_nvme_cpl cpl;
+	struct spdk_nvme_ctrlr_data *cdata;
+	struct spdk_nvme_ns_data *nsdata;
+	union spdk_nvme_cap_register cap;
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	opts.num_io_queues = 4;
+	opts.num_blocks = 1000;
+	opts.block_size = 4096;
+
+	emu = ut_enable(&opts, &adminq);
+
+	cap.raw = emu->regs->cap.raw;
+	CU_ASSERT(cap.bits.mqes == opts.max_queue_entries - 1);
+	CU_ASSERT(cap.bits.cqr == 1);
+	CU_ASSERT(cap.bits.dstrd == 0);
+
+	cdata = ut_alloc(sizeof(*cdata));
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_IDENTIFY;
+	cmd.cdw10 = SPDK_NVME_IDENTIFY_CTRLR;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)cdata;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(cdata->nn == 1);
+	CU_ASSERT(cdata->mdts == NVME_EMU_MDTS);
+	CU_ASSERT(cdata->sgls.supported == 0);
+	CU_ASSERT(memcmp(cdata->mn, "SPDK Emulated Controller", 24) == 0);
+	free(cdata);
+
+	nsdata = ut_alloc(sizeof(*nsdata));
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_IDENTIFY;
+	cmd.cdw10 = SPDK_NVME_IDENTIFY_NS;
+	cmd.nsid = 1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)nsdata;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(nsdata->nsze == 1000);
+	CU_ASSERT(nsdata->lbaf[nsdata->flbas.format].lbads == 12);
+
+	cmd.nsid = 2;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(cpl.status.sct == SPDK_NVME_SCT_GENERIC);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_INVALID_NAMESPACE_OR_FORMAT);
+	free(nsdata);
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_SET_FEATURES;
+	cmd.cdw10 = SPDK_NVME_FEAT_NUMBER_OF_QUEUES;
+	cmd.cdw11 = (63 << 16) | 63;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(cpl.cdw0 == ((3 << 16) | 3));
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = 0xC0;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_INVALID_OPCODE);
+
+	ut_disable(emu, &adminq);
+}
+
+static void
+test_io_queues(void)
+{
+	struct spdk_nvme_emu_opts opts;
+	struct spdk_nvme_emu_ctrlr *emu;
+	struct ut_queue adminq, ioq;
+	struct spdk_nvme_cmd cmd;
+	struct spdk_nvme_cpl cpl;
+	uint8_t *wbuf, *rbuf;
+	uint64_t *prp_list;
+	int i;
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	opts.num_io_queues = 2;
+	opts.num_blocks = 64;
+	opts.block_size = 512;
+	opts.store_data = true;
+
+	emu = ut_enable(&opts, &adminq);
+	ut_queue_init(&ioq, 1);
+
+	/* SQ creation must fail until its CQ exists. */
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_CREATE_IO_SQ;
+	cmd.cdw10 = ((UT_QUEUE_ENTRIES - 1) << 16) | 1;
+	cmd.cdw11 = (1 << 16) | 0x1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)ioq.cmds;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(cpl.status.sct == SPDK_NVME_SCT_COMMAND_SPECIFIC);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_COMPLETION_QUEUE_INVALID);
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_CREATE_IO_CQ;
+	cmd.cdw10 = ((UT_QUEUE_ENTRIES - 1) << 16) | 3;
+	cmd.cdw11 = 0x1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)ioq.cpls;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_INVALID_QUEUE_IDENTIFIER);
+
+	cmd.cdw10 = ((UT_QUEUE_ENTRIES - 1) << 16) | 1;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_CREATE_IO_SQ;
+	cmd.cdw10 = ((UT_QUEUE_ENTRIES - 1) << 16) | 1;
+	cmd.cdw11 = (1 << 16) | 0x1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)ioq.cmds;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+
+	/* 12 KiB write spanning 3 pages described by a PRP list. */
+	wbuf = ut_alloc(3 * 4096);
+	rbuf = ut_alloc(3 * 4096);
+	prp_list = ut_alloc(4096);
+	for (i = 0; i < 3 * 4096; i++) {
+		wbuf[i] = (uint8_t)(i * 7);
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_WRITE;
+	cmd.nsid = 1;
+	cmd.cdw10 = 8;
+	cmd.cdw12 = 24 - 1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)wbuf;
+	cmd.dptr.prp.prp2 = (uint64_t)(uintptr_t)prp_list;
+	prp_list[0] = (uint64_t)(uintptr_t)(wbuf + 4096);
+	prp_list[1] = (uint64_t)(uintptr_t)(wbuf + 8192);
+	cpl = ut_execute(emu, &ioq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(memcmp(emu->data + 8 * 512, wbuf, 3 * 4096) == 0);
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_READ;
+	cmd.nsid = 1;
+	cmd.cdw10 = 8;
+	cmd.cdw12 = 24 - 1;
+	cmd.dptr.prp.prp1 = (uint64_t)(uintptr_t)rbuf;
+	cmd.dptr.prp.prp2 = (uint64_t)(uintptr_t)prp_list;
+	prp_list[0] = (uint64_t)(uintptr_t)(rbuf + 4096);
+	prp_list[1] = (uint64_t)(uintptr_t)(rbuf + 8192);
+	cpl = ut_execute(emu, &ioq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(memcmp(rbuf, wbuf, 3 * 4096) == 0);
+
+	/* Two pages: PRP2 points straight at the second page. */
+	memset(rbuf, 0, 3 * 4096);
+	cmd.cdw12 = 16 - 1;
+	cmd.dptr.prp.prp2 = (uint64_t)(uintptr_t)(rbuf + 4096);
+	cpl = ut_execute(emu, &ioq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	CU_ASSERT(memcmp(rbuf, wbuf, 2 * 4096) == 0);
+
+	cmd.cdw10 = 60;
+	cmd.cdw12 = 8 - 1;
+	cpl = ut_execute(emu, &ioq, &cmd);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_LBA_OUT_OF_RANGE);
+
+	/* Enough commands to wrap the queues and flip the phase. */
+	for (i = 0; i < 2 * UT_QUEUE_ENTRIES; i++) {
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.opc = SPDK_NVME_OPC_FLUSH;
+		cmd.nsid = 1;
+		cpl = ut_execute(emu, &ioq, &cmd);
+		CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opc = SPDK_NVME_OPC_DELETE_IO_CQ;
+	cmd.cdw10 = 1;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(cpl.status.sc == SPDK_NVME_SC_INVALID_QUEUE_DELETION);
+
+	cmd.opc = SPDK_NVME_OPC_DELETE_IO_SQ;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+
+	cmd.opc = SPDK_NVME_OPC_DELETE_IO_CQ;
+	cpl = ut_execute(emu, &adminq, &cmd);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&cpl));
+
+	free(prp_list);
+	free(rbuf);
+	free(wbuf);
+	ut_queue_free(&ioq);
+	ut_disable(emu, &adminq);
+}
+
+static void
+test_shutdown(void)
+{
+	struct spdk_nvme_emu_opts opts;
+	struct spdk_nvme_emu_ctrlr *emu;
+	struct ut_queue adminq;
+	union spdk_nvme_cc_register cc;
+	union spdk_nvme_csts_register csts;
+
+	spdk_nvme_emu_opts_set_defaults(&opts);
+	emu = ut_enable(&opts, &adminq);
+
+	cc.raw = emu->regs->cc.raw;
+	cc.bits.shn = SPDK_NVME_SHN_NORMAL;
+	emu->regs->cc.raw = cc.raw;
+
+	csts.raw = 0;
+	csts.bits.rdy = 1;
+	csts.bits.shst = SPDK_NVME_SHST_COMPLETE;
+	CU_ASSERT(ut_wait_csts(emu, 0xFFFFFFFF, csts.raw));
+
+	ut_disable(emu, &adminq);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("nvme_emu", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "create_invalid_opts", test_create_invalid_opts) == NULL
+		|| CU_add_test(suite, "enable_identify", test_enable_identify) == NULL
+		|| CU_add_test(suite, "io_queues", test_io_queues) == NULL
+		|| CU_add_test(suite, "shutdown", test_shutdown) == NULL
+	) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
@@ -66,6 +66,9 @@ extern char outbuf[OUTBUF_SIZE];
 uint64_t nvme_vtophys(void *buf);
 #define NVME_VTOPHYS_ERROR	(0xFFFFFFFFFFFFFFFFULL)
 
+/* nvme_malloc() above uses phys == virt, so the reverse translation is the identity. */
+#define nvme_phys_to_virt(phys)		((void *)(uintptr_t)(phys))
+
 #define nvme_alloc_request(bufp)	\
 do					\
 	{				\
@@ -632,6 +632,76 @@ test_nvme_qpair_process_completions_limit(void)
 	cleanup_submit_request_test(&qpair);
 }
 
+static void
+test_nvme_qpair_batch_doorbell(void)
+{
+	struct spdk_nvme_qpair		qpair = {};
+	struct spdk_nvme_qpair		adminq = {};
+	struct spdk_nvme_ctrlr		ctrlr = {};
+	struct spdk_nvme_registers	regs = {};
+	struct nvme_request		*req;
+	volatile uint32_t		sq_tdbl = 0;
+	volatile uint32_t		cq_hdbl = 0;
+	int				i;
+
+	prepare_submit_request_test(&qpair, &ctrlr, &regs);
+	qpair.is_enabled = true;
+	qpair.sq_tdbl = &sq_tdbl;
+	qpair.cq_hdbl = &cq_hdbl;
+
+	CU_ASSERT(spdk_nvme_qpair_set_batch_doorbell(&qpair, true) == 0);
+
+	/* Submissions are staged without touching the doorbell */
+	for (i = 0; i < 3; i++) {
+		req = nvme_allocate_request_null(expected_success_callback, NULL);
+		SPDK_CU_ASSERT_FATAL(req != NULL);
+		CU_ASSERT(nvme_qpair_submit_request(&qpair, req) == 0);
+	}
+	CU_ASSERT(qpair.sq_tail == 3);
+	CU_ASSERT(sq_tdbl == 0);
+	CU_ASSERT(qpair.sq_doorbell_pending == true);
+
+	/* One doorbell write covers the whole batch */
+	spdk_nvme_qpair_flush(&qpair);
+	CU_ASSERT(sq_tdbl == 3);
+	CU_ASSERT(qpair.sq_doorbell_pending == false);
+
+	/* Polling for completions also rings any staged submissions */
+	req = nvme_allocate_request_null(expected_success_callback, NULL);
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(nvme_qpair_submit_request(&qpair, req) == 0);
+	CU_ASSERT(sq_tdbl == 3);
+	CU_ASSERT(spdk_nvme_qpair_process_completions(&qpair, 0) == 0);
+	CU_ASSERT(sq_tdbl == 4);
+	CU_ASSERT(cq_hdbl == 0);
+
+	/* Disabling batching flushes, and later submissions ring immediately */
+	req = nvme_allocate_request_null(expected_success_callback, NULL);
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(nvme_qpair_submit_request(&qpair, req) == 0);
+	CU_ASSERT(sq_tdbl == 4);
+	CU_ASSERT(spdk_nvme_qpair_set_batch_doorbell(&qpair, false) == 0);
+	CU_ASSERT(sq_tdbl == 5);
+
+	req = nvme_allocate_request_null(expected_success_callback, NULL);
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(nvme_qpair_submit_request(&qpair, req) == 0);
+	CU_ASSERT(sq_tdbl == 6);
+
+	/* Complete the outstanding trackers so that the requests are freed */
+	for (i = 0; i < 6; i++) {
+		nvme_qpair_manual_complete_tracker(&qpair, &qpair.tr[qpair.cmd[i].cid],
+						   SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS, 0, false);
+	}
+
+	cleanup_submit_request_test(&qpair);
+
+	/* The admin queue always rings the doorbell per command */
+	adminq.id = 0;
+	CU_ASSERT(spdk_nvme_qpair_set_batch_doorbell(&adminq, true) == -EINVAL);
+	CU_ASSERT(adminq.batch_doorbell == false);
+}
+
 static void test_nvme_qpair_destroy(void)
 {
 	struct spdk_nvme_qpair		qpair = {};
@@ -809,6 +879,7 @@ int main(int argc, char **argv)
 			       test_nvme_qpair_process_completions) == NULL
 		|| CU_add_test(suite, "spdk_nvme_qpair_process_completions_limit",
 			       test_nvme_qpair_process_completions_limit) == NULL
+		|| CU_add_test(suite, "nvme_qpair_batch_doorbell", test_nvme_qpair_batch_doorbell) == NULL
 		|| CU_add_test(suite, "nvme_qpair_destroy", test_nvme_qpair_destroy) == NULL
 		|| CU_add_test(suite, "nvme_completion_is_retry", test_nvme_completion_is_retry) == NULL
 		|| CU_add_test(suite, "get_status_string", test_get_status_string) == NULL
@@ -12,6 +12,7 @@ timing_enter unit
 $testdir/request/request_ut
 $testdir/session/session_ut
 $testdir/subsystem/subsystem_ut
+$testdir/tcp/tcp_ut
 timing_exit unit
 
 timing_exit nvmf
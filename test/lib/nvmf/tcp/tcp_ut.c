@@ -0,0 +1,504 @@
+/*-
+ *   BSD LICENSE
+ *
+ *   Copyright (c) Intel Corporation.
+ *   All rights reserved.
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * Neither the name of Intel Corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "spdk_cunit.h"
+
+#include "tcp.c"
+
+SPDK_LOG_REGISTER_TRACE_FLAG("nvmf", SPDK_TRACE_NVMF)
+
+#define UT_MAX_QUEUE_DEPTH	4
+#define UT_MAX_IO_SIZE		8192
+#define UT_IN_CAPSULE_SIZE	4096
+
+static struct spdk_nvmf_request *g_exec_req;
+static int g_exec_count;
+
+void spdk_trace_record(uint16_t tpoint_id, uint16_t poller_id, uint32_t size,
+		       uint64_t object_id, uint64_t arg1)
+{
+}
+
+void *
+rte_calloc(const char *type, size_t num, size_t size, unsigned align)
+{
+	return calloc(num, size);
+}
+
+void
+rte_free(void *ptr)
+{
+	free(ptr);
+}
+
+int
+spdk_sock_listen(const char *ip, int port)
+{
+	return -1;
+}
+
+int
+spdk_sock_accept(int sock)
+{
+	errno = EAGAIN;
+	return -1;
+}
+
+int
+spdk_sock_close(int sock)
+{
+	return close(sock);
+}
+
+ssize_t
+spdk_sock_recv(int sock, void *buf, size_t len)
+{
+	return recv(sock, buf, len, MSG_DONTWAIT);
+}
+
+ssize_t
+spdk_sock_writev(int sock, struct iovec *iov, int iovcnt)
+{
+	return writev(sock, iov, iovcnt);
+}
+
+int
+spdk_nvmf_request_exec(struct spdk_nvmf_request *req)
+{
+	g_exec_req = req;
+	g_exec_count++;
+	return 0;
+}
+
+int
+spdk_nvmf_request_complete(struct spdk_nvmf_request *req)
+{
+	req->rsp->nvme_cpl.cid = req->cmd->nvme_cmd.cid;
+	return req->conn->transport->req_complete(req);
+}
+
+struct ut_conn {
+	struct spdk_nvmf_tcp_conn	*tcp_conn;
+	struct nvmf_session		session;
+	int				host_sock;
+};
+
+static void
+ut_conn_init(struct ut_conn *ut, bool connected)
+{
+	int socks[2];
+	int rc;
+
+	rc = socketpair(AF_UNIX, SOCK_STREAM, 0, socks);
+	SPDK_CU_ASSERT_FATAL(rc == 0);
+
+	spdk_nvmf_tcp_init(UT_MAX_QUEUE_DEPTH, UT_MAX_IO_SIZE, UT_IN_CAPSULE_SIZE);
+	ut->tcp_conn = spdk_nvmf_tcp_conn_create(socks[0], UT_MAX_QUEUE_DEPTH);
+	SPDK_CU_ASSERT_FATAL(ut->tcp_conn != NULL);
+	ut->host_sock = socks[1];
+
+	memset(&ut->session, 0, sizeof(ut->session));
+	if (connected) {
+		rc = spdk_nvmf_tcp_session_init(&ut->session, &ut->tcp_conn->conn);
+		SPDK_CU_ASSERT_FATAL(rc == 0);
+		ut->tcp_conn->conn.sess = &ut->session;
+		ut->tcp_conn->conn.sq_head_max = UT_MAX_QUEUE_DEPTH - 1;
+	}
+
+	g_exec_req = NULL;
+	g_exec_count = 0;
+}
+
+static void
+ut_conn_fini(struct ut_conn *ut)
+{
+	if (ut->session.trctx) {
+		spdk_nvmf_tcp_session_fini(&ut->session);
+	}
+	spdk_nvmf_tcp_conn_destroy(ut->tcp_conn);
+	close(ut->host_sock);
+}
+
+static void
+ut_host_send(struct ut_conn *ut, const void *buf, size_t len)
+{
+	CU_ASSERT((ssize_t)len == send(ut->host_sock, buf, len, 0));
+}
+
+static void
+ut_host_recv(struct ut_conn *ut, void *buf, size_t len)
+{
+	CU_ASSERT((ssize_t)len == recv(ut->host_sock, buf, len, MSG_DONTWAIT));
+}
+
+static void
+ut_host_send_ic_req(struct ut_conn *ut)
+{
+	struct spdk_nvme_tcp_ic_req	ic_req = {};
+	struct spdk_nvme_tcp_ic_resp	ic_resp;
+
+	ic_req.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_IC_REQ;
+	ic_req.common.hlen = sizeof(ic_req);
+	ic_req.common.plen = sizeof(ic_req);
+	ic_req.pfv = SPDK_NVME_TCP_PFV_1_0;
+	ic_req.dgst = SPDK_NVME_TCP_DIGEST_HEADER | SPDK_NVME_TCP_DIGEST_DATA;
+	ut_host_send(ut, &ic_req, sizeof(ic_req));
+
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut->tcp_conn->conn) == 0);
+
+	ut_host_recv(ut, &ic_resp, sizeof(ic_resp));
+	CU_ASSERT(ic_resp.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_IC_RESP);
+	CU_ASSERT(ic_resp.common.hlen == sizeof(ic_resp));
+	CU_ASSERT(ic_resp.common.plen == sizeof(ic_resp));
+	CU_ASSERT(ic_resp.pfv == SPDK_NVME_TCP_PFV_1_0);
+	CU_ASSERT(ic_resp.cpda == 0);
+	/* Digests are never enabled */
+	CU_ASSERT(ic_resp.dgst == 0);
+	CU_ASSERT(ic_resp.maxh2cdata == UT_MAX_IO_SIZE);
+}
+
+static void
+ut_build_capsule(struct spdk_nvme_tcp_cmd *capsule, uint8_t opc, uint16_t cid,
+		 uint8_t sgl_type, uint8_t sgl_subtype, uint32_t length, uint32_t in_capsule_len)
+{
+	memset(capsule, 0, sizeof(*capsule));
+	capsule->common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_CAPSULE_CMD;
+	capsule->common.hlen = sizeof(*capsule);
+	capsule->common.pdo = in_capsule_len ? sizeof(*capsule) : 0;
+	capsule->common.plen = sizeof(*capsule) + in_capsule_len;
+	capsule->ccsqe.opc = opc;
+	capsule->ccsqe.cid = cid;
+	capsule->ccsqe.dptr.sgl1.unkeyed.type = sgl_type;
+	capsule->ccsqe.dptr.sgl1.unkeyed.subtype = sgl_subtype;
+	capsule->ccsqe.dptr.sgl1.unkeyed.length = length;
+}
+
+static void
+ut_host_recv_capsule_resp(struct ut_conn *ut, uint16_t cid, uint16_t sqhd)
+{
+	struct spdk_nvme_tcp_rsp rsp;
+
+	ut_host_recv(ut, &rsp, sizeof(rsp));
+	CU_ASSERT(rsp.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_CAPSULE_RESP);
+	CU_ASSERT(rsp.common.plen == sizeof(rsp));
+	CU_ASSERT(rsp.rccqe.cid == cid);
+	CU_ASSERT(rsp.rccqe.sqhd == sqhd);
+	CU_ASSERT(rsp.rccqe.status.sc == SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+test_nvmf_tcp_ic_req(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_ic_req	ic_req = {};
+
+	/* Valid ICReq */
+	ut_conn_init(&ut, false);
+	ut_host_send_ic_req(&ut);
+	CU_ASSERT(ut.tcp_conn->ic_done == true);
+	ut_conn_fini(&ut);
+
+	/* Unsupported PDU format version */
+	ut_conn_init(&ut, false);
+	ic_req.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_IC_REQ;
+	ic_req.common.hlen = sizeof(ic_req);
+	ic_req.common.plen = sizeof(ic_req);
+	ic_req.pfv = 1;
+	ut_host_send(&ut, &ic_req, sizeof(ic_req));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+
+	/* Peer closed the connection */
+	ut_conn_init(&ut, false);
+	shutdown(ut.host_sock, SHUT_WR);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+}
+
+static void
+test_nvmf_tcp_protocol_errors(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_cmd	capsule;
+
+	/* CapsuleCmd before ICReq */
+	ut_conn_init(&ut, true);
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_FLUSH, 1, 0, 0, 0, 0);
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+
+	/* Header digest flag without a negotiated digest */
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_FLUSH, 1, 0, 0, 0, 0);
+	capsule.common.flags = SPDK_NVME_TCP_CH_FLAGS_HDGSTF;
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+
+	/* In-capsule data larger than InCapsuleDataSize */
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_WRITE, 1, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			 SPDK_NVME_SGL_SUBTYPE_OFFSET, UT_IN_CAPSULE_SIZE + 16, UT_IN_CAPSULE_SIZE + 16);
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+
+	/* Unsolicited H2CData */
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+	{
+		struct spdk_nvme_tcp_h2c_data_hdr h2c = {};
+
+		h2c.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_H2C_DATA;
+		h2c.common.hlen = sizeof(h2c);
+		h2c.common.pdo = sizeof(h2c);
+		h2c.common.plen = sizeof(h2c) + 16;
+		h2c.ttag = 0;
+		h2c.datal = 16;
+		ut_host_send(&ut, &h2c, sizeof(h2c));
+	}
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+	ut_conn_fini(&ut);
+}
+
+static void
+test_nvmf_tcp_in_capsule_write(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_cmd	capsule;
+	uint8_t				data[512];
+
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+
+	memset(data, 0xA5, sizeof(data));
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_WRITE, 7, SPDK_NVME_SGL_TYPE_DATA_BLOCK,
+			 SPDK_NVME_SGL_SUBTYPE_OFFSET, sizeof(data), sizeof(data));
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+	ut_host_send(&ut, data, sizeof(data));
+
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 1);
+	SPDK_CU_ASSERT_FATAL(g_exec_req != NULL);
+	CU_ASSERT(g_exec_req->xfer == SPDK_NVME_DATA_HOST_TO_CONTROLLER);
+	CU_ASSERT(g_exec_req->length == sizeof(data));
+	CU_ASSERT(memcmp(g_exec_req->data, data, sizeof(data)) == 0);
+	CU_ASSERT(ut.tcp_conn->cur_queue_depth == 1);
+
+	CU_ASSERT(spdk_nvmf_request_complete(g_exec_req) == 0);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 0);
+	ut_host_recv_capsule_resp(&ut, 7, 1);
+	CU_ASSERT(ut.tcp_conn->cur_queue_depth == 0);
+
+	ut_conn_fini(&ut);
+}
+
+static void
+test_nvmf_tcp_read(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_cmd	capsule;
+	struct spdk_nvme_tcp_c2h_data_hdr c2h;
+	uint8_t				data[UT_MAX_IO_SIZE];
+	uint8_t				buf[UT_MAX_IO_SIZE];
+	struct spdk_nvmf_tcp_session	*tcp_sess;
+	void				*pool_buf;
+
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+	tcp_sess = ut.session.trctx;
+
+	/* A read larger than the in-capsule buffer uses the session pool */
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_READ, 3, SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK,
+			 SPDK_NVME_SGL_SUBTYPE_TRANSPORT, sizeof(data), 0);
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 1);
+	SPDK_CU_ASSERT_FATAL(g_exec_req != NULL);
+	CU_ASSERT(g_exec_req->xfer == SPDK_NVME_DATA_CONTROLLER_TO_HOST);
+	CU_ASSERT(g_exec_req->length == sizeof(data));
+	CU_ASSERT((uint8_t *)g_exec_req->data >= tcp_sess->buf &&
+		  (uint8_t *)g_exec_req->data < tcp_sess->buf + UT_MAX_QUEUE_DEPTH * UT_MAX_IO_SIZE);
+
+	pool_buf = g_exec_req->data;
+	memset(data, 0x5A, sizeof(data));
+	memcpy(g_exec_req->data, data, sizeof(data));
+	CU_ASSERT(spdk_nvmf_request_complete(g_exec_req) == 0);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 0);
+
+	ut_host_recv(&ut, &c2h, sizeof(c2h));
+	CU_ASSERT(c2h.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_C2H_DATA);
+	CU_ASSERT(c2h.common.flags == SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU);
+	CU_ASSERT(c2h.common.pdo == sizeof(c2h));
+	CU_ASSERT(c2h.common.plen == sizeof(c2h) + sizeof(data));
+	CU_ASSERT(c2h.cccid == 3);
+	CU_ASSERT(c2h.datao == 0);
+	CU_ASSERT(c2h.datal == sizeof(data));
+	ut_host_recv(&ut, buf, sizeof(buf));
+	CU_ASSERT(memcmp(buf, data, sizeof(data)) == 0);
+	ut_host_recv_capsule_resp(&ut, 3, 1);
+
+	/* The pool buffer was returned once the response was sent */
+	CU_ASSERT(ut.tcp_conn->cur_queue_depth == 0);
+	CU_ASSERT((void *)SLIST_FIRST(&tcp_sess->data_buf_pool) == pool_buf);
+
+	ut_conn_fini(&ut);
+}
+
+static void
+test_nvmf_tcp_r2t_write(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_cmd	capsule;
+	struct spdk_nvme_tcp_r2t_hdr	r2t;
+	struct spdk_nvme_tcp_h2c_data_hdr h2c = {};
+	uint8_t				data[2048];
+	uint32_t			i;
+
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+
+	for (i = 0; i < sizeof(data); i++) {
+		data[i] = i;
+	}
+
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_WRITE, 9, SPDK_NVME_SGL_TYPE_TRANSPORT_DATA_BLOCK,
+			 SPDK_NVME_SGL_SUBTYPE_TRANSPORT, sizeof(data), 0);
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+
+	/* The command waits for data, and an R2T is sent */
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 0);
+	CU_ASSERT(g_exec_count == 0);
+	ut_host_recv(&ut, &r2t, sizeof(r2t));
+	CU_ASSERT(r2t.common.pdu_type == SPDK_NVME_TCP_PDU_TYPE_R2T);
+	CU_ASSERT(r2t.common.plen == sizeof(r2t));
+	CU_ASSERT(r2t.cccid == 9);
+	CU_ASSERT(r2t.r2to == 0);
+	CU_ASSERT(r2t.r2tl == sizeof(data));
+
+	/* Send the data in two H2CData PDUs */
+	h2c.common.pdu_type = SPDK_NVME_TCP_PDU_TYPE_H2C_DATA;
+	h2c.common.hlen = sizeof(h2c);
+	h2c.common.pdo = sizeof(h2c);
+	h2c.common.plen = sizeof(h2c) + sizeof(data) / 2;
+	h2c.cccid = 9;
+	h2c.ttag = r2t.ttag;
+	h2c.datao = 0;
+	h2c.datal = sizeof(data) / 2;
+	ut_host_send(&ut, &h2c, sizeof(h2c));
+	ut_host_send(&ut, data, sizeof(data) / 2);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 0);
+	CU_ASSERT(g_exec_count == 0);
+
+	h2c.common.flags = SPDK_NVME_TCP_DATA_FLAGS_LAST_PDU;
+	h2c.datao = sizeof(data) / 2;
+	ut_host_send(&ut, &h2c, sizeof(h2c));
+	ut_host_send(&ut, data + sizeof(data) / 2, sizeof(data) / 2);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 1);
+	SPDK_CU_ASSERT_FATAL(g_exec_req != NULL);
+	CU_ASSERT(g_exec_req->length == sizeof(data));
+	CU_ASSERT(memcmp(g_exec_req->data, data, sizeof(data)) == 0);
+
+	CU_ASSERT(spdk_nvmf_request_complete(g_exec_req) == 0);
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == 0);
+	ut_host_recv_capsule_resp(&ut, 9, 1);
+
+	ut_conn_fini(&ut);
+}
+
+static void
+test_nvmf_tcp_queue_depth(void)
+{
+	struct ut_conn			ut;
+	struct spdk_nvme_tcp_cmd	capsule;
+	uint16_t			cid;
+
+	ut_conn_init(&ut, true);
+	ut_host_send_ic_req(&ut);
+
+	/* Several capsules arriving together are all handled in one poll */
+	for (cid = 0; cid < UT_MAX_QUEUE_DEPTH; cid++) {
+		ut_build_capsule(&capsule, SPDK_NVME_OPC_FLUSH, cid, 0, 0, 0, 0);
+		ut_host_send(&ut, &capsule, sizeof(capsule));
+	}
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == UT_MAX_QUEUE_DEPTH);
+	CU_ASSERT(ut.tcp_conn->cur_queue_depth == UT_MAX_QUEUE_DEPTH);
+
+	/* One more than the queue can hold is a protocol error */
+	ut_build_capsule(&capsule, SPDK_NVME_OPC_FLUSH, cid, 0, 0, 0, 0);
+	ut_host_send(&ut, &capsule, sizeof(capsule));
+	CU_ASSERT(spdk_nvmf_tcp_poll(&ut.tcp_conn->conn) == -1);
+
+	ut_conn_fini(&ut);
+}
+
+int main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	if (CU_initialize_registry() != CUE_SUCCESS) {
+		return CU_get_error();
+	}
+
+	suite = CU_add_suite("nvmf_tcp", NULL, NULL);
+	if (suite == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+		CU_add_test(suite, "ic_req", test_nvmf_tcp_ic_req) == NULL ||
+		CU_add_test(suite, "protocol_errors", test_nvmf_tcp_protocol_errors) == NULL ||
+		CU_add_test(suite, "in_capsule_write", test_nvmf_tcp_in_capsule_write) == NULL ||
+		CU_add_test(suite, "read", test_nvmf_tcp_read) == NULL ||
+		CU_add_test(suite, "r2t_write", test_nvmf_tcp_r2t_write) == NULL ||
+		CU_add_test(suite, "queue_depth", test_nvmf_tcp_queue_depth) == NULL) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+	CU_cleanup_registry();
+	return num_failures;
+}
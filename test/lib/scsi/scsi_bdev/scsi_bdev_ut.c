@@ -139,6 +139,15 @@ spdk_bdev_read(struct spdk_bdev *bdev,
 	return NULL;
 }
 
+struct spdk_bdev_io *
+spdk_bdev_readv(struct spdk_bdev *bdev,
+		struct iovec *iov, int iovcnt,
+		uint64_t offset, uint64_t nbytes,
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return NULL;
+}
+
 struct spdk_bdev_io *
 spdk_bdev_writev(struct spdk_bdev *bdev,
 		 struct iovec *iov, int iovcnt,
@@ -17,6 +17,10 @@ make -C test/lib/ioat/unit CONFIG_WERROR=y
 
 test/lib/ioat/unit/ioat_ut
 
+make -C test/lib/bdev/blockdev_nvme CONFIG_WERROR=y
+
+test/lib/bdev/blockdev_nvme/blockdev_nvme_ut
+
 make -C test/lib/json CONFIG_WERROR=y
 
 test/lib/json/parse/json_parse_ut